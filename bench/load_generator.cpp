@@ -0,0 +1,213 @@
+#include "load_generator.h"
+#include "gis/query_metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <sys/socket.h>
+    #include <sys/types.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <unistd.h>
+#endif
+
+namespace gis {
+
+namespace {
+
+#if defined(__linux__)
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+constexpr size_t kReadChunk = 16 * 1024;
+
+void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+int connectTo(const std::string& host, int port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address && fd < 0; address = address->ai_next) {
+        fd = static_cast<int>(socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+        if (fd < 0) continue;
+        if (connect(fd, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0) {
+            closeSocket(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (fd >= 0) {
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&opt), sizeof(opt));
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = send(fd, data.data() + sent, static_cast<int>(data.size() - sent), kSendFlags);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Read one response; bytes past it stay in buffer
+ * @return HTTP status, or 0 if the connection failed or the response is unusable
+ */
+int readResponse(int fd, std::string& buffer) {
+    char chunk[kReadChunk];
+    auto fill = [&]() {
+        int n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(n));
+        return true;
+    };
+
+    size_t header_end;
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill()) return 0;
+    }
+
+    // Status line, then the Content-Length header (names are case-insensitive)
+    int status = 0;
+    size_t space = buffer.find(' ');
+    if (space != std::string::npos && space < header_end) {
+        status = std::atoi(buffer.c_str() + space + 1);
+    }
+    size_t content_length = std::string::npos;
+    size_t pos = buffer.find("\r\n") + 2;
+    while (pos < header_end) {
+        size_t end = buffer.find("\r\n", pos);
+        static const char kName[] = "content-length:";
+        size_t name_length = sizeof(kName) - 1;
+        if (end - pos > name_length &&
+            std::equal(kName, kName + name_length, buffer.begin() + pos,
+                       [](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); })) {
+            content_length = std::strtoull(buffer.c_str() + pos + name_length, nullptr, 10);
+        }
+        pos = end + 2;
+    }
+    if (content_length == std::string::npos) {
+        return 0;
+    }
+
+    size_t total = header_end + 4 + content_length;
+    while (buffer.size() < total) {
+        if (!fill()) return 0;
+    }
+    buffer.erase(0, total);
+    return status;
+}
+
+} // namespace
+
+bool runLoad(const LoadOptions& options) {
+    if (options.paths.empty() || options.connections == 0) {
+        std::cerr << "Nothing to request" << std::endl;
+        return false;
+    }
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+    std::vector<std::string> requests;
+    for (const std::string& path : options.paths) {
+        requests.push_back("GET " + path + " HTTP/1.1\r\nHost: " + options.host + "\r\n\r\n");
+    }
+
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors(0);
+    std::atomic<uint64_t> non_ok(0);
+    std::atomic<size_t> connected(0);
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(options.duration_seconds));
+
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < options.connections; ++c) {
+        threads.emplace_back([&, c]() {
+            int fd = connectTo(options.host, options.port);
+            if (fd < 0) return;
+            connected.fetch_add(1, std::memory_order_relaxed);
+
+            std::string buffer;
+            size_t next = c % requests.size();
+            while (std::chrono::steady_clock::now() < deadline) {
+                auto sent_at = std::chrono::steady_clock::now();
+                int status = sendAll(fd, requests[next]) ? readResponse(fd, buffer) : 0;
+                if (status == 0) {
+                    errors.fetch_add(1, std::memory_order_relaxed);
+                    closeSocket(fd);
+                    buffer.clear();
+                    fd = connectTo(options.host, options.port);
+                    if (fd < 0) return;
+                    continue;
+                }
+                latency.record(std::chrono::steady_clock::now() - sent_at);
+                if (status != 200) {
+                    non_ok.fetch_add(1, std::memory_order_relaxed);
+                }
+                next = (next + 1) % requests.size();
+            }
+            closeSocket(fd);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    if (connected == 0) {
+        std::cerr << "Could not connect to " << options.host << ":" << options.port << std::endl;
+        return false;
+    }
+
+    uint64_t completed = latency.count();
+    std::printf("Connections:  %zu of %zu\n", connected.load(), options.connections);
+    std::printf("Duration:     %.2f s\n", seconds);
+    std::printf("Requests:     %llu (%.0f/s), %llu not 200, %llu failed\n",
+                static_cast<unsigned long long>(completed), completed / seconds,
+                static_cast<unsigned long long>(non_ok.load()), static_cast<unsigned long long>(errors.load()));
+    std::printf("Latency (us): mean %.1f  p50 %.1f  p99 %.1f  p999 %.1f\n",
+                completed > 0 ? latency.sumNanoseconds() / 1e3 / completed : 0.0,
+                latency.percentile(0.5) / 1e3, latency.percentile(0.99) / 1e3, latency.percentile(0.999) / 1e3);
+    return true;
+}
+
+} // namespace gis
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gis {
+
+/**
+ * @brief Settings of a closed-loop HTTP load run
+ */
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    size_t connections = 4;     // Each on its own thread, one request in flight
+    double duration_seconds = 10.0;
+    std::vector<std::string> paths;  // Request targets, taken in turn
+};
+
+/**
+ * @brief Drive a running gis-server with keep-alive GET requests
+ *
+ * Every connection sends a request, waits for the whole response and sends
+ * the next, cycling through the paths (each connection starting at its own
+ * offset). Latency is measured per request from send to the last body
+ * byte. Responses must carry a Content-Length, so the streamed batch
+ * endpoints are not supported. A failed request is counted as an error and
+ * the connection is opened again.
+ *
+ * Prints throughput, errors and latency percentiles to stdout.
+ *
+ * @return false if no connection could be made
+ */
+bool runLoad(const LoadOptions& options);
+
+} // namespace gis
@@ -0,0 +1,356 @@
+#include "load_generator.h"
+#include "gis/geocoder.h"
+#include "gis/shapefile_reader.h"
+#include "gis/spatial_index.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t kDefaultSeed = 42;
+constexpr size_t kPointQueries = 20000;
+constexpr size_t kAddressQueries = 4000;
+
+// Query points and boxes fall in the contiguous US: the data's own bounds
+// cross the antimeridian and are mostly ocean
+const gis::BoundingBox kQueryArea(-125.0, 25.0, -67.0, 49.0);
+
+/**
+ * @brief Times named benchmarks and prints one line per benchmark
+ *
+ * A benchmark is a callable doing a fixed amount of work and returning a
+ * checksum of its results. It runs once to warm up, then `repeat` times;
+ * the median and the fastest run are reported per operation. The
+ * checksum must be the same from run to run and build to build, so a
+ * change that alters results shows up next to the timing.
+ */
+class BenchmarkRunner {
+private:
+    std::string filter_;
+    size_t repeat_;
+
+public:
+    BenchmarkRunner(std::string filter, size_t repeat) : filter_(std::move(filter)), repeat_(std::max<size_t>(1, repeat)) {
+        std::printf("%-36s %8s %14s %14s %20s\n", "benchmark", "ops", "median ns/op", "min ns/op", "checksum");
+    }
+
+    bool selected(const std::string& name) const {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+
+    template<typename Fn>
+    void run(const std::string& name, size_t ops, Fn&& fn) {
+        if (!selected(name)) return;
+
+        uint64_t checksum = fn();
+        std::vector<double> times;
+        for (size_t i = 0; i < repeat_; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t result = fn();
+            times.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+            if (result != checksum) {
+                std::fprintf(stderr, "%s: checksum changed between runs\n", name.c_str());
+            }
+        }
+        std::sort(times.begin(), times.end());
+        double per_op = static_cast<double>(std::max<size_t>(1, ops));
+        std::printf("%-36s %8zu %14.1f %14.1f %20llu\n", name.c_str(), ops, times[times.size() / 2] / per_op,
+                    times.front() / per_op, static_cast<unsigned long long>(checksum));
+        std::fflush(stdout);
+    }
+};
+
+/**
+ * @brief Uniform doubles from the raw mt19937_64 stream
+ *
+ * The engine's output is fixed by the standard but the distributions are
+ * not, so inputs built this way are the same with every standard library.
+ */
+class InputGenerator {
+private:
+    std::mt19937_64 engine_;
+
+public:
+    explicit InputGenerator(uint64_t seed) : engine_(seed) {}
+
+    double uniform(double low, double high) {
+        double unit = static_cast<double>(engine_() >> 11) * 0x1.0p-53;
+        return low + (high - low) * unit;
+    }
+
+    size_t index(size_t count) { return static_cast<size_t>(engine_() % count); }
+
+    std::vector<gis::Point2D> points(const gis::BoundingBox& bounds, size_t count) {
+        std::vector<gis::Point2D> result;
+        result.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            double x = uniform(bounds.min_x, bounds.max_x);
+            result.emplace_back(x, uniform(bounds.min_y, bounds.max_y));
+        }
+        return result;
+    }
+};
+
+struct Dataset {
+    std::string name;   // e.g. USA_2
+    std::string path;   // Shapefile path without extension
+};
+
+std::vector<std::unique_ptr<gis::ShapeRecord>> readRecords(const std::string& path) {
+    gis::ShapefileReader reader(path);
+    if (!reader.open()) {
+        return {};
+    }
+    return reader.readAllRecords();
+}
+
+std::string stringField(const gis::ShapeRecord& record, const char* name) {
+    auto it = record.attributes.find(name);
+    if (it == record.attributes.end()) return std::string();
+    const std::string* value = std::get_if<std::string>(&it->second);
+    return value ? *value : std::string();
+}
+
+/**
+ * @brief Address queries drawn from the records: states, "county, state" and misspellings of both
+ */
+std::vector<std::string> addressQueries(const std::vector<std::unique_ptr<gis::ShapeRecord>>& records,
+                                        InputGenerator& input, size_t count) {
+    std::vector<std::string> queries;
+    if (records.empty()) return queries;
+
+    while (queries.size() < count) {
+        const gis::ShapeRecord& record = *records[input.index(records.size())];
+        std::string state = stringField(record, "NAME_1");
+        std::string county = stringField(record, "NAME_2");
+        if (state.empty()) continue;
+
+        std::string query = (county.empty() || input.index(2) == 0) ? state : county + ", " + state;
+        if (input.index(4) == 0 && query.size() > 3) {
+            query[1 + input.index(query.size() - 2)] = static_cast<char>('a' + input.index(26));
+        }
+        queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+uint64_t resultChecksum(const gis::GeocodeResult& result) {
+    if (result.confidence_score <= 0) return 0;
+    return static_cast<uint64_t>(std::llround(result.confidence_score * 1000.0)) +
+           result.matched_address.full_address.size() * 1000003ull;
+}
+
+void runMicrobenchmarks(const std::string& data_dir, const std::string& filter, size_t repeat, uint64_t seed) {
+    std::vector<Dataset> datasets;
+    for (const char* level : {"0", "1", "2"}) {
+        datasets.push_back({std::string("USA_") + level, data_dir + "/gadm41_USA_" + level});
+    }
+
+    BenchmarkRunner runner(filter, repeat);
+    InputGenerator input(seed);
+
+    for (const Dataset& dataset : datasets) {
+        runner.run("read_all_records/" + dataset.name, 1, [&]() {
+            return static_cast<uint64_t>(readRecords(dataset.path).size());
+        });
+    }
+
+    // Indexes over the finest level
+    const Dataset& finest = datasets.back();
+    auto records = readRecords(finest.path);
+    if (records.empty()) {
+        std::cerr << "Could not read " << finest.path << std::endl;
+        return;
+    }
+
+    runner.run("build_index/" + finest.name, 1, [&]() {
+        gis::SpatialIndex index;
+        index.buildIndex(records);
+        return static_cast<uint64_t>(index.getTree().size());
+    });
+
+    gis::SpatialIndex index;
+    index.buildIndex(records);
+    const gis::RTree& tree = index.getTree();
+
+    std::vector<gis::BoundingBox> boxes;
+    for (size_t i = 0; i < kPointQueries; ++i) {
+        double x = input.uniform(kQueryArea.min_x, kQueryArea.max_x);
+        double y = input.uniform(kQueryArea.min_y, kQueryArea.max_y);
+        double size = input.uniform(0.01, 1.0);
+        boxes.emplace_back(x, y, x + size, y + size);
+    }
+    std::vector<gis::Point2D> points = input.points(kQueryArea, kPointQueries);
+
+    runner.run("rtree_query/" + finest.name, boxes.size(), [&]() {
+        uint64_t sum = 0;
+        for (const gis::BoundingBox& box : boxes) {
+            sum += tree.query(box).size();
+        }
+        return sum;
+    });
+
+    for (size_t k : {size_t(1), size_t(10)}) {
+        runner.run("rtree_nearest_k" + std::to_string(k) + "/" + finest.name, points.size(), [&]() {
+            uint64_t sum = 0;
+            for (const gis::Point2D& point : points) {
+                for (size_t idx : tree.nearestNeighbors(point, k)) sum += idx;
+            }
+            return sum;
+        });
+    }
+
+    auto pointInPolygon = [&]() {
+        uint64_t sum = 0;
+        for (const gis::Point2D& point : points) {
+            size_t idx = index.findContainingRecord(point);
+            sum += idx != SIZE_MAX ? idx + 1 : 0;
+        }
+        return sum;
+    };
+    runner.run("point_in_polygon/" + finest.name, points.size(), pointInPolygon);
+    if (runner.selected("point_in_polygon_grid/" + finest.name)) {
+        index.buildCellGrid(1024);
+        runner.run("point_in_polygon_grid/" + finest.name, points.size(), pointInPolygon);
+        index.buildCellGrid(0);
+    }
+
+    // The geocoder over all three levels, as gis-server loads it
+    const std::string geocode_name = "geocode/USA_0-2";
+    const std::string reverse_name = "reverse_geocode/USA_0-2";
+    if (!runner.selected(geocode_name) && !runner.selected(reverse_name)) {
+        return;
+    }
+    std::vector<std::string> paths;
+    for (const Dataset& dataset : datasets) {
+        paths.push_back(dataset.path);
+    }
+    gis::Geocoder geocoder;
+    if (!geocoder.loadAdministrativeLevels(paths)) {
+        std::cerr << "Could not load the geocoder data" << std::endl;
+        return;
+    }
+
+    std::vector<std::string> addresses = addressQueries(records, input, kAddressQueries);
+    runner.run(geocode_name, addresses.size(), [&]() {
+        uint64_t sum = 0;
+        for (const std::string& address : addresses) {
+            sum += resultChecksum(geocoder.geocode(address));
+        }
+        return sum;
+    });
+    runner.run(reverse_name, points.size(), [&]() {
+        uint64_t sum = 0;
+        for (const gis::Point2D& point : points) {
+            sum += resultChecksum(geocoder.reverseGeocode(point));
+        }
+        return sum;
+    });
+}
+
+/**
+ * @brief Reverse geocoding targets at seeded random points in the contiguous US
+ */
+std::vector<std::string> randomReversePaths(size_t count, uint64_t seed) {
+    InputGenerator input(seed);
+    std::vector<std::string> paths;
+    char path[96];
+    for (size_t i = 0; i < count; ++i) {
+        double lng = input.uniform(kQueryArea.min_x, kQueryArea.max_x);
+        double lat = input.uniform(kQueryArea.min_y, kQueryArea.max_y);
+        std::snprintf(path, sizeof(path), "/reverse?lat=%.6f&lng=%.6f", lat, lng);
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+void printUsage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [options]\n\n";
+    std::cout << "Microbenchmarks (default):\n";
+    std::cout << "  -d, --data <dir>        Directory holding gadm41_USA_0/1/2 (default: data)\n";
+    std::cout << "  -f, --filter <text>     Only run benchmarks whose name contains text\n";
+    std::cout << "  -r, --repeat <n>        Timed runs per benchmark (default: 5)\n";
+    std::cout << "      --seed <n>          Seed of the generated inputs (default: 42)\n\n";
+    std::cout << "Load generator:\n";
+    std::cout << "  -l, --load <host:port>  Send requests to a running gis-server\n";
+    std::cout << "  -c, --connections <n>   Concurrent keep-alive connections (default: 4)\n";
+    std::cout << "  -t, --duration <s>      Seconds to run (default: 10)\n";
+    std::cout << "      --path <target>     Request target, repeatable (e.g. /geocode?address=Texas)\n";
+    std::cout << "      --paths-file <file> One request target per line\n";
+    std::cout << "                          Without targets, 1000 seeded random /reverse points\n";
+    std::cout << "  -h, --help              Show this help\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string data_dir = "data";
+    std::string filter;
+    size_t repeat = 5;
+    uint64_t seed = kDefaultSeed;
+    std::string load_target;
+    gis::LoadOptions load;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if ((arg == "-d" || arg == "--data") && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if ((arg == "-f" || arg == "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if ((arg == "-r" || arg == "--repeat") && i + 1 < argc) {
+            repeat = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if ((arg == "-l" || arg == "--load") && i + 1 < argc) {
+            load_target = argv[++i];
+        } else if ((arg == "-c" || arg == "--connections") && i + 1 < argc) {
+            load.connections = std::stoul(argv[++i]);
+        } else if ((arg == "-t" || arg == "--duration") && i + 1 < argc) {
+            load.duration_seconds = std::stod(argv[++i]);
+        } else if (arg == "--path" && i + 1 < argc) {
+            load.paths.push_back(argv[++i]);
+        } else if (arg == "--paths-file" && i + 1 < argc) {
+            std::ifstream file(argv[++i]);
+            std::string line;
+            while (std::getline(file, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) load.paths.push_back(line);
+            }
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!load_target.empty()) {
+        size_t colon = load_target.rfind(':');
+        if (colon != std::string::npos) {
+            load.host = load_target.substr(0, colon);
+            load.port = std::stoi(load_target.substr(colon + 1));
+        } else {
+            load.host = load_target;
+        }
+        if (load.paths.empty()) {
+            load.paths = randomReversePaths(1000, seed);
+        }
+        return gis::runLoad(load) ? 0 : 1;
+    }
+
+    runMicrobenchmarks(data_dir, filter, repeat, seed);
+    return 0;
+}
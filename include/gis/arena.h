@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace gis {
+
+/**
+ * @brief Monotonic memory for the arrays a loaded dataset keeps until it is dropped
+ *
+ * Allocations are carved one after another out of fixed-size blocks taken
+ * from an upstream resource, and are never freed individually: the whole
+ * dataset goes away with one release() or with the arena. Allocations
+ * larger than a quarter block get a block of their own, so at most a
+ * quarter of each shared block is left unused. Geometries and prepared
+ * polygons refer to arena memory through borrowed Buffers, so the arena
+ * must outlive everything built on it.
+ *
+ * Usable as a std::pmr::memory_resource. Allocation is serialised by a
+ * mutex, so the worker threads of a parallel load can share one arena.
+ */
+class DatasetArena : public std::pmr::memory_resource {
+private:
+    struct Block {
+        void* data;
+        size_t size;
+        size_t alignment;
+    };
+
+    static constexpr size_t kBlockAlignment = alignof(std::max_align_t);
+
+    mutable std::mutex mutex_;
+    std::pmr::memory_resource* upstream_;
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    char* cursor_;      // Free space of the current shared block
+    char* block_end_;
+    size_t bytes_reserved_;
+    size_t bytes_used_;
+    size_t allocation_count_;
+
+public:
+    /**
+     * @brief Constructor
+     * @param block_size Size of the shared blocks
+     * @param upstream Where blocks come from
+     */
+    explicit DatasetArena(size_t block_size = 4 << 20,
+                          std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    ~DatasetArena() override;
+
+    // Delete copy constructor and assignment
+    DatasetArena(const DatasetArena&) = delete;
+    DatasetArena& operator=(const DatasetArena&) = delete;
+
+    /**
+     * @brief Uninitialised room for count objects of a trivially destructible type
+     */
+    template<typename T>
+    T* allocateArray(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /**
+     * @brief Return every block to the upstream resource at once
+     *
+     * Anything still pointing into the arena is left dangling.
+     */
+    void release();
+
+    /**
+     * @brief Bytes handed out by allocations
+     */
+    size_t bytesUsed() const;
+
+    /**
+     * @brief Bytes held in blocks, including what is not handed out yet
+     */
+    size_t bytesReserved() const;
+
+    size_t blockCount() const;
+    size_t allocationCount() const;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    void* allocateBlock(size_t size, size_t alignment);
+};
+
+} // namespace gis
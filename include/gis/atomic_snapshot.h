@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gis {
+
+/**
+ * @brief Atomically replaceable, read-mostly object (RCU style)
+ *
+ * Readers pin the current version with acquire() and read it without taking
+ * any lock: pinning is an increment on the version's reader counter plus a
+ * re-check that the version is still current. publish() swaps in a new
+ * version and then waits until every reader that pinned the old one has let
+ * go before destroying it, so in-flight work always finishes on the version
+ * it started with.
+ *
+ * Retired version slots (a pointer and a counter each) are kept until the
+ * AtomicSnapshot itself is destroyed, because a reader may still be about to
+ * touch the counter of a slot it loaded just before the swap.
+ */
+template<typename T>
+class AtomicSnapshot {
+private:
+    struct Slot {
+        std::unique_ptr<const T> value;
+        std::atomic<size_t> readers{0};
+    };
+
+    std::atomic<Slot*> current_;
+    std::atomic<size_t> version_;
+    std::vector<std::unique_ptr<Slot>> slots_;  // Guarded by publish_mutex_
+    std::mutex publish_mutex_;                  // Serializes writers only
+
+public:
+    /**
+     * @brief Pinned version; valid (and immutable) until the guard is destroyed
+     */
+    class Guard {
+    private:
+        Slot* slot_;
+
+    public:
+        explicit Guard(Slot* slot) : slot_(slot) {}
+        ~Guard() {
+            if (slot_) slot_->readers.fetch_sub(1, std::memory_order_release);
+        }
+
+        Guard(Guard&& other) noexcept : slot_(other.slot_) { other.slot_ = nullptr; }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+
+        const T* get() const { return slot_ ? slot_->value.get() : nullptr; }
+        const T* operator->() const { return get(); }
+        const T& operator*() const { return *get(); }
+        explicit operator bool() const { return get() != nullptr; }
+    };
+
+    AtomicSnapshot() : current_(nullptr), version_(0) {}
+
+    explicit AtomicSnapshot(std::unique_ptr<const T> value) : current_(nullptr), version_(0) {
+        publish(std::move(value));
+    }
+
+    // Readers hold raw slot pointers, so the container itself never moves
+    AtomicSnapshot(const AtomicSnapshot&) = delete;
+    AtomicSnapshot& operator=(const AtomicSnapshot&) = delete;
+
+    /**
+     * @brief Pin the current version (lock-free)
+     * @return Guard that is empty if nothing has been published yet
+     */
+    Guard acquire() const {
+        while (true) {
+            Slot* slot = current_.load(std::memory_order_seq_cst);
+            if (!slot) {
+                return Guard(nullptr);
+            }
+
+            slot->readers.fetch_add(1, std::memory_order_seq_cst);
+            if (current_.load(std::memory_order_seq_cst) == slot) {
+                return Guard(slot);
+            }
+
+            // Replaced between the load and the pin; the writer may already
+            // have seen zero readers, so retry on the new version
+            slot->readers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Make value the current version and retire the previous one
+     *
+     * Blocks until all readers of the previous version are done with it.
+     */
+    void publish(std::unique_ptr<const T> value) {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+
+        auto slot = std::make_unique<Slot>();
+        slot->value = std::move(value);
+        slots_.reserve(slots_.size() + 1);  // No throwing once the slot is live
+        Slot* previous = current_.exchange(slot.get(), std::memory_order_seq_cst);
+        slots_.push_back(std::move(slot));
+        version_.fetch_add(1, std::memory_order_relaxed);
+
+        if (previous) {
+            while (previous->readers.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+            previous->value.reset();
+        }
+    }
+
+    /**
+     * @brief Number of versions published so far
+     */
+    size_t getVersion() const { return version_.load(std::memory_order_relaxed); }
+};
+
+} // namespace gis
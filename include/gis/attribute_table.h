@@ -0,0 +1,141 @@
+#pragma once
+
+#include "dbf_reader.h"
+#include "mapped_file.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace gis {
+
+/**
+ * @brief Location of a record's attributes: a table and a row within it
+ */
+struct AttributeRef {
+    uint32_t table;
+    uint32_t row;
+};
+
+/**
+ * @brief Columnar, lazily decoded attributes of one .dbf file
+ *
+ * The file is mapped (or borrowed, see openBuffer()) and only its header is
+ * parsed up front. The first access to a field decodes that field for every
+ * row: Character and Date values become ids into a per-column pool of
+ * distinct strings, Numeric and Float values doubles, Logical values bytes.
+ * Fields that are never read cost nothing but their share of the mapping,
+ * and repeated values such as state names are stored once per column
+ * instead of once per record.
+ *
+ * Columns are decoded at most once, under std::call_once, so the const
+ * accessors may be called concurrently. Deleted rows read as empty values.
+ */
+class AttributeTable {
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+private:
+    struct Column {
+        std::once_flag decoded;
+        std::atomic<bool> ready{false};    // Set once decoding has finished
+        std::vector<uint32_t> string_ids;  // Character/Date/Unknown: pool index per row
+        std::vector<std::string> strings;  // Distinct trimmed values; 0 is ""
+        std::vector<double> numbers;       // Numeric/Float
+        std::vector<uint8_t> flags;        // Logical
+    };
+
+    MappedFile file_;
+    const char* data_;
+    size_t size_;
+
+    DBFLayout layout_;
+    std::vector<std::unique_ptr<Column>> columns_;
+
+    bool readHeader();
+    const Column& column(size_t field) const;
+    void decodeColumn(size_t field, Column& column) const;
+    const char* rowData(uint32_t row) const;
+
+public:
+    AttributeTable();
+    ~AttributeTable();
+
+    // Delete copy constructor and assignment
+    AttributeTable(const AttributeTable&) = delete;
+    AttributeTable& operator=(const AttributeTable&) = delete;
+
+    /**
+     * @brief Map a .dbf file
+     * @param filename Full path of the .dbf
+     * @return true if successful
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * @brief Read .dbf contents held elsewhere (e.g. inside a snapshot)
+     *
+     * The bytes are borrowed and must outlive the table.
+     */
+    bool openBuffer(const char* data, size_t size);
+
+    void close();
+
+    bool isOpen() const { return data_ != nullptr; }
+    uint32_t getRecordCount() const { return layout_.record_count; }
+    const std::vector<FieldDefinition>& getFieldDefinitions() const { return layout_.fields; }
+
+    /**
+     * @brief Index of a field by name
+     * @return Field index, or npos if there is no such field
+     */
+    size_t findField(std::string_view name) const { return layout_.findField(name); }
+
+    /**
+     * @brief Check the row's deletion flag
+     */
+    bool isDeleted(uint32_t row) const;
+
+    /**
+     * @brief Trimmed text of a Character, Date or unknown-type field
+     * @return The value; empty for other types, deleted rows or bad indices
+     */
+    std::string_view getString(uint32_t row, size_t field) const;
+
+    /**
+     * @brief Value of a Numeric or Float field (0 otherwise)
+     */
+    double getNumber(uint32_t row, size_t field) const;
+
+    /**
+     * @brief Value of a Logical field (false otherwise)
+     */
+    bool getLogical(uint32_t row, size_t field) const;
+
+    /**
+     * @brief Value as decodeDBFField() decodes it into ShapeRecord::attributes
+     */
+    FieldValue getValue(uint32_t row, size_t field) const;
+
+    /**
+     * @brief Raw .dbf bytes the table reads from
+     */
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Number of fields decoded so far
+     */
+    size_t getDecodedFieldCount() const;
+
+    /**
+     * @brief Approximate heap memory used by the decoded columns, in bytes
+     */
+    size_t memoryUsage() const;
+};
+
+} // namespace gis
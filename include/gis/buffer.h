@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace gis {
+
+/**
+ * @brief Read-only array that either owns its elements or borrows them
+ *
+ * Owned buffers hold a std::vector. Borrowed buffers point into memory kept
+ * alive elsewhere, typically a mapped snapshot file, so large arrays can be
+ * served straight from the mapping without being copied. Whoever creates a
+ * borrowed buffer is responsible for keeping the memory valid for as long
+ * as the buffer (and anything it is moved into) is in use.
+ *
+ * Copying always produces an owned copy, so a copy can safely outlive the
+ * memory the original borrowed from.
+ */
+template<typename T>
+class Buffer {
+private:
+    std::vector<T> owned_;
+    const T* data_;
+    size_t size_;
+
+public:
+    Buffer() : data_(nullptr), size_(0) {}
+
+    Buffer(std::vector<T> values) : owned_(std::move(values)), data_(owned_.data()), size_(owned_.size()) {}
+
+    Buffer(size_t count, const T& value) : Buffer(std::vector<T>(count, value)) {}
+
+    Buffer(const Buffer& other) : Buffer(std::vector<T>(other.begin(), other.end())) {}
+
+    Buffer(Buffer&& other) noexcept
+        : owned_(std::move(other.owned_)), data_(other.data_), size_(other.size_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    Buffer& operator=(const Buffer& other) {
+        if (this != &other) {
+            *this = Buffer(other);
+        }
+        return *this;
+    }
+
+    Buffer& operator=(Buffer&& other) noexcept {
+        if (this != &other) {
+            owned_ = std::move(other.owned_);
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief View memory owned by someone else
+     */
+    static Buffer borrow(const T* data, size_t size) {
+        Buffer buffer;
+        buffer.data_ = data;
+        buffer.size_ = size;
+        return buffer;
+    }
+
+    /**
+     * @brief Exchange contents with a vector
+     *
+     * The vector's elements become owned by the buffer. The vector receives
+     * the previous elements if they were owned, and is left empty if they
+     * were borrowed.
+     */
+    void swap(std::vector<T>& values) {
+        bool borrowed = isBorrowed();
+        owned_.swap(values);
+        if (borrowed) {
+            values.clear();
+        }
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    const T& front() const { return data_[0]; }
+    const T& back() const { return data_[size_ - 1]; }
+
+    bool isBorrowed() const { return size_ != 0 && data_ != owned_.data(); }
+
+    /**
+     * @brief Heap bytes owned by this buffer (0 when borrowed)
+     */
+    size_t memoryUsage() const { return isBorrowed() ? 0 : owned_.capacity() * sizeof(T); }
+};
+
+} // namespace gis
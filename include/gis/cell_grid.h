@@ -0,0 +1,106 @@
+#pragma once
+
+#include "buffer.h"
+#include "geometry.h"
+#include "prepared_polygon.h"
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace gis {
+
+/**
+ * @brief Uniform grid over a set of polygons for constant-time point lookups
+ *
+ * The bounds of the polygons are cut into square cells. A cell no polygon
+ * boundary passes through lies either wholly inside or wholly outside each
+ * polygon, so the polygon with the lowest index containing it is stored
+ * with the cell and a query answers from one array read. A cell crossed by
+ * boundaries also lists the crossing polygons whose index is below that
+ * one; only those get an exact test, in index order.
+ *
+ * Answers follow SpatialIndex::findContainingRecord(): the lowest index
+ * whose prepared polygon contains the point. The polygons must be the ones
+ * the grid was built from.
+ */
+class CellGrid {
+public:
+    static constexpr uint32_t kNoRecord = std::numeric_limits<uint32_t>::max();
+
+    /**
+     * @brief Cell of the grid; its candidates run up to the next cell's first_candidate
+     */
+    struct Cell {
+        uint32_t first_candidate;
+        uint32_t inside;            // Lowest index containing the whole cell, or kNoRecord
+    };
+
+private:
+    BoundingBox bounds_;
+    uint32_t columns_;
+    uint32_t rows_;
+    double scale_x_;                // Cells per unit of x
+    double scale_y_;
+    Buffer<Cell> cells_;            // Row-major, columns_ * rows_ + 1 entries
+    Buffer<uint32_t> candidates_;   // Polygon indices, ascending within a cell
+
+    void setLayout(const BoundingBox& bounds, uint32_t columns, uint32_t rows);
+    size_t columnOf(double x) const;
+    size_t rowOf(double y) const;
+
+public:
+    CellGrid();
+
+    /**
+     * @brief Rasterise the polygons' boundaries and classify every cell
+     * @param polygons Prepared polygons by record index; empty ones are skipped
+     * @param resolution Cells along the longer side of the polygons' bounds
+     */
+    CellGrid(const std::vector<PreparedPolygon>& polygons, size_t resolution);
+
+    /**
+     * @brief Adopt a grid built earlier for the same polygons
+     *
+     * The arguments must come from getBounds(), getColumns(), getRows(),
+     * getCells() and getCandidates(); check the result with fits().
+     */
+    CellGrid(const BoundingBox& bounds, uint32_t columns, uint32_t rows,
+             Buffer<Cell> cells, Buffer<uint32_t> candidates);
+
+    /**
+     * @brief Lowest polygon index containing the point
+     * @return Index, or SIZE_MAX if no polygon contains the point
+     */
+    size_t findContaining(const Point2D& point, const std::vector<PreparedPolygon>& polygons) const;
+
+    /**
+     * @brief Check that an adopted grid is well formed and references only these polygons
+     */
+    bool fits(const std::vector<PreparedPolygon>& polygons) const;
+
+    bool isEmpty() const { return cells_.empty(); }
+    const BoundingBox& getBounds() const { return bounds_; }
+    uint32_t getColumns() const { return columns_; }
+    uint32_t getRows() const { return rows_; }
+    const Buffer<Cell>& getCells() const { return cells_; }
+    const Buffer<uint32_t>& getCandidates() const { return candidates_; }
+
+    /**
+     * @brief Cells along the longer side, as passed to the constructor; 0 if empty
+     */
+    size_t getResolution() const { return isEmpty() ? 0 : std::max(columns_, rows_); }
+
+    /**
+     * @brief Approximate heap memory used by the grid, in bytes
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * @brief Cell counts by kind, for statistics
+     */
+    std::string getStats() const;
+};
+
+} // namespace gis
@@ -1,41 +1,295 @@
-#include "gis/shapefile_reader.h"
+#pragma once
+
+#include "mapped_file.h"
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
 namespace gis {
 
+/**
+ * @brief Supported field types in DBF files
+ */
+enum class FieldType {
+    Character,
+    Numeric,
+    Logical,
+    Date,
+    Float,
+    Unknown
+};
+
+/**
+ * @brief Represents a field value from DBF record
+ */
+using FieldValue = std::variant<std::string, double, bool, int>;
+
+/**
+ * @brief Field definition from DBF header
+ */
+struct FieldDefinition {
+    std::string name;
+    FieldType type;
+    uint8_t length;
+    uint8_t decimal_count;
+};
+
+/**
+ * @brief Field text without the blanks DBF writers pad it with
+ */
+std::string_view trimDBFField(const char* data, size_t length);
+
+/**
+ * @brief Parse the text of a DBF Numeric or Float field
+ *
+ * Blanks around the number are ignored. Plain decimals with up to 15
+ * significant digits (all that DBF writers produce in practice) are
+ * converted exactly with one multiplication or division by a power of ten;
+ * anything else goes through strtod. Never allocates or throws.
+ *
+ * @return The value, or 0 for an empty or unparsable field
+ */
+double parseDBFNumber(const char* data, size_t length);
+
+/**
+ * @brief Parse a DBF Logical field: true for T, t, Y or y
+ */
+bool parseDBFLogical(const char* data, size_t length);
+
+/**
+ * @brief Parse a DBF Date field (YYYYMMDD)
+ * @return The date as the integer yyyymmdd, or 0 if blank or malformed
+ */
+int32_t parseDBFDate(const char* data, size_t length);
+
+/**
+ * @brief Decode a field the way ShapeRecord::attributes holds it
+ *
+ * Numeric and Float become doubles, Logical bools, everything else the
+ * trimmed text. A string already held by value is assigned in place so a
+ * reused value keeps its capacity.
+ */
+void decodeDBFField(const char* data, size_t length, FieldType type, FieldValue& value);
+
+/**
+ * @brief Record layout of a .dbf file, parsed from its header
+ *
+ * Shared by every reader of DBF data so that they agree on field offsets,
+ * types and record counts.
+ */
+struct DBFLayout {
+    static constexpr size_t kFixedHeaderSize = 32;
+
+    std::vector<FieldDefinition> fields;
+    std::vector<size_t> field_offsets;  // Byte offset of each field within a row
+    uint32_t record_count = 0;
+    uint16_t header_length = 0;
+    uint16_t record_length = 0;
+
+    /**
+     * @brief Parse the fixed part of the header (first 32 bytes)
+     */
+    bool parseFixedHeader(const char* data);
+
+    /**
+     * @brief Parse the field descriptors from the whole header (header_length bytes)
+     *
+     * Fields running past the end of a row are dropped, since they can
+     * never be read.
+     */
+    bool parseFieldDescriptors(const char* data);
+
+    /**
+     * @brief Parse a header held in memory and trust only the rows present
+     * @param data Start of the file
+     * @param file_size Bytes available from data
+     */
+    bool parse(const char* data, size_t file_size);
+
+    /**
+     * @brief Lower record_count to the rows a file of this size actually holds
+     */
+    void clampToFileSize(size_t file_size);
+
+    /**
+     * @brief Index of a field by name
+     * @return Field index, or SIZE_MAX if there is no such field
+     */
+    size_t findField(std::string_view name) const;
+
+    size_t rowOffset(uint32_t row) const {
+        return header_length + static_cast<size_t>(row) * record_length;
+    }
+};
+
 /**
  * @brief DBF (dBase) file reader implementation
- * 
+ *
  * Handles reading attribute data from DBF files associated with shapefiles.
  * Supports various field types including character, numeric, logical, and date fields.
+ *
+ * All reads go through blocks of consecutive rows: a block is one pointer
+ * into the mapping in memory-mapped mode and one read into a staging
+ * buffer in buffered mode. readColumn() walks the file in blocks of about
+ * 1 MB, so decoding one field over every row is a sequential scan, and
+ * row-at-a-time reads that continue a scan prefetch the next block.
+ *
+ * The methods taking a Cursor are const and may be called from several
+ * threads at once, each with its own cursor.
  */
 class DBFReader {
+public:
+    /**
+     * @brief Read position of one thread
+     *
+     * In buffered mode the cursor owns its stream and the staging buffer
+     * holding the last block read; in memory-mapped mode it stays empty.
+     */
+    struct Cursor {
+        std::ifstream file;
+        std::vector<char> buffer;
+        uint32_t block_first = 0;
+        uint32_t block_count = 0;
+    };
+
+    /**
+     * @brief Consecutive raw rows, valid until the cursor reads again
+     */
+    struct Block {
+        const char* data = nullptr;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint16_t record_length = 0;
+
+        /** @brief Row by absolute record index (first <= index < first + count) */
+        const char* row(uint32_t index) const {
+            return data + static_cast<size_t>(index - first) * record_length;
+        }
+        bool isDeleted(uint32_t index) const { return row(index)[0] == '*'; }
+    };
+
 private:
-    std::ifstream file_;
-    std::vector<FieldDefinition> fields_;
-    uint32_t record_count_;
-    uint16_t header_length_;
-    uint16_t record_length_;
+    std::string filename_;
+    IOMode io_mode_;
+    MappedFile map_;
+    Cursor cursor_;
+    DBFLayout layout_;
     bool is_open_;
-    
+
 public:
+    /**
+     * @brief Constructor
+     * @param filename Base filename without extension (e.g., "data/cities")
+     */
     explicit DBFReader(const std::string& filename);
     ~DBFReader();
-    
-    bool open();
+
+    // Delete copy constructor and assignment
+    DBFReader(const DBFReader&) = delete;
+    DBFReader& operator=(const DBFReader&) = delete;
+
+    bool open(IOMode mode = IOMode::Buffered);
     void close();
     bool isOpen() const { return is_open_; }
-    
-    uint32_t getRecordCount() const { return record_count_; }
-    const std::vector<FieldDefinition>& getFields() const { return fields_; }
-    
+    IOMode getIOMode() const { return io_mode_; }
+
+    uint32_t getRecordCount() const { return layout_.record_count; }
+    const std::vector<FieldDefinition>& getFields() const { return layout_.fields; }
+    const DBFLayout& getLayout() const { return layout_; }
+    const std::string& getFilename() const { return filename_; }
+
+    /**
+     * @brief Index of a field by name, SIZE_MAX if there is none
+     */
+    size_t findField(std::string_view name) const { return layout_.findField(name); }
+
+    /**
+     * @brief Hint that the file is about to be read front to back
+     */
+    void adviseSequential() const { map_.adviseSequential(); }
+
+    /**
+     * @brief Prepare a cursor for reads on another thread
+     */
+    bool openCursor(Cursor& cursor) const;
+
+    /**
+     * @brief Read and decode every field of one record
+     * @return Field values by name; empty for deleted or unreadable records
+     */
     std::unordered_map<std::string, FieldValue> readRecord(uint32_t index);
-    
+
+    /**
+     * @brief Decode selected fields of one record into an existing map
+     *
+     * Existing entries are overwritten in place, so a map reused from one
+     * record to the next keeps its nodes and string capacity.
+     *
+     * @param fields Indices into getFields()
+     * @return false for deleted or unreadable records
+     */
+    bool readRecord(uint32_t index, Cursor& cursor, const std::vector<size_t>& fields,
+                    std::unordered_map<std::string, FieldValue>& attributes) const;
+
+    /**
+     * @brief Read and decode consecutive records with one read per block
+     * @return One map per record, empty for deleted records; fewer than
+     *         count if the file ends or a read fails
+     */
+    std::vector<std::unordered_map<std::string, FieldValue>> readRecords(uint32_t first, uint32_t count);
+
+    /**
+     * @brief Read up to count consecutive raw rows in a single read
+     *
+     * The block is cut short at the end of the file.
+     *
+     * @return false if first is past the end or the read fails
+     */
+    bool readBlock(uint32_t first, uint32_t count, Block& block);
+    bool readBlock(uint32_t first, uint32_t count, Cursor& cursor, Block& block) const;
+
+    /**
+     * @brief Raw bytes of one row, or nullptr
+     *
+     * Served from the cursor's current block when possible; a row just past
+     * the block is taken as a scan and fetches a whole new block.
+     */
+    const char* fetchRow(uint32_t index, Cursor& cursor) const;
+
+    /**
+     * @brief Decode one field for rows [first, first + count) into out
+     *
+     * Each overload decodes the field text as its output type, whatever the
+     * declared field type: doubles as by parseDBFNumber(), int32_t as
+     * yyyymmdd for Date fields and the integer part of the number otherwise,
+     * bools as by parseDBFLogical(), strings trimmed. Deleted rows receive
+     * 0, false or an empty string.
+     *
+     * @param field Index into getFields()
+     * @param out Room for count values
+     * @return Number of values written (fewer at the end of the file or on a read error)
+     */
+    size_t readColumn(size_t field, double* out, size_t count, uint32_t first = 0);
+    size_t readColumn(size_t field, int32_t* out, size_t count, uint32_t first = 0);
+    size_t readColumn(size_t field, bool* out, size_t count, uint32_t first = 0);
+    size_t readColumn(size_t field, std::string* out, size_t count, uint32_t first = 0);
+
+    /**
+     * @brief Deletion flag of rows [first, first + count) into out
+     * @return Number of flags written
+     */
+    size_t readDeletionFlags(bool* out, size_t count, uint32_t first = 0);
+
 private:
-    bool readHeader();
-    FieldValue parseFieldValue(const std::string& data, const FieldDefinition& field);
-    
-    template<typename T>
-    T readValue();
+    uint32_t blockRows() const;
+
+    template<typename T, typename Decode>
+    size_t readColumnWith(size_t field, T* out, size_t count, uint32_t first, Decode decode);
 };
 
 } // namespace gis
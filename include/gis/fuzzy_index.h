@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace gis {
+
+/**
+ * @brief Levenshtein distance between two strings, with an optional bound
+ *
+ * Uses the bit-parallel Myers/Hyyrö algorithm when the shorter string fits
+ * in 64 characters and a banded dynamic program otherwise, so a bounded call
+ * costs O(n) or O(k * n) instead of the full O(n * m) matrix.
+ *
+ * @param a First string
+ * @param b Second string
+ * @param max_distance Stop early once the distance is known to exceed this
+ * @return Edit distance, or max_distance + 1 if it is larger than max_distance
+ */
+size_t editDistance(std::string_view a, std::string_view b, size_t max_distance = SIZE_MAX);
+
+/**
+ * @brief Bit-parallel edit distance against a fixed pattern
+ *
+ * Precomputes the pattern's character masks once so that it can be compared
+ * with many texts. Patterns longer than 64 characters fall back to
+ * editDistance().
+ */
+class EditDistanceMatcher {
+private:
+    std::string pattern_;
+    std::array<uint64_t, 256> masks_;
+
+public:
+    explicit EditDistanceMatcher(std::string_view pattern);
+
+    /**
+     * @brief Distance from the pattern to text, same contract as editDistance()
+     */
+    size_t distance(std::string_view text, size_t max_distance = SIZE_MAX) const;
+
+    const std::string& getPattern() const { return pattern_; }
+};
+
+/**
+ * @brief Trigram inverted index for misspelling-tolerant name lookup
+ *
+ * Every name is padded and split into overlapping 3-byte grams, and each gram
+ * keeps a posting list of the names that contain it. Two strings within k
+ * edits share at least |query| + 2 - 3k grams, so search() only verifies
+ * names reaching that count instead of scanning them all. Queries too short
+ * for the bound to prune anything are checked against the names of
+ * compatible length.
+ *
+ * Immutable after build(); search() is safe to call concurrently.
+ */
+class TrigramIndex {
+public:
+    struct Match {
+        uint32_t id;        // Position of the name passed to build()
+        uint32_t distance;  // Edit distance to the query
+    };
+
+private:
+    std::vector<std::string> names_;
+    std::vector<uint32_t> gram_keys_;     // Sorted distinct grams
+    std::vector<uint32_t> gram_offsets_;  // gram_keys_.size() + 1 entries into postings_
+    std::vector<uint32_t> postings_;      // Name ids per gram, ascending, repeated per occurrence
+
+    static void collectGrams(std::string_view name, std::vector<uint32_t>& grams);
+
+public:
+    /**
+     * @brief Index a set of names; ids are their positions in names
+     */
+    void build(std::vector<std::string> names);
+
+    /**
+     * @brief Find names within max_distance edits of query
+     * @return Matches ordered by distance, then id
+     */
+    std::vector<Match> search(std::string_view query, size_t max_distance) const;
+
+    const std::string& getName(uint32_t id) const { return names_[id]; }
+    size_t size() const { return names_.size(); }
+    bool empty() const { return names_.empty(); }
+
+    /**
+     * @brief Approximate heap memory used by the index, in bytes
+     */
+    size_t memoryUsage() const;
+};
+
+} // namespace gis
@@ -1,12 +1,21 @@
 #pragma once
 
+#include "arena.h"
 #include "geometry.h"
 #include "shapefile_reader.h"
 #include "spatial_index.h"
+#include "fuzzy_index.h"
+#include "snapshot.h"
+#include "attribute_table.h"
+#include "result_cache.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <unordered_map>
+#include <cstdint>
+#include <limits>
 
 namespace gis {
 
@@ -51,17 +60,48 @@ struct GeocodeResult {
 
 /**
  * @brief Address parser for extracting components from address strings
+ * 
+ * The abbreviation tables are filled by the constructor and read-only
+ * afterwards, so one parser can be shared by concurrent callers.
  */
 class AddressParser {
 private:
+    /**
+     * @brief Fixed abbreviation -> expansion table with a collision-free hash
+     *
+     * The hash seed and table size are searched for when the table is built
+     * so that every key owns its slot; a lookup is one hash and at most one
+     * key comparison.
+     */
+    class KeywordTable {
+    private:
+        std::vector<std::pair<std::string, std::string>> entries_;
+        std::vector<uint16_t> slots_;  // Entry index per slot, kEmptySlot if unused
+        uint32_t seed_ = 0;
+        uint32_t mask_ = 0;
+        
+        static constexpr uint16_t kEmptySlot = 0xFFFF;
+        static uint32_t hash(std::string_view key, uint32_t seed);
+        
+    public:
+        void build(const std::unordered_map<std::string, std::string>& entries);
+        const std::string* find(std::string_view key) const;
+    };
+    
     std::unordered_map<std::string, std::string> street_type_abbreviations_;
     std::unordered_map<std::string, std::string> state_abbreviations_;
+    KeywordTable street_type_table_;
+    KeywordTable state_table_;
     
 public:
     AddressParser();
     
     /**
      * @brief Parse an address string into components
+     * 
+     * Tokens are views into a per-thread scratch buffer, so the only
+     * allocations are the strings of the returned address.
+     * 
      * @param address_string Raw address string
      * @return Parsed address structure
      */
@@ -74,18 +114,42 @@ public:
      */
     std::string normalize(const std::string& address) const;
     
+    /**
+     * @brief Normalize into a caller-owned buffer
+     * 
+     * Upper-cases ASCII, turns commas and periods into spaces, collapses
+     * whitespace runs and trims. Reusing output across calls avoids any
+     * allocation once it has grown large enough.
+     * 
+     * @param address Raw address string
+     * @param output Receives the normalized string
+     */
+    void normalize(std::string_view address, std::string& output) const;
+    
     /**
      * @brief Get state abbreviations map
      * @return Reference to state abbreviations map
      */
     const std::unordered_map<std::string, std::string>& getStateAbbreviations() const;
+    
+    /**
+     * @brief Expand a normalized two-letter state code
+     * @return Full state name, or nullptr if the code is unknown
+     */
+    const std::string* findStateName(std::string_view abbreviation) const;
+    
+    /**
+     * @brief Expand a normalized street type abbreviation
+     * @return Full street type, or nullptr if the abbreviation is unknown
+     */
+    const std::string* findStreetType(std::string_view abbreviation) const;
 
 private:
     void initializeAbbreviations();
-    std::vector<std::string> tokenize(const std::string& text) const;
+    void tokenize(std::string_view text, std::vector<std::string_view>& tokens) const;
     std::string expandAbbreviations(const std::string& text) const;
-    bool isNumeric(const std::string& str) const;
-    bool isZipCode(const std::string& str) const;
+    bool isNumeric(std::string_view str) const;
+    bool isZipCode(std::string_view str) const;
 };
 
 /**
@@ -93,8 +157,22 @@ private:
  * 
  * Provides address-to-coordinate conversion using shapefile data
  * and various matching algorithms.
+ * 
+ * Thread safety: all state is built by loadAddressData() (or
+ * loadAdministrativeLevels()) and never changes afterwards (nothing is
+ * cached or built lazily), so the const member functions may be called
+ * concurrently without locking. Loading itself must not overlap with any
+ * other call; to replace data while serving, load a new Geocoder and
+ * publish it through an AtomicSnapshot.
  */
 class Geocoder {
+public:
+    /**
+     * @brief Receives batch results in input order
+     * @return false to cancel the rest of the batch
+     */
+    using BatchSink = std::function<bool(size_t index, const GeocodeResult& result)>;
+    
 private:
     struct AddressIndex {
         std::unordered_map<std::string, std::vector<size_t>> street_index;
@@ -102,15 +180,101 @@ private:
         std::unordered_map<std::string, std::vector<size_t>> zip_index;
     };
     
+    // Memory the records' geometry borrows from: the mapping after
+    // loadSnapshot(), the arena after loadAdministrativeLevels(). Declared
+    // first so they are released after everything that uses them
+    IndexSnapshot snapshot_;
+    DatasetArena arena_;
+    std::vector<std::string> source_paths_;
+    
+    // Records are loaded without attribute maps; their fields are read from
+    // one columnar table per source file (attribute_refs_ is parallel to
+    // address_data_)
     std::vector<std::unique_ptr<ShapeRecord>> address_data_;
+    std::vector<std::unique_ptr<AttributeTable>> attribute_tables_;
+    std::vector<AttributeRef> attribute_refs_;
     AddressIndex index_;
     AddressParser parser_;
     SpatialIndex spatial_index_;
+    size_t cell_grid_resolution_ = 0;  // 0 = no cell grid
+    
+    // Optional result caches in front of geocode() and reverseGeocode().
+    // They belong to the loaded data, so results never outlive a reload.
+    struct ReverseKey {
+        int64_t x;                  // Coordinates in units of cache_precision_
+        int64_t y;
+        double max_distance;
+        bool operator==(const ReverseKey& other) const {
+            return x == other.x && y == other.y && max_distance == other.max_distance;
+        }
+    };
+    struct ReverseKeyHash {
+        size_t operator()(const ReverseKey& key) const;
+    };
+    std::unique_ptr<ShardedLRUCache<std::string, GeocodeResult>> geocode_cache_;
+    std::unique_ptr<ShardedLRUCache<ReverseKey, GeocodeResult, ReverseKeyHash>> reverse_cache_;
+    double cache_precision_ = 0.0;
+    
+    // Everything the query path needs from a record, extracted once at load
+    // time so lookups never touch the attribute maps. Names are interned:
+    // records sharing a NAME_1 (or NAME_2) share one CandidateName.
+    struct CandidateName {
+        std::string name;           // Name as stored
+        std::string normalized;     // AddressParser::normalize(name)
+        std::string abbreviation;   // Two-letter code if this is a state's name
+    };
+    struct CandidateRecord {
+        uint32_t name_id;           // NAME_1 in candidate_names_, or kNoName
+        uint32_t place_id;          // NAME_2 (level-2 data), or kNoName
+        uint32_t parent;            // Enclosing unit one level up, or kNoRecord
+        uint32_t level;             // GADM administrative level (0 = country)
+        Point2D centroid;           // Bbox centre
+        BoundingBox bounds;         // Geometry bbox (empty without geometry)
+        
+        // The unit's own name: its county name if it has one, else its state name
+        uint32_t ownName() const { return place_id != kNoName ? place_id : name_id; }
+    };
+    static constexpr uint32_t kNoName = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t kNoRecord = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t kMaxAdminLevels = 6;  // GADM goes down to GID_5
+    
+    // Outcome of a name lookup
+    struct CandidateMatch {
+        size_t record = SIZE_MAX;
+        uint32_t matched_name = kNoName;  // Name that matched (may be the record's NAME_2)
+        double confidence = 0.0;
+        bool exact = false;
+    };
+    
+    std::vector<CandidateName> candidate_names_;
+    std::vector<CandidateRecord> candidate_records_;  // Parallel to address_data_
+    
+    // Records using each name as NAME_1 or NAME_2, ascending (CSR layout),
+    // and the trigram index over the normalized names for misspelled queries
+    std::vector<uint32_t> name_record_offsets_;
+    std::vector<uint32_t> name_records_;
+    TrigramIndex fuzzy_index_;
+    
+    // Administrative hierarchy (country -> state -> county) linked by GID.
+    // Children of each unit are ascending record indices (CSR layout);
+    // roots are the units without a loaded parent.
+    std::vector<uint32_t> child_offsets_;
+    std::vector<uint32_t> children_;
+    std::vector<uint32_t> roots_;
+    size_t num_levels_ = 0;
+    bool hierarchical_ = false;  // Some unit has a parent, so lookups descend
+    
+    // Index over the centroids of named records for the reverse geocoding fallback
+    RTree centroid_index_;
     
 public:
     Geocoder();
     ~Geocoder();
     
+    // spatial_index_ points at address_data_, so a Geocoder stays in place
+    Geocoder(const Geocoder&) = delete;
+    Geocoder& operator=(const Geocoder&) = delete;
+    
     /**
      * @brief Load address data from shapefile
      * @param shapefile_path Path to address shapefile
@@ -120,6 +284,114 @@ public:
     bool loadAddressData(const std::string& shapefile_path, 
                         const std::string& address_field = "ADDRESS");
     
+    /**
+     * @brief Load several GADM administrative levels into one hierarchy
+     * 
+     * Each record's level is the deepest GID_<n> field it carries, and its
+     * parent is the unit one level up with the same GID_<n-1>. Units are kept
+     * ordered coarsest level first. Reverse geocoding then descends from the
+     * roots, testing only the children of the unit that matched, and forward
+     * queries of the form "<county>, <state>" search only that state's
+     * counties.
+     * 
+     * @param shapefile_paths Shapefiles to load, e.g. gadm41_USA_0/1/2
+     * @return true if every file loaded and at least one record was read
+     */
+    bool loadAdministrativeLevels(const std::vector<std::string>& shapefile_paths);
+    
+    /**
+     * @brief Save the loaded records and spatial index to a snapshot file
+     * 
+     * The snapshot records the shapefiles the data came from (size,
+     * modification time and content hash of each .shp and .dbf), so a later
+     * loadSnapshot() can tell whether it is still current.
+     * 
+     * @param snapshot_path File to create or replace
+     * @return true if successful
+     */
+    bool saveSnapshot(const std::string& snapshot_path) const;
+    
+    /**
+     * @brief Load data from a snapshot written by saveSnapshot()
+     * 
+     * Geometry and prepared polygons are served straight from the mapped
+     * file; the name tables and hierarchy are rebuilt from the restored
+     * records. When shapefile_paths is given, the snapshot is only used if
+     * it was built from exactly those shapefiles and none of them changed
+     * since; a false return then means the caller should load the
+     * shapefiles (and may save a fresh snapshot).
+     * 
+     * @param snapshot_path Snapshot file
+     * @param shapefile_paths Expected sources; empty to accept any snapshot
+     * @return true if the snapshot was valid, current and loaded
+     */
+    bool loadSnapshot(const std::string& snapshot_path,
+                      const std::vector<std::string>& shapefile_paths = {});
+    
+    /**
+     * @brief Give the spatial index a cell grid of this resolution from the next load on
+     * 
+     * The grid answers point-in-polygon lookups away from boundaries from
+     * a table (see CellGrid) and is saved with snapshots. A snapshot whose
+     * grid has another resolution gets its grid rebuilt when loaded.
+     * Reverse geocoding only uses it when the data has no hierarchy to
+     * descend.
+     * 
+     * @param cells Cells along the longer side of the data's bounds; 0 for no grid
+     */
+    void setCellGridResolution(size_t cells) { cell_grid_resolution_ = cells; }
+    
+    /**
+     * @brief Hit counts and fill of one result cache
+     */
+    struct CacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        size_t capacity = 0;
+    };
+    
+    /**
+     * @brief Put result caches in front of geocode() and reverseGeocode()
+     * 
+     * Addresses are keyed on their text with letters upper-cased and
+     * whitespace collapsed and trimmed, none of which changes a result.
+     * Points are keyed on their coordinates rounded to multiples of
+     * coordinate_precision, so nearby points within one step share the
+     * result of the first one looked up. Every load empties the caches.
+     * Call before queries run; the caches themselves are thread-safe.
+     * 
+     * @param capacity Entries per cache; 0 removes the caches
+     * @param coordinate_precision Step of the point keys, in coordinate units; 0 for exact coordinates
+     */
+    void enableResultCache(size_t capacity, double coordinate_precision = 1e-6);
+    
+    CacheStats getGeocodeCacheStats() const;
+    CacheStats getReverseCacheStats() const;
+    
+    /**
+     * @brief Searches of one R-tree and the nodes they visited
+     */
+    struct TreeCounters {
+        uint64_t queries = 0;
+        uint64_t nodes_visited = 0;
+    };
+    
+    /**
+     * @brief Counters of the polygon index (point-in-polygon without a hierarchy)
+     */
+    TreeCounters getPolygonTreeCounters() const;
+    
+    /**
+     * @brief Counters of the centroid index (reverse geocoding fallback)
+     */
+    TreeCounters getCentroidTreeCounters() const;
+    
+    /**
+     * @brief Shapefiles the current data was loaded from
+     */
+    const std::vector<std::string>& getSourcePaths() const { return source_paths_; }
+    
     /**
      * @brief Geocode a single address
      * @param address Address string to geocode
@@ -130,9 +402,29 @@ public:
     /**
      * @brief Geocode multiple addresses in batch
      * @param addresses Vector of address strings
-     * @return Vector of geocoding results
+     * @param num_threads Most threads of ThreadPool::shared() to use, caller included (0 = all)
+     * @return Vector of geocoding results, in input order
+     */
+    std::vector<GeocodeResult> geocodeBatch(const std::vector<std::string>& addresses,
+                                            size_t num_threads = 0) const;
+    
+    /**
+     * @brief Geocode a batch in parallel and hand results over as they are ready
+     * 
+     * Identical addresses are geocoded once. The input is processed in
+     * blocks; the distinct addresses of each block are spread over the
+     * shared thread pool and the calling thread, then the block's results
+     * are passed to sink in input order from the calling thread, so output
+     * can be streamed while later blocks run. Concurrent batches share the
+     * pool's threads rather than starting their own.
+     * 
+     * @param addresses Vector of address strings
+     * @param sink Called once per input, in order
+     * @param num_threads Most threads of ThreadPool::shared() to use, caller included (0 = all)
+     * @return Number of results delivered (less than the input if cancelled)
      */
-    std::vector<GeocodeResult> geocodeBatch(const std::vector<std::string>& addresses) const;
+    size_t geocodeBatchStreaming(const std::vector<std::string>& addresses, const BatchSink& sink,
+                                 size_t num_threads = 0) const;
     
     /**
      * @brief Reverse geocode - find address from coordinates
@@ -142,6 +434,35 @@ public:
      */
     GeocodeResult reverseGeocode(const Point2D& point, double max_distance = 100.0) const;
     
+    /**
+     * @brief Reverse geocode many points
+     * @param points Coordinate points
+     * @param max_distance Maximum search distance, as for reverseGeocode()
+     * @param num_threads Most threads of ThreadPool::shared() to use, caller included (0 = all)
+     * @return Results in input order
+     */
+    std::vector<GeocodeResult> reverseGeocodeBatch(const std::vector<Point2D>& points,
+                                                   double max_distance = 100.0,
+                                                   size_t num_threads = 0) const;
+    
+    /**
+     * @brief Reverse geocode many points, handing results over as they are ready
+     * 
+     * Points are processed in large blocks. Each block is visited in Hilbert
+     * curve order, so consecutive lookups touch the same R-tree nodes and
+     * polygon edges while they are still cached, and the sorted sequence is
+     * split into contiguous (spatially compact) ranges across the workers.
+     * The block's results then go to sink in input order.
+     * 
+     * @param points Coordinate points
+     * @param sink Called once per point, in order
+     * @param max_distance Maximum search distance, as for reverseGeocode()
+     * @param num_threads Most threads of ThreadPool::shared() to use, caller included (0 = all)
+     * @return Number of results delivered (less than the input if cancelled)
+     */
+    size_t reverseGeocodeBatchStreaming(const std::vector<Point2D>& points, const BatchSink& sink,
+                                        double max_distance = 100.0, size_t num_threads = 0) const;
+    
     /**
      * @brief Get statistics about loaded data
      * @return String with data statistics
@@ -149,13 +470,38 @@ public:
     std::string getStats() const;
 
 private:
+    /**
+     * @brief Drop all loaded data, leaving every index empty
+     *
+     * The spatial index and derived tables point into the records, the
+     * arena and the snapshot mapping, so they are rebuilt over nothing
+     * before those are freed.
+     */
+    void clearData();
+    
+    void buildCandidateTable();
+    void buildHierarchy();
+    uint32_t administrativeLevel(size_t record, std::string_view* gid) const;
+    void buildCentroidIndex();
     void buildIndex();
-    std::vector<GeocodeResult> findCandidates(const ParsedAddress& parsed_address) const;
+    GeocodeResult geocodeUncached(const std::string& address) const;
+    GeocodeResult reverseGeocodeUncached(const Point2D& point, double max_distance) const;
+    void clearResultCache();
+    GeocodeResult findBestCandidate(const ParsedAddress& parsed_address) const;
+    GeocodeResult geocodeHierarchical(const std::string& address, const ParsedAddress& parsed) const;
+    CandidateMatch matchName(const std::string& search_term) const;
+    CandidateMatch matchFuzzy(const std::string& normalized_term) const;
+    CandidateMatch matchChild(size_t parent, const std::string& normalized_place) const;
+    size_t findContainingUnit(const Point2D& point) const;
+    size_t findContainingUnit(const Point2D& point, const uint32_t* begin, const uint32_t* end) const;
+    GeocodeResult makeResult(const CandidateMatch& match, const std::string& match_type) const;
     GeocodeResult geocodeStateName(const std::string& query) const;
     double calculateConfidence(const ParsedAddress& input, const ParsedAddress& candidate) const;
     double calculateStateConfidence(const std::string& input_state, const std::string& candidate_state) const;
+    double calculateStateConfidence(const std::string& input_state, const std::string& normalized_input,
+                                    const CandidateName& candidate) const;
     double calculateDistance(const Point2D& p1, const Point2D& p2) const;
-    std::string extractAddressFromRecord(const ShapeRecord& record, const std::string& field_name) const;
+    std::string_view recordAttribute(size_t record, std::string_view field_name) const;
     
     // Fuzzy matching algorithms
     double levenshteinDistance(const std::string& s1, const std::string& s2) const;
@@ -1,11 +1,13 @@
 #pragma once
 
+#include "buffer.h"
 #include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <fstream>
 #include <cstdint>
+#include <cmath>
 
 namespace gis {
 
@@ -66,6 +68,22 @@ struct BoundingBox {
     bool contains(const Point2D& point) const;
     bool intersects(const BoundingBox& other) const;
     double area() const { return (max_x - min_x) * (max_y - min_y); }
+    
+    /**
+     * @brief Distance from a point to the nearest point of the box (0 if inside)
+     */
+    double distanceTo(const Point2D& point) const;
+    
+    /**
+     * @brief Box that contains nothing and intersects nothing; expand() grows it
+     */
+    static BoundingBox empty();
+    bool isEmpty() const { return min_x > max_x || min_y > max_y; }
+    
+    /**
+     * @brief Grow this box to also cover another box
+     */
+    void expand(const BoundingBox& other);
 };
 
 /**
@@ -77,6 +95,14 @@ public:
     virtual ShapeType getType() const = 0;
     virtual BoundingBox getBounds() const = 0;
     virtual std::unique_ptr<Geometry> clone() const = 0;
+    
+    /**
+     * @brief Euclidean distance from a point to the geometry (0 if on or inside it)
+     * 
+     * Never less than getBounds().distanceTo(point), so the bbox distance can
+     * be used as a lower bound when searching for the nearest geometry.
+     */
+    virtual double distanceTo(const Point2D& point) const = 0;
 };
 
 /**
@@ -92,49 +118,149 @@ public:
     ShapeType getType() const override { return ShapeType::Point; }
     BoundingBox getBounds() const override;
     std::unique_ptr<Geometry> clone() const override;
+    double distanceTo(const Point2D& point) const override;
     
     const Point2D& getPoint() const { return point_; }
+    void setPoint(const Point2D& point) { point_ = point; }
 };
 
 /**
- * @brief Polyline geometry (series of connected line segments)
+ * @brief Non-owning view of a contiguous run of points (one ring or part)
  */
-class PolylineGeometry : public Geometry {
+class PointSpan {
 private:
-    std::vector<std::vector<Point2D>> parts_;
+    const Point2D* data_;
+    size_t size_;
+    
+public:
+    PointSpan() : data_(nullptr), size_(0) {}
+    PointSpan(const Point2D* data, size_t size) : data_(data), size_(size) {}
+    
+    const Point2D* begin() const { return data_; }
+    const Point2D* end() const { return data_ + size_; }
+    const Point2D* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const Point2D& operator[](size_t i) const { return data_[i]; }
+};
+
+/**
+ * @brief Shared storage for geometries made of several point runs
+ * 
+ * All coordinates live in one contiguous buffer, with part i spanning
+ * [part_offsets[i], part_offsets[i + 1]). This mirrors the shapefile's
+ * on-disk layout, so a whole record is decoded with one copy. The buffers
+ * may also borrow from a mapped snapshot (see Buffer).
+ */
+class MultiPartGeometry : public Geometry {
+protected:
+    Buffer<Point2D> points_;
+    Buffer<uint32_t> part_offsets_;  // num_parts + 1 entries, first is 0
+    
+    // Computed once whenever the coordinates change
+    BoundingBox bounds_;
+    Buffer<BoundingBox> part_bounds_;
+    
+    MultiPartGeometry() : part_offsets_(1, 0) {}
+    MultiPartGeometry(std::vector<Point2D> points, std::vector<uint32_t> part_offsets);
+    MultiPartGeometry(Buffer<Point2D> points, Buffer<uint32_t> part_offsets, Buffer<BoundingBox> part_bounds);
+    explicit MultiPartGeometry(const std::vector<std::vector<Point2D>>& parts);
+    
+    void updateBounds();
+    
+    /**
+     * @brief Distance to the closest segment of any part
+     * @param closed Also consider the segment from each part's last point back to its first
+     */
+    double distanceToParts(const Point2D& point, bool closed) const;
+    
+public:
+    /**
+     * @brief Get the cached bounding box, O(1)
+     */
+    BoundingBox getBounds() const override { return bounds_; }
+    
+    /**
+     * @brief Get the cached bounding box of one part (ring)
+     */
+    const BoundingBox& getPartBounds(size_t i) const { return part_bounds_[i]; }
+    
+    size_t getNumParts() const { return part_offsets_.empty() ? 0 : part_offsets_.size() - 1; }
+    size_t getNumPoints() const { return points_.size(); }
+    
+    PointSpan getPart(size_t i) const {
+        return PointSpan(points_.data() + part_offsets_[i], part_offsets_[i + 1] - part_offsets_[i]);
+    }
+    
+    const Buffer<Point2D>& getPoints() const { return points_; }
+    const Buffer<uint32_t>& getPartOffsets() const { return part_offsets_; }
+    const Buffer<BoundingBox>& getAllPartBounds() const { return part_bounds_; }
     
+    /**
+     * @brief Exchange coordinate storage with the caller (lets readers reuse buffers)
+     * 
+     * Cached bounds are recomputed for the coordinates swapped in.
+     */
+    void swapStorage(std::vector<Point2D>& points, std::vector<uint32_t>& part_offsets) {
+        points_.swap(points);
+        part_offsets_.swap(part_offsets);
+        updateBounds();
+    }
+};
+
+/**
+ * @brief Polyline geometry (series of connected line segments)
+ */
+class PolylineGeometry : public MultiPartGeometry {
 public:
-    explicit PolylineGeometry(std::vector<std::vector<Point2D>> parts) 
-        : parts_(std::move(parts)) {}
+    PolylineGeometry() = default;
+    PolylineGeometry(std::vector<Point2D> points, std::vector<uint32_t> part_offsets)
+        : MultiPartGeometry(std::move(points), std::move(part_offsets)) {}
+    
+    /**
+     * @brief Adopt coordinates whose part bounds are already known (no scan)
+     */
+    PolylineGeometry(Buffer<Point2D> points, Buffer<uint32_t> part_offsets, Buffer<BoundingBox> part_bounds)
+        : MultiPartGeometry(std::move(points), std::move(part_offsets), std::move(part_bounds)) {}
+    explicit PolylineGeometry(const std::vector<std::vector<Point2D>>& parts) 
+        : MultiPartGeometry(parts) {}
     
     ShapeType getType() const override { return ShapeType::PolyLine; }
-    BoundingBox getBounds() const override;
     std::unique_ptr<Geometry> clone() const override;
-    
-    const std::vector<std::vector<Point2D>>& getParts() const { return parts_; }
-    size_t getNumParts() const { return parts_.size(); }
+    double distanceTo(const Point2D& point) const override { return distanceToParts(point, false); }
 };
 
 /**
  * @brief Polygon geometry with support for holes
  */
-class PolygonGeometry : public Geometry {
-private:
-    std::vector<std::vector<Point2D>> rings_;
-    
+class PolygonGeometry : public MultiPartGeometry {
 public:
-    explicit PolygonGeometry(std::vector<std::vector<Point2D>> rings) 
-        : rings_(std::move(rings)) {}
+    PolygonGeometry() = default;
+    PolygonGeometry(std::vector<Point2D> points, std::vector<uint32_t> part_offsets)
+        : MultiPartGeometry(std::move(points), std::move(part_offsets)) {}
+    
+    /**
+     * @brief Adopt coordinates whose ring bounds are already known (no scan)
+     */
+    PolygonGeometry(Buffer<Point2D> points, Buffer<uint32_t> part_offsets, Buffer<BoundingBox> part_bounds)
+        : MultiPartGeometry(std::move(points), std::move(part_offsets), std::move(part_bounds)) {}
+    explicit PolygonGeometry(const std::vector<std::vector<Point2D>>& rings) 
+        : MultiPartGeometry(rings) {}
     
     ShapeType getType() const override { return ShapeType::Polygon; }
-    BoundingBox getBounds() const override;
     std::unique_ptr<Geometry> clone() const override;
+    double distanceTo(const Point2D& point) const override;
     
-    const std::vector<std::vector<Point2D>>& getRings() const { return rings_; }
-    size_t getNumRings() const { return rings_.size(); }
+    PointSpan getRing(size_t i) const { return getPart(i); }
+    size_t getNumRings() const { return getNumParts(); }
     
     /**
      * @brief Check if a point is inside the polygon
+     * 
+     * Uses the even-odd rule over all rings, so holes and additional outer
+     * rings (multipolygon parts) are both handled. Rings whose bbox does not
+     * contain the point are skipped without touching their vertices.
+     * 
      * @param point The point to test
      * @return true if point is inside the polygon
      */
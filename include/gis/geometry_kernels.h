@@ -0,0 +1,72 @@
+#pragma once
+
+#include "geometry.h"
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace gis {
+
+/**
+ * @brief Inner loops of point-in-polygon tests, bbox computation and R-tree scans
+ *
+ * Each kernel has a scalar version and, on x86-64 builds with GCC or Clang,
+ * an AVX2 version selected at run time when the CPU supports it. The vector
+ * versions evaluate the same IEEE operations in the same order per element
+ * as the scalar ones, so both give bit-identical results. Builds with
+ * GIS_DISABLE_SIMD defined use the scalar versions only.
+ */
+
+/**
+ * @brief Number of ring edges crossed by the ray from point towards +x
+ *
+ * The ring is closed implicitly (edge from the last point to the first).
+ * Uses the same crossing rule as PolygonGeometry::contains(), so the point
+ * is inside the ring iff the count is odd.
+ */
+size_t countRingCrossings(const Point2D* ring, size_t count, const Point2D& point);
+
+/**
+ * @brief Bounding box of a run of points
+ *
+ * Matches a std::min/std::max fold started from (max, max, lowest, lowest),
+ * which is also what an empty run returns.
+ */
+BoundingBox computePointBounds(const Point2D* points, size_t count);
+
+/**
+ * @brief Test one query box against up to 64 boxes stored as separate coordinate arrays
+ * @return Bit e set iff box e intersects the query (BoundingBox::intersects semantics)
+ */
+uint64_t intersectingBoxMask(const double* min_x, const double* min_y, const double* max_x,
+                             const double* max_y, size_t count, const BoundingBox& query);
+
+/**
+ * @brief Name of the kernel set in use: "avx2" or "scalar"
+ */
+const char* activeKernelSet();
+
+/**
+ * @brief Switch between the vector kernels (when supported) and the scalar fallback
+ *
+ * Meant for benchmarks and comparisons; results are identical either way.
+ */
+void setSimdKernelsEnabled(bool enabled);
+
+/**
+ * @brief Index of the lowest set bit of a non-zero mask
+ */
+inline unsigned lowestSetBit(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+} // namespace gis
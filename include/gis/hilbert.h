@@ -0,0 +1,80 @@
+#pragma once
+
+#include "geometry.h"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace gis {
+
+/**
+ * @brief Position of grid cell (x, y) along a Hilbert curve over a 65536 x 65536 grid
+ *
+ * Cells that are close on the curve are close in space, so visiting points
+ * in curve order keeps consecutive lookups in the same index nodes and
+ * polygons.
+ */
+inline uint32_t hilbertIndex(uint32_t x, uint32_t y) {
+    constexpr uint32_t n = 1u << 16;
+    uint32_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the sub-curve is entered the right way
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+/**
+ * @brief Permutation that visits points in Hilbert curve order
+ *
+ * The curve is laid over the points' own bounding box. Non-finite
+ * coordinates are ordered last.
+ *
+ * @param points Points to order
+ * @param count Number of points (must fit in 32 bits)
+ * @return Indices into points, sorted along the curve
+ */
+inline std::vector<uint32_t> hilbertSortOrder(const Point2D* points, size_t count) {
+    BoundingBox extent = BoundingBox::empty();
+    for (size_t i = 0; i < count; ++i) {
+        if (std::isfinite(points[i].x) && std::isfinite(points[i].y)) {
+            extent.expand(BoundingBox(points[i].x, points[i].y, points[i].x, points[i].y));
+        }
+    }
+
+    constexpr double kCells = 65535.0;
+    double scale_x = extent.max_x > extent.min_x ? kCells / (extent.max_x - extent.min_x) : 0.0;
+    double scale_y = extent.max_y > extent.min_y ? kCells / (extent.max_y - extent.min_y) : 0.0;
+
+    // Sort (key << 32 | index) pairs as plain integers
+    std::vector<uint64_t> keyed(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t key = 0xFFFFFFFFull;  // Last cell of the curve
+        if (std::isfinite(points[i].x) && std::isfinite(points[i].y)) {
+            auto cell_x = static_cast<uint32_t>((points[i].x - extent.min_x) * scale_x);
+            auto cell_y = static_cast<uint32_t>((points[i].y - extent.min_y) * scale_y);
+            key = hilbertIndex(cell_x, cell_y);
+        }
+        keyed[i] = (key << 32) | static_cast<uint32_t>(i);
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; ++i) {
+        order[i] = static_cast<uint32_t>(keyed[i]);
+    }
+    return order;
+}
+
+} // namespace gis
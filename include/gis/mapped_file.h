@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace gis {
+
+/**
+ * @brief File access strategy used by the shapefile and DBF readers
+ */
+enum class IOMode {
+    Buffered,       // std::ifstream, one read per record
+    MemoryMapped    // Map the whole file once and decode records in place
+};
+
+/**
+ * @brief Read-only memory mapping of a complete file
+ *
+ * Thin RAII wrapper around mmap (POSIX) / MapViewOfFile (Windows). The
+ * mapping stays valid until close() is called or the object is destroyed.
+ */
+class MappedFile {
+private:
+    const char* data_;
+    size_t size_;
+#ifdef _WIN32
+    void* file_handle_;
+    void* mapping_handle_;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Map a file into memory
+     * @param filename Full path of the file to map
+     * @return true if successful, false otherwise (missing or empty file)
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * @brief Unmap the file
+     */
+    void close();
+
+    /**
+     * @brief Hint to the OS that the mapping will be read front to back
+     */
+    void adviseSequential() const;
+
+    bool isOpen() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+} // namespace gis
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gis {
+
+/**
+ * @brief Resolve a requested worker count (0 = one per hardware thread)
+ */
+inline size_t resolveThreadCount(size_t num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    return std::max<size_t>(1, num_threads);
+}
+
+/**
+ * @brief Run fn(begin, end, worker) over [0, count) on threads of its own
+ *
+ * Threads are started and joined on every call, which suits one-off work
+ * such as loading a dataset; work cut into many small calls belongs on a
+ * ThreadPool. The range is cut into contiguous chunks that workers claim
+ * dynamically, so uneven per-item cost (one huge polygon among small ones)
+ * still balances.
+ * `worker` is a stable index in [0, threads) for per-thread scratch state.
+ * The first exception thrown by any worker is rethrown in the caller.
+ *
+ * @param count Number of items
+ * @param num_threads Worker count, 0 = std::thread::hardware_concurrency()
+ * @param fn Callable invoked as fn(size_t begin, size_t end, size_t worker)
+ * @return Number of workers used
+ */
+template<typename Fn>
+size_t parallelFor(size_t count, size_t num_threads, Fn&& fn) {
+    if (count == 0) return 0;
+    
+    size_t threads = std::min(resolveThreadCount(num_threads), count);
+    if (threads == 1) {
+        fn(size_t(0), count, size_t(0));
+        return 1;
+    }
+    
+    // Several chunks per worker keeps the tail short without much contention
+    size_t grain = std::max<size_t>(1, count / (threads * 8));
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    
+    auto worker_loop = [&](size_t worker) {
+        try {
+            for (;;) {
+                size_t begin = next.fetch_add(grain, std::memory_order_relaxed);
+                if (begin >= count) break;
+                fn(begin, std::min(count, begin + grain), worker);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = std::current_exception();
+            next.store(count, std::memory_order_relaxed);  // Stop handing out work
+        }
+    };
+    
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (size_t t = 1; t < threads; ++t) {
+        pool.emplace_back(worker_loop, t);
+    }
+    worker_loop(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return threads;
+}
+
+/**
+ * @brief Threads started once and shared by every call submitted to them
+ *
+ * parallelFor() on a pool claims chunks the same way as the free function,
+ * but its helpers are pool threads and the calling thread takes part. A
+ * call therefore progresses even while other calls keep every pool thread
+ * busy, and any number of concurrent calls together use no more threads
+ * than the pool's plus their callers'.
+ */
+class ThreadPool {
+private:
+    struct Job {
+        std::function<void(size_t)> work;  // Claims and runs chunks until none are left
+        size_t pending = 0;                // Queue entries not yet finished
+    };
+    
+    std::vector<std::thread> threads_;
+    std::deque<Job*> queue_;  // One entry per helper a call asked for
+    std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::condition_variable job_done_;
+    bool stopping_ = false;
+    
+    void run(size_t worker) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            has_work_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            Job* job = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
+            job->work(worker);
+            lock.lock();
+            if (--job->pending == 0) {
+                job_done_.notify_all();
+            }
+        }
+    }
+    
+public:
+    /**
+     * @param num_threads Threads including a caller, 0 = one per hardware thread
+     */
+    explicit ThreadPool(size_t num_threads = 0) {
+        size_t helpers = resolveThreadCount(num_threads) - 1;
+        threads_.reserve(helpers);
+        for (size_t t = 0; t < helpers; ++t) {
+            threads_.emplace_back([this, t]() { run(t + 1); });
+        }
+    }
+    
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        has_work_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    /**
+     * @brief Most workers one call can use: the pool threads and its caller
+     */
+    size_t size() const { return threads_.size() + 1; }
+    
+    /**
+     * @brief Pool for batch queries, one thread per hardware thread, started on first use
+     */
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+    
+    /**
+     * @brief Run fn(begin, end, worker) over [0, count) on the pool and the calling thread
+     *
+     * `worker` is 0 for the caller and a pool thread's own index otherwise,
+     * so it is stable and below size(). The first exception thrown by any
+     * worker is rethrown in the caller.
+     *
+     * @param count Number of items
+     * @param max_workers Most workers to use, caller included, 0 = size()
+     * @param fn Callable invoked as fn(size_t begin, size_t end, size_t worker)
+     * @return Number of workers asked for
+     */
+    template<typename Fn>
+    size_t parallelFor(size_t count, size_t max_workers, Fn&& fn) {
+        if (count == 0) return 0;
+        
+        size_t workers = std::min({max_workers == 0 ? size() : max_workers, size(), count});
+        if (workers == 1) {
+            fn(size_t(0), count, size_t(0));
+            return 1;
+        }
+        
+        size_t grain = std::max<size_t>(1, count / (workers * 8));
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        
+        Job job;
+        job.work = [&](size_t worker) {
+            try {
+                for (;;) {
+                    size_t begin = next.fetch_add(grain, std::memory_order_relaxed);
+                    if (begin >= count) break;
+                    fn(begin, std::min(count, begin + grain), worker);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                next.store(count, std::memory_order_relaxed);  // Stop handing out work
+            }
+        };
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job.pending = workers - 1;
+            queue_.insert(queue_.end(), workers - 1, &job);
+        }
+        has_work_.notify_all();
+        job.work(0);
+        
+        {
+            // Entries no pool thread has taken yet would find nothing left to claim
+            std::unique_lock<std::mutex> lock(mutex_);
+            size_t queued = queue_.size();
+            queue_.erase(std::remove(queue_.begin(), queue_.end(), &job), queue_.end());
+            job.pending -= queued - queue_.size();
+            job_done_.wait(lock, [&job]() { return job.pending == 0; });
+        }
+        
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return workers;
+    }
+};
+
+} // namespace gis
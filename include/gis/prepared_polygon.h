@@ -0,0 +1,120 @@
+#pragma once
+
+#include "arena.h"
+#include "geometry.h"
+#include <vector>
+#include <cstdint>
+
+namespace gis {
+
+/**
+ * @brief Polygon preprocessed for repeated point-in-polygon tests
+ *
+ * The polygon's y-extent is cut into equal horizontal bands, and each band
+ * lists the ring edges whose y-range overlaps it. A horizontal ray from the
+ * query point can only cross edges of the point's own band, so contains()
+ * runs the even-odd test over a handful of edges instead of every vertex.
+ *
+ * Polygons detailed enough for their bands to get long also get a pyramid
+ * of simplified versions (see DetailLevel), tried coarsest first: a point
+ * well away from the boundary is settled by a few coarse edges, and only
+ * points near the boundary reach the full-resolution bands.
+ *
+ * Edges reference the polygon's coordinate buffer, so the polygon must
+ * outlive the prepared form and must not be modified while it is in use.
+ */
+class PreparedPolygon {
+public:
+    /**
+     * @brief Ring edge as indices into the polygon's coordinate buffer
+     */
+    struct Edge {
+        uint32_t from;
+        uint32_t to;
+    };
+
+    /**
+     * @brief Ring edge by its end points
+     */
+    struct Segment {
+        Point2D from;
+        Point2D to;
+    };
+
+    /**
+     * @brief Douglas-Peucker simplification of every ring, with its own bands
+     *
+     * No boundary point of the polygon is farther than tolerance / 2 from
+     * the simplified rings, so for a point farther than tolerance from every
+     * simplified edge both give the same even-odd answer. Each band lists
+     * the edges that come within tolerance of it as well as those crossing
+     * it, so one band decides whether a point is that far out. Edges are
+     * stored by value, band after band, so a test reads one short run.
+     */
+    struct DetailLevel {
+        double tolerance = 0.0;
+        double band_scale = 0.0;
+        Buffer<uint32_t> band_offsets;  // num_bands + 1 entries into band_segments
+        Buffer<Segment> band_segments;
+    };
+
+private:
+    const PolygonGeometry* polygon_;
+    BoundingBox bounds_;
+    double band_scale_;              // Bands per unit of y
+    Buffer<uint32_t> band_offsets_;  // num_bands + 1 entries into band_edges_
+    Buffer<Edge> band_edges_;
+    std::vector<DetailLevel> levels_;  // Coarsest first
+
+    size_t bandOf(double y) const;
+    void buildDetailLevels(DatasetArena* arena);
+
+    /**
+     * @brief Even-odd answer of one level: 1 inside, 0 outside, -1 too close to tell
+     */
+    int classify(const DetailLevel& level, const Point2D& point) const;
+
+public:
+    PreparedPolygon();
+
+    /**
+     * @brief Build the band index and detail levels for a polygon
+     * @param polygon Polygon to prepare; referenced, not copied
+     * @param arena Where to put the band lists and simplified rings,
+     *              borrowed from then on; null to own them
+     */
+    explicit PreparedPolygon(const PolygonGeometry& polygon, DatasetArena* arena = nullptr);
+
+    /**
+     * @brief Adopt a band index built earlier for the same polygon
+     *
+     * Used to restore a saved index without rebuilding it. The arguments must
+     * come from getBandScale(), getBandOffsets(), getBandEdges() and
+     * getDetailLevels() of a PreparedPolygon built from identical coordinates.
+     */
+    PreparedPolygon(const PolygonGeometry& polygon, double band_scale,
+                    Buffer<uint32_t> band_offsets, Buffer<Edge> band_edges,
+                    std::vector<DetailLevel> levels = {});
+
+    /**
+     * @brief Check if a point is inside the polygon
+     *
+     * Gives the same answer as PolygonGeometry::contains().
+     */
+    bool contains(const Point2D& point) const;
+
+    bool isEmpty() const { return polygon_ == nullptr; }
+    const PolygonGeometry* getPolygon() const { return polygon_; }
+    size_t getNumBands() const { return band_offsets_.empty() ? 0 : band_offsets_.size() - 1; }
+    double getBandScale() const { return band_scale_; }
+    const Buffer<uint32_t>& getBandOffsets() const { return band_offsets_; }
+    const Buffer<Edge>& getBandEdges() const { return band_edges_; }
+    const std::vector<DetailLevel>& getDetailLevels() const { return levels_; }
+
+    /**
+     * @brief Approximate heap memory used by the band index, in bytes
+     */
+    size_t memoryUsage() const;
+};
+
+} // namespace gis
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace gis {
+
+/**
+ * @brief Lock-free latency histogram with a bounded relative error
+ *
+ * Nanosecond values fall into log-linear buckets: every power of two is
+ * split into kSubBuckets equal steps, so a reported percentile is within
+ * 1/kSubBuckets (about 6%) of the true one. record() is three relaxed
+ * atomic adds, cheap enough to call on every request from every thread;
+ * percentiles are worked out when they are read.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr unsigned kMaxExponent = 40;  // 2^40 ns is about 18 minutes
+    static constexpr size_t kBucketCount = kSubBuckets + (kMaxExponent - kSubBucketBits) * kSubBuckets;
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_ns_;
+
+public:
+    LatencyHistogram();
+
+    // Shared by every thread that records into it
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t nanoseconds) {
+        buckets_[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    void record(std::chrono::steady_clock::duration elapsed) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        record(static_cast<uint64_t>(ns > 0 ? ns : 0));
+    }
+
+    /**
+     * @brief Smallest bucket bound at or above the given fraction of the samples
+     * @param fraction Between 0 and 1, e.g. 0.99 for p99
+     * @return Nanoseconds, 0 if nothing was recorded
+     */
+    uint64_t percentile(double fraction) const;
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sumNanoseconds() const { return sum_ns_.load(std::memory_order_relaxed); }
+
+    static size_t bucketOf(uint64_t nanoseconds);
+
+    /**
+     * @brief Largest value that falls into a bucket
+     */
+    static uint64_t bucketUpperBound(size_t bucket);
+};
+
+/**
+ * @brief Steps of a lookup that time is charged to
+ *
+ * Parse turns the request into a query (query string, coordinates,
+ * address parsing); Index finds candidates (R-tree, cell grid, hierarchy
+ * descent, name tables, caches); Refine runs the exact tests on them
+ * (point-in-polygon, edit distances); Serialize writes the response.
+ */
+enum class QueryStage : uint8_t {
+    Parse,
+    Index,
+    Refine,
+    Serialize
+};
+
+constexpr size_t kQueryStageCount = 4;
+
+/**
+ * @brief Lower-case name of a stage, for reports
+ */
+const char* queryStageName(QueryStage stage);
+
+/**
+ * @brief Time the request running on this thread has spent per stage
+ *
+ * A Scope makes a trace current for its thread; StageTimer objects in the
+ * code it calls then charge time to their stage. Each moment is charged to
+ * the innermost running stage only, so a Refine inside an Index pauses
+ * the Index. Without a current trace a StageTimer reads no clock, so
+ * untraced callers (batches, the benchmarks) pay a thread-local load.
+ */
+class QueryTrace {
+public:
+    std::array<uint64_t, kQueryStageCount> stage_ns{};
+    uint32_t stages_entered = 0;  // Bit per QueryStage
+
+    /**
+     * @brief Make a trace current on this thread until the scope ends
+     */
+    class Scope {
+    private:
+        QueryTrace* previous_;
+
+    public:
+        explicit Scope(QueryTrace& trace);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    static QueryTrace* current();
+
+    bool entered(QueryStage stage) const {
+        return (stages_entered >> static_cast<unsigned>(stage)) & 1u;
+    }
+
+private:
+    friend class StageTimer;
+
+    static constexpr int kNoStage = -1;
+    int running_ = kNoStage;
+    std::chrono::steady_clock::time_point mark_;
+
+    void switchTo(int stage);
+};
+
+/**
+ * @brief Charge the time until it is destroyed to one stage of the current trace
+ */
+class StageTimer {
+private:
+    QueryTrace* trace_;
+    int previous_;
+
+public:
+    explicit StageTimer(QueryStage stage) : trace_(QueryTrace::current()), previous_(0) {
+        if (trace_) {
+            previous_ = trace_->running_;
+            trace_->switchTo(static_cast<int>(stage));
+        }
+    }
+
+    ~StageTimer() {
+        if (trace_) {
+            trace_->switchTo(previous_);
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+} // namespace gis
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace gis {
+
+/**
+ * @brief Fixed-capacity LRU map split into independently locked shards
+ *
+ * A key always lands in the same shard, chosen from its hash, and each
+ * shard evicts its own least recently used entry once it holds its share
+ * of the capacity. Concurrent callers only contend when their keys fall
+ * into the same shard. Values are copied in and out, so nothing handed
+ * out refers into the cache.
+ *
+ * Hit and miss counts are relaxed atomics, for statistics only.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedLRUCache {
+private:
+    struct Shard {
+        using Entry = std::pair<Key, Value>;
+
+        std::mutex mutex;
+        std::list<Entry> entries;  // Most recently used first
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_capacity_;
+    Hash hash_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+
+    Shard& shardOf(const Key& key) {
+        // Spread the hash over the high bits; the shard maps use the low ones
+        uint64_t mixed = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+        return *shards_[(mixed >> 32) % shards_.size()];
+    }
+
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Total number of entries kept, rounded up to a multiple of the shard count
+     * @param shard_count Number of independently locked shards
+     */
+    explicit ShardedLRUCache(size_t capacity, size_t shard_count = 16)
+        : shard_capacity_(0), hits_(0), misses_(0) {
+        shard_count = std::max<size_t>(1, std::min(shard_count, capacity));
+        shard_capacity_ = (capacity + shard_count - 1) / shard_count;
+        for (size_t i = 0; i < shard_count; ++i) {
+            shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    // Shards hold mutexes and are referenced by concurrent callers
+    ShardedLRUCache(const ShardedLRUCache&) = delete;
+    ShardedLRUCache& operator=(const ShardedLRUCache&) = delete;
+
+    /**
+     * @brief Copy the value cached for key, marking it most recently used
+     * @return false on a miss
+     */
+    bool find(const Key& key, Value& value) {
+        Shard& shard = shardOf(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                value = it->second->second;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /**
+     * @brief Cache a value, replacing any entry for the same key
+     */
+    void insert(const Key& key, Value value) {
+        if (shard_capacity_ == 0) return;
+
+        Shard& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            it->second->second = std::move(value);
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return;
+        }
+
+        if (shard.entries.size() >= shard_capacity_) {
+            // Reuse the evicted node rather than freeing and allocating one
+            auto last = std::prev(shard.entries.end());
+            shard.index.erase(last->first);
+            last->first = key;
+            last->second = std::move(value);
+            shard.entries.splice(shard.entries.begin(), shard.entries, last);
+        } else {
+            shard.entries.emplace_front(key, std::move(value));
+        }
+        shard.index.emplace(key, shard.entries.begin());
+    }
+
+    /**
+     * @brief Drop every entry; the hit and miss counts are kept
+     */
+    void clear() {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->index.clear();
+            shard->entries.clear();
+        }
+    }
+
+    size_t size() const {
+        size_t count = 0;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            count += shard->entries.size();
+        }
+        return count;
+    }
+
+    size_t capacity() const { return shard_capacity_ * shards_.size(); }
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+};
+
+} // namespace gis
@@ -1,48 +1,40 @@
 #pragma once
 
+#include "arena.h"
+#include "dbf_reader.h"
 #include "geometry.h"
+#include "mapped_file.h"
 #include <memory>
 #include <vector>
 #include <unordered_map>
 #include <string>
 #include <variant>
+#include <functional>
 
 namespace gis {
 
-/**
- * @brief Supported field types in DBF files
- */
-enum class FieldType {
-    Character,
-    Numeric,
-    Logical,
-    Date,
-    Float,
-    Unknown
-};
-
-/**
- * @brief Represents a field value from DBF record
- */
-using FieldValue = std::variant<std::string, double, bool, int>;
+class RTree;
 
 /**
  * @brief Shapefile record containing geometry and attributes
  */
 struct ShapeRecord {
     int32_t record_number;
+    uint32_t index;  // Zero-based position in the shapefile, also its row in the .dbf
     std::unique_ptr<Geometry> geometry;
     std::unordered_map<std::string, FieldValue> attributes;
     
-    ShapeRecord() : record_number(0) {}
+    ShapeRecord() : record_number(0), index(0) {}
     ShapeRecord(ShapeRecord&& other) noexcept 
         : record_number(other.record_number)
+        , index(other.index)
         , geometry(std::move(other.geometry))
         , attributes(std::move(other.attributes)) {}
     
     ShapeRecord& operator=(ShapeRecord&& other) noexcept {
         if (this != &other) {
             record_number = other.record_number;
+            index = other.index;
             geometry = std::move(other.geometry);
             attributes = std::move(other.attributes);
         }
@@ -55,28 +47,73 @@ struct ShapeRecord {
 };
 
 /**
- * @brief Field definition from DBF header
+ * @brief Selects which parts of each record a scan decodes
  */
-struct FieldDefinition {
-    std::string name;
-    FieldType type;
-    uint8_t length;
-    uint8_t decimal_count;
+struct ReadOptions {
+    bool read_geometry = true;
+    bool read_attributes = true;
+    std::vector<std::string> fields;  // Attribute subset by name; empty = all fields
+    
+    // Where readAllRecordsParallel() puts coordinate arrays; the geometries
+    // borrow them, so the arena must outlive the records. Null = each
+    // geometry owns its arrays. forEachRecord() reuses one record and ignores it
+    DatasetArena* arena = nullptr;
 };
 
+/**
+ * @brief Callback for streaming scans; return false to stop the scan
+ */
+using RecordVisitor = std::function<bool(const ShapeRecord& record)>;
+
 /**
  * @brief Main class for reading ESRI Shapefiles
  * 
  * This class provides a complete implementation for reading shapefiles (.shp),
  * index files (.shx), and database files (.dbf). It supports all standard
  * shapefile geometry types and provides efficient access to spatial data.
+ * 
+ * Geometry is decoded by a decoder instantiated for the header's shape
+ * type and selected once by open(). Point, PolyLine and Polygon records
+ * and their Z and M variants are read as 2D geometry (the Z and M values
+ * are skipped); MultiPoint and MultiPatch records have no geometry.
  */
 class ShapefileReader {
+public:
+    /**
+     * @brief Geometry decoder instantiated for one shape type
+     *
+     * decode() reads a record's content after the shape type, into
+     * coordinate arrays allocated from the arena when one is given;
+     * refill() does the same into an existing geometry_type geometry,
+     * reusing its buffers. Z and M types decode to their 2D geometry.
+     */
+    struct GeometryCodec {
+        ShapeType geometry_type;
+        std::unique_ptr<Geometry> (*decode)(const char* data, size_t size, DatasetArena* arena);
+        bool (*refill)(const char* data, size_t size, Geometry& geometry);
+    };
+    
 private:
+    /**
+     * @brief Per-thread read position: file streams and staging buffers
+     *
+     * In buffered mode each cursor owns its streams so that several threads
+     * can read concurrently; in memory-mapped mode cursors stay empty and all
+     * threads decode from the shared mappings.
+     */
+    struct RecordCursor {
+        std::ifstream shp_file;
+        std::ifstream shx_file;
+        std::vector<char> index_buffer;
+        std::vector<char> record_buffer;
+        DBFReader::Cursor dbf;
+    };
+    
     std::string base_filename_;
-    std::ifstream shp_file_;
-    std::ifstream shx_file_;
-    std::ifstream dbf_file_;
+    IOMode io_mode_;
+    RecordCursor cursor_;
+    MappedFile shp_map_;
+    MappedFile shx_map_;
     
     // Header information
     int32_t file_code_;
@@ -84,13 +121,17 @@ private:
     int32_t version_;
     ShapeType shape_type_;
     BoundingBox bounds_;
+    GeometryCodec codec_;  // Decoder specialised on shape_type_, chosen at open()
     
-    // DBF information
-    std::vector<FieldDefinition> field_definitions_;
+    // Attributes, read through the shared DBF engine
+    DBFReader dbf_;
     uint32_t record_count_;
-    uint16_t header_length_;
-    uint16_t record_length_;
     
+    // Per-record bounding boxes (empty for null shapes) and an R-tree over them
+    std::vector<BoundingBox> record_bounds_;
+    std::unique_ptr<RTree> bounds_index_;
+    
+    bool has_dbf_;
     bool is_open_;
     
 public:
@@ -107,9 +148,11 @@ public:
     
     /**
      * @brief Open the shapefile and associated files
+     * @param mode Buffered stream reads, or map .shp/.shx/.dbf once and
+     *             decode records straight from the mapped bytes
      * @return true if successful, false otherwise
      */
-    bool open();
+    bool open(IOMode mode = IOMode::Buffered);
     
     /**
      * @brief Close all open files
@@ -122,6 +165,11 @@ public:
      */
     bool isOpen() const { return is_open_; }
     
+    /**
+     * @brief Get the mode the files were opened with
+     */
+    IOMode getIOMode() const { return io_mode_; }
+    
     /**
      * @brief Get the number of records in the shapefile
      * @return Number of records
@@ -145,9 +193,16 @@ public:
      * @return Vector of field definitions
      */
     const std::vector<FieldDefinition>& getFieldDefinitions() const { 
-        return field_definitions_; 
+        return dbf_.getFields(); 
     }
     
+    /**
+     * @brief Get the reader of the .dbf, for bulk column and block reads
+     * 
+     * Opened in the same mode as the shapefile; not open if there is no .dbf.
+     */
+    DBFReader& getDBFReader() { return dbf_; }
+    
     /**
      * @brief Read a specific record by index
      * @param index Zero-based record index
@@ -161,13 +216,82 @@ public:
      */
     std::vector<std::unique_ptr<ShapeRecord>> readAllRecords();
     
+    /**
+     * @brief Read all records using a pool of worker threads
+     * 
+     * The .shx offset table is split into ranges; each worker decodes geometry
+     * and attributes for its ranges with its own cursor (own streams in
+     * buffered mode, a shared read-only mapping in memory-mapped mode).
+     * With options.arena set, each multipart geometry's points, part offsets
+     * and ring bounds take one arena allocation instead of three heap ones.
+     * 
+     * @param num_threads Number of workers, 0 = one per hardware thread
+     * @param options Geometry only, attributes only, or a subset of fields;
+     *                without geometry record_number is the 1-based index
+     * @return Vector of shape records in file order, same as readAllRecords();
+     *         empty if a worker could not open its own streams
+     */
+    std::vector<std::unique_ptr<ShapeRecord>> readAllRecordsParallel(size_t num_threads = 0,
+                                                                     const ReadOptions& options = ReadOptions());
+    
+    /**
+     * @brief Stream every record through a visitor in file order
+     * 
+     * Decodes into a single scratch record whose geometry and attribute
+     * buffers are reused from one record to the next, so a scan runs in
+     * constant memory. The record is only valid for the duration of the
+     * call. When geometry is not requested the .shp is not touched and
+     * record_number is the 1-based record index.
+     * 
+     * @param visitor Called once per record; return false to stop early
+     * @param options Geometry only, attributes only, or a subset of fields
+     * @return Number of records passed to the visitor
+     */
+    size_t forEachRecord(const RecordVisitor& visitor, const ReadOptions& options = ReadOptions());
+    
     /**
      * @brief Read records within a bounding box
+     * 
+     * Only the 32-byte bbox stored in each record header is read to filter;
+     * geometry and attributes are decoded for hits only. After
+     * buildBoundsIndex() the filter is an R-tree query and no longer touches
+     * the .shp for misses at all.
+     * 
      * @param bbox Bounding box to filter records
-     * @return Vector of shape records that intersect the bbox
+     * @return Vector of shape records that intersect the bbox, in file order
      */
     std::vector<std::unique_ptr<ShapeRecord>> readRecordsInBounds(const BoundingBox& bbox);
     
+    /**
+     * @brief Read the bounding box a record stores in its header
+     * @param index Zero-based record index
+     * @param bounds Receives the bbox (the point itself for Point shapes)
+     * @return false for null shapes or unreadable records
+     */
+    bool readRecordBounds(uint32_t index, BoundingBox& bounds);
+    
+    /**
+     * @brief Build the per-record bbox index used by readRecordsInBounds
+     * 
+     * Loads the "<base>.bbx" sidecar when it matches the current .shp (size,
+     * modification time and record count), otherwise reads every record's
+     * bbox from the .shp.
+     * 
+     * @param persist Write the sidecar if it had to be rebuilt
+     * @return true if the index is available
+     */
+    bool buildBoundsIndex(bool persist = false);
+    
+    /**
+     * @brief Check whether buildBoundsIndex() has been run
+     */
+    bool hasBoundsIndex() const { return bounds_index_ != nullptr; }
+    
+    /**
+     * @brief Per-record bounding boxes collected by buildBoundsIndex()
+     */
+    const std::vector<BoundingBox>& getRecordBounds() const { return record_bounds_; }
+    
     /**
      * @brief Get detailed information about the shapefile
      * @return String containing shapefile metadata
@@ -175,18 +299,28 @@ public:
     std::string getInfo() const;
 
 private:
+    bool openCursor(RecordCursor& cursor) const;
     bool readShapefileHeader();
-    bool readDBFHeader();
-    std::unique_ptr<Geometry> readGeometry(std::ifstream& file, ShapeType type);
-    std::unique_ptr<PointGeometry> readPoint(std::ifstream& file);
-    std::unique_ptr<PolylineGeometry> readPolyline(std::ifstream& file);
-    std::unique_ptr<PolygonGeometry> readPolygon(std::ifstream& file);
-    std::unordered_map<std::string, FieldValue> readDBFRecord(uint32_t record_index);
+    const char* fetchBytes(std::ifstream& file, const MappedFile& map, size_t offset,
+                           size_t size, std::vector<char>& buffer) const;
+    std::vector<size_t> resolveFields(const ReadOptions& options) const;
+    std::unique_ptr<ShapeRecord> readRecord(uint32_t index, RecordCursor& cursor, const ReadOptions& options,
+                                            const std::vector<size_t>& field_indices) const;
+    const char* fetchShape(uint32_t index, RecordCursor& cursor, size_t& content_length) const;
+    bool readRecordBounds(uint32_t index, RecordCursor& cursor, BoundingBox& bounds) const;
+    bool loadBoundsSidecar(const std::string& filename);
+    bool saveBoundsSidecar(const std::string& filename) const;
+    static GeometryCodec selectCodec(ShapeType type);
+    static std::unique_ptr<Geometry> readGeometry(const char* data, size_t size, ShapeType type,
+                                                  DatasetArena* arena = nullptr);
+    std::unique_ptr<Geometry> decodeShape(const char* content, size_t length, DatasetArena* arena) const;
+    void readGeometryInto(const char* data, size_t size, std::unique_ptr<Geometry>& geometry,
+                          std::unique_ptr<Geometry>& spare) const;
     
     template<typename T>
-    T readValue(std::ifstream& file, bool swap_endian = false);
+    static T readValue(const char* data, bool swap_endian = false);
     
-    void swapEndian(void* data, size_t size);
+    static void swapEndian(void* data, size_t size);
 };
 
 } // namespace gis
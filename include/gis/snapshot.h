@@ -0,0 +1,140 @@
+#pragma once
+
+#include "attribute_table.h"
+#include "mapped_file.h"
+#include "shapefile_reader.h"
+#include "spatial_index.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace gis {
+
+/**
+ * @brief 64-bit hash of a byte range
+ *
+ * Four independent multiply-rotate lanes over 32-byte blocks, so it runs
+ * at memory speed on large inputs. Used for the snapshot checksum and for
+ * source file content hashes. Not cryptographic.
+ */
+uint64_t snapshotChecksum(const char* data, size_t size);
+
+/**
+ * @brief Identity of a source file when a snapshot was written
+ */
+struct SourceStamp {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;  // snapshotChecksum() of the contents; 0 if missing
+
+    /**
+     * @brief Stamp a file as it is on disk now (a missing file gets a zero stamp)
+     */
+    static SourceStamp capture(const std::string& path);
+
+    /**
+     * @brief Check whether the file on disk still has this content
+     *
+     * A different size means it changed and the same size and modification
+     * time mean it did not; only when just the time differs is the file
+     * read again and its hash compared.
+     */
+    bool isCurrent() const;
+};
+
+/**
+ * @brief Versioned, checksummed binary image of a loaded dataset
+ *
+ * Holds what SpatialIndex::buildIndex() and shapefile decoding produce:
+ * the records' flattened coordinates, part offsets and part bounds, the
+ * frozen R-tree, the prepared polygon bands and detail levels, the cell
+ * grid if one was built, the raw .dbf bytes behind each AttributeTable,
+ * plus stamps of the source files.
+ * Arrays are 16-byte aligned in the file, so restore() hands the large
+ * ones (coordinates, part tables, polygon bands) to the records as Buffers
+ * that borrow straight from the mapping instead of copying them, and the
+ * attribute tables decode their columns lazily from the mapping as well.
+ *
+ * The file starts with a magic, format version, byte order mark and the
+ * sizes of the stored structs; a snapshot written by an incompatible
+ * build or platform is rejected by open(). Every section carries its own
+ * checksum: open() verifies the section table and source stamps, and
+ * restore() the rest, so a stale snapshot is rejected without reading it
+ * all.
+ */
+class IndexSnapshot {
+private:
+    MappedFile file_;
+    std::vector<std::string> shapefiles_;
+    std::vector<SourceStamp> sources_;
+
+    bool verifySection(uint32_t id) const;
+    const char* section(uint32_t id, size_t alignment, size_t element_size, size_t& count) const;
+
+public:
+    /**
+     * @brief Write a snapshot of records and the index built over them
+     *
+     * The file is written under a temporary name and renamed into place, so
+     * a process still serving from an older snapshot keeps a valid mapping.
+     *
+     * @param path Snapshot file to create or replace
+     * @param shapefiles Shapefile paths the records were loaded from
+     * @param records Loaded records, in index order
+     * @param spatial_index Frozen index built over records
+     * @param attribute_tables Attribute tables of the source files
+     * @param attribute_refs Table row of each record, parallel to records
+     * @return true if successful
+     */
+    static bool write(const std::string& path, const std::vector<std::string>& shapefiles,
+                      const std::vector<std::unique_ptr<ShapeRecord>>& records,
+                      const SpatialIndex& spatial_index,
+                      const std::vector<std::unique_ptr<AttributeTable>>& attribute_tables,
+                      const std::vector<AttributeRef>& attribute_refs);
+
+    /**
+     * @brief Map a snapshot and validate its header, section table and source stamps
+     * @return false if the file is missing, foreign, corrupt or from another format version
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Unmap the file; anything restored from it must be gone by then
+     */
+    void close();
+
+    bool isOpen() const { return file_.isOpen(); }
+
+    /**
+     * @brief Shapefile paths the snapshot was built from (absolute)
+     */
+    const std::vector<std::string>& getShapefiles() const { return shapefiles_; }
+
+    /**
+     * @brief Check that the snapshot was built from exactly these shapefiles, unchanged since
+     */
+    bool matchesSources(const std::vector<std::string>& shapefiles) const;
+
+    /**
+     * @brief Recreate the records, their spatial index and attribute tables
+     *
+     * The records and tables borrow memory from this snapshot, which must
+     * stay open for as long as they are in use (moving it keeps the mapping).
+     *
+     * @param records Receives the records
+     * @param spatial_index Receives the index over records
+     * @param attribute_tables Receives the attribute tables
+     * @param attribute_refs Receives the table row of each record
+     * @return false if a checksum does not match or the contents are inconsistent
+     */
+    bool restore(std::vector<std::unique_ptr<ShapeRecord>>& records, SpatialIndex& spatial_index,
+                 std::vector<std::unique_ptr<AttributeTable>>& attribute_tables,
+                 std::vector<AttributeRef>& attribute_refs) const;
+
+    size_t size() const { return file_.size(); }
+};
+
+} // namespace gis
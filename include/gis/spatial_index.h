@@ -1,10 +1,17 @@
 #pragma once
 
 #include "geometry.h"
+#include "geometry_kernels.h"
 #include "shapefile_reader.h"
+#include "prepared_polygon.h"
+#include "cell_grid.h"
 #include <vector>
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <string>
 
 namespace gis {
 
@@ -21,18 +28,68 @@ struct RTreeNode {
     RTreeNode(bool leaf = false) : is_leaf(leaf), parent(nullptr) {}
 };
 
+/**
+ * @brief Immutable, pointer-free R-tree layout produced by RTree::freeze()
+ * 
+ * Nodes are stored in one array in BFS order (nodes[0] is the root). The
+ * entries of node n are the contiguous range [first_entry, first_entry +
+ * entry_count) of the SoA bbox arrays; refs holds the child node index for
+ * inner nodes and the data index for leaves.
+ */
+struct FlatRTree {
+    struct Node {
+        uint32_t first_entry;
+        uint16_t entry_count;
+        uint16_t is_leaf;
+    };
+    
+    std::vector<Node> nodes;
+    std::vector<double> min_x;
+    std::vector<double> min_y;
+    std::vector<double> max_x;
+    std::vector<double> max_y;
+    std::vector<uint32_t> refs;
+    BoundingBox root_bounds;
+    uint32_t height = 0;
+    
+    void clear();
+    size_t memoryUsage() const;
+};
+
 /**
  * @brief R-tree spatial index for efficient spatial queries
  * 
  * Implements the R-tree data structure for indexing geometric objects
  * in multi-dimensional space. Optimized for 2D spatial queries.
+ * 
+ * Const queries may run concurrently with each other (the statistics
+ * counters are atomic); insert(), bulkLoad(), freeze() and clear() need
+ * exclusive access.
  */
 class RTree {
+public:
+    /**
+     * @brief Exact distance from the query point to the object with a data index
+     * 
+     * Must never be less than the distance to the object's bounding box.
+     */
+    using DistanceFunction = std::function<double(size_t data_index)>;
+    
 private:
     std::unique_ptr<RTreeNode> root_;
     size_t max_entries_;
     size_t min_entries_;
-    std::vector<BoundingBox> object_bounds_;
+    std::vector<BoundingBox> object_bounds_;  // Indexed by data index; empty for gaps
+    size_t object_count_;
+    
+    // Frozen form; when set, root_ is released and all queries use flat_
+    FlatRTree flat_;
+    bool frozen_;
+    
+    // Instrumentation (relaxed atomics so concurrent queries can update them)
+    double build_time_ms_;
+    mutable std::atomic<uint64_t> query_count_;
+    mutable std::atomic<uint64_t> nodes_visited_;
     
 public:
     /**
@@ -53,6 +110,57 @@ public:
      */
     void insert(const BoundingBox& bounds, size_t data_index);
     
+    /**
+     * @brief Replace the contents with a packed tree built in one pass
+     * 
+     * Uses Sort-Tile-Recursive packing: entries are sorted into vertical
+     * slices by center x, each slice is sorted by center y and cut into full
+     * nodes, and the same is repeated level by level. Nodes end up full and
+     * spatially compact, with far less overlap than repeated insert(). Meant
+     * for static datasets that are loaded once and then only queried.
+     * 
+     * @param bounds Bounding box per data index; empty boxes are skipped
+     */
+    void bulkLoad(const std::vector<BoundingBox>& bounds);
+    
+    /**
+     * @brief Convert the tree into its compact, read-only FlatRTree form
+     * 
+     * The node objects are released. A frozen tree serves query(),
+     * withinDistance() and nearestNeighbors() with iterative, fixed-stack
+     * traversals that allocate nothing beyond their result buffers. A later
+     * insert() transparently rebuilds a pointer tree first.
+     * 
+     * @return false if the tree is too large or wide for the flat layout
+     */
+    bool freeze();
+    
+    /**
+     * @brief Check whether the tree is in its frozen form
+     */
+    bool isFrozen() const { return frozen_; }
+    
+    /**
+     * @brief Replace the contents with a frozen tree saved earlier
+     * 
+     * Takes the layout and object bounds of a frozen tree, as returned by
+     * getFlatTree() and getObjectBounds(), so a saved index can be reused
+     * without packing it again. The layout is checked before it is adopted.
+     * 
+     * @return false if the layout is not a valid tree (the index is left empty)
+     */
+    bool restoreFrozen(FlatRTree flat, std::vector<BoundingBox> object_bounds);
+    
+    /**
+     * @brief Frozen layout (empty unless isFrozen())
+     */
+    const FlatRTree& getFlatTree() const { return flat_; }
+    
+    /**
+     * @brief Bounding box per data index, as passed to bulkLoad() or insert()
+     */
+    const std::vector<BoundingBox>& getObjectBounds() const { return object_bounds_; }
+    
     /**
      * @brief Query objects that intersect with given bounding box
      * @param query_bounds Query bounding box
@@ -60,13 +168,34 @@ public:
      */
     std::vector<size_t> query(const BoundingBox& query_bounds) const;
     
+    /**
+     * @brief Call visit(data_index) for every object intersecting the bounds
+     * @return Number of nodes visited
+     */
+    template<typename Visitor>
+    uint64_t search(const BoundingBox& query_bounds, Visitor&& visit) const;
+    
     /**
      * @brief Find nearest neighbors to a point
+     * 
+     * Best-first search ordered by MINDIST from the point to node boxes, so
+     * only the nodes that can hold one of the k results are expanded. Objects
+     * are ranked by the distance to their bounding box, or, when
+     * object_distance is given, by its exact value; it is only evaluated for
+     * objects whose box is close enough to matter. Equal distances are
+     * ordered by data index. With a finite max_distance the search stops as
+     * soon as everything left is farther away, so a query with no object in
+     * range costs a few node visits.
+     * 
      * @param point Query point
      * @param k Number of neighbors to find
+     * @param object_distance Optional refinement with the true object distance
+     * @param max_distance Only return objects at most this far away
      * @return Vector of data indices sorted by distance
      */
-    std::vector<size_t> nearestNeighbors(const Point2D& point, size_t k) const;
+    std::vector<size_t> nearestNeighbors(const Point2D& point, size_t k,
+                                         const DistanceFunction& object_distance = DistanceFunction(),
+                                         double max_distance = std::numeric_limits<double>::infinity()) const;
     
     /**
      * @brief Query objects within distance of a point
@@ -90,12 +219,23 @@ public:
     /**
      * @brief Get total number of indexed objects
      */
-    size_t size() const { return object_bounds_.size(); }
+    size_t size() const { return object_count_; }
+    
+    /**
+     * @brief Searches run since the last clear() and the nodes they visited, for monitoring
+     */
+    uint64_t getQueryCount() const { return query_count_.load(std::memory_order_relaxed); }
+    uint64_t getNodesVisited() const { return nodes_visited_.load(std::memory_order_relaxed); }
 
 private:
+    // Limits of the frozen layout's fixed-size traversal stacks
+    static constexpr size_t kMaxFlatFanout = 64;
+    static constexpr size_t kMaxFlatStack = 1024;
+    
     void insertHelper(RTreeNode* node, const BoundingBox& bounds, size_t data_index);
-    void queryHelper(const RTreeNode* node, const BoundingBox& query_bounds, 
-                    std::vector<size_t>& results) const;
+    template<typename Visitor>
+    void searchNode(const RTreeNode* node, const BoundingBox& query_bounds,
+                    Visitor& visit, uint64_t& visited) const;
     void splitNode(RTreeNode* node);
     BoundingBox calculateBounds(const RTreeNode* node) const;
     double calculateArea(const BoundingBox& bounds) const;
@@ -105,26 +245,104 @@ private:
     void updateNodeBounds(RTreeNode* node);
     void updateLeafNodeBounds(RTreeNode* node);
     void updateInternalNodeBounds(RTreeNode* node);
+    void thaw();
+    std::vector<size_t> nearestNeighborsFlat(const Point2D& point, size_t k,
+                                             const DistanceFunction& object_distance,
+                                             double max_distance) const;
     
+    // Entry of the kNN queue; on equal distance nodes are expanded before
+    // objects are refined, and objects are refined before any is reported
     struct DistanceItem {
-        size_t index;
         double distance;
+        enum Kind { Node, Object, RefinedObject } kind;
+        size_t index;
+        const RTreeNode* node;
         
         bool operator>(const DistanceItem& other) const {
-            return distance > other.distance;
+            if (distance != other.distance) return distance > other.distance;
+            if (kind != other.kind) return kind > other.kind;
+            return index > other.index;
         }
     };
 };
 
+template<typename Visitor>
+uint64_t RTree::search(const BoundingBox& query_bounds, Visitor&& visit) const {
+    uint64_t visited = 0;
+    
+    if (frozen_) {
+        if (!flat_.nodes.empty() && flat_.root_bounds.intersects(query_bounds)) {
+            uint32_t stack[kMaxFlatStack];
+            size_t top = 0;
+            stack[top++] = 0;
+            
+            while (top > 0) {
+                const FlatRTree::Node& node = flat_.nodes[stack[--top]];
+                ++visited;
+                
+                // All entries of the node against the query at once; bits
+                // come out in entry order, same as a scalar scan
+                uint32_t first = node.first_entry;
+                uint64_t hits = intersectingBoxMask(flat_.min_x.data() + first, flat_.min_y.data() + first,
+                                                    flat_.max_x.data() + first, flat_.max_y.data() + first,
+                                                    node.entry_count, query_bounds);
+                while (hits != 0) {
+                    uint32_t e = first + lowestSetBit(hits);
+                    hits &= hits - 1;
+                    if (node.is_leaf) {
+                        visit(static_cast<size_t>(flat_.refs[e]));
+                    } else {
+                        stack[top++] = flat_.refs[e];
+                    }
+                }
+            }
+        }
+    } else if (root_) {
+        searchNode(root_.get(), query_bounds, visit, visited);
+    }
+    
+    query_count_.fetch_add(1, std::memory_order_relaxed);
+    nodes_visited_.fetch_add(visited, std::memory_order_relaxed);
+    return visited;
+}
+
+template<typename Visitor>
+void RTree::searchNode(const RTreeNode* node, const BoundingBox& query_bounds,
+                       Visitor& visit, uint64_t& visited) const {
+    ++visited;
+    if (!node->bounds.intersects(query_bounds)) {
+        return;
+    }
+    
+    if (node->is_leaf) {
+        // Check each data item in leaf
+        for (size_t idx : node->data_indices) {
+            if (idx < object_bounds_.size() && object_bounds_[idx].intersects(query_bounds)) {
+                visit(idx);
+            }
+        }
+    } else {
+        // Recursively search children
+        for (const auto& child : node->children) {
+            searchNode(child.get(), query_bounds, visit, visited);
+        }
+    }
+}
+
 /**
  * @brief High-level spatial index interface
  * 
  * Provides a simple interface for spatial indexing of shapefile records
+ * 
+ * Queries are read-only and safe to call concurrently once buildIndex()
+ * has returned. The indexed records must stay alive and unmodified.
  */
 class SpatialIndex {
 private:
     RTree rtree_;
     std::vector<std::unique_ptr<ShapeRecord>>* records_;
+    std::vector<PreparedPolygon> prepared_;  // Per record; empty for non-polygons
+    CellGrid cell_grid_;                     // Optional, over prepared_
     
 public:
     SpatialIndex();
@@ -132,9 +350,44 @@ public:
     
     /**
      * @brief Build index from shapefile records
+     * 
+     * The R-tree is packed and frozen straight away, so its node objects
+     * only live for the duration of the build.
+     * 
      * @param records Vector of shape records to index
+     * @param arena Where to put the prepared polygons' band lists, typically
+     *              the arena the records were loaded into; null to own them
+     */
+    void buildIndex(std::vector<std::unique_ptr<ShapeRecord>>& records, DatasetArena* arena = nullptr);
+    
+    /**
+     * @brief Adopt an index saved from an earlier buildIndex() over the same records
+     * 
+     * @param records Records the index was built for
+     * @param tree Frozen R-tree layout, from getTree().getFlatTree()
+     * @param object_bounds Per-record bounds, from getTree().getObjectBounds()
+     * @param prepared One entry per record, referencing the records' own polygons
+     * @param cell_grid Grid from getCellGrid(), or an empty one
+     * @return false if the saved index does not fit the records
+     */
+    bool restoreIndex(std::vector<std::unique_ptr<ShapeRecord>>& records, FlatRTree tree,
+                      std::vector<BoundingBox> object_bounds, std::vector<PreparedPolygon> prepared,
+                      CellGrid cell_grid = CellGrid());
+    
+    /**
+     * @brief Build the cell grid that findContainingRecord() answers from
+     * 
+     * Optional: without a grid every lookup searches the R-tree. Finer
+     * grids answer more points from the table alone but take more memory
+     * (8 bytes per cell) and time to build.
+     * 
+     * @param resolution Cells along the longer side of the polygons' bounds; 0 drops the grid
      */
-    void buildIndex(std::vector<std::unique_ptr<ShapeRecord>>& records);
+    void buildCellGrid(size_t resolution);
+    
+    const RTree& getTree() const { return rtree_; }
+    const std::vector<PreparedPolygon>& getPreparedPolygons() const { return prepared_; }
+    const CellGrid& getCellGrid() const { return cell_grid_; }
     
     /**
      * @brief Find records that intersect with bounding box
@@ -161,11 +414,31 @@ public:
     
     /**
      * @brief Check if a point is contained in any indexed polygon
+     * 
+     * R-tree candidates are tested exactly against the prepared polygons
+     * built by buildIndex(). If polygons overlap, the record with the lowest
+     * index wins. With a cell grid, a point in a cell no boundary crosses
+     * is answered by the table, and one in a boundary cell only tests the
+     * polygons crossing that cell.
+     * 
      * @param point Query point
      * @return Pointer to containing polygon record, or nullptr
      */
     ShapeRecord* pointInPolygon(const Point2D& point) const;
     
+    /**
+     * @brief Index of the record containing a point, same rules as pointInPolygon()
+     * @param point Query point
+     * @return Record index, or SIZE_MAX if no polygon contains the point
+     */
+    size_t findContainingRecord(const Point2D& point) const;
+    
+    /**
+     * @brief Exact test of one record's polygon, without an index search
+     * @return true if record index is a polygon containing point
+     */
+    bool recordContains(size_t index, const Point2D& point) const;
+    
     /**
      * @brief Get statistics about the spatial index
      */
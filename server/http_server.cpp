@@ -1,7 +1,16 @@
 #include "http_server.h"
+#include "gis/parallel.h"
 #include <iostream>
-#include <sstream>
-#include <regex>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -9,14 +18,621 @@
     #pragma comment(lib, "ws2_32.lib")
 #else
     #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <unistd.h>
     #include <arpa/inet.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <cerrno>
+    #if defined(__linux__)
+        #include <sys/epoll.h>
+        #define GIS_HTTP_EPOLL
+    #elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+        #include <sys/event.h>
+        #include <time.h>
+        #define GIS_HTTP_KQUEUE
+    #endif
 #endif
 
 namespace gis {
 
-HttpServer::HttpServer(int port) : port_(port), running_(false) {
+namespace {
+
+constexpr size_t kReadChunk = 16 * 1024;
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+constexpr size_t kMaxBodyBytes = 16 * 1024 * 1024;
+constexpr size_t kMaxEvents = 256;
+constexpr int kPollTimeoutMs = 100;  // Bounds how long stop() waits for workers
+constexpr std::chrono::seconds kKeepAliveTimeout(15);
+
+// How long a worker stops accepting after running out of descriptors
+constexpr std::chrono::milliseconds kAcceptBackoff(250);
+
+// Queued response bytes past which a connection's further requests wait,
+// and its socket is not read, until the client has taken some
+constexpr size_t kMaxQueuedOutput = 1024 * 1024;
+
+// Streamed bodies: producers per worker, bytes buffered per stream before
+// its producer waits, and how long a client may take nothing at all
+constexpr size_t kMaxStreamsPerWorker = 4;
+constexpr size_t kStreamBufferBytes = 256 * 1024;
+constexpr std::chrono::seconds kStreamStallTimeout(10);
+
+// Pieces handed to one gathering send; well below IOV_MAX everywhere
+constexpr size_t kMaxGather = 64;
+
+// Sent pieces are kept for reuse up to this many and this size
+constexpr size_t kMaxSpareBuffers = 8;
+constexpr size_t kMaxSpareBytes = 64 * 1024;
+constexpr size_t kHeadReserve = 256;
+
+#if defined(__linux__)
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+bool setNonBlocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool lastErrorWouldBlock() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+bool lastErrorOutOfDescriptors() {
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEMFILE || error == WSAENOBUFS;
+#else
+    return errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM;
+#endif
+}
+
+#ifdef _WIN32
+using IoSlice = WSABUF;
+
+void setSlice(IoSlice& slice, const char* data, size_t size) {
+    slice.buf = const_cast<char*>(data);
+    slice.len = static_cast<ULONG>(size);
+}
+
+long sendGather(int fd, IoSlice* slices, size_t count) {
+    DWORD sent = 0;
+    if (WSASend(fd, slices, static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) != 0) {
+        return -1;
+    }
+    return static_cast<long>(sent);
+}
+#else
+using IoSlice = iovec;
+
+void setSlice(IoSlice& slice, const char* data, size_t size) {
+    slice.iov_base = const_cast<char*>(data);
+    slice.iov_len = size;
+}
+
+long sendGather(int fd, IoSlice* slices, size_t count) {
+    // sendmsg rather than writev: only send() calls take kSendFlags
+    msghdr message = {};
+    message.msg_iov = slices;
+    message.msg_iovlen = count;
+    return static_cast<long>(sendmsg(fd, &message, kSendFlags));
+}
+#endif
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+template<typename T>
+void appendInteger(std::string& out, T value) {
+    char digits[24];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+bool equalsIgnoreCase(const std::string& a, const char* b) {
+    size_t i = 0;
+    for (; i < a.size() && b[i]; ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return i == a.size() && !b[i];
+}
+
+std::string trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos) return "";
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+/**
+ * @brief Status line and headers; without a content length the body is sent chunked
+ */
+void appendHead(std::string& out, const char* status, const std::string& content_type,
+                bool keep_alive, size_t content_length = std::string::npos) {
+    out += "HTTP/1.1 ";
+    out += status;
+    out += "\r\nContent-Type: ";
+    out += content_type;
+    if (content_length == std::string::npos) {
+        out += "\r\nTransfer-Encoding: chunked";
+    } else {
+        out += "\r\nContent-Length: ";
+        appendInteger(out, content_length);
+    }
+    out += "\r\nAccess-Control-Allow-Origin: *\r\nConnection: ";
+    out += keep_alive ? "keep-alive" : "close";
+    out += "\r\n\r\n";
+}
+
+/**
+ * @brief Lets other threads interrupt an event loop wait
+ *
+ * A pipe on POSIX; WSAPoll only takes sockets, so on Windows a UDP socket
+ * connected to itself over loopback.
+ */
+class Waker {
+private:
+    int read_fd_ = -1;
+    int write_fd_ = -1;
+
+public:
+    Waker() {
+#ifdef _WIN32
+        int fd = static_cast<int>(socket(AF_INET, SOCK_DGRAM, 0));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int length = sizeof(address);
+        if (fd < 0) return;
+        if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 ||
+            getsockname(fd, (sockaddr*)&address, &length) != 0 ||
+            connect(fd, (sockaddr*)&address, sizeof(address)) != 0 || !setNonBlocking(fd)) {
+            closeSocket(fd);
+            return;
+        }
+        read_fd_ = write_fd_ = fd;
+#else
+        int fds[2];
+        if (pipe(fds) != 0) return;
+        if (!setNonBlocking(fds[0]) || !setNonBlocking(fds[1])) {
+            close(fds[0]);
+            close(fds[1]);
+            return;
+        }
+        read_fd_ = fds[0];
+        write_fd_ = fds[1];
+#endif
+    }
+
+    ~Waker() {
+#ifdef _WIN32
+        if (read_fd_ >= 0) closeSocket(read_fd_);
+#else
+        if (read_fd_ >= 0) close(read_fd_);
+        if (write_fd_ >= 0) close(write_fd_);
+#endif
+    }
+
+    Waker(const Waker&) = delete;
+    Waker& operator=(const Waker&) = delete;
+
+    bool isValid() const { return read_fd_ >= 0; }
+    int fd() const { return read_fd_; }
+
+    void wake() {
+        // A full pipe already has a wake-up pending
+        char byte = 0;
+#ifdef _WIN32
+        send(write_fd_, &byte, 1, 0);
+#else
+        ssize_t written = write(write_fd_, &byte, 1);
+        (void)written;
+#endif
+    }
+
+    void drain() {
+        char buffer[64];
+#ifdef _WIN32
+        while (recv(read_fd_, buffer, sizeof(buffer), 0) > 0) {}
+#else
+        while (read(read_fd_, buffer, sizeof(buffer)) > 0) {}
+#endif
+    }
+};
+
+/**
+ * @brief Hand-over between the thread producing a streamed body and the worker sending it
+ *
+ * push() blocks while kStreamBufferBytes are waiting, so a client that
+ * reads slowly holds up its own producer only, never its worker.
+ */
+struct StreamChannel {
+    std::mutex mutex;
+    std::condition_variable has_room;
+    std::deque<std::string> pieces;  // Ready to send, framing included
+    size_t bytes = 0;
+    bool finished = false;   // The producer has returned
+    bool failed = false;     // The body is incomplete; the connection must be dropped
+    bool cancelled = false;  // The connection is gone
+    Waker& waker;
+
+    explicit StreamChannel(Waker& waker_) : waker(waker_) {}
+
+    /**
+     * @return false once the connection is gone
+     */
+    bool push(std::string piece) {
+        bool was_empty;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            has_room.wait(lock, [this]() { return cancelled || bytes < kStreamBufferBytes; });
+            if (cancelled) return false;
+            was_empty = pieces.empty();
+            bytes += piece.size();
+            pieces.push_back(std::move(piece));
+        }
+        if (was_empty) waker.wake();
+        return true;
+    }
+
+    void finish(bool complete) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            failed = !complete;
+        }
+        waker.wake();
+    }
+
+    void cancel() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+        }
+        has_room.notify_all();
+    }
+
+    bool isFinished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return finished;
+    }
+};
+
+struct LoopEvent {
+    int fd;
+    bool readable;
+    bool writable;
+};
+
+/**
+ * @brief Readiness notification over the best mechanism of the platform
+ *
+ * Level-triggered: a socket keeps being reported until it has been drained.
+ */
+class EventLoop {
+private:
+#if defined(GIS_HTTP_EPOLL)
+    int epoll_fd_;
+#elif defined(GIS_HTTP_KQUEUE)
+    int kqueue_fd_;
+#else
+    std::vector<pollfd> fds_;
+#endif
+
+public:
+    EventLoop() {
+#if defined(GIS_HTTP_EPOLL)
+        epoll_fd_ = epoll_create1(0);
+#elif defined(GIS_HTTP_KQUEUE)
+        kqueue_fd_ = kqueue();
+#endif
+    }
+
+    ~EventLoop() {
+#if defined(GIS_HTTP_EPOLL)
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+#elif defined(GIS_HTTP_KQUEUE)
+        if (kqueue_fd_ >= 0) close(kqueue_fd_);
+#endif
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool isValid() const {
+#if defined(GIS_HTTP_EPOLL)
+        return epoll_fd_ >= 0;
+#elif defined(GIS_HTTP_KQUEUE)
+        return kqueue_fd_ >= 0;
+#else
+        return true;
+#endif
+    }
+
+    /**
+     * @brief Watch a socket for readability
+     * @param exclusive Wake only one of the loops sharing this socket (listen socket)
+     */
+    bool add(int fd, bool exclusive = false) {
+#if defined(GIS_HTTP_EPOLL)
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+    #ifdef EPOLLEXCLUSIVE
+        if (exclusive) ev.events |= EPOLLEXCLUSIVE;
+    #endif
+        ev.data.fd = fd;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+#elif defined(GIS_HTTP_KQUEUE)
+        (void)exclusive;
+        struct kevent change;
+        EV_SET(&change, fd, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+        return kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr) == 0;
+#else
+        (void)exclusive;
+        pollfd entry = {};
+        entry.fd = fd;
+        entry.events = POLLIN;
+        fds_.push_back(entry);
+        return true;
+#endif
+    }
+
+    /**
+     * @brief Choose whether an added socket is watched for readability and writability
+     *
+     * Hang-ups and errors are still reported while reads are paused.
+     */
+    void setInterest(int fd, bool want_read, bool want_write) {
+#if defined(GIS_HTTP_EPOLL)
+        epoll_event ev = {};
+        ev.events = (want_read ? uint32_t(EPOLLIN) : 0u) | (want_write ? uint32_t(EPOLLOUT) : 0u);
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+#elif defined(GIS_HTTP_KQUEUE)
+        // Separate calls: a failed EV_DELETE must not keep the other change from applying
+        struct kevent change;
+        EV_SET(&change, fd, EVFILT_READ, want_read ? EV_ENABLE : EV_DISABLE, 0, 0, nullptr);
+        kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr);
+        EV_SET(&change, fd, EVFILT_WRITE, want_write ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr);
+#else
+        for (auto& entry : fds_) {
+            if (static_cast<int>(entry.fd) == fd) {
+                entry.events = (want_read ? POLLIN : 0) | (want_write ? POLLOUT : 0);
+                break;
+            }
+        }
+#endif
+    }
+
+    void remove(int fd) {
+#if defined(GIS_HTTP_EPOLL)
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#elif defined(GIS_HTTP_KQUEUE)
+        // Closing a socket drops its write filter; the listen socket stays open
+        struct kevent change;
+        EV_SET(&change, fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+        kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr);
+#else
+        fds_.erase(std::remove_if(fds_.begin(), fds_.end(),
+                                  [fd](const pollfd& entry) { return static_cast<int>(entry.fd) == fd; }),
+                   fds_.end());
+#endif
+    }
+
+    /**
+     * @brief Wait for ready sockets
+     * @return Number of events stored in events
+     */
+    size_t wait(std::vector<LoopEvent>& events, int timeout_ms) {
+        events.clear();
+#if defined(GIS_HTTP_EPOLL)
+        epoll_event ready[kMaxEvents];
+        int count = epoll_wait(epoll_fd_, ready, static_cast<int>(kMaxEvents), timeout_ms);
+        for (int i = 0; i < count; ++i) {
+            // Hang-ups and errors surface as a failed recv()
+            bool readable = (ready[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+            bool writable = (ready[i].events & EPOLLOUT) != 0;
+            events.push_back({ready[i].data.fd, readable, writable});
+        }
+#elif defined(GIS_HTTP_KQUEUE)
+        struct kevent ready[kMaxEvents];
+        timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        int count = kevent(kqueue_fd_, nullptr, 0, ready, static_cast<int>(kMaxEvents), &timeout);
+        for (int i = 0; i < count; ++i) {
+            int fd = static_cast<int>(ready[i].ident);
+            bool readable = ready[i].filter == EVFILT_READ || (ready[i].flags & (EV_EOF | EV_ERROR));
+            bool writable = ready[i].filter == EVFILT_WRITE;
+            events.push_back({fd, readable, writable});
+        }
+#else
+    #ifdef _WIN32
+        int count = WSAPoll(fds_.data(), static_cast<ULONG>(fds_.size()), timeout_ms);
+    #else
+        int count = poll(fds_.data(), fds_.size(), timeout_ms);
+    #endif
+        for (size_t i = 0; count > 0 && i < fds_.size(); ++i) {
+            if (fds_[i].revents == 0) continue;
+            bool readable = (fds_[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+            bool writable = (fds_[i].revents & POLLOUT) != 0;
+            events.push_back({static_cast<int>(fds_[i].fd), readable, writable});
+            --count;
+        }
+#endif
+        return events.size();
+    }
+};
+
+} // namespace
+
+std::string urlDecode(std::string_view str) {
+    std::string result;
+    result.reserve(str.size());
+    for (size_t i = 0; i < str.size(); ++i) {
+        char c = str[i];
+        int high = 0, low = 0;
+        if (c == '%' && i + 2 < str.size() &&
+            (high = hexValue(str[i + 1])) >= 0 && (low = hexValue(str[i + 2])) >= 0) {
+            result += static_cast<char>(high * 16 + low);
+            i += 2;
+        } else {
+            result += c == '+' ? ' ' : c;
+        }
+    }
+    return result;
+}
+
+QueryParameters::QueryParameters(std::string_view query) {
+    while (!query.empty()) {
+        size_t end = query.find('&');
+        std::string_view pair = query.substr(0, end);
+        query = end == std::string_view::npos ? std::string_view() : query.substr(end + 1);
+        if (pair.empty()) continue;
+
+        size_t equals = pair.find('=');
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : pair.substr(equals + 1);
+        pairs_.emplace_back(urlDecode(pair.substr(0, equals)), urlDecode(value));
+    }
+}
+
+const std::string& QueryParameters::get(std::string_view name) const {
+    static const std::string kAbsent;
+    for (const auto& pair : pairs_) {
+        if (pair.first == name) return pair.second;
+    }
+    return kAbsent;
+}
+
+/**
+ * @brief Per-socket state owned by one worker
+ */
+struct HttpServer::Connection {
+    int fd;
+    std::string input;                // Received bytes not yet parsed
+    std::deque<std::string> output;   // Pieces not yet sent, in request order
+    size_t output_offset = 0;         // Bytes of the first piece already sent
+    size_t output_bytes = 0;          // Bytes in output, sent ones excluded
+    std::vector<std::string> spare;   // Sent pieces kept for their capacity
+    bool close_after_write = false;
+    bool peer_closed = false;         // The client will send nothing more
+    bool held_back = false;           // Complete requests wait for output to drain
+    bool want_read = true;
+    bool want_write = false;
+    std::chrono::steady_clock::time_point last_active;
+
+    // Set while a streamed body is being produced; later requests wait
+    std::shared_ptr<StreamChannel> stream;
+    std::thread producer;
+
+    explicit Connection(int fd_) : fd(fd_), last_active(std::chrono::steady_clock::now()) {
+        spare.emplace_back();
+        spare.back().reserve(kHeadReserve);
+    }
+
+    bool hasPendingOutput() const { return !output.empty(); }
+
+    /**
+     * @brief Empty buffer for headers and framing, reusing one already sent
+     */
+    std::string takeBuffer() {
+        if (spare.empty()) {
+            std::string buffer;
+            buffer.reserve(kHeadReserve);
+            return buffer;
+        }
+        std::string buffer = std::move(spare.back());
+        spare.pop_back();
+        return buffer;
+    }
+
+    void queue(std::string piece) {
+        if (!piece.empty()) {
+            output_bytes += piece.size();
+            output.push_back(std::move(piece));
+        }
+    }
+
+    /**
+     * @brief Drop bytes the socket has taken from the front of the queue
+     */
+    void consume(size_t bytes) {
+        output_bytes -= bytes;
+        while (bytes > 0) {
+            std::string& front = output.front();
+            size_t remaining = front.size() - output_offset;
+            if (bytes < remaining) {
+                output_offset += bytes;
+                return;
+            }
+            bytes -= remaining;
+            output_offset = 0;
+            if (spare.size() < kMaxSpareBuffers && front.capacity() <= kMaxSpareBytes) {
+                front.clear();
+                spare.push_back(std::move(front));
+            }
+            output.pop_front();
+        }
+    }
+};
+
+/**
+ * @brief State of one worker thread shared by its connections
+ */
+struct HttpServer::Worker {
+    Waker waker;                      // Producers signal new stream pieces here
+    std::vector<int> streaming;       // Connections with a stream in progress
+    size_t producers = 0;             // Producer threads not yet joined
+
+    // Producers of connections closed mid-stream, joined once they return
+    std::vector<std::pair<std::shared_ptr<StreamChannel>, std::thread>> abandoned;
+
+    void reapAbandoned(bool wait) {
+        for (auto it = abandoned.begin(); it != abandoned.end();) {
+            if (wait || it->first->isFinished()) {
+                it->second.join();
+                --producers;
+                it = abandoned.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+HttpServer::HttpServer(int port, size_t num_threads)
+    : port_(port)
+    , num_threads_(resolveThreadCount(num_threads))
+    , server_fd_(-1)
+    , running_(false) {
 #ifdef _WIN32
     WSADATA wsaData;
     WSAStartup(MAKEWORD(2, 2), &wsaData);
@@ -38,28 +654,43 @@ bool HttpServer::start() {
     if (running_) {
         return false;
     }
-    
+
+    if (!openListenSocket()) {
+        return false;
+    }
+
     running_ = true;
-    server_thread_ = std::thread(&HttpServer::serverLoop, this);
-    
-    std::cout << "HTTP Server starting on port " << port_ << std::endl;
+    for (size_t i = 0; i < num_threads_; ++i) {
+        workers_.emplace_back(&HttpServer::workerLoop, this);
+    }
+
+    std::cout << "HTTP Server starting on port " << port_ << " with "
+              << num_threads_ << " worker threads" << std::endl;
     return true;
 }
 
 void HttpServer::stop() {
     running_ = false;
-    if (server_thread_.joinable()) {
-        server_thread_.join();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+
+    if (server_fd_ >= 0) {
+        closeSocket(server_fd_);
+        server_fd_ = -1;
     }
 }
 
-void HttpServer::serverLoop() {
+bool HttpServer::openListenSocket() {
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
         std::cerr << "Failed to create socket" << std::endl;
-        return;
+        return false;
     }
-    
+
     // Set socket options
     int opt = 1;
 #ifdef _WIN32
@@ -67,111 +698,514 @@ void HttpServer::serverLoop() {
 #else
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 #endif
-    
+
     struct sockaddr_in address;
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port_);
-    
+
     if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
         std::cerr << "Failed to bind to port " << port_ << std::endl;
-#ifdef _WIN32
-        closesocket(server_fd);
-#else
-        close(server_fd);
-#endif
-        return;
+        closeSocket(server_fd);
+        return false;
     }
-    
-    if (listen(server_fd, 3) < 0) {
+
+    // Workers accept from this socket concurrently, so it must never block
+    if (listen(server_fd, SOMAXCONN) < 0 || !setNonBlocking(server_fd)) {
         std::cerr << "Failed to listen on socket" << std::endl;
-#ifdef _WIN32
-        closesocket(server_fd);
-#else
-        close(server_fd);
-#endif
-        return;
+        closeSocket(server_fd);
+        return false;
     }
-    
+
+    server_fd_ = server_fd;
     std::cout << "Server listening on port " << port_ << std::endl;
-    
+    return true;
+}
+
+void HttpServer::workerLoop() {
+    Worker worker;
+    EventLoop loop;
+    if (!worker.waker.isValid() || !loop.isValid() || !loop.add(server_fd_, true) ||
+        !loop.add(worker.waker.fd())) {
+        std::cerr << "Failed to create event loop" << std::endl;
+        return;
+    }
+
+    std::unordered_map<int, Connection> connections;
+    std::vector<LoopEvent> events;
+    events.reserve(kMaxEvents);
+    auto last_sweep = std::chrono::steady_clock::now();
+
+    // Off while out of descriptors: the listen socket stays readable and
+    // would otherwise wake this loop over and over
+    bool accepting = true;
+    bool accept_warned = false;  // Reported once until an accept succeeds again
+    std::chrono::steady_clock::time_point accept_resume;
+
+    auto closeConnection = [&](std::unordered_map<int, Connection>::iterator it) {
+        Connection& connection = it->second;
+        if (connection.stream) {
+            // The producer may be busy for a while; join it once it notices
+            connection.stream->cancel();
+            worker.abandoned.emplace_back(std::move(connection.stream), std::move(connection.producer));
+            worker.streaming.erase(std::find(worker.streaming.begin(), worker.streaming.end(), it->first));
+        }
+        loop.remove(it->first);
+        closeSocket(it->first);
+        return connections.erase(it);
+    };
+
+    // Answer requests held back once their output has drained, watch for
+    // writability while output is queued, and read only while requests
+    // would be answered; close once done if asked
+    auto settle = [&](std::unordered_map<int, Connection>::iterator it, bool keep) {
+        Connection& connection = it->second;
+        while (keep && connection.held_back && connection.output_bytes < kMaxQueuedOutput) {
+            keep = processRequests(connection, worker) && writeToConnection(connection);
+        }
+        if (keep) {
+            bool want_write = connection.hasPendingOutput();
+            bool want_read = !connection.stream && !connection.peer_closed &&
+                             connection.output_bytes < kMaxQueuedOutput;
+            bool done = connection.close_after_write || connection.peer_closed;
+            if (!want_write && done && !connection.stream) {
+                keep = false;
+            } else if (want_write != connection.want_write || want_read != connection.want_read) {
+                loop.setInterest(connection.fd, want_read, want_write);
+                connection.want_read = want_read;
+                connection.want_write = want_write;
+            }
+        }
+        if (!keep) {
+            closeConnection(it);
+        }
+    };
+
     while (running_) {
-        struct sockaddr_in client_address;
-        socklen_t client_len = sizeof(client_address);
-        
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_address, &client_len);
-        if (client_fd < 0) {
-            if (running_) {
-                std::cerr << "Failed to accept connection" << std::endl;
-            }
-            continue;
-        }
-        
-        // Read request
-        char buffer[4096] = {0};
-        int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_read > 0) {
-            std::string request(buffer, bytes_read);
-            std::string response = handleRequest(request);
-            
-            send(client_fd, response.c_str(), response.length(), 0);
+        loop.wait(events, kPollTimeoutMs);
+        auto now = std::chrono::steady_clock::now();
+
+        if (!accepting && now >= accept_resume) {
+            accepting = loop.add(server_fd_, true);
+            accept_resume = now + kAcceptBackoff;
         }
-        
+
+        for (const LoopEvent& event : events) {
+            if (event.fd == server_fd_) {
+                // Take every pending connection; another worker may win some
+                while (true) {
+                    int client_fd = static_cast<int>(accept(server_fd_, nullptr, nullptr));
+                    if (client_fd < 0) {
+                        if (lastErrorOutOfDescriptors() && accepting) {
+                            if (!accept_warned) {
+                                std::cerr << "Out of file descriptors; pausing accept" << std::endl;
+                                accept_warned = true;
+                            }
+                            loop.remove(server_fd_);
+                            accepting = false;
+                            accept_resume = now + kAcceptBackoff;
+                        }
+                        break;
+                    }
+                    accept_warned = false;
+
+                    int opt = 1;
 #ifdef _WIN32
-        closesocket(client_fd);
+                    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(opt));
 #else
-        close(client_fd);
+                    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    #ifdef SO_NOSIGPIPE
+                    setsockopt(client_fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+    #endif
 #endif
+                    if (!setNonBlocking(client_fd) || !loop.add(client_fd)) {
+                        closeSocket(client_fd);
+                        continue;
+                    }
+                    connections.emplace(client_fd, Connection(client_fd));
+                }
+                continue;
+            }
+
+            if (event.fd == worker.waker.fd()) {
+                // Producers have queued pieces (or finished); move them along
+                worker.waker.drain();
+                std::vector<int> streaming = worker.streaming;
+                for (int fd : streaming) {
+                    auto it = connections.find(fd);
+                    if (it != connections.end()) {
+                        settle(it, serviceStream(it->second, worker));
+                    }
+                }
+                continue;
+            }
+
+            auto it = connections.find(event.fd);
+            if (it == connections.end()) {
+                continue;
+            }
+
+            Connection& connection = it->second;
+            connection.last_active = now;
+
+            bool keep = true;
+            if (event.readable) {
+                keep = readFromConnection(connection, worker);
+            }
+            if (keep && event.writable) {
+                keep = writeToConnection(connection);
+            }
+            if (keep && connection.stream) {
+                keep = serviceStream(connection, worker);
+            }
+            settle(it, keep);
+        }
+
+        // Drop keep-alive connections that have gone quiet, and clients
+        // that stopped reading a stream; a stream still being produced waits
+        if (now - last_sweep >= std::chrono::seconds(1)) {
+            last_sweep = now;
+            for (auto it = connections.begin(); it != connections.end();) {
+                const Connection& connection = it->second;
+                bool producing = connection.stream && !connection.hasPendingOutput();
+                auto timeout = connection.stream ? kStreamStallTimeout : kKeepAliveTimeout;
+                if (!producing && now - connection.last_active > timeout) {
+                    it = closeConnection(it);
+                } else {
+                    ++it;
+                }
+            }
+            worker.reapAbandoned(false);
+        }
     }
-    
-#ifdef _WIN32
-    closesocket(server_fd);
-#else
-    close(server_fd);
-#endif
+
+    for (auto it = connections.begin(); it != connections.end();) {
+        it = closeConnection(it);
+    }
+    worker.reapAbandoned(true);
 }
 
-std::string HttpServer::handleRequest(const std::string& request) {
+bool HttpServer::readFromConnection(Connection& connection, Worker& worker) {
+    char buffer[kReadChunk];
+
+    // Bounded per call; a level-triggered loop reports whatever is left
+    while (connection.input.size() <= kMaxHeaderBytes + kMaxBodyBytes) {
+        int bytes_read = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (bytes_read > 0) {
+            connection.input.append(buffer, bytes_read);
+            if (static_cast<size_t>(bytes_read) < sizeof(buffer)) {
+                break;  // Drained for now; level-triggered loops report any rest
+            }
+        } else if (bytes_read == 0) {
+            // Still answer what arrived before the client half-closed
+            connection.peer_closed = true;
+            break;
+        } else if (lastErrorWouldBlock()) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    if (!processRequests(connection, worker)) {
+        return false;
+    }
+    // Reads pause while requests are held back, so only a hang-up report
+    // gets here with a backlog; past one maximal request it is dropped
+    if (connection.input.size() > kMaxHeaderBytes + kMaxBodyBytes) {
+        return false;
+    }
+    return writeToConnection(connection);
+}
+
+bool HttpServer::writeToConnection(Connection& connection) {
+    IoSlice slices[kMaxGather];
+    while (connection.hasPendingOutput()) {
+        size_t count = std::min(connection.output.size(), kMaxGather);
+        for (size_t i = 0; i < count; ++i) {
+            size_t skip = i == 0 ? connection.output_offset : 0;
+            const std::string& piece = connection.output[i];
+            setSlice(slices[i], piece.data() + skip, piece.size() - skip);
+        }
+
+        long bytes_sent = sendGather(connection.fd, slices, count);
+        if (bytes_sent > 0) {
+            connection.consume(static_cast<size_t>(bytes_sent));
+        } else if (bytes_sent < 0 && lastErrorWouldBlock()) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HttpServer::serviceStream(Connection& connection, Worker& worker) {
+    std::shared_ptr<StreamChannel> channel = connection.stream;
+    if (!channel) {
+        return true;
+    }
+
+    // Take pieces only while the socket keeps up, so a slow client leaves
+    // them with the channel and its producer waits. Go on until the socket
+    // is full (it reports when writable) or the channel is empty (the
+    // producer wakes the loop on its next piece).
+    while (true) {
+        bool finished = false;
+        bool failed = false;
+        bool moved = false;
+        {
+            std::lock_guard<std::mutex> lock(channel->mutex);
+            while (!channel->pieces.empty() && connection.output_bytes < kStreamBufferBytes) {
+                channel->bytes -= channel->pieces.front().size();
+                connection.queue(std::move(channel->pieces.front()));
+                channel->pieces.pop_front();
+                moved = true;
+            }
+            finished = channel->finished && channel->pieces.empty();
+            failed = channel->failed;
+        }
+        if (moved) {
+            channel->has_room.notify_one();
+            connection.last_active = std::chrono::steady_clock::now();
+        }
+
+        if (finished) {
+            // The producer is past its last piece; joining only waits for its exit
+            connection.producer.join();
+            connection.stream.reset();
+            --worker.producers;
+            worker.streaming.erase(std::find(worker.streaming.begin(), worker.streaming.end(), connection.fd));
+            if (failed) {
+                // Headers are gone already; dropping the connection marks the body incomplete
+                return false;
+            }
+            return processRequests(connection, worker) && writeToConnection(connection);
+        }
+
+        if (!writeToConnection(connection)) {
+            return false;
+        }
+        if (!moved || connection.hasPendingOutput()) {
+            return true;
+        }
+    }
+}
+
+bool HttpServer::processRequests(Connection& connection, Worker& worker) {
+    // Pipelining: answer every complete request in the buffer, in order,
+    // until a client that does not read its answers has too many queued
+    size_t offset = 0;
+    connection.held_back = false;
+    while (!connection.close_after_write && !connection.stream && offset < connection.input.size()) {
+        if (connection.output_bytes >= kMaxQueuedOutput) {
+            if (!writeToConnection(connection)) {
+                return false;
+            }
+            if (connection.output_bytes >= kMaxQueuedOutput) {
+                connection.held_back = true;  // Resumed once the socket has taken enough
+                break;
+            }
+        }
+
+        HttpRequest request;
+        size_t consumed = parseRequest(connection.input, offset, request);
+        if (consumed == 0) {
+            break;  // Wait for the rest of the request
+        }
+        if (consumed == std::string::npos) {
+            queueResponse(connection, R"({"error": "Bad request", "code": 400})", false,
+                          "application/json", "400 Bad Request");
+            connection.close_after_write = true;
+            break;
+        }
+
+        offset += consumed;
+        if (!handleRequest(request, connection, worker)) {
+            return false;
+        }
+        if (!request.keep_alive) {
+            connection.close_after_write = true;
+        }
+    }
+
+    connection.input.erase(0, offset);
+    return true;
+}
+
+bool HttpServer::handleRequest(const HttpRequest& request, Connection& connection, Worker& worker) {
     try {
-        auto [path, query] = parseRequest(request);
-        
         if (handler_) {
-            std::string content = handler_(path, query);
-            return createResponse(content);
+            HttpResponse response = handler_(request);
+            if (response.stream) {
+                startStream(request, std::move(response), connection, worker);
+                return true;
+            }
+            queueResponse(connection, std::move(response.content), request.keep_alive, response.content_type);
         } else {
-            return createResponse(R"({"error": "No handler configured"})", "application/json");
+            queueResponse(connection, R"({"error": "No handler configured"})", request.keep_alive);
         }
     } catch (const std::exception& e) {
         std::string error_content = R"({"error": ")" + std::string(e.what()) + R"("})";
-        return createResponse(error_content, "application/json");
+        queueResponse(connection, std::move(error_content), request.keep_alive);
+    }
+    return true;
+}
+
+void HttpServer::startStream(const HttpRequest& request, HttpResponse response,
+                             Connection& connection, Worker& worker) {
+    if (worker.producers >= kMaxStreamsPerWorker) {
+        queueResponse(connection, R"({"error": "Too many streamed responses in progress", "code": 503})",
+                      request.keep_alive, "application/json", "503 Service Unavailable");
+        return;
+    }
+
+    // HTTP/1.0 has no chunked encoding; the producer collects the body and sends it whole
+    bool chunked = request.version != "HTTP/1.0";
+    if (chunked) {
+        std::string head = connection.takeBuffer();
+        appendHead(head, "200 OK", response.content_type, request.keep_alive);
+        connection.queue(std::move(head));
     }
+
+    auto channel = std::make_shared<StreamChannel>(worker.waker);
+    connection.stream = channel;
+    connection.producer = std::thread([channel, chunked, keep_alive = request.keep_alive,
+                                       response = std::move(response)]() {
+        if (!chunked) {
+            std::string body;
+            try {
+                response.stream([&body](const std::string& chunk) {
+                    body += chunk;
+                    return true;
+                });
+            } catch (const std::exception& e) {
+                body = R"({"error": ")" + std::string(e.what()) + R"("})";
+            }
+            std::string head;
+            appendHead(head, "200 OK", response.content_type, keep_alive, body.size());
+            channel->finish(channel->push(std::move(head)) && channel->push(std::move(body)));
+            return;
+        }
+
+        bool complete = true;
+        try {
+            response.stream([&](const std::string& chunk) {
+                if (chunk.empty()) return true;  // A zero-size chunk would end the body
+
+                // The chunk is only borrowed; frame it into a piece of its own
+                char size_line[24];
+                char* size_end = std::to_chars(size_line, size_line + sizeof(size_line), chunk.size(), 16).ptr;
+                std::string framed;
+                framed.reserve(chunk.size() + 32);
+                framed.append(size_line, size_end);
+                framed += "\r\n";
+                framed += chunk;
+                framed += "\r\n";
+                return channel->push(std::move(framed));
+            });
+        } catch (const std::exception& e) {
+            std::cerr << "Streamed response failed: " << e.what() << std::endl;
+            complete = false;
+        }
+        channel->finish(complete && channel->push("0\r\n\r\n"));
+    });
+    ++worker.producers;
+    worker.streaming.push_back(connection.fd);
 }
 
-std::string HttpServer::createResponse(const std::string& content, const std::string& content_type) {
-    std::ostringstream response;
-    response << "HTTP/1.1 200 OK\r\n";
-    response << "Content-Type: " << content_type << "\r\n";
-    response << "Content-Length: " << content.length() << "\r\n";
-    response << "Access-Control-Allow-Origin: *\r\n";
-    response << "Connection: close\r\n";
-    response << "\r\n";
-    response << content;
-    
-    return response.str();
+void HttpServer::queueResponse(Connection& connection, std::string content, bool keep_alive,
+                               const std::string& content_type, const char* status) {
+    std::string head = connection.takeBuffer();
+    appendHead(head, status, content_type, keep_alive, content.size());
+
+    // The body is moved in, not copied; one send gathers both
+    connection.queue(std::move(head));
+    connection.queue(std::move(content));
 }
 
-std::pair<std::string, std::string> HttpServer::parseRequest(const std::string& request) {
-    std::istringstream iss(request);
-    std::string method, path_with_query, version;
-    iss >> method >> path_with_query >> version;
-    
+size_t HttpServer::parseRequest(const std::string& buffer, size_t offset, HttpRequest& request) {
+    // Tolerate stray CRLFs between pipelined requests
+    size_t start = offset;
+    while (buffer.compare(start, 2, "\r\n") == 0) {
+        start += 2;
+    }
+    if (start >= buffer.size()) {
+        return start > offset && start == buffer.size() ? start - offset : 0;
+    }
+
+    size_t header_end = buffer.find("\r\n\r\n", start);
+    if (header_end == std::string::npos) {
+        return buffer.size() - start > kMaxHeaderBytes ? std::string::npos : 0;
+    }
+    if (header_end - start > kMaxHeaderBytes) {
+        return std::string::npos;
+    }
+
+    // Request line: METHOD SP target SP version
+    size_t line_end = buffer.find("\r\n", start);
+    size_t cursor = start;
+    auto nextToken = [&]() {
+        size_t begin = buffer.find_first_not_of(" \t", cursor);
+        if (begin == std::string::npos || begin >= line_end) return std::string();
+        size_t end = std::min(buffer.find_first_of(" \t", begin), line_end);
+        cursor = end;
+        return buffer.substr(begin, end - begin);
+    };
+    request.method = nextToken();
+    std::string target = nextToken();
+    request.version = nextToken();
+    if (request.method.empty() || target.empty() || request.version.compare(0, 5, "HTTP/") != 0) {
+        return std::string::npos;
+    }
+
     // Extract path and query string
-    size_t query_pos = path_with_query.find('?');
-    std::string path = path_with_query.substr(0, query_pos);
-    std::string query = (query_pos != std::string::npos) ? path_with_query.substr(query_pos + 1) : "";
-    
-    return {path, query};
+    size_t query_pos = target.find('?');
+    request.path = target.substr(0, query_pos);
+    request.query = (query_pos != std::string::npos) ? target.substr(query_pos + 1) : "";
+
+    // HTTP/1.1 connections persist unless asked otherwise; 1.0 ones do not
+    request.keep_alive = request.version == "HTTP/1.1";
+
+    size_t content_length = 0;
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        size_t end = buffer.find("\r\n", pos);
+        size_t colon = buffer.find(':', pos);
+        if (colon == std::string::npos || colon > end) {
+            return std::string::npos;
+        }
+
+        std::string name = buffer.substr(pos, colon - pos);
+        std::string value = trim(buffer.substr(colon + 1, end - colon - 1));
+
+        if (equalsIgnoreCase(name, "Content-Length")) {
+            char* parse_end = nullptr;
+            unsigned long long length = std::strtoull(value.c_str(), &parse_end, 10);
+            if (value.empty() || *parse_end != '\0' || length > kMaxBodyBytes) {
+                return std::string::npos;
+            }
+            content_length = static_cast<size_t>(length);
+        } else if (equalsIgnoreCase(name, "Connection")) {
+            if (equalsIgnoreCase(value, "close")) {
+                request.keep_alive = false;
+            } else if (equalsIgnoreCase(value, "keep-alive")) {
+                request.keep_alive = true;
+            }
+        } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+            return std::string::npos;  // Chunked request bodies are not supported
+        }
+
+        pos = end + 2;
+    }
+
+    size_t body_start = header_end + 4;
+    if (buffer.size() - body_start < content_length) {
+        return 0;
+    }
+    request.body = buffer.substr(body_start, content_length);
+
+    return body_start + content_length - offset;
 }
 
 } // namespace gis
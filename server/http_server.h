@@ -1,57 +1,163 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <utility>
+#include <vector>
 
 namespace gis {
 
+/**
+ * @brief Parsed HTTP request passed to the handler
+ */
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::string query;
+    std::string version;
+    std::string body;
+    bool keep_alive = true;
+};
+
+/**
+ * @brief Decode %XX escapes and '+' in a URL component
+ *
+ * A '%' not followed by two hex digits is kept as it is.
+ */
+std::string urlDecode(std::string_view str);
+
+/**
+ * @brief Query string split into decoded name/value pairs in one pass
+ *
+ * Names must match exactly; when one repeats, its first value is used.
+ */
+class QueryParameters {
+private:
+    std::vector<std::pair<std::string, std::string>> pairs_;
+
+public:
+    explicit QueryParameters(std::string_view query);
+
+    /**
+     * @brief Decoded value of a parameter
+     * @return The value, or an empty string if the parameter is absent
+     */
+    const std::string& get(std::string_view name) const;
+};
+
+/**
+ * @brief Response returned by the handler
+ *
+ * Converts implicitly from a string for plain JSON responses. A response
+ * with a stream callback is sent with chunked transfer encoding instead:
+ * the callback produces the body piece by piece through write(), which
+ * returns false once the client has gone away.
+ */
+struct HttpResponse {
+    using ChunkWriter = std::function<bool(const std::string& chunk)>;
+
+    std::string content;
+    std::string content_type = "application/json";
+    std::function<void(const ChunkWriter& write)> stream;
+
+    HttpResponse() = default;
+    HttpResponse(std::string content_) : content(std::move(content_)) {}
+    HttpResponse(const char* content_) : content(content_) {}
+};
+
 /**
  * @brief Simple HTTP server for GIS API endpoints
- * 
- * This is a minimal HTTP server implementation for demonstration purposes.
- * In production, you would use a robust framework like Crow, Beast, or similar.
+ *
+ * A fixed pool of worker threads each run their own event loop (epoll on
+ * Linux, kqueue on macOS/BSD, poll elsewhere) over non-blocking sockets and
+ * all accept from one shared listening socket. Connections stay on the
+ * worker that accepted them and support HTTP/1.1 keep-alive and pipelining;
+ * responses go out in request order.
+ *
+ * Response bodies are queued as they are, next to their headers, and the
+ * socket takes all queued pieces in one gathering send, so a body is
+ * copied only by the kernel.
+ *
+ * The handler is invoked concurrently from all workers and must be
+ * thread-safe. A streamed body is produced on a thread of its own and sent
+ * by the worker as the socket takes it; the producer waits while a slow
+ * client lets output pile up, so other connections are not held up. Each
+ * worker runs a few streams at a time and answers 503 beyond that.
  */
 class HttpServer {
 public:
-    using RequestHandler = std::function<std::string(const std::string& path, const std::string& query)>;
-    
+    using RequestHandler = std::function<HttpResponse(const HttpRequest& request)>;
+
 private:
     int port_;
+    size_t num_threads_;
+    int server_fd_;
     std::atomic<bool> running_;
-    std::thread server_thread_;
+    std::vector<std::thread> workers_;
     RequestHandler handler_;
-    
+
 public:
-    explicit HttpServer(int port = 8080);
+    /**
+     * @brief Constructor
+     * @param port TCP port to listen on
+     * @param num_threads Worker threads (0 = hardware concurrency)
+     */
+    explicit HttpServer(int port = 8080, size_t num_threads = 0);
     ~HttpServer();
-    
+
     /**
      * @brief Set the request handler function
      */
     void setHandler(RequestHandler handler);
-    
+
     /**
      * @brief Start the server
+     * @return false if it is already running or the port cannot be bound
      */
     bool start();
-    
+
     /**
      * @brief Stop the server
      */
     void stop();
-    
+
     /**
      * @brief Check if server is running
      */
     bool isRunning() const { return running_; }
 
+    size_t getThreadCount() const { return num_threads_; }
+
 private:
-    void serverLoop();
-    std::string handleRequest(const std::string& request);
-    std::string createResponse(const std::string& content, const std::string& content_type = "application/json");
-    std::pair<std::string, std::string> parseRequest(const std::string& request);
+    struct Connection;
+    struct Worker;
+
+    bool openListenSocket();
+    void workerLoop();
+    bool readFromConnection(Connection& connection, Worker& worker);
+    bool writeToConnection(Connection& connection);
+    bool processRequests(Connection& connection, Worker& worker);
+    bool handleRequest(const HttpRequest& request, Connection& connection, Worker& worker);
+    void startStream(const HttpRequest& request, HttpResponse response, Connection& connection, Worker& worker);
+
+    /**
+     * @brief Move a stream's pieces to the socket, and finish the stream once they are all out
+     * @return false if the connection must be closed
+     */
+    bool serviceStream(Connection& connection, Worker& worker);
+    void queueResponse(Connection& connection, std::string content, bool keep_alive,
+                       const std::string& content_type = "application/json",
+                       const char* status = "200 OK");
+
+    /**
+     * @brief Parse one request from the front of a buffer
+     * @return Bytes consumed, 0 if the request is not complete yet, or
+     *         std::string::npos if it is malformed
+     */
+    size_t parseRequest(const std::string& buffer, size_t offset, HttpRequest& request);
 };
 
 } // namespace gis
@@ -1,47 +1,210 @@
 #include "http_server.h"
 #include "gis/geocoder.h"
 #include "gis/shapefile_reader.h"
+#include "gis/atomic_snapshot.h"
+#include "gis/query_metrics.h"
 #include <iostream>
 #include <sstream>
-#include <regex>
-#include <iomanip>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 class GeocodingAPI {
 private:
-    gis::Geocoder geocoder_;
-    bool data_loaded_;
+    using GeocoderGuard = gis::AtomicSnapshot<gis::Geocoder>::Guard;
+    
+    // Streamed batch output is flushed to the client in pieces of about this size
+    static constexpr size_t kBatchChunkBytes = 16 * 1024;
+    
+    // Reserved up front for a single-result response
+    static constexpr size_t kResponseReserve = 512;
+    
+    enum Endpoint {
+        kRoot, kGeocode, kGeocodeBatch, kReverse, kReverseBatch,
+        kHealth, kStats, kMetrics, kReload, kNotFound, kEndpointCount
+    };
+    static constexpr const char* kEndpointNames[kEndpointCount] = {
+        "root", "geocode", "geocode_batch", "reverse", "reverse_batch",
+        "health", "stats", "metrics", "reload", "not_found"
+    };
+    
+    // Percentiles reported for every latency histogram
+    static constexpr double kQuantiles[] = {0.5, 0.99, 0.999};
+    static constexpr const char* kQuantileNames[] = {"p50", "p99", "p999"};
+    
+    // Current data set; requests pin one version for their whole duration
+    gis::AtomicSnapshot<gis::Geocoder> geocoder_;
+    
+    // Background reloads (never touched on the query path)
+    std::mutex reload_mutex_;
+    std::string data_path_;
+    const std::string snapshot_path_;  // Empty when snapshots are not used
+    const std::filesystem::path reload_dir_;  // Empty = /reload only re-checks the loaded sources
+    const size_t cell_grid_resolution_;  // 0 = no cell grid
+    const size_t cache_capacity_;        // Result cache entries, 0 = no cache
+    const double cache_precision_;       // Step of the reverse cache keys, in degrees
+    std::thread reload_thread_;
+    std::atomic<bool> reloading_;
+    
+    // Request latency by endpoint and time per lookup stage; they outlive
+    // reloads, unlike the R-tree counters, which belong to the loaded data
+    std::array<gis::LatencyHistogram, kEndpointCount> endpoint_latency_;
+    std::array<gis::LatencyHistogram, gis::kQueryStageCount> stage_latency_;
     
 public:
-    GeocodingAPI() : data_loaded_(false) {}
+    explicit GeocodingAPI(std::string snapshot_path = std::string(), size_t cell_grid_resolution = 0,
+                          size_t cache_capacity = 0, double cache_precision = 1e-6,
+                          const std::string& reload_dir = std::string())
+        : snapshot_path_(std::move(snapshot_path))
+        , reload_dir_(canonicalPath(reload_dir))
+        , cell_grid_resolution_(cell_grid_resolution)
+        , cache_capacity_(cache_capacity)
+        , cache_precision_(cache_precision)
+        , reloading_(false) {}
     
+    ~GeocodingAPI() {
+        // A running reload takes reload_mutex_ to record its sources, so
+        // join it without holding the lock
+        std::thread reload;
+        {
+            std::lock_guard<std::mutex> lock(reload_mutex_);
+            reload.swap(reload_thread_);
+        }
+        if (reload.joinable()) {
+            reload.join();
+        }
+    }
+    
+    /**
+     * @brief Load shapefile data into a fresh Geocoder and publish it
+     * 
+     * A comma-separated list of paths (e.g. the GADM level 0/1/2 files) is
+     * loaded as one administrative hierarchy. Requests already running keep
+     * using the previous data until they finish.
+     * 
+     * With a snapshot file configured, the snapshot is used as long as it
+     * was built from these shapefiles and they are unchanged; otherwise the
+     * shapefiles are loaded and the snapshot is rewritten. An empty path
+     * loads whatever the snapshot holds.
+     * 
+     * Each data set gets its own result caches, so a reload starts cold
+     * and never serves results of the data it replaced.
+     */
     bool loadData(const std::string& shapefile_path) {
-        if (geocoder_.loadAddressData(shapefile_path)) {
-            data_loaded_ = true;
-            std::cout << "Loaded geocoding data from: " << shapefile_path << std::endl;
-            return true;
-        }
-        return false;
-    }
-    
-    std::string handleRequest(const std::string& path, const std::string& query) {
-        if (path == "/") {
-            return createWelcomeResponse();
-        } else if (path == "/geocode") {
-            return handleGeocode(query);
-        } else if (path == "/reverse") {
-            return handleReverseGeocode(query);
-        } else if (path == "/health") {
-            return createHealthResponse();
-        } else if (path == "/stats") {
-            return createStatsResponse();
+        std::vector<std::string> paths;
+        std::istringstream path_list(shapefile_path);
+        std::string path;
+        while (std::getline(path_list, path, ',')) {
+            if (!path.empty()) paths.push_back(path);
+        }
+        
+        auto geocoder = std::make_unique<gis::Geocoder>();
+        geocoder->setCellGridResolution(cell_grid_resolution_);
+        geocoder->enableResultCache(cache_capacity_, cache_precision_);
+        bool from_snapshot = !snapshot_path_.empty() && geocoder->loadSnapshot(snapshot_path_, paths);
+        if (!from_snapshot) {
+            if (paths.empty() || !geocoder->loadAdministrativeLevels(paths)) {
+                return false;
+            }
+            if (!snapshot_path_.empty() && geocoder->saveSnapshot(snapshot_path_)) {
+                std::cout << "Wrote snapshot: " << snapshot_path_ << std::endl;
+            }
+        }
+        
+        // Remember the sources so a plain /reload can check them again
+        std::string loaded_path;
+        for (const std::string& source : geocoder->getSourcePaths()) {
+            loaded_path += (loaded_path.empty() ? "" : ",") + source;
+        }
+        
+        geocoder_.publish(std::move(geocoder));
+        {
+            std::lock_guard<std::mutex> lock(reload_mutex_);
+            data_path_ = loaded_path;
+        }
+        std::cout << "Loaded geocoding data from: " << loaded_path
+                  << (from_snapshot ? " (snapshot " + snapshot_path_ + ")" : "") << std::endl;
+        return true;
+    }
+    
+    // Called concurrently from every server worker; only reads the pinned data
+    gis::HttpResponse handleRequest(const gis::HttpRequest& request) {
+        auto start = std::chrono::steady_clock::now();
+        Endpoint endpoint = endpointOf(request.path);
+        
+        gis::QueryTrace trace;
+        gis::HttpResponse response;
+        {
+            gis::QueryTrace::Scope scope(trace);
+            response = dispatch(endpoint, request);
+        }
+        for (size_t stage = 0; stage < gis::kQueryStageCount; ++stage) {
+            if (trace.entered(static_cast<gis::QueryStage>(stage))) {
+                stage_latency_[stage].record(trace.stage_ns[stage]);
+            }
+        }
+        
+        if (response.stream) {
+            // A streamed body is produced after this returns; time it to the end
+            auto body = std::move(response.stream);
+            response.stream = [this, body, endpoint, start](const gis::HttpResponse::ChunkWriter& write) {
+                body(write);
+                endpoint_latency_[endpoint].record(std::chrono::steady_clock::now() - start);
+            };
         } else {
-            return createErrorResponse("Not Found", 404);
+            endpoint_latency_[endpoint].record(std::chrono::steady_clock::now() - start);
         }
+        return response;
     }
     
 private:
-    std::string createWelcomeResponse() {
+    static Endpoint endpointOf(const std::string& path) {
+        if (path == "/") return kRoot;
+        if (path == "/geocode") return kGeocode;
+        if (path == "/geocode/batch") return kGeocodeBatch;
+        if (path == "/reverse") return kReverse;
+        if (path == "/reverse/batch") return kReverseBatch;
+        if (path == "/health") return kHealth;
+        if (path == "/stats") return kStats;
+        if (path == "/metrics") return kMetrics;
+        if (path == "/reload") return kReload;
+        return kNotFound;
+    }
+    
+    gis::HttpResponse dispatch(Endpoint endpoint, const gis::HttpRequest& request) {
+        auto geocoder = geocoder_.acquire();
+        
+        switch (endpoint) {
+            case kRoot: return createWelcomeResponse(geocoder.get());
+            case kGeocode: return handleGeocode(geocoder.get(), parseQuery(request.query));
+            case kGeocodeBatch: return handleGeocodeBatch(std::move(geocoder), request);
+            case kReverse: return handleReverseGeocode(geocoder.get(), parseQuery(request.query));
+            case kReverseBatch: return handleReverseBatch(std::move(geocoder), request);
+            case kHealth: return createHealthResponse(geocoder.get());
+            case kStats: return createStatsResponse(geocoder.get());
+            case kMetrics: return createMetricsResponse(geocoder.get());
+            case kReload: return handleReload(request, parseQuery(request.query));
+            default: return createErrorResponse("Not Found", 404);
+        }
+    }
+    
+    static gis::QueryParameters parseQuery(const std::string& query) {
+        gis::StageTimer parse(gis::QueryStage::Parse);
+        return gis::QueryParameters(query);
+    }
+
+    std::string createWelcomeResponse(const gis::Geocoder* geocoder) {
         std::ostringstream json;
         json << "{\n";
         json << "  \"service\": \"GIS Shapefile Geocoding API\",\n";
@@ -49,182 +212,607 @@ private:
         json << "  \"author\": \"Tuan Luong\",\n";
         json << "  \"endpoints\": {\n";
         json << "    \"GET /geocode?address=<address>\": \"Geocode an address\",\n";
+        json << "    \"POST /geocode/batch\": \"Geocode one address per line, streamed back as NDJSON\",\n";
         json << "    \"GET /reverse?lat=<lat>&lng=<lng>\": \"Reverse geocode coordinates\",\n";
+        json << "    \"POST /reverse/batch\": \"Reverse geocode one 'lat,lng' per line, streamed back as NDJSON\",\n";
         json << "    \"GET /health\": \"Health check\",\n";
-        json << "    \"GET /stats\": \"Service statistics\"\n";
+        json << "    \"GET /stats\": \"Service statistics\",\n";
+        json << "    \"GET /metrics\": \"Latency and index metrics in Prometheus text format\",\n";
+        json << "    \"POST /reload\": \"Reload the current data in the background and swap it in\",\n";
+        json << "    \"POST /reload?path=<path>\": \"Load data from the reload directory instead (--reload-dir)\"\n";
         json << "  },\n";
-        json << "  \"data_loaded\": " << (data_loaded_ ? "true" : "false") << ",\n";
+        json << "  \"data_loaded\": " << (geocoder ? "true" : "false") << ",\n";
         json << "  \"description\": \"Modern C++ GIS library for enterprise geocoding systems\"\n";
         json << "}";
         return json.str();
     }
     
-    std::string handleGeocode(const std::string& query) {
-        if (!data_loaded_) {
+    std::string handleGeocode(const gis::Geocoder* geocoder, const gis::QueryParameters& params) {
+        if (!geocoder) {
             return createErrorResponse("No geocoding data loaded");
         }
         
-        std::string address = extractParameter(query, "address");
+        const std::string& address = params.get("address");
         if (address.empty()) {
             return createErrorResponse("Missing 'address' parameter");
         }
         
-        // URL decode address
-        address = urlDecode(address);
+        gis::GeocodeResult result = geocoder->geocode(address);
         
-        gis::GeocodeResult result = geocoder_.geocode(address);
+        gis::StageTimer serialize(gis::QueryStage::Serialize);
+        std::string json;
+        json.reserve(kResponseReserve);
+        json += "{\n  \"input_address\": \"";
+        appendJsonString(json, address);
+        json += "\",\n  \"success\": ";
+        json += result.confidence_score > 0 ? "true" : "false";
+        json += ",\n";
         
-        std::ostringstream json;
-        json << "{\n";
-        json << "  \"input_address\": \"" << escapeJson(address) << "\",\n";
-        json << "  \"success\": " << (result.confidence_score > 0 ? "true" : "false") << ",\n";
+        if (result.confidence_score > 0) {
+            json += "  \"result\": {\n    \"latitude\": ";
+            appendFixed(json, result.coordinate.y, 8);
+            json += ",\n    \"longitude\": ";
+            appendFixed(json, result.coordinate.x, 8);
+            json += ",\n    \"matched_address\": \"";
+            appendJsonString(json, result.matched_address.toString());
+            json += "\",\n    \"confidence\": ";
+            appendFixed(json, result.confidence_score, 3);
+            json += ",\n    \"match_type\": \"";
+            json += result.match_type;
+            json += "\"\n  }\n";
+        } else {
+            json += "  \"error\": \"No match found\"\n";
+        }
+        
+        json += "}";
+        return json;
+    }
+    
+    gis::HttpResponse handleGeocodeBatch(GeocoderGuard geocoder, const gis::HttpRequest& request) {
+        if (!geocoder) {
+            return createErrorResponse("No geocoding data loaded");
+        }
+        if (request.method != "POST") {
+            return createErrorResponse("Use POST with one address per line", 405);
+        }
+        
+        std::shared_ptr<std::vector<std::string>> addresses;
+        {
+            gis::StageTimer parse(gis::QueryStage::Parse);
+            addresses = std::make_shared<std::vector<std::string>>(splitLines(request.body));
+        }
+        
+        // The stream runs after this returns; keep the data version pinned until it ends
+        auto pinned = std::make_shared<GeocoderGuard>(std::move(geocoder));
+        
+        gis::HttpResponse response;
+        response.content_type = "application/x-ndjson";
+        response.stream = [this, pinned, addresses](const gis::HttpResponse::ChunkWriter& write) {
+            std::string chunk;
+            (*pinned)->geocodeBatchStreaming(*addresses, [&](size_t index, const gis::GeocodeResult& result) {
+                appendBatchLine(chunk, index, (*addresses)[index], result);
+                if (chunk.size() < kBatchChunkBytes) {
+                    return true;
+                }
+                bool connected = write(chunk);
+                chunk.clear();
+                return connected;
+            });
+            write(chunk);
+        };
+        return response;
+    }
+    
+    gis::HttpResponse handleReverseBatch(GeocoderGuard geocoder, const gis::HttpRequest& request) {
+        if (!geocoder) {
+            return createErrorResponse("No geocoding data loaded");
+        }
+        if (request.method != "POST") {
+            return createErrorResponse("Use POST with one 'lat,lng' pair per line", 405);
+        }
+        
+        // Unparsable lines become NaN points; the batch reports them as invalid
+        gis::StageTimer parse(gis::QueryStage::Parse);
+        auto points = std::make_shared<std::vector<gis::Point2D>>();
+        for (const std::string& line : splitLines(request.body)) {
+            double lat = std::numeric_limits<double>::quiet_NaN();
+            double lng = std::numeric_limits<double>::quiet_NaN();
+            const char* line_end = line.c_str() + line.size();
+            char* end = nullptr;
+            double parsed_lat = std::strtod(line.c_str(), &end);
+            if (end != line.c_str() && *end == ',') {
+                const char* lng_start = end + 1;
+                double parsed_lng = std::strtod(lng_start, &end);
+                const char* rest = end;
+                if (rest != lng_start && std::all_of(rest, line_end, [](char c) { return std::isspace(static_cast<unsigned char>(c)); })) {
+                    lat = parsed_lat;
+                    lng = parsed_lng;
+                }
+            }
+            points->emplace_back(lng, lat);  // Note: GIS convention is (x=lng, y=lat)
+        }
+        
+        auto pinned = std::make_shared<GeocoderGuard>(std::move(geocoder));
+        
+        gis::HttpResponse response;
+        response.content_type = "application/x-ndjson";
+        response.stream = [this, pinned, points](const gis::HttpResponse::ChunkWriter& write) {
+            std::string chunk;
+            (*pinned)->reverseGeocodeBatchStreaming(*points, [&](size_t index, const gis::GeocodeResult& result) {
+                appendReverseBatchLine(chunk, index, (*points)[index], result);
+                if (chunk.size() < kBatchChunkBytes) {
+                    return true;
+                }
+                bool connected = write(chunk);
+                chunk.clear();
+                return connected;
+            });
+            write(chunk);
+        };
+        return response;
+    }
+    
+    void appendReverseBatchLine(std::string& out, size_t index, const gis::Point2D& point,
+                                const gis::GeocodeResult& result) {
+        out += "{\"index\":";
+        appendInteger(out, index);
+        out += ",";
+        
+        if (!std::isfinite(point.x) || !std::isfinite(point.y)) {
+            out += "\"success\":false,\"error\":\"Invalid coordinates\"}\n";
+            return;
+        }
+        
+        out += "\"latitude\":";
+        appendFixed(out, point.y, 8);
+        out += ",\"longitude\":";
+        appendFixed(out, point.x, 8);
+        out += ",\"success\":";
+        out += result.confidence_score > 0 ? "true" : "false";
         
         if (result.confidence_score > 0) {
-            json << "  \"result\": {\n";
-            json << "    \"latitude\": " << std::fixed << std::setprecision(8) << result.coordinate.y << ",\n";
-            json << "    \"longitude\": " << std::fixed << std::setprecision(8) << result.coordinate.x << ",\n";
-            json << "    \"matched_address\": \"" << escapeJson(result.matched_address.toString()) << "\",\n";
-            json << "    \"confidence\": " << std::setprecision(3) << result.confidence_score << ",\n";
-            json << "    \"match_type\": \"" << result.match_type << "\"\n";
-            json << "  }\n";
+            out += ",\"result\":{\"address\":\"";
+            appendJsonString(out, result.matched_address.toString());
+            out += "\",\"confidence\":";
+            appendFixed(out, result.confidence_score, 3);
+            out += ",\"match_type\":\"";
+            out += result.match_type;
+            out += "\"}";
         } else {
-            json << "  \"error\": \"No match found\"\n";
+            out += ",\"error\":\"No address found at coordinates\"";
         }
         
-        json << "}";
-        return json.str();
+        out += "}\n";
+    }
+    
+    void appendBatchLine(std::string& out, size_t index, const std::string& address,
+                         const gis::GeocodeResult& result) {
+        out += "{\"index\":";
+        appendInteger(out, index);
+        out += ",\"input_address\":\"";
+        appendJsonString(out, address);
+        out += "\",\"success\":";
+        out += result.confidence_score > 0 ? "true" : "false";
+        
+        if (result.confidence_score > 0) {
+            out += ",\"result\":{\"latitude\":";
+            appendFixed(out, result.coordinate.y, 8);
+            out += ",\"longitude\":";
+            appendFixed(out, result.coordinate.x, 8);
+            out += ",\"matched_address\":\"";
+            appendJsonString(out, result.matched_address.toString());
+            out += "\",\"confidence\":";
+            appendFixed(out, result.confidence_score, 3);
+            out += ",\"match_type\":\"";
+            out += result.match_type;
+            out += "\"}";
+        } else {
+            out += ",\"error\":\"No match found\"";
+        }
+        
+        out += "}\n";
+    }
+    
+    std::vector<std::string> splitLines(const std::string& body) {
+        std::vector<std::string> lines;
+        size_t start = 0;
+        while (start < body.size()) {
+            size_t end = body.find('\n', start);
+            if (end == std::string::npos) {
+                end = body.size();
+            }
+            size_t length = end - start;
+            if (length > 0 && body[start + length - 1] == '\r') {
+                --length;
+            }
+            lines.push_back(body.substr(start, length));
+            start = end + 1;
+        }
+        return lines;
     }
     
-    std::string handleReverseGeocode(const std::string& query) {
-        if (!data_loaded_) {
+    std::string handleReverseGeocode(const gis::Geocoder* geocoder, const gis::QueryParameters& params) {
+        if (!geocoder) {
             return createErrorResponse("No geocoding data loaded");
         }
         
-        std::string lat_str = extractParameter(query, "lat");
-        std::string lng_str = extractParameter(query, "lng");
+        const std::string& lat_str = params.get("lat");
+        const std::string& lng_str = params.get("lng");
         
         if (lat_str.empty() || lng_str.empty()) {
             return createErrorResponse("Missing 'lat' or 'lng' parameter");
         }
         
         try {
-            double lat = std::stod(lat_str);
-            double lng = std::stod(lng_str);
+            double lat, lng;
+            {
+                gis::StageTimer parse(gis::QueryStage::Parse);
+                lat = std::stod(lat_str);
+                lng = std::stod(lng_str);
+            }
             
             gis::Point2D point(lng, lat);  // Note: GIS convention is (x=lng, y=lat)
-            gis::GeocodeResult result = geocoder_.reverseGeocode(point);
+            gis::GeocodeResult result = geocoder->reverseGeocode(point);
             
-            std::ostringstream json;
-            json << "{\n";
-            json << "  \"input_coordinates\": {\n";
-            json << "    \"latitude\": " << std::fixed << std::setprecision(8) << lat << ",\n";
-            json << "    \"longitude\": " << std::fixed << std::setprecision(8) << lng << "\n";
-            json << "  },\n";
-            json << "  \"success\": " << (result.confidence_score > 0 ? "true" : "false") << ",\n";
+            gis::StageTimer serialize(gis::QueryStage::Serialize);
+            std::string json;
+            json.reserve(kResponseReserve);
+            json += "{\n  \"input_coordinates\": {\n    \"latitude\": ";
+            appendFixed(json, lat, 8);
+            json += ",\n    \"longitude\": ";
+            appendFixed(json, lng, 8);
+            json += "\n  },\n  \"success\": ";
+            json += result.confidence_score > 0 ? "true" : "false";
+            json += ",\n";
             
             if (result.confidence_score > 0) {
-                json << "  \"result\": {\n";
-                json << "    \"address\": \"" << escapeJson(result.matched_address.toString()) << "\",\n";
-                json << "    \"confidence\": " << std::setprecision(3) << result.confidence_score << ",\n";
-                json << "    \"match_type\": \"" << result.match_type << "\"\n";
-                json << "  }\n";
+                json += "  \"result\": {\n    \"address\": \"";
+                appendJsonString(json, result.matched_address.toString());
+                json += "\",\n    \"confidence\": ";
+                appendFixed(json, result.confidence_score, 3);
+                json += ",\n    \"match_type\": \"";
+                json += result.match_type;
+                json += "\"\n  }\n";
             } else {
-                json << "  \"error\": \"No address found at coordinates\"\n";
+                json += "  \"error\": \"No address found at coordinates\"\n";
             }
             
-            json << "}";
-            return json.str();
+            json += "}";
+            return json;
             
         } catch (const std::exception& e) {
             return createErrorResponse("Invalid coordinates");
         }
     }
     
-    std::string createHealthResponse() {
-        std::ostringstream json;
-        json << "{\n";
-        json << "  \"status\": \"healthy\",\n";
-        json << "  \"data_loaded\": " << (data_loaded_ ? "true" : "false") << ",\n";
-        json << "  \"timestamp\": \"" << getCurrentTimestamp() << "\"\n";
-        json << "}";
-        return json.str();
+    std::string createHealthResponse(const gis::Geocoder* geocoder) {
+        std::string json;
+        json.reserve(kResponseReserve);
+        json += "{\n  \"status\": \"healthy\",\n  \"data_loaded\": ";
+        json += geocoder ? "true" : "false";
+        json += ",\n  \"reloading\": ";
+        json += reloading_ ? "true" : "false";
+        json += ",\n  \"timestamp\": \"";
+        appendTimestamp(json);
+        json += "\"\n}";
+        return json;
     }
     
-    std::string createStatsResponse() {
-        std::ostringstream json;
-        json << "{\n";
-        json << "  \"service\": \"GIS Geocoding API\",\n";
-        json << "  \"data_loaded\": " << (data_loaded_ ? "true" : "false") << ",\n";
+    std::string createStatsResponse(const gis::Geocoder* geocoder) {
+        std::string json;
+        json.reserve(kResponseReserve);
+        json += "{\n  \"service\": \"GIS Geocoding API\",\n  \"data_loaded\": ";
+        json += geocoder ? "true" : "false";
+        json += ",\n  \"data_version\": ";
+        appendInteger(json, geocoder_.getVersion());
+        json += ",\n";
         
-        if (data_loaded_) {
-            json << "  \"geocoder_stats\": " << escapeJson(geocoder_.getStats()) << ",\n";
+        if (geocoder) {
+            json += "  \"geocoder_stats\": \"";
+            appendJsonString(json, geocoder->getStats());
+            json += "\",\n";
+            appendCacheStats(json, "geocode_cache", geocoder->getGeocodeCacheStats());
+            appendCacheStats(json, "reverse_cache", geocoder->getReverseCacheStats());
+            
+            gis::Geocoder::TreeCounters polygon = geocoder->getPolygonTreeCounters();
+            gis::Geocoder::TreeCounters centroid = geocoder->getCentroidTreeCounters();
+            json += "  \"rtree\": {\"polygon_index\": {\"queries\": ";
+            appendInteger(json, polygon.queries);
+            json += ", \"nodes_visited\": ";
+            appendInteger(json, polygon.nodes_visited);
+            json += "}, \"centroid_index\": {\"queries\": ";
+            appendInteger(json, centroid.queries);
+            json += ", \"nodes_visited\": ";
+            appendInteger(json, centroid.nodes_visited);
+            json += "}},\n";
         }
         
-        json << "  \"timestamp\": \"" << getCurrentTimestamp() << "\"\n";
-        json << "}";
-        return json.str();
+        json += "  \"latency_us\": {\n";
+        for (size_t endpoint = 0; endpoint < kEndpointCount; ++endpoint) {
+            appendLatencyStats(json, kEndpointNames[endpoint], endpoint_latency_[endpoint],
+                               endpoint + 1 < kEndpointCount);
+        }
+        json += "  },\n  \"stage_latency_us\": {\n";
+        for (size_t stage = 0; stage < gis::kQueryStageCount; ++stage) {
+            appendLatencyStats(json, gis::queryStageName(static_cast<gis::QueryStage>(stage)),
+                               stage_latency_[stage], stage + 1 < gis::kQueryStageCount);
+        }
+        json += "  },\n";
+        
+        json += "  \"timestamp\": \"";
+        appendTimestamp(json);
+        json += "\"\n}";
+        return json;
     }
     
-    std::string createErrorResponse(const std::string& message, int code = 400) {
-        std::ostringstream json;
-        json << "{\n";
-        json << "  \"error\": \"" << escapeJson(message) << "\",\n";
-        json << "  \"code\": " << code << "\n";
-        json << "}";
-        return json.str();
+    void appendCacheStats(std::string& json, const char* name, const gis::Geocoder::CacheStats& stats) {
+        uint64_t lookups = stats.hits + stats.misses;
+        json += "  \"";
+        json += name;
+        json += "\": {\"entries\": ";
+        appendInteger(json, stats.entries);
+        json += ", \"capacity\": ";
+        appendInteger(json, stats.capacity);
+        json += ", \"hits\": ";
+        appendInteger(json, stats.hits);
+        json += ", \"misses\": ";
+        appendInteger(json, stats.misses);
+        json += ", \"hit_rate\": ";
+        appendFixed(json, lookups > 0 ? static_cast<double>(stats.hits) / lookups : 0.0, 4);
+        json += "},\n";
     }
     
-    std::string extractParameter(const std::string& query, const std::string& param) {
-        std::regex param_regex(param + "=([^&]+)");
-        std::smatch match;
-        if (std::regex_search(query, match, param_regex)) {
-            return match[1].str();
+    void appendLatencyStats(std::string& json, const char* name, const gis::LatencyHistogram& histogram,
+                            bool more) {
+        json += "    \"";
+        json += name;
+        json += "\": {\"count\": ";
+        appendInteger(json, histogram.count());
+        for (size_t q = 0; q < std::size(kQuantiles); ++q) {
+            json += ", \"";
+            json += kQuantileNames[q];
+            json += "\": ";
+            appendFixed(json, histogram.percentile(kQuantiles[q]) / 1e3, 3);
         }
-        return "";
+        json += more ? "},\n" : "}\n";
     }
     
-    std::string urlDecode(const std::string& str) {
-        std::string result;
-        for (size_t i = 0; i < str.length(); ++i) {
-            if (str[i] == '%' && i + 2 < str.length()) {
-                int hex_value;
-                std::istringstream iss(str.substr(i + 1, 2));
-                if (iss >> std::hex >> hex_value) {
-                    result += static_cast<char>(hex_value);
-                    i += 2;
-                } else {
-                    result += str[i];
-                }
-            } else if (str[i] == '+') {
-                result += ' ';
+    gis::HttpResponse createMetricsResponse(const gis::Geocoder* geocoder) {
+        std::string text;
+        text.reserve(8 * 1024);
+        
+        text += "# HELP gis_request_duration_seconds Time to answer a request, by endpoint\n"
+                "# TYPE gis_request_duration_seconds summary\n";
+        for (size_t endpoint = 0; endpoint < kEndpointCount; ++endpoint) {
+            appendSummary(text, "gis_request_duration_seconds", "endpoint", kEndpointNames[endpoint],
+                          endpoint_latency_[endpoint]);
+        }
+        
+        text += "# HELP gis_query_stage_duration_seconds Time a request spent in one lookup stage\n"
+                "# TYPE gis_query_stage_duration_seconds summary\n";
+        for (size_t stage = 0; stage < gis::kQueryStageCount; ++stage) {
+            appendSummary(text, "gis_query_stage_duration_seconds", "stage",
+                          gis::queryStageName(static_cast<gis::QueryStage>(stage)), stage_latency_[stage]);
+        }
+        
+        text += "# HELP gis_data_version Version of the loaded data, bumped by every reload\n"
+                "# TYPE gis_data_version gauge\ngis_data_version ";
+        appendInteger(text, geocoder_.getVersion());
+        text += "\n";
+        
+        if (geocoder) {
+            gis::Geocoder::TreeCounters polygon = geocoder->getPolygonTreeCounters();
+            gis::Geocoder::TreeCounters centroid = geocoder->getCentroidTreeCounters();
+            text += "# HELP gis_rtree_queries_total R-tree searches since the data was loaded\n"
+                    "# TYPE gis_rtree_queries_total counter\n";
+            appendSample(text, "gis_rtree_queries_total{tree=\"polygon\"}", polygon.queries);
+            appendSample(text, "gis_rtree_queries_total{tree=\"centroid\"}", centroid.queries);
+            text += "# HELP gis_rtree_nodes_visited_total R-tree nodes visited by those searches\n"
+                    "# TYPE gis_rtree_nodes_visited_total counter\n";
+            appendSample(text, "gis_rtree_nodes_visited_total{tree=\"polygon\"}", polygon.nodes_visited);
+            appendSample(text, "gis_rtree_nodes_visited_total{tree=\"centroid\"}", centroid.nodes_visited);
+            
+            gis::Geocoder::CacheStats geocode_cache = geocoder->getGeocodeCacheStats();
+            gis::Geocoder::CacheStats reverse_cache = geocoder->getReverseCacheStats();
+            text += "# HELP gis_cache_hits_total Result cache hits since the data was loaded\n"
+                    "# TYPE gis_cache_hits_total counter\n";
+            appendSample(text, "gis_cache_hits_total{cache=\"geocode\"}", geocode_cache.hits);
+            appendSample(text, "gis_cache_hits_total{cache=\"reverse\"}", reverse_cache.hits);
+            text += "# HELP gis_cache_misses_total Result cache misses since the data was loaded\n"
+                    "# TYPE gis_cache_misses_total counter\n";
+            appendSample(text, "gis_cache_misses_total{cache=\"geocode\"}", geocode_cache.misses);
+            appendSample(text, "gis_cache_misses_total{cache=\"reverse\"}", reverse_cache.misses);
+        }
+        
+        gis::HttpResponse response(std::move(text));
+        response.content_type = "text/plain; version=0.0.4";
+        return response;
+    }
+    
+    void appendSummary(std::string& text, const char* metric, const char* label, const char* value,
+                       const gis::LatencyHistogram& histogram) {
+        auto appendLabels = [&](const char* quantile) {
+            text += "{";
+            text += label;
+            text += "=\"";
+            text += value;
+            text += "\"";
+            if (quantile) {
+                text += ",quantile=\"";
+                text += quantile;
+                text += "\"";
+            }
+            text += "} ";
+        };
+        
+        static const char* const kQuantileLabels[] = {"0.5", "0.99", "0.999"};
+        uint64_t count = histogram.count();
+        for (size_t q = 0; q < std::size(kQuantiles); ++q) {
+            text += metric;
+            appendLabels(kQuantileLabels[q]);
+            if (count > 0) {
+                appendFixed(text, histogram.percentile(kQuantiles[q]) / 1e9, 9);
             } else {
-                result += str[i];
+                text += "NaN";
+            }
+            text += "\n";
+        }
+        text += metric;
+        text += "_sum";
+        appendLabels(nullptr);
+        appendFixed(text, histogram.sumNanoseconds() / 1e9, 9);
+        text += "\n";
+        text += metric;
+        text += "_count";
+        appendLabels(nullptr);
+        appendInteger(text, count);
+        text += "\n";
+    }
+    
+    void appendSample(std::string& text, const char* name, uint64_t value) {
+        text += name;
+        text += " ";
+        appendInteger(text, value);
+        text += "\n";
+    }
+    
+    std::string handleReload(const gis::HttpRequest& request, const gis::QueryParameters& params) {
+        if (request.method != "POST") {
+            return createErrorResponse("Use POST to reload data", 405);
+        }
+        
+        bool expected = false;
+        if (!reloading_.compare_exchange_strong(expected, true)) {
+            return createErrorResponse("Reload already in progress", 409);
+        }
+        
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        std::string path = params.get("path");
+        if (!path.empty() && !isReloadable(path)) {
+            reloading_ = false;
+            return createErrorResponse(reload_dir_.empty()
+                                           ? "Reloading from a 'path' is disabled (start with --reload-dir)"
+                                           : "Every 'path' must be inside the reload directory", 403);
+        }
+        if (path.empty()) {
+            path = data_path_;
+        }
+        if (path.empty()) {
+            reloading_ = false;
+            return createErrorResponse("No data loaded yet and no 'path' given");
+        }
+        
+        // The previous reload has finished (reloading_ was clear); reap its thread
+        if (reload_thread_.joinable()) {
+            reload_thread_.join();
+        }
+        reload_thread_ = std::thread([this, path]() {
+            if (!loadData(path)) {
+                std::cerr << "Reload failed, keeping current data: " << path << std::endl;
+            }
+            reloading_ = false;
+        });
+        
+        std::string json = "{\n  \"status\": \"reloading\",\n  \"path\": \"";
+        appendJsonString(json, path);
+        json += "\"\n}";
+        return json;
+    }
+    
+    /**
+     * @brief Absolute path with ".." and symlinks resolved, empty for an empty path
+     *
+     * Shapefile paths name the files without extension, so the path itself
+     * need not exist; the existing part of it is resolved.
+     */
+    static std::filesystem::path canonicalPath(const std::string& path) {
+        if (path.empty()) {
+            return std::filesystem::path();
+        }
+        std::error_code ec;
+        std::filesystem::path resolved = std::filesystem::weakly_canonical(path, ec);
+        return ec ? std::filesystem::path() : resolved;
+    }
+    
+    /**
+     * @brief Whether every path of a comma-separated /reload list is inside the reload directory
+     */
+    bool isReloadable(const std::string& path_list) const {
+        if (reload_dir_.empty()) {
+            return false;
+        }
+        std::istringstream paths(path_list);
+        std::string path;
+        while (std::getline(paths, path, ',')) {
+            if (path.empty()) continue;
+            std::filesystem::path resolved = canonicalPath(path);
+            if (resolved.empty()) {
+                return false;
+            }
+            auto mismatch = std::mismatch(reload_dir_.begin(), reload_dir_.end(), resolved.begin(), resolved.end());
+            if (mismatch.first != reload_dir_.end() || mismatch.second == resolved.end()) {
+                return false;
             }
         }
-        return result;
+        return true;
     }
     
-    std::string escapeJson(const std::string& str) {
-        std::string result;
-        for (char c : str) {
-            switch (c) {
-                case '"': result += "\\\""; break;
-                case '\\': result += "\\\\"; break;
-                case '\n': result += "\\n"; break;
-                case '\r': result += "\\r"; break;
-                case '\t': result += "\\t"; break;
-                default: result += c; break;
+    std::string createErrorResponse(const std::string& message, int code = 400) {
+        std::string json;
+        json += "{\n  \"error\": \"";
+        appendJsonString(json, message);
+        json += "\",\n  \"code\": ";
+        appendInteger(json, code);
+        json += "\n}";
+        return json;
+    }
+    
+    void appendJsonString(std::string& out, const std::string& str) {
+        // Copy unescaped runs whole
+        size_t run = 0;
+        for (size_t i = 0; i < str.size(); ++i) {
+            const char* escaped = nullptr;
+            switch (str[i]) {
+                case '"': escaped = "\\\""; break;
+                case '\\': escaped = "\\\\"; break;
+                case '\n': escaped = "\\n"; break;
+                case '\r': escaped = "\\r"; break;
+                case '\t': escaped = "\\t"; break;
+                default: continue;
             }
+            out.append(str, run, i - run);
+            out += escaped;
+            run = i + 1;
         }
-        return result;
+        out.append(str, run, std::string::npos);
     }
     
-    std::string getCurrentTimestamp() {
+    // Same digits as std::fixed << std::setprecision(precision), without a stream
+    void appendFixed(std::string& out, double value, int precision) {
+        char digits[std::numeric_limits<double>::max_exponent10 + 32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision);
+        out.append(digits, result.ptr);
+    }
+    
+    template<typename T>
+    void appendInteger(std::string& out, T value) {
+        char digits[24];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+    
+    void appendTimestamp(std::string& out) {
         auto now = std::chrono::system_clock::now();
         auto time_t = std::chrono::system_clock::to_time_t(now);
-        std::ostringstream oss;
-        oss << std::put_time(std::gmtime(&time_t), "%Y-%m-%dT%H:%M:%SZ");
-        return oss.str();
+        
+        // std::gmtime returns a shared buffer; use the reentrant variants
+        std::tm utc = {};
+#ifdef _WIN32
+        gmtime_s(&utc, &time_t);
+#else
+        gmtime_r(&time_t, &utc);
+#endif
+        char timestamp[32];
+        out.append(timestamp, std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &utc));
     }
 };
 
@@ -232,22 +820,47 @@ void printUsage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [options]\n\n";
     std::cout << "Options:\n";
     std::cout << "  -p, --port <port>     Server port (default: 8080)\n";
-    std::cout << "  -d, --data <path>     Path to shapefile data\n";
+    std::cout << "  -d, --data <path>     Path to shapefile data (comma-separated for several levels)\n";
+    std::cout << "  -s, --snapshot <file> Serve from this index snapshot, rebuilding it when the\n";
+    std::cout << "                        shapefiles change (alone: load the snapshot as is)\n";
+    std::cout << "  -t, --threads <n>     Server worker threads (default: one per core)\n";
+    std::cout << "  -g, --grid <cells>    Cell grid for point-in-polygon lookups, cells along the\n";
+    std::cout << "                        longer side of the data (default: 0, no grid)\n";
+    std::cout << "  -c, --cache <n>       Cache up to n geocode and n reverse results (default: 0)\n";
+    std::cout << "      --cache-precision <degrees>\n";
+    std::cout << "                        Reverse results are shared by coordinates this close\n";
+    std::cout << "                        (default: 1e-6; 0 caches exact coordinates only)\n";
+    std::cout << "  -r, --reload-dir <dir>\n";
+    std::cout << "                        Let POST /reload?path= load shapefiles from this\n";
+    std::cout << "                        directory (default: /reload only re-checks --data)\n";
     std::cout << "  -h, --help            Show this help\n\n";
     std::cout << "Examples:\n";
     std::cout << "  " << program_name << " --port 8080 --data data/addresses\n";
-    std::cout << "  " << program_name << " -p 9000 -d /path/to/geocoding/data\n\n";
+    std::cout << "  " << program_name << " -p 9000 -d /path/to/geocoding/data\n";
+    std::cout << "  " << program_name << " -d data/gadm41_USA_0,data/gadm41_USA_1,data/gadm41_USA_2\n";
+    std::cout << "  " << program_name << " -d data/gadm41_USA_1 --snapshot data/usa.snap\n\n";
     std::cout << "API Endpoints:\n";
     std::cout << "  GET /                                 - API information\n";
     std::cout << "  GET /geocode?address=<address>        - Geocode address\n";
+    std::cout << "  POST /geocode/batch                   - Batch geocode (one address per line, NDJSON out)\n";
     std::cout << "  GET /reverse?lat=<lat>&lng=<lng>      - Reverse geocode\n";
+    std::cout << "  POST /reverse/batch                   - Batch reverse geocode (one lat,lng per line)\n";
     std::cout << "  GET /health                           - Health check\n";
     std::cout << "  GET /stats                            - Service statistics\n";
+    std::cout << "  GET /metrics                          - Prometheus metrics\n";
+    std::cout << "  POST /reload                          - Reload changed data and hot-swap it in\n";
+    std::cout << "  POST /reload?path=<path>              - Hot-swap in data from --reload-dir\n";
 }
 
 int main(int argc, char* argv[]) {
     int port = 8080;
+    size_t threads = 0;
+    size_t grid_cells = 0;
+    size_t cache_entries = 0;
+    double cache_precision = 1e-6;
     std::string data_path;
+    std::string snapshot_path;
+    std::string reload_dir;
     
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
@@ -257,6 +870,18 @@ int main(int argc, char* argv[]) {
             port = std::stoi(argv[++i]);
         } else if ((arg == "-d" || arg == "--data") && i + 1 < argc) {
             data_path = argv[++i];
+        } else if ((arg == "-s" || arg == "--snapshot") && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if ((arg == "-g" || arg == "--grid") && i + 1 < argc) {
+            grid_cells = std::stoul(argv[++i]);
+        } else if ((arg == "-c" || arg == "--cache") && i + 1 < argc) {
+            cache_entries = std::stoul(argv[++i]);
+        } else if (arg == "--cache-precision" && i + 1 < argc) {
+            cache_precision = std::stod(argv[++i]);
+        } else if ((arg == "-r" || arg == "--reload-dir") && i + 1 < argc) {
+            reload_dir = argv[++i];
         } else if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
             return 0;
@@ -265,12 +890,13 @@ int main(int argc, char* argv[]) {
     
     std::cout << "=== GIS Geocoding API Server ===\n\n";
     
-    GeocodingAPI api;
+    GeocodingAPI api(snapshot_path, grid_cells, cache_entries, cache_precision, reload_dir);
     
     // Load data if provided
-    if (!data_path.empty()) {
+    if (!data_path.empty() || !snapshot_path.empty()) {
         if (!api.loadData(data_path)) {
-            std::cerr << "Warning: Failed to load data from " << data_path << std::endl;
+            std::cerr << "Warning: Failed to load data from "
+                      << (data_path.empty() ? snapshot_path : data_path) << std::endl;
             std::cerr << "Server will start but geocoding will not work.\n" << std::endl;
         }
     } else {
@@ -278,9 +904,9 @@ int main(int argc, char* argv[]) {
     }
     
     // Create and start server
-    gis::HttpServer server(port);
-    server.setHandler([&api](const std::string& path, const std::string& query) {
-        return api.handleRequest(path, query);
+    gis::HttpServer server(port, threads);
+    server.setHandler([&api](const gis::HttpRequest& request) {
+        return api.handleRequest(request);
     });
     
     if (!server.start()) {
@@ -0,0 +1,280 @@
+#include "gis/fuzzy_index.h"
+#include <algorithm>
+#include <utility>
+
+namespace gis {
+
+namespace {
+
+constexpr size_t kGramSize = 3;
+constexpr unsigned char kPadFront = 0x01;
+constexpr unsigned char kPadBack = 0x02;
+
+void buildMasks(std::string_view pattern, std::array<uint64_t, 256>& masks) {
+    masks.fill(0);
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        masks[static_cast<unsigned char>(pattern[i])] |= uint64_t(1) << i;
+    }
+}
+
+// Myers/Hyyrö bit-vector recurrence over one column of the DP matrix per
+// text character. Requires 1 <= pattern length <= 64.
+size_t bitParallelDistance(const std::array<uint64_t, 256>& masks, size_t pattern_length,
+                           std::string_view text, size_t max_distance) {
+    const uint64_t last_bit = uint64_t(1) << (pattern_length - 1);
+    uint64_t positive = ~uint64_t(0);
+    uint64_t negative = 0;
+    size_t score = pattern_length;
+
+    for (size_t j = 0; j < text.size(); ++j) {
+        uint64_t eq = masks[static_cast<unsigned char>(text[j])];
+        uint64_t xv = eq | negative;
+        uint64_t xh = (((eq & positive) + positive) ^ positive) | eq;
+        uint64_t horizontal_positive = negative | ~(xh | positive);
+        uint64_t horizontal_negative = positive & xh;
+
+        if (horizontal_positive & last_bit) {
+            ++score;
+        } else if (horizontal_negative & last_bit) {
+            --score;
+        }
+
+        // Row 0 grows by one per column for a global (not substring) distance
+        horizontal_positive = (horizontal_positive << 1) | 1;
+        horizontal_negative <<= 1;
+        positive = horizontal_negative | ~(xv | horizontal_positive);
+        negative = horizontal_positive & xv;
+
+        // Each remaining column can lower the score by at most one
+        size_t remaining = text.size() - j - 1;
+        if (score > max_distance && score - max_distance > remaining) {
+            return max_distance + 1;
+        }
+    }
+
+    return score <= max_distance ? score : max_distance + 1;
+}
+
+// Classic two-row DP restricted to the diagonal band |i - j| <= max_distance
+size_t bandedDistance(std::string_view a, std::string_view b, size_t max_distance) {
+    const size_t len_a = a.size();
+    const size_t len_b = b.size();
+    const size_t band = std::min(max_distance, std::max(len_a, len_b));
+    const size_t infinity = band + 1;
+
+    std::vector<size_t> previous(len_b + 1, infinity);
+    std::vector<size_t> current(len_b + 1, infinity);
+    for (size_t j = 0; j <= std::min(len_b, band); ++j) {
+        previous[j] = j;
+    }
+
+    for (size_t i = 1; i <= len_a; ++i) {
+        size_t low = i > band ? i - band : 1;
+        size_t high = std::min(len_b, i + band);
+
+        current[low - 1] = (low == 1 && i <= band) ? i : infinity;
+        size_t row_min = current[low - 1];
+
+        for (size_t j = low; j <= high; ++j) {
+            size_t cost = a[i - 1] == b[j - 1] ? 0 : 1;
+            size_t value = std::min({previous[j - 1] + cost, previous[j] + 1, current[j - 1] + 1});
+            current[j] = std::min(value, infinity);
+            row_min = std::min(row_min, current[j]);
+        }
+        if (high < len_b) {
+            current[high + 1] = infinity;
+        }
+
+        if (row_min > band) {
+            return max_distance + 1;
+        }
+        std::swap(previous, current);
+    }
+
+    size_t distance = previous[len_b];
+    return distance <= max_distance ? distance : max_distance + 1;
+}
+
+// The distance is at least the length difference, and exactly that if
+// either string is empty
+bool trivialDistance(std::string_view a, std::string_view b, size_t max_distance, size_t& distance) {
+    size_t gap = a.size() > b.size() ? a.size() - b.size() : b.size() - a.size();
+    if (gap > max_distance) {
+        distance = max_distance + 1;
+        return true;
+    }
+    if (a.empty() || b.empty()) {
+        distance = gap;
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+size_t editDistance(std::string_view a, std::string_view b, size_t max_distance) {
+    size_t distance = 0;
+    if (trivialDistance(a, b, max_distance, distance)) {
+        return distance;
+    }
+
+    // The bit vectors hold the shorter string
+    if (a.size() > b.size()) {
+        std::swap(a, b);
+    }
+    if (a.size() > 64) {
+        return bandedDistance(a, b, max_distance);
+    }
+
+    std::array<uint64_t, 256> masks;
+    buildMasks(a, masks);
+    return bitParallelDistance(masks, a.size(), b, max_distance);
+}
+
+EditDistanceMatcher::EditDistanceMatcher(std::string_view pattern)
+    : pattern_(pattern) {
+    buildMasks(pattern_.size() <= 64 ? std::string_view(pattern_) : std::string_view(), masks_);
+}
+
+size_t EditDistanceMatcher::distance(std::string_view text, size_t max_distance) const {
+    size_t distance = 0;
+    if (trivialDistance(pattern_, text, max_distance, distance)) {
+        return distance;
+    }
+    if (pattern_.size() > 64) {
+        return editDistance(pattern_, text, max_distance);
+    }
+    return bitParallelDistance(masks_, pattern_.size(), text, max_distance);
+}
+
+void TrigramIndex::collectGrams(std::string_view name, std::vector<uint32_t>& grams) {
+    grams.clear();
+
+    // Pad so every character starts and ends kGramSize grams
+    thread_local std::string padded;
+    padded.clear();
+    padded.reserve(name.size() + 2 * (kGramSize - 1));
+    padded.append(kGramSize - 1, static_cast<char>(kPadFront));
+    padded.append(name.data(), name.size());
+    padded.append(kGramSize - 1, static_cast<char>(kPadBack));
+
+    for (size_t i = 0; i + kGramSize <= padded.size(); ++i) {
+        grams.push_back((uint32_t(static_cast<unsigned char>(padded[i])) << 16) |
+                        (uint32_t(static_cast<unsigned char>(padded[i + 1])) << 8) |
+                        uint32_t(static_cast<unsigned char>(padded[i + 2])));
+    }
+    std::sort(grams.begin(), grams.end());
+}
+
+void TrigramIndex::build(std::vector<std::string> names) {
+    names_ = std::move(names);
+    gram_keys_.clear();
+    gram_offsets_.clear();
+    postings_.clear();
+
+    // (gram, name id) pairs, sorted to lay out the posting lists
+    std::vector<std::pair<uint32_t, uint32_t>> entries;
+    std::vector<uint32_t> grams;
+    for (size_t id = 0; id < names_.size(); ++id) {
+        collectGrams(names_[id], grams);
+        for (uint32_t gram : grams) {
+            entries.emplace_back(gram, static_cast<uint32_t>(id));
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    postings_.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i == 0 || entries[i].first != entries[i - 1].first) {
+            gram_keys_.push_back(entries[i].first);
+            gram_offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+        }
+        postings_.push_back(entries[i].second);
+    }
+    gram_offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+}
+
+std::vector<TrigramIndex::Match> TrigramIndex::search(std::string_view query, size_t max_distance) const {
+    std::vector<Match> matches;
+    if (names_.empty()) {
+        return matches;
+    }
+
+    EditDistanceMatcher matcher(query);
+    auto verify = [&](uint32_t id) {
+        const std::string& name = names_[id];
+        size_t length_gap = name.size() > query.size() ? name.size() - query.size()
+                                                       : query.size() - name.size();
+        if (length_gap > max_distance) return;
+
+        size_t distance = matcher.distance(name, max_distance);
+        if (distance <= max_distance) {
+            matches.push_back(Match{id, static_cast<uint32_t>(distance)});
+        }
+    };
+
+    // Shared grams guaranteed by the count filter
+    size_t query_grams = query.size() + kGramSize - 1;
+    size_t destroyed = max_distance < query_grams ? kGramSize * max_distance : query_grams;
+
+    if (destroyed >= query_grams) {
+        for (uint32_t id = 0; id < names_.size(); ++id) {
+            verify(id);
+        }
+    } else {
+        // Per-thread counters, returned to zero after every search
+        thread_local std::vector<uint32_t> grams;
+        thread_local std::vector<uint32_t> counts;
+        thread_local std::vector<uint32_t> touched;
+        const size_t threshold = query_grams - destroyed;
+        if (counts.size() < names_.size()) {
+            counts.resize(names_.size(), 0);
+        }
+        touched.clear();
+
+        collectGrams(query, grams);
+        for (size_t g = 0; g < grams.size();) {
+            // Multiset intersection: a gram counts min(query, name) times
+            size_t g_end = g;
+            while (g_end < grams.size() && grams[g_end] == grams[g]) ++g_end;
+            uint32_t query_count = static_cast<uint32_t>(g_end - g);
+
+            auto key_it = std::lower_bound(gram_keys_.begin(), gram_keys_.end(), grams[g]);
+            if (key_it != gram_keys_.end() && *key_it == grams[g]) {
+                size_t key = static_cast<size_t>(key_it - gram_keys_.begin());
+                for (uint32_t p = gram_offsets_[key]; p < gram_offsets_[key + 1];) {
+                    uint32_t id = postings_[p];
+                    uint32_t p_end = p;
+                    while (p_end < gram_offsets_[key + 1] && postings_[p_end] == id) ++p_end;
+
+                    if (counts[id] == 0) touched.push_back(id);
+                    counts[id] += std::min(query_count, p_end - p);
+                    p = p_end;
+                }
+            }
+            g = g_end;
+        }
+
+        for (uint32_t id : touched) {
+            if (counts[id] >= threshold) {
+                verify(id);
+            }
+            counts[id] = 0;
+        }
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+        return a.distance != b.distance ? a.distance < b.distance : a.id < b.id;
+    });
+    return matches;
+}
+
+size_t TrigramIndex::memoryUsage() const {
+    size_t bytes = (gram_keys_.capacity() + gram_offsets_.capacity() + postings_.capacity()) * sizeof(uint32_t);
+    for (const auto& name : names_) {
+        bytes += sizeof(std::string) + name.capacity();
+    }
+    return bytes;
+}
+
+} // namespace gis
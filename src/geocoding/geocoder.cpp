@@ -1,13 +1,126 @@
 #include "gis/geocoder.h"
 #include "gis/shapefile_reader.h"
+#include "gis/parallel.h"
+#include "gis/hilbert.h"
+#include "gis/query_metrics.h"
 #include <algorithm>
 #include <sstream>
+#include <iostream>
 #include <regex>
 #include <cmath>
 #include <cctype>
+#include <cstring>
+#include <string_view>
 
 namespace gis {
 
+namespace {
+
+// Per-thread buffers reused by every parse on that thread
+struct ParseScratch {
+    std::string normalized;
+    std::vector<std::string_view> tokens;
+};
+
+thread_local ParseScratch parse_scratch;
+
+// One edit allowed per 4 characters, so short codes never match fuzzily
+inline size_t maxEditsFor(size_t length) {
+    constexpr size_t kCharsPerEdit = 4;
+    constexpr size_t kMaxEdits = 3;
+    return std::min(length / kCharsPerEdit, kMaxEdits);
+}
+
+inline bool isAsciiDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool isDigits(std::string_view str) {
+    return std::all_of(str.begin(), str.end(), isAsciiDigit);
+}
+
+// Result cache key of an address: letters upper-cased, whitespace runs
+// collapsed and trimmed. Punctuation is kept, since commas split the
+// address into parts.
+void addressCacheKey(const std::string& address, std::string& key) {
+    key.clear();
+    bool pending_space = false;
+    for (char c : address) {
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            pending_space = !key.empty();
+            continue;
+        }
+        if (pending_space) {
+            key += ' ';
+            pending_space = false;
+        }
+        key += (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+}
+
+// Coordinate in units of precision, or its bit pattern for exact keys
+int64_t quantizeCoordinate(double value, double precision) {
+    if (precision > 0.0) {
+        constexpr double kLimit = 4.0e18;
+        return static_cast<int64_t>(std::clamp(std::round(value / precision), -kLimit, kLimit));
+    }
+    int64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+} // anonymous namespace
+
+// KeywordTable implementation
+uint32_t AddressParser::KeywordTable::hash(std::string_view key, uint32_t seed) {
+    // Seeded FNV-1a with a final mix so low bits depend on every byte
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : key) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+void AddressParser::KeywordTable::build(const std::unordered_map<std::string, std::string>& entries) {
+    entries_.assign(entries.begin(), entries.end());
+    std::sort(entries_.begin(), entries_.end());
+    
+    // Grow the table until some seed places every key in its own slot
+    constexpr uint32_t kSeedsPerSize = 256;
+    size_t size = 8;
+    while (size < entries_.size() * 2) size *= 2;
+    
+    for (;; size *= 2) {
+        for (uint32_t seed = 0; seed < kSeedsPerSize; ++seed) {
+            slots_.assign(size, kEmptySlot);
+            mask_ = static_cast<uint32_t>(size - 1);
+            seed_ = seed;
+            
+            bool collision = false;
+            for (size_t i = 0; i < entries_.size() && !collision; ++i) {
+                uint16_t& slot = slots_[hash(entries_[i].first, seed_) & mask_];
+                collision = slot != kEmptySlot;
+                slot = static_cast<uint16_t>(i);
+            }
+            if (!collision) return;
+        }
+    }
+}
+
+const std::string* AddressParser::KeywordTable::find(std::string_view key) const {
+    if (slots_.empty()) return nullptr;
+    
+    uint16_t slot = slots_[hash(key, seed_) & mask_];
+    if (slot == kEmptySlot || entries_[slot].first != key) {
+        return nullptr;
+    }
+    return &entries_[slot].second;
+}
+
 // AddressParser implementation
 AddressParser::AddressParser() {
     initializeAbbreviations();
@@ -42,13 +155,19 @@ void AddressParser::initializeAbbreviations() {
         {"VA", "VIRGINIA"}, {"WA", "WASHINGTON"}, {"WV", "WEST VIRGINIA"},
         {"WI", "WISCONSIN"}, {"WY", "WYOMING"}, {"DC", "DISTRICT OF COLUMBIA"}
     };
+    
+    street_type_table_.build(street_type_abbreviations_);
+    state_table_.build(state_abbreviations_);
 }
 
 ParsedAddress AddressParser::parse(const std::string& address_string) const {
     ParsedAddress address;
     address.full_address = address_string;
     
-    std::vector<std::string> tokens = tokenize(normalize(address_string));
+    ParseScratch& scratch = parse_scratch;
+    normalize(address_string, scratch.normalized);
+    tokenize(scratch.normalized, scratch.tokens);
+    const std::vector<std::string_view>& tokens = scratch.tokens;
     
     if (tokens.empty()) return address;
     
@@ -56,96 +175,108 @@ ParsedAddress AddressParser::parse(const std::string& address_string) const {
     
     // Extract house number (first numeric token)
     if (i < tokens.size() && isNumeric(tokens[i])) {
-        address.house_number = tokens[i];
+        address.house_number = std::string(tokens[i]);
         i++;
     }
     
     // Extract street name and type
-    std::vector<std::string> street_parts;
-    while (i < tokens.size() && !isZipCode(tokens[i]) && 
-           state_abbreviations_.find(tokens[i]) == state_abbreviations_.end()) {
-        street_parts.push_back(tokens[i]);
+    size_t street_begin = i;
+    while (i < tokens.size() && !isZipCode(tokens[i]) && !findStateName(tokens[i])) {
         i++;
     }
+    size_t street_end = i;
     
-    if (!street_parts.empty()) {
+    if (street_end > street_begin) {
         // Last token might be street type
-        std::string last_token = street_parts.back();
-        if (street_type_abbreviations_.find(last_token) != street_type_abbreviations_.end()) {
-            address.street_type = street_type_abbreviations_.at(last_token);
-            street_parts.pop_back();
+        if (const std::string* street_type = findStreetType(tokens[street_end - 1])) {
+            address.street_type = *street_type;
+            street_end--;
         }
         
         // Join remaining tokens as street name
-        std::ostringstream oss;
-        for (size_t j = 0; j < street_parts.size(); ++j) {
-            if (j > 0) oss << " ";
-            oss << street_parts[j];
+        for (size_t j = street_begin; j < street_end; ++j) {
+            if (j > street_begin) address.street_name += ' ';
+            address.street_name.append(tokens[j].data(), tokens[j].size());
         }
-        address.street_name = oss.str();
     }
     
     // Extract state
-    if (i < tokens.size() && state_abbreviations_.find(tokens[i]) != state_abbreviations_.end()) {
-        address.state = tokens[i];
+    if (i < tokens.size() && findStateName(tokens[i])) {
+        address.state = std::string(tokens[i]);
         i++;
     }
     
     // Extract zip code
     if (i < tokens.size() && isZipCode(tokens[i])) {
-        address.zip_code = tokens[i];
+        address.zip_code = std::string(tokens[i]);
         i++;
     }
     
     // Remaining tokens are likely city
     if (i < tokens.size()) {
-        std::ostringstream oss;
         for (size_t j = 0; j < i; ++j) {
-            if (j > 0) oss << " ";
-            oss << tokens[j];
+            if (j > 0) address.city += ' ';
+            address.city.append(tokens[j].data(), tokens[j].size());
         }
-        address.city = oss.str();
     }
     
     return address;
 }
 
 std::string AddressParser::normalize(const std::string& address) const {
-    std::string normalized = address;
-    
-    // Convert to uppercase
-    std::transform(normalized.begin(), normalized.end(), normalized.begin(), 
-                   [](unsigned char c) { return std::toupper(c); });
-    
-    // Remove common punctuation
-    std::regex punct_regex("[,\\.]");
-    normalized = std::regex_replace(normalized, punct_regex, " ");
-    
-    // Collapse multiple spaces
-    std::regex spaces_regex("\\s+");
-    normalized = std::regex_replace(normalized, spaces_regex, " ");
-    
-    // Trim
-    normalized.erase(0, normalized.find_first_not_of(" \t"));
-    normalized.erase(normalized.find_last_not_of(" \t") + 1);
-    
+    std::string normalized;
+    normalize(address, normalized);
     return normalized;
 }
 
+void AddressParser::normalize(std::string_view address, std::string& output) const {
+    output.clear();
+    output.reserve(address.size());
+    
+    // Single pass: convert to uppercase, treat common punctuation as
+    // whitespace, collapse whitespace runs and trim both ends
+    bool pending_space = false;
+    for (char c : address) {
+        switch (c) {
+            case ',': case '.':
+            case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+                pending_space = !output.empty();
+                continue;
+            default:
+                break;
+        }
+        if (pending_space) {
+            output += ' ';
+            pending_space = false;
+        }
+        output += (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+}
+
 const std::unordered_map<std::string, std::string>& AddressParser::getStateAbbreviations() const {
     return state_abbreviations_;
 }
 
-std::vector<std::string> AddressParser::tokenize(const std::string& text) const {
-    std::vector<std::string> tokens;
-    std::istringstream iss(text);
-    std::string token;
+const std::string* AddressParser::findStateName(std::string_view abbreviation) const {
+    return state_table_.find(abbreviation);
+}
+
+const std::string* AddressParser::findStreetType(std::string_view abbreviation) const {
+    return street_type_table_.find(abbreviation);
+}
+
+void AddressParser::tokenize(std::string_view text, std::vector<std::string_view>& tokens) const {
+    tokens.clear();
     
-    while (iss >> token) {
-        tokens.push_back(token);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t start = text.find_first_not_of(' ', pos);
+        if (start == std::string_view::npos) break;
+        size_t end = text.find(' ', start);
+        if (end == std::string_view::npos) end = text.size();
+        tokens.push_back(text.substr(start, end - start));
+        pos = end;
     }
-    
-    return tokens;
 }
 
 std::string AddressParser::expandAbbreviations(const std::string& text) const {
@@ -160,18 +291,17 @@ std::string AddressParser::expandAbbreviations(const std::string& text) const {
     return expanded;
 }
 
-bool AddressParser::isNumeric(const std::string& str) const {
-    return !str.empty() && std::all_of(str.begin(), str.end(), ::isdigit);
+bool AddressParser::isNumeric(std::string_view str) const {
+    return !str.empty() && isDigits(str);
 }
 
-bool AddressParser::isZipCode(const std::string& str) const {
+bool AddressParser::isZipCode(std::string_view str) const {
     // Simple check for 5 or 9 digit zip codes
     if (str.length() == 5) {
-        return std::all_of(str.begin(), str.end(), ::isdigit);
+        return isDigits(str);
     }
     if (str.length() == 10 && str[5] == '-') {
-        return std::all_of(str.begin(), str.begin() + 5, ::isdigit) &&
-               std::all_of(str.begin() + 6, str.end(), ::isdigit);
+        return isDigits(str.substr(0, 5)) && isDigits(str.substr(6));
     }
     return false;
 }
@@ -205,35 +335,212 @@ Geocoder::~Geocoder() = default;
 
 bool Geocoder::loadAddressData(const std::string& shapefile_path, const std::string& address_field) {
     (void)address_field; // Mark as intentionally unused for now
-    ShapefileReader reader(shapefile_path);
+    return loadAdministrativeLevels({shapefile_path});
+}
+
+void Geocoder::clearData() {
+    address_data_.clear();
+    attribute_refs_.clear();
+    buildCandidateTable();
+    buildHierarchy();
+    buildCentroidIndex();
+    buildIndex();
+    spatial_index_.buildIndex(address_data_);
+    attribute_tables_.clear();
+    snapshot_.close();
+    arena_.release();
+    source_paths_.clear();
+    clearResultCache();
+}
+
+bool Geocoder::loadAdministrativeLevels(const std::vector<std::string>& shapefile_paths) {
+    clearData();
+    source_paths_ = shapefile_paths;
     
-    if (!reader.open()) {
-        return false;
+    // Geometry only, with coordinates packed into the arena; attributes are
+    // read column by column from the mapped .dbf
+    ReadOptions geometry_only;
+    geometry_only.read_attributes = false;
+    geometry_only.arena = &arena_;
+    
+    for (const std::string& path : shapefile_paths) {
+        ShapefileReader reader(path);
+        if (!reader.open(IOMode::MemoryMapped)) {
+            clearData();
+            return false;
+        }
+        
+        auto table = std::make_unique<AttributeTable>();
+        if (!table->open(path + ".dbf")) {
+            std::cerr << "No attributes for " << path << std::endl;
+        }
+        uint32_t table_id = static_cast<uint32_t>(attribute_tables_.size());
+        attribute_tables_.push_back(std::move(table));
+        
+        auto records = reader.readAllRecordsParallel(0, geometry_only);
+        if (records.empty() && reader.getRecordCount() > 0) {
+            clearData();
+            return false;
+        }
+        address_data_.reserve(address_data_.size() + records.size());
+        for (auto& record : records) {
+            attribute_refs_.push_back(AttributeRef{table_id, record->index});
+            address_data_.push_back(std::move(record));
+        }
+    }
+    
+    // Coarser levels first, so index order runs parent before child
+    // whatever order the files came in
+    std::vector<std::pair<uint32_t, size_t>> by_level(address_data_.size());
+    for (size_t i = 0; i < address_data_.size(); ++i) {
+        by_level[i] = {address_data_[i] ? administrativeLevel(i, nullptr) : 0, i};
+    }
+    std::stable_sort(by_level.begin(), by_level.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::vector<std::unique_ptr<ShapeRecord>> ordered(address_data_.size());
+    std::vector<AttributeRef> ordered_refs(address_data_.size());
+    for (size_t i = 0; i < by_level.size(); ++i) {
+        ordered[i] = std::move(address_data_[by_level[i].second]);
+        ordered_refs[i] = attribute_refs_[by_level[i].second];
     }
+    address_data_ = std::move(ordered);
+    attribute_refs_ = std::move(ordered_refs);
     
-    address_data_ = reader.readAllRecords();
+    buildCandidateTable();
+    buildHierarchy();
+    buildCentroidIndex();
     buildIndex();
     
     // Build spatial index for efficient point-in-polygon queries
-    spatial_index_.buildIndex(address_data_);
+    spatial_index_.buildIndex(address_data_, &arena_);
+    spatial_index_.buildCellGrid(cell_grid_resolution_);
+    
+    return !address_data_.empty();
+}
+
+bool Geocoder::saveSnapshot(const std::string& snapshot_path) const {
+    if (!IndexSnapshot::write(snapshot_path, source_paths_, address_data_, spatial_index_,
+                              attribute_tables_, attribute_refs_)) {
+        std::cerr << "Failed to write snapshot " << snapshot_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Geocoder::loadSnapshot(const std::string& snapshot_path, const std::vector<std::string>& shapefile_paths) {
+    IndexSnapshot snapshot;
+    if (!snapshot.open(snapshot_path)) {
+        return false;
+    }
+    if (!shapefile_paths.empty() && !snapshot.matchesSources(shapefile_paths)) {
+        return false;  // Stale: built from other or since modified shapefiles
+    }
+    
+    // Records restored from the previous snapshot borrow from its mapping
+    clearData();
+    snapshot_ = std::move(snapshot);
+    if (!snapshot_.restore(address_data_, spatial_index_, attribute_tables_, attribute_refs_)) {
+        std::cerr << "Inconsistent snapshot " << snapshot_path << std::endl;
+        clearData();
+        return false;
+    }
+    source_paths_ = snapshot_.getShapefiles();
+    if (spatial_index_.getCellGrid().getResolution() != cell_grid_resolution_) {
+        spatial_index_.buildCellGrid(cell_grid_resolution_);
+    }
+    
+    // Records were saved in load order (coarsest level first), so the
+    // derived tables come out exactly as after loadAdministrativeLevels()
+    buildCandidateTable();
+    buildHierarchy();
+    buildCentroidIndex();
+    buildIndex();
     
     return !address_data_.empty();
 }
 
+size_t Geocoder::ReverseKeyHash::operator()(const ReverseKey& key) const {
+    size_t hash = std::hash<int64_t>()(key.x);
+    hash = hash * 31 + std::hash<int64_t>()(key.y);
+    return hash * 31 + std::hash<double>()(key.max_distance);
+}
+
+void Geocoder::enableResultCache(size_t capacity, double coordinate_precision) {
+    geocode_cache_.reset();
+    reverse_cache_.reset();
+    cache_precision_ = coordinate_precision > 0.0 ? coordinate_precision : 0.0;
+    if (capacity > 0) {
+        geocode_cache_ = std::make_unique<ShardedLRUCache<std::string, GeocodeResult>>(capacity);
+        reverse_cache_ = std::make_unique<ShardedLRUCache<ReverseKey, GeocodeResult, ReverseKeyHash>>(capacity);
+    }
+}
+
+void Geocoder::clearResultCache() {
+    if (geocode_cache_) geocode_cache_->clear();
+    if (reverse_cache_) reverse_cache_->clear();
+}
+
+Geocoder::CacheStats Geocoder::getGeocodeCacheStats() const {
+    CacheStats stats;
+    if (geocode_cache_) {
+        stats = {geocode_cache_->hits(), geocode_cache_->misses(), geocode_cache_->size(), geocode_cache_->capacity()};
+    }
+    return stats;
+}
+
+Geocoder::CacheStats Geocoder::getReverseCacheStats() const {
+    CacheStats stats;
+    if (reverse_cache_) {
+        stats = {reverse_cache_->hits(), reverse_cache_->misses(), reverse_cache_->size(), reverse_cache_->capacity()};
+    }
+    return stats;
+}
+
+Geocoder::TreeCounters Geocoder::getPolygonTreeCounters() const {
+    const RTree& tree = spatial_index_.getTree();
+    return {tree.getQueryCount(), tree.getNodesVisited()};
+}
+
+Geocoder::TreeCounters Geocoder::getCentroidTreeCounters() const {
+    return {centroid_index_.getQueryCount(), centroid_index_.getNodesVisited()};
+}
+
 GeocodeResult Geocoder::geocode(const std::string& address) const {
+    StageTimer index(QueryStage::Index);
+    if (!geocode_cache_) {
+        return geocodeUncached(address);
+    }
+    
+    thread_local std::string key;
+    addressCacheKey(address, key);
+    GeocodeResult result;
+    if (!geocode_cache_->find(key, result)) {
+        result = geocodeUncached(address);
+        geocode_cache_->insert(key, result);
+    }
+    return result;
+}
+
+GeocodeResult Geocoder::geocodeUncached(const std::string& address) const {
     // First try standard address parsing
-    ParsedAddress parsed = parser_.parse(address);
+    ParsedAddress parsed;
+    {
+        StageTimer parse(QueryStage::Parse);
+        parsed = parser_.parse(address);
+    }
+    
+    // "<county>, <state>" is resolved inside the state first
+    if (hierarchical_) {
+        GeocodeResult scoped = geocodeHierarchical(address, parsed);
+        if (scoped.confidence_score > 0) {
+            return scoped;
+        }
+    }
     
     if (parsed.isValid()) {
-        std::vector<GeocodeResult> candidates = findCandidates(parsed);
-        
-        if (!candidates.empty()) {
-            // Sort by confidence and return best match
-            std::sort(candidates.begin(), candidates.end(), 
-                      [](const GeocodeResult& a, const GeocodeResult& b) {
-                          return a.confidence_score > b.confidence_score;
-                      });
-            return candidates[0];
+        GeocodeResult best = findBestCandidate(parsed);
+        if (best.confidence_score > 0) {
+            return best;
         }
     }
     
@@ -246,73 +553,316 @@ GeocodeResult Geocoder::geocode(const std::string& address) const {
     return GeocodeResult();  // Empty result with 0 confidence
 }
 
-std::vector<GeocodeResult> Geocoder::geocodeBatch(const std::vector<std::string>& addresses) const {
-    std::vector<GeocodeResult> results;
-    results.reserve(addresses.size());
+std::vector<GeocodeResult> Geocoder::geocodeBatch(const std::vector<std::string>& addresses,
+                                                  size_t num_threads) const {
+    std::vector<GeocodeResult> results(addresses.size());
     
-    for (const auto& address : addresses) {
-        results.push_back(geocode(address));
-    }
+    geocodeBatchStreaming(addresses, [&results](size_t index, const GeocodeResult& result) {
+        results[index] = result;
+        return true;
+    }, num_threads);
     
     return results;
 }
 
+size_t Geocoder::geocodeBatchStreaming(const std::vector<std::string>& addresses, const BatchSink& sink,
+                                       size_t num_threads) const {
+    // Inputs per block; bounds the latency until the first results are streamed
+    constexpr size_t kBlockSize = 1024;
+    
+    // Number distinct addresses in order of first occurrence, so the ones
+    // first seen in a block form one contiguous range
+    std::unordered_map<std::string_view, size_t> unique_ids;
+    unique_ids.reserve(addresses.size());
+    std::vector<size_t> unique_of(addresses.size());
+    std::vector<size_t> first_input;
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        auto [it, inserted] = unique_ids.emplace(addresses[i], first_input.size());
+        if (inserted) {
+            first_input.push_back(i);
+        }
+        unique_of[i] = it->second;
+    }
+    
+    std::vector<GeocodeResult> unique_results(first_input.size());
+    size_t computed = 0;
+    
+    for (size_t block_begin = 0; block_begin < addresses.size(); block_begin += kBlockSize) {
+        size_t block_end = std::min(addresses.size(), block_begin + kBlockSize);
+        
+        size_t needed = computed;
+        while (needed < first_input.size() && first_input[needed] < block_end) {
+            ++needed;
+        }
+        
+        size_t base = computed;
+        ThreadPool::shared().parallelFor(needed - base, num_threads, [&](size_t begin, size_t end, size_t) {
+            for (size_t u = base + begin; u < base + end; ++u) {
+                unique_results[u] = geocode(addresses[first_input[u]]);
+            }
+        });
+        computed = needed;
+        
+        for (size_t i = block_begin; i < block_end; ++i) {
+            if (!sink(i, unique_results[unique_of[i]])) {
+                return i;
+            }
+        }
+    }
+    
+    return addresses.size();
+}
+
 GeocodeResult Geocoder::reverseGeocode(const Point2D& point, double max_distance) const {
-    // First try spatial index for exact point-in-polygon testing
-    ShapeRecord* containing_record = spatial_index_.pointInPolygon(point);
+    StageTimer index(QueryStage::Index);
+    if (!reverse_cache_ || !std::isfinite(point.x) || !std::isfinite(point.y)) {
+        return reverseGeocodeUncached(point, max_distance);
+    }
     
-    if (containing_record) {
-        // Extract state name from GADM data (NAME_1 field)
-        std::string address_str = extractAddressFromRecord(*containing_record, "NAME_1");
+    ReverseKey key{quantizeCoordinate(point.x, cache_precision_), quantizeCoordinate(point.y, cache_precision_),
+                   max_distance};
+    GeocodeResult result;
+    if (!reverse_cache_->find(key, result)) {
+        result = reverseGeocodeUncached(point, max_distance);
+        reverse_cache_->insert(key, result);
+    }
+    return result;
+}
+
+GeocodeResult Geocoder::reverseGeocodeUncached(const Point2D& point, double max_distance) const {
+    // First try exact point-in-polygon testing: down the hierarchy if there
+    // is one, otherwise over every record through the spatial index
+    size_t containing = hierarchical_ ? findContainingUnit(point)
+                                      : spatial_index_.findContainingRecord(point);
+    
+    if (containing < candidate_records_.size() && candidate_records_[containing].name_id != kNoName) {
+        CandidateMatch match;
+        match.record = containing;
+        match.matched_name = hierarchical_ ? candidate_records_[containing].ownName() : kNoName;
+        match.confidence = 1.0;  // High confidence for exact polygon match
+        return makeResult(match, "reverse");
+    }
+    
+    // Fallback: nearest record centroid within max_distance. The R-tree
+    // search gives up once every remaining node is out of range.
+    std::vector<size_t> nearest = centroid_index_.nearestNeighbors(point, 1, RTree::DistanceFunction(),
+                                                                   max_distance);
+    if (nearest.empty()) {
+        return GeocodeResult();
+    }
+    
+    CandidateMatch match;
+    match.record = nearest[0];
+    match.matched_name = hierarchical_ ? candidate_records_[match.record].ownName() : kNoName;
+    match.confidence = 1.0 - (calculateDistance(point, candidate_records_[match.record].centroid) / max_distance);
+    return makeResult(match, "reverse");
+}
+
+std::vector<GeocodeResult> Geocoder::reverseGeocodeBatch(const std::vector<Point2D>& points,
+                                                         double max_distance, size_t num_threads) const {
+    std::vector<GeocodeResult> results(points.size());
+    
+    reverseGeocodeBatchStreaming(points, [&results](size_t index, const GeocodeResult& result) {
+        results[index] = result;
+        return true;
+    }, max_distance, num_threads);
+    
+    return results;
+}
+
+size_t Geocoder::reverseGeocodeBatchStreaming(const std::vector<Point2D>& points, const BatchSink& sink,
+                                              double max_distance, size_t num_threads) const {
+    // Large enough for the curve order to pay off, small enough to stream
+    constexpr size_t kBlockSize = 64 * 1024;
+    
+    std::vector<GeocodeResult> block_results;
+    
+    for (size_t block_begin = 0; block_begin < points.size(); block_begin += kBlockSize) {
+        size_t block_size = std::min(kBlockSize, points.size() - block_begin);
+        const Point2D* block = points.data() + block_begin;
         
-        if (!address_str.empty()) {
-            ParsedAddress parsed;
-            parsed.state = address_str;
-            parsed.full_address = address_str;
-            
-            // Get centroid for result coordinates
-            BoundingBox bounds = containing_record->geometry->getBounds();
-            Point2D centroid((bounds.min_x + bounds.max_x) / 2.0, 
-                            (bounds.min_y + bounds.max_y) / 2.0);
-            
-            GeocodeResult result(centroid, parsed, 1.0); // High confidence for exact polygon match
-            result.match_type = "reverse";
-            return result;
+        std::vector<uint32_t> order = hilbertSortOrder(block, block_size);
+        block_results.assign(block_size, GeocodeResult());
+        
+        ThreadPool::shared().parallelFor(block_size, num_threads, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                block_results[order[i]] = reverseGeocode(block[order[i]], max_distance);
+            }
+        });
+        
+        for (size_t i = 0; i < block_size; ++i) {
+            if (!sink(block_begin + i, block_results[i])) {
+                return block_begin + i;
+            }
         }
     }
     
-    // Fallback to distance-based matching if spatial index fails
-    double min_distance = std::numeric_limits<double>::max();
-    GeocodeResult best_result;
+    return points.size();
+}
+
+void Geocoder::buildCandidateTable() {
+    candidate_names_.clear();
+    candidate_records_.assign(address_data_.size(), CandidateRecord{kNoName, kNoName, kNoRecord, 0, Point2D(), BoundingBox::empty()});
+    
+    // Full state name -> abbreviation, so each name is matched in one lookup
+    std::unordered_map<std::string, std::string> abbreviation_of;
+    for (const auto& abbrev_pair : parser_.getStateAbbreviations()) {
+        abbreviation_of.emplace(abbrev_pair.second, abbrev_pair.first);
+    }
+    
+    std::unordered_map<std::string_view, uint32_t> name_ids;
+    auto intern = [&](std::string_view value) {
+        auto inserted = name_ids.emplace(value, static_cast<uint32_t>(candidate_names_.size()));
+        if (inserted.second) {
+            CandidateName name;
+            name.name = std::string(value);
+            name.normalized = parser_.normalize(name.name);
+            auto abbrev_it = abbreviation_of.find(name.normalized);
+            if (abbrev_it != abbreviation_of.end()) {
+                name.abbreviation = abbrev_it->second;
+            }
+            candidate_names_.push_back(std::move(name));
+        }
+        return inserted.first->second;
+    };
     
-    for (const auto& record : address_data_) {
+    for (size_t i = 0; i < address_data_.size(); ++i) {
+        const auto& record = address_data_[i];
         if (!record || !record->geometry) continue;
         
-        // Get centroid of geometry for distance calculation
-        BoundingBox bounds = record->geometry->getBounds();
-        Point2D centroid((bounds.min_x + bounds.max_x) / 2.0, 
-                        (bounds.min_y + bounds.max_y) / 2.0);
+        CandidateRecord& candidate = candidate_records_[i];
+        candidate.bounds = record->geometry->getBounds();
+        candidate.centroid = Point2D((candidate.bounds.min_x + candidate.bounds.max_x) / 2.0, 
+                                     (candidate.bounds.min_y + candidate.bounds.max_y) / 2.0);
         
-        double distance = calculateDistance(point, centroid);
+        // Extract state name from NAME_1 field (primary state name)
+        std::string_view state_name = recordAttribute(i, "NAME_1");
+        if (state_name.empty()) continue;
         
-        if (distance <= max_distance && distance < min_distance) {
-            min_distance = distance;
-            
-            // Extract state name from GADM data (NAME_1 field)
-            std::string address_str = extractAddressFromRecord(*record, "NAME_1");
-            
-            if (!address_str.empty()) {
-                ParsedAddress parsed;
-                parsed.state = address_str;
-                parsed.full_address = address_str;
-                
-                best_result = GeocodeResult(centroid, parsed, 1.0 - (distance / max_distance));
-                best_result.match_type = "reverse";
-            }
+        candidate.name_id = intern(state_name);
+        
+        // County (or equivalent) name in level-2 data
+        std::string_view place_name = recordAttribute(i, "NAME_2");
+        if (!place_name.empty()) {
+            candidate.place_id = intern(place_name);
+        }
+    }
+    
+    // Invert record -> names into name -> records
+    name_record_offsets_.assign(candidate_names_.size() + 1, 0);
+    for (const CandidateRecord& candidate : candidate_records_) {
+        if (candidate.name_id != kNoName) ++name_record_offsets_[candidate.name_id + 1];
+        if (candidate.place_id != kNoName && candidate.place_id != candidate.name_id) {
+            ++name_record_offsets_[candidate.place_id + 1];
+        }
+    }
+    for (size_t n = 0; n < candidate_names_.size(); ++n) {
+        name_record_offsets_[n + 1] += name_record_offsets_[n];
+    }
+    
+    name_records_.assign(name_record_offsets_.back(), 0);
+    std::vector<uint32_t> fill(name_record_offsets_.begin(), name_record_offsets_.end() - 1);
+    for (size_t i = 0; i < candidate_records_.size(); ++i) {
+        const CandidateRecord& candidate = candidate_records_[i];
+        if (candidate.name_id != kNoName) {
+            name_records_[fill[candidate.name_id]++] = static_cast<uint32_t>(i);
+        }
+        if (candidate.place_id != kNoName && candidate.place_id != candidate.name_id) {
+            name_records_[fill[candidate.place_id]++] = static_cast<uint32_t>(i);
+        }
+    }
+    
+    std::vector<std::string> normalized_names;
+    normalized_names.reserve(candidate_names_.size());
+    for (const CandidateName& name : candidate_names_) {
+        normalized_names.push_back(name.normalized);
+    }
+    fuzzy_index_.build(std::move(normalized_names));
+}
+
+void Geocoder::buildHierarchy() {
+    // Views into the attribute tables' string pools
+    std::vector<std::string_view> gids(address_data_.size());
+    for (size_t i = 0; i < address_data_.size(); ++i) {
+        if (address_data_[i]) {
+            candidate_records_[i].level = administrativeLevel(i, &gids[i]);
+        }
+    }
+    
+    // Link each unit to the unit one level up with the matching GID
+    std::vector<std::unordered_map<std::string_view, uint32_t>> units_by_gid(kMaxAdminLevels);
+    for (size_t i = 0; i < gids.size(); ++i) {
+        if (!gids[i].empty()) {
+            units_by_gid[candidate_records_[i].level].emplace(gids[i], static_cast<uint32_t>(i));
+        }
+    }
+    
+    hierarchical_ = false;
+    num_levels_ = 0;
+    for (const auto& units : units_by_gid) {
+        if (!units.empty()) ++num_levels_;
+    }
+    
+    child_offsets_.assign(address_data_.size() + 1, 0);
+    for (size_t i = 0; i < address_data_.size(); ++i) {
+        CandidateRecord& candidate = candidate_records_[i];
+        if (!address_data_[i] || candidate.level == 0 || gids[i].empty()) continue;
+        
+        uint32_t parent_level = candidate.level - 1;
+        std::string_view parent_gid = recordAttribute(i, "GID_" + std::to_string(parent_level));
+        auto parent_it = units_by_gid[parent_level].find(parent_gid);
+        if (parent_it != units_by_gid[parent_level].end()) {
+            candidate.parent = parent_it->second;
+            ++child_offsets_[candidate.parent + 1];
+            hierarchical_ = true;
+        }
+    }
+    for (size_t i = 0; i < address_data_.size(); ++i) {
+        child_offsets_[i + 1] += child_offsets_[i];
+    }
+    
+    children_.assign(child_offsets_.back(), 0);
+    roots_.clear();
+    std::vector<uint32_t> fill(child_offsets_.begin(), child_offsets_.end() - 1);
+    for (size_t i = 0; i < address_data_.size(); ++i) {
+        uint32_t parent = candidate_records_[i].parent;
+        if (parent != kNoRecord) {
+            children_[fill[parent]++] = static_cast<uint32_t>(i);
+        } else if (address_data_[i] && address_data_[i]->geometry) {
+            roots_.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+uint32_t Geocoder::administrativeLevel(size_t record, std::string_view* gid) const {
+    // Deepest GID_<n> the record carries
+    for (uint32_t level = kMaxAdminLevels; level-- > 0;) {
+        std::string_view value = recordAttribute(record, "GID_" + std::to_string(level));
+        if (!value.empty()) {
+            if (gid) *gid = value;
+            return level;
         }
     }
+    return 0;
+}
+
+void Geocoder::buildCentroidIndex() {
+    std::vector<BoundingBox> points(address_data_.size(), BoundingBox::empty());
+    
+    for (size_t i = 0; i < candidate_records_.size(); ++i) {
+        const CandidateRecord& candidate = candidate_records_[i];
+        
+        // Only records that can produce an answer; in a hierarchy only the
+        // finest units, so the fallback is as specific as a polygon hit
+        bool has_children = child_offsets_[i + 1] > child_offsets_[i];
+        if (candidate.name_id == kNoName || has_children) continue;
+        
+        points[i] = BoundingBox(candidate.centroid.x, candidate.centroid.y,
+                                candidate.centroid.x, candidate.centroid.y);
+    }
     
-    return best_result;
+    centroid_index_.bulkLoad(points);
+    centroid_index_.freeze();
 }
 
 void Geocoder::buildIndex() {
@@ -321,106 +871,275 @@ void Geocoder::buildIndex() {
     index_.city_index.clear();
     index_.zip_index.clear();
     
-    // Build unified state index optimized for GADM administrative boundary data
-    for (size_t i = 0; i < address_data_.size(); ++i) {
-        const auto& record = address_data_[i];
-        if (!record) continue;
+    // Build unified state index optimized for GADM administrative boundary data:
+    // original name for exact matching, normalized name for fuzzy matching and
+    // the standard US state abbreviation
+    for (size_t i = 0; i < candidate_records_.size(); ++i) {
+        uint32_t name_id = candidate_records_[i].name_id;
+        if (name_id == kNoName) continue;
         
-        // Extract state name from NAME_1 field (primary state name)
-        std::string state_name = extractAddressFromRecord(*record, "NAME_1");
-        if (!state_name.empty()) {
-            // Index by normalized state name for fuzzy matching
-            std::string normalized_state = parser_.normalize(state_name);
-            index_.city_index[normalized_state].push_back(i);
-            
-            // Also index the original case for exact matching
-            index_.city_index[state_name].push_back(i);
+        const CandidateName& name = candidate_names_[name_id];
+        index_.city_index[name.normalized].push_back(i);
+        if (name.name != name.normalized) {
+            index_.city_index[name.name].push_back(i);
         }
-        
-        // Index all standard US state abbreviations for this record
-        if (!state_name.empty()) {
-            // Find matching state abbreviation and index it
-            for (const auto& abbrev_pair : parser_.getStateAbbreviations()) {
-                if (abbrev_pair.second == parser_.normalize(state_name)) {
-                    index_.city_index[abbrev_pair.first].push_back(i);
-                    break;
-                }
-            }
+        if (!name.abbreviation.empty()) {
+            index_.city_index[name.abbreviation].push_back(i);
         }
     }
 }
 
-std::vector<GeocodeResult> Geocoder::findCandidates(const ParsedAddress& parsed_address) const {
-    std::vector<GeocodeResult> candidates;
-    std::vector<size_t> candidate_indices;
-    
+GeocodeResult Geocoder::findBestCandidate(const ParsedAddress& parsed_address) const {
     // Unified state-only lookup strategy using single index
-    std::string search_term = parsed_address.state.empty() ? 
-                             parsed_address.full_address : parsed_address.state;
+    const std::string& search_term = parsed_address.state.empty() ? 
+                                     parsed_address.full_address : parsed_address.state;
     
-    if (!search_term.empty()) {
-        // Strategy 1: Direct exact match
-        auto exact_it = index_.city_index.find(search_term);
-        if (exact_it != index_.city_index.end()) {
-            candidate_indices.insert(candidate_indices.end(), 
-                                    exact_it->second.begin(), exact_it->second.end());
+    CandidateMatch match = matchName(search_term);
+    if (match.record == SIZE_MAX) {
+        return GeocodeResult();
+    }
+    return makeResult(match, match.exact ? "exact" : "fuzzy");
+}
+
+Geocoder::CandidateMatch Geocoder::matchName(const std::string& search_term) const {
+    if (search_term.empty()) {
+        return CandidateMatch();
+    }
+    
+    // Per-thread buffer, so normalizing the query does not allocate
+    thread_local std::string normalized_term;
+    parser_.normalize(search_term, normalized_term);
+    
+    // Strategy 1: direct exact match, 2: normalized match,
+    // 3: state abbreviation expansion (if 2-letter code)
+    const std::vector<size_t>* lists[3] = {nullptr, nullptr, nullptr};
+    auto exact_it = index_.city_index.find(search_term);
+    if (exact_it != index_.city_index.end()) {
+        lists[0] = &exact_it->second;
+    }
+    auto normalized_it = index_.city_index.find(normalized_term);
+    if (normalized_it != index_.city_index.end()) {
+        lists[1] = &normalized_it->second;
+    }
+    if (search_term.length() == 2) {
+        if (const std::string* state_name = parser_.findStateName(normalized_term)) {
+            auto expanded_it = index_.city_index.find(*state_name);
+            if (expanded_it != index_.city_index.end()) {
+                lists[2] = &expanded_it->second;
+            }
         }
-        
-        // Strategy 2: Normalized match
-        std::string normalized_term = parser_.normalize(search_term);
-        auto normalized_it = index_.city_index.find(normalized_term);
-        if (normalized_it != index_.city_index.end()) {
-            candidate_indices.insert(candidate_indices.end(), 
-                                    normalized_it->second.begin(), normalized_it->second.end());
+    }
+    
+    // Highest confidence wins, ties go to the first record. Records sharing a
+    // name share a confidence, so it is computed once per run of equal names.
+    size_t best_index = SIZE_MAX;
+    double best_confidence = 0.3;  // Minimum confidence threshold
+    uint32_t last_name_id = kNoName;
+    double last_confidence = 0.0;
+    
+    for (const std::vector<size_t>* list : lists) {
+        if (!list) continue;
+        for (size_t idx : *list) {
+            uint32_t name_id = candidate_records_[idx].name_id;
+            if (name_id != last_name_id) {
+                last_name_id = name_id;
+                last_confidence = calculateStateConfidence(search_term, normalized_term,
+                                                           candidate_names_[name_id]);
+            }
+            if (last_confidence > best_confidence ||
+                (last_confidence == best_confidence && best_index != SIZE_MAX && idx < best_index)) {
+                best_confidence = last_confidence;
+                best_index = idx;
+            }
         }
+    }
+    
+    if (best_index == SIZE_MAX) {
+        // Nothing under any exact spelling, so look for a misspelling
+        return matchFuzzy(normalized_term);
+    }
+    
+    CandidateMatch match;
+    match.record = best_index;
+    match.confidence = best_confidence;
+    match.exact = best_confidence > 0.9;
+    return match;
+}
+
+Geocoder::CandidateMatch Geocoder::matchFuzzy(const std::string& normalized_term) const {
+    size_t max_edits = maxEditsFor(normalized_term.size());
+    if (max_edits == 0) {
+        return CandidateMatch();
+    }
+    
+    StageTimer refine(QueryStage::Refine);
+    size_t best_index = SIZE_MAX;
+    uint32_t best_name = kNoName;
+    uint32_t best_distance = 0;
+    double best_confidence = 0.3;  // Minimum confidence threshold
+    
+    for (const TrigramIndex::Match& match : fuzzy_index_.search(normalized_term, max_edits)) {
+        size_t length = std::max(normalized_term.size(), fuzzy_index_.getName(match.id).size());
+        double confidence = 1.0 - static_cast<double>(match.distance) / static_cast<double>(length);
+        
+        // Records are ascending; the first one naming a state wins over
+        // counties of the same name, otherwise the first county
+        uint32_t begin = name_record_offsets_[match.id];
+        uint32_t end = name_record_offsets_[match.id + 1];
+        if (begin == end) continue;
         
-        // Strategy 3: State abbreviation expansion (if 2-letter code)
-        if (search_term.length() == 2) {
-            const auto& abbrevs = parser_.getStateAbbreviations();
-            auto abbrev_it = abbrevs.find(parser_.normalize(search_term));
-            if (abbrev_it != abbrevs.end()) {
-                auto expanded_it = index_.city_index.find(abbrev_it->second);
-                if (expanded_it != index_.city_index.end()) {
-                    candidate_indices.insert(candidate_indices.end(), 
-                                            expanded_it->second.begin(), expanded_it->second.end());
-                }
+        size_t idx = name_records_[begin];
+        for (uint32_t r = begin; r < end; ++r) {
+            if (candidate_records_[name_records_[r]].name_id == match.id) {
+                idx = name_records_[r];
+                break;
             }
         }
+        
+        if (confidence > best_confidence ||
+            (confidence == best_confidence && best_index != SIZE_MAX && idx < best_index)) {
+            best_confidence = confidence;
+            best_index = idx;
+            best_name = match.id;
+            best_distance = match.distance;
+        }
     }
     
-    // Remove duplicates and sort
-    std::sort(candidate_indices.begin(), candidate_indices.end());
-    candidate_indices.erase(std::unique(candidate_indices.begin(), candidate_indices.end()), 
-                           candidate_indices.end());
+    CandidateMatch match;
+    if (best_index != SIZE_MAX) {
+        match.record = best_index;
+        match.matched_name = best_name;
+        match.confidence = best_confidence;
+        match.exact = best_distance == 0;
+    }
+    return match;
+}
+
+GeocodeResult Geocoder::geocodeHierarchical(const std::string& address, const ParsedAddress& parsed) const {
+    // "<place>, <scope>", or a place followed by a state code without a comma
+    std::string place;
+    std::string scope;
+    size_t comma = address.rfind(',');
+    if (comma != std::string::npos) {
+        parser_.normalize(std::string_view(address).substr(0, comma), place);
+        parser_.normalize(std::string_view(address).substr(comma + 1), scope);
+    } else if (!parsed.state.empty() && !parsed.street_name.empty()) {
+        place = parsed.street_name;
+        scope = parsed.state;
+    }
+    if (place.empty() || scope.empty()) {
+        return GeocodeResult();
+    }
     
-    // Evaluate candidates with simplified state-focused confidence calculation
-    for (size_t idx : candidate_indices) {
-        if (idx >= address_data_.size() || !address_data_[idx] || !address_data_[idx]->geometry) {
-            continue;
+    CandidateMatch scope_match = matchName(scope);
+    if (scope_match.record == SIZE_MAX) {
+        return GeocodeResult();
+    }
+    
+    // The lookup may land on any unit carrying the state name; climb to the
+    // state itself, whose children are the counties to search
+    size_t unit = scope_match.record;
+    while (candidate_records_[unit].parent != kNoRecord &&
+           candidate_records_[candidate_records_[unit].parent].name_id == candidate_records_[unit].name_id) {
+        unit = candidate_records_[unit].parent;
+    }
+    
+    CandidateMatch match = matchChild(unit, place);
+    if (match.record == SIZE_MAX) {
+        // GADM names leave out the unit type ("Harris", not "Harris County")
+        static const char* const kUnitSuffixes[] = {" COUNTY", " PARISH", " BOROUGH", " CENSUS AREA"};
+        for (const char* suffix : kUnitSuffixes) {
+            std::string_view tail(suffix);
+            if (place.size() > tail.size() && place.compare(place.size() - tail.size(), tail.size(), tail) == 0) {
+                match = matchChild(unit, place.substr(0, place.size() - tail.size()));
+                break;
+            }
         }
+    }
+    if (match.record == SIZE_MAX) {
+        return GeocodeResult();
+    }
+    match.confidence = std::min(match.confidence, scope_match.confidence);
+    match.exact = match.exact && scope_match.exact;
+    return makeResult(match, match.exact ? "exact" : "fuzzy");
+}
+
+Geocoder::CandidateMatch Geocoder::matchChild(size_t parent, const std::string& normalized_place) const {
+    StageTimer refine(QueryStage::Refine);
+    CandidateMatch best;
+    best.confidence = 0.3;  // Minimum confidence threshold
+    
+    EditDistanceMatcher matcher(normalized_place);
+    size_t max_edits = maxEditsFor(normalized_place.size());
+    
+    for (uint32_t c = child_offsets_[parent]; c < child_offsets_[parent + 1]; ++c) {
+        uint32_t child = children_[c];
+        uint32_t name_id = candidate_records_[child].ownName();
+        if (name_id == kNoName) continue;
         
-        const auto& record = address_data_[idx];
-        
-        // Create candidate address from GADM data
-        ParsedAddress candidate_address;
-        candidate_address.state = extractAddressFromRecord(*record, "NAME_1");
-        candidate_address.full_address = candidate_address.state;
+        const std::string& name = candidate_names_[name_id].normalized;
+        size_t distance = matcher.distance(name, max_edits);
+        if (distance > max_edits) continue;
         
-        // Simplified confidence calculation for state matching
-        double confidence = calculateStateConfidence(search_term, candidate_address.state);
+        double confidence = 1.0 - static_cast<double>(distance) /
+                                  static_cast<double>(std::max(normalized_place.size(), name.size()));
+        // Children are ascending, so the first of equals is kept
+        if (confidence > best.confidence) {
+            best.record = child;
+            best.matched_name = name_id;
+            best.confidence = confidence;
+            best.exact = distance == 0;
+        }
+    }
+    
+    if (best.record == SIZE_MAX) {
+        return CandidateMatch();
+    }
+    return best;
+}
+
+size_t Geocoder::findContainingUnit(const Point2D& point) const {
+    return findContainingUnit(point, roots_.data(), roots_.data() + roots_.size());
+}
+
+size_t Geocoder::findContainingUnit(const Point2D& point, const uint32_t* begin, const uint32_t* end) const {
+    // A unit's children tile it, so only leaf polygons are tested exactly:
+    // a parent is entered on its bbox alone and a containing child proves
+    // the parent contains the point as well
+    for (const uint32_t* it = begin; it != end; ++it) {
+        uint32_t unit = *it;
+        if (!candidate_records_[unit].bounds.contains(point)) continue;
         
-        if (confidence > 0.3) {  // Minimum confidence threshold
-            BoundingBox bounds = record->geometry->getBounds();
-            Point2D centroid((bounds.min_x + bounds.max_x) / 2.0, 
-                           (bounds.min_y + bounds.max_y) / 2.0);
-            
-            GeocodeResult result(centroid, candidate_address, confidence);
-            result.match_type = (confidence > 0.9) ? "exact" : "fuzzy";
-            candidates.push_back(result);
+        uint32_t first_child = child_offsets_[unit];
+        uint32_t last_child = child_offsets_[unit + 1];
+        if (first_child == last_child) {
+            if (spatial_index_.recordContains(unit, point)) {
+                return unit;
+            }
+        } else {
+            size_t found = findContainingUnit(point, children_.data() + first_child,
+                                              children_.data() + last_child);
+            if (found != SIZE_MAX) {
+                return found;
+            }
         }
     }
+    return SIZE_MAX;
+}
+
+GeocodeResult Geocoder::makeResult(const CandidateMatch& match, const std::string& match_type) const {
+    const CandidateRecord& record = candidate_records_[match.record];
+    
+    ParsedAddress parsed;
+    parsed.state = candidate_names_[record.name_id].name;
+    if (match.matched_name != kNoName && match.matched_name == record.place_id) {
+        parsed.city = candidate_names_[record.place_id].name;
+    }
+    parsed.full_address = parsed.city.empty() ? parsed.state : parsed.city + ", " + parsed.state;
     
-    return candidates;
+    GeocodeResult result(record.centroid, parsed, match.confidence);
+    result.match_type = match_type;
+    return result;
 }
 
 double Geocoder::calculateConfidence(const ParsedAddress& input, const ParsedAddress& candidate) const {
@@ -460,6 +1179,24 @@ double Geocoder::calculateStateConfidence(const std::string& input_state, const
     return similarity;
 }
 
+double Geocoder::calculateStateConfidence(const std::string& input_state, const std::string& normalized_input,
+                                          const CandidateName& candidate) const {
+    // Same rules as above, against the precomputed normalized name
+    if (input_state.empty() || candidate.name.empty()) {
+        return 0.0;
+    }
+    if (input_state == candidate.name || normalized_input == candidate.normalized) {
+        return 1.0;
+    }
+    if (input_state.length() == 2) {
+        const std::string* state_name = parser_.findStateName(normalized_input);
+        if (state_name && *state_name == candidate.normalized) {
+            return 1.0;
+        }
+    }
+    return jaroWinklerSimilarity(normalized_input, candidate.normalized);
+}
+
 double Geocoder::calculateDistance(const Point2D& p1, const Point2D& p2) const {
     // Simple Euclidean distance - in production, use proper geodesic distance
     double dx = p1.x - p2.x;
@@ -467,14 +1204,13 @@ double Geocoder::calculateDistance(const Point2D& p1, const Point2D& p2) const {
     return std::sqrt(dx * dx + dy * dy);
 }
 
-std::string Geocoder::extractAddressFromRecord(const ShapeRecord& record, const std::string& field_name) const {
-    auto it = record.attributes.find(field_name);
-    if (it != record.attributes.end()) {
-        if (std::holds_alternative<std::string>(it->second)) {
-            return std::get<std::string>(it->second);
-        }
+std::string_view Geocoder::recordAttribute(size_t record, std::string_view field_name) const {
+    if (record >= attribute_refs_.size()) {
+        return std::string_view();
     }
-    return "";
+    const AttributeRef& ref = attribute_refs_[record];
+    const AttributeTable& table = *attribute_tables_[ref.table];
+    return table.getString(ref.row, table.findField(field_name));
 }
 
 double Geocoder::jaroWinklerSimilarity(const std::string& s1, const std::string& s2) const {
@@ -494,33 +1230,7 @@ double Geocoder::jaroWinklerSimilarity(const std::string& s1, const std::string&
 }
 
 double Geocoder::levenshteinDistance(const std::string& s1, const std::string& s2) const {
-    size_t len1 = s1.length();
-    size_t len2 = s2.length();
-    
-    if (len1 == 0) return static_cast<double>(len2);
-    if (len2 == 0) return static_cast<double>(len1);
-    
-    std::vector<std::vector<size_t>> matrix(len1 + 1, std::vector<size_t>(len2 + 1));
-    
-    for (size_t i = 0; i <= len1; ++i) {
-        matrix[i][0] = i;
-    }
-    for (size_t j = 0; j <= len2; ++j) {
-        matrix[0][j] = j;
-    }
-    
-    for (size_t i = 1; i <= len1; ++i) {
-        for (size_t j = 1; j <= len2; ++j) {
-            size_t cost = (s1[i-1] == s2[j-1]) ? 0 : 1;
-            matrix[i][j] = std::min({
-                matrix[i-1][j] + 1,      // deletion
-                matrix[i][j-1] + 1,      // insertion
-                matrix[i-1][j-1] + cost  // substitution
-            });
-        }
-    }
-    
-    return static_cast<double>(matrix[len1][len2]);
+    return static_cast<double>(editDistance(s1, s2));
 }
 
 std::string Geocoder::getStats() const {
@@ -530,6 +1240,37 @@ std::string Geocoder::getStats() const {
     oss << "  Unified State Index Entries: " << index_.city_index.size() << "\n";
     oss << "  Street Index Entries: " << index_.street_index.size() << " (unused)\n";
     oss << "  Zip Index Entries: " << index_.zip_index.size() << " (unused)\n";
+    oss << "  Administrative Levels: " << num_levels_ << (hierarchical_ ? " (linked)" : "") << "\n";
+    oss << "  Fuzzy Index Names: " << fuzzy_index_.size() << " (" << fuzzy_index_.memoryUsage() << " bytes)\n";
+    size_t decoded_fields = 0;
+    size_t column_bytes = 0;
+    for (const auto& table : attribute_tables_) {
+        decoded_fields += table->getDecodedFieldCount();
+        column_bytes += table->memoryUsage();
+    }
+    oss << "  Attribute Tables: " << attribute_tables_.size() << " (" << decoded_fields
+        << " fields decoded, " << column_bytes << " bytes)\n";
+    auto cacheLine = [&oss](const char* name, const CacheStats& stats) {
+        uint64_t lookups = stats.hits + stats.misses;
+        oss << "  " << name << ": " << stats.entries << " of " << stats.capacity << " entries, " << stats.hits
+            << " hits / " << lookups << " lookups ("
+            << (lookups > 0 ? 100.0 * static_cast<double>(stats.hits) / lookups : 0.0) << "%)\n";
+    };
+    if (geocode_cache_) {
+        cacheLine("Geocode Cache", getGeocodeCacheStats());
+        cacheLine("Reverse Cache", getReverseCacheStats());
+    }
+    const CellGrid& grid = spatial_index_.getCellGrid();
+    if (!grid.isEmpty()) {
+        oss << "  Cell Grid: " << grid.getStats() << " (" << grid.memoryUsage() << " bytes)\n";
+    }
+    if (snapshot_.isOpen()) {
+        oss << "  Snapshot Mapped: " << snapshot_.size() << " bytes\n";
+    }
+    if (arena_.blockCount() > 0) {
+        oss << "  Dataset Arena: " << arena_.bytesUsed() << " of " << arena_.bytesReserved() << " bytes in "
+            << arena_.blockCount() << " blocks (" << arena_.allocationCount() << " allocations)\n";
+    }
     return oss.str();
 }
 
@@ -539,18 +1280,7 @@ GeocodeResult Geocoder::geocodeStateName(const std::string& query) const {
     parsed.state = query;
     parsed.full_address = query;
     
-    std::vector<GeocodeResult> candidates = findCandidates(parsed);
-    
-    if (!candidates.empty()) {
-        // Sort by confidence and return best match
-        std::sort(candidates.begin(), candidates.end(), 
-                  [](const GeocodeResult& a, const GeocodeResult& b) {
-                      return a.confidence_score > b.confidence_score;
-                  });
-        return candidates[0];
-    }
-    
-    return GeocodeResult(); // Empty result
+    return findBestCandidate(parsed);
 }
 
 } // namespace gis
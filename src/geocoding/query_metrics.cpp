@@ -0,0 +1,119 @@
+#include "gis/query_metrics.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace gis {
+
+namespace {
+
+thread_local QueryTrace* current_trace = nullptr;
+
+unsigned highestSetBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() : count_(0), sum_ns_(0) {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t nanoseconds) {
+    if (nanoseconds < kSubBuckets) {
+        return static_cast<size_t>(nanoseconds);
+    }
+    unsigned exponent = highestSetBit(nanoseconds);
+    if (exponent >= kMaxExponent) {
+        return kBucketCount - 1;
+    }
+    unsigned shift = exponent - kSubBucketBits;
+    size_t step = static_cast<size_t>(nanoseconds >> shift) - kSubBuckets;
+    return kSubBuckets + shift * kSubBuckets + step;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    size_t shift = (bucket - kSubBuckets) / kSubBuckets;
+    uint64_t step = (bucket - kSubBuckets) % kSubBuckets;
+    return ((kSubBuckets + step + 1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    // Buckets are read once each; samples recorded meanwhile may or may not count
+    std::array<uint64_t, kBucketCount> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    double clamped = std::min(1.0, std::max(0.0, fraction));
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return bucketUpperBound(i);
+        }
+    }
+    return bucketUpperBound(kBucketCount - 1);
+}
+
+const char* queryStageName(QueryStage stage) {
+    switch (stage) {
+        case QueryStage::Parse: return "parse";
+        case QueryStage::Index: return "index";
+        case QueryStage::Refine: return "refine";
+        case QueryStage::Serialize: return "serialize";
+    }
+    return "unknown";
+}
+
+QueryTrace::Scope::Scope(QueryTrace& trace) : previous_(current_trace) {
+    current_trace = &trace;
+}
+
+QueryTrace::Scope::~Scope() {
+    QueryTrace* trace = current_trace;
+    trace->switchTo(kNoStage);
+    current_trace = previous_;
+}
+
+QueryTrace* QueryTrace::current() {
+    return current_trace;
+}
+
+void QueryTrace::switchTo(int stage) {
+    if (stage == running_) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (running_ != kNoStage) {
+        stage_ns[running_] += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - mark_).count());
+    }
+    mark_ = now;
+    running_ = stage;
+    if (stage != kNoStage) {
+        stages_entered |= 1u << stage;
+    }
+}
+
+} // namespace gis
@@ -0,0 +1,867 @@
+#include "gis/snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace gis {
+
+namespace {
+
+const char kSnapshotMagic[8] = {'G', 'I', 'S', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t kSnapshotVersion = 4;
+const uint32_t kByteOrderMark = 0x01020304;
+const size_t kSectionAlignment = 16;
+
+enum SectionId : uint32_t {
+    kSources = 1,
+    kRecords,
+    kPoints,
+    kPartOffsets,
+    kPartBounds,
+    kBandOffsets,
+    kBandEdges,
+    kAttributeTables,
+    kAttributeData,
+    kAttributeRefs,
+    kTreeNodes,
+    kTreeMinX,
+    kTreeMinY,
+    kTreeMaxX,
+    kTreeMaxY,
+    kTreeRefs,
+    kObjectBounds,
+    kDetailLevels,
+    kLevelBandOffsets,
+    kLevelSegments,
+    kGridLayout,
+    kGridCells,
+    kGridCandidates,
+    kSectionCount = kGridCandidates
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;      // kByteOrderMark in the writer's byte order
+    uint32_t struct_sizes[4]; // Point2D, BoundingBox, PreparedPolygon::Edge, FlatRTree::Node
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t file_size;
+    uint64_t table_checksum;  // snapshotChecksum() of the section table
+};
+
+struct SectionEntry {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;          // From the start of the file
+    uint64_t size;
+    uint64_t checksum;        // snapshotChecksum() of the section bytes
+};
+
+// One per record; ranges index the shared arrays of the snapshot
+struct RecordEntry {
+    int32_t record_number;
+    int32_t shape_type;       // ShapeType, NullShape without geometry
+    uint32_t flags;
+    uint32_t part_count;
+    uint32_t index;           // ShapeRecord::index
+    uint32_t level_count;     // Detail levels, stored in record order
+    uint64_t point_begin;
+    uint64_t point_count;
+    uint64_t offset_begin;    // part_count + 1 entries, relative to point_begin
+    uint64_t bounds_begin;    // part_count entries
+    uint64_t band_begin;      // Prepared polygon: num_bands + 1 entries
+    uint64_t band_count;
+    uint64_t edge_begin;
+    uint64_t edge_count;
+    double band_scale;
+};
+
+// One per detail level of a prepared polygon, coarsest first
+struct LevelEntry {
+    double tolerance;
+    double band_scale;
+    uint64_t band_begin;      // num_bands + 1 entries
+    uint64_t band_count;
+    uint64_t segment_begin;
+    uint64_t segment_count;
+};
+
+// Layout of the cell grid; the grid layout section holds one, or none
+// when the index had no grid
+struct GridEntry {
+    BoundingBox bounds;
+    uint32_t columns;
+    uint32_t rows;
+};
+
+const uint32_t kRecordPresent = 1;
+const uint32_t kRecordPrepared = 2;
+
+// One per attribute table; a range of the attribute data section holding
+// the table's .dbf bytes as they were on disk (size 0 if it had none)
+struct TableEntry {
+    uint64_t offset;
+    uint64_t size;
+};
+
+static_assert(std::is_trivially_copyable<Point2D>::value, "Point2D is stored as raw bytes");
+static_assert(std::is_trivially_copyable<BoundingBox>::value, "BoundingBox is stored as raw bytes");
+static_assert(std::is_trivially_copyable<PreparedPolygon::Edge>::value, "Edge is stored as raw bytes");
+static_assert(std::is_trivially_copyable<PreparedPolygon::Segment>::value, "Segment is stored as raw bytes");
+static_assert(std::is_trivially_copyable<FlatRTree::Node>::value, "FlatRTree::Node is stored as raw bytes");
+static_assert(std::is_trivially_copyable<CellGrid::Cell>::value, "CellGrid::Cell is stored as raw bytes");
+static_assert(std::is_trivially_copyable<AttributeRef>::value, "AttributeRef is stored as raw bytes");
+
+inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t loadWord(const char* data) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+// Append-only byte stream for the variable-length sections
+class ByteWriter {
+private:
+    std::vector<char> bytes_;
+
+public:
+    template<typename T>
+    void put(const T& value) {
+        const char* raw = reinterpret_cast<const char*>(&value);
+        bytes_.insert(bytes_.end(), raw, raw + sizeof(T));
+    }
+
+    void putString(const std::string& value) {
+        put(static_cast<uint32_t>(value.size()));
+        bytes_.insert(bytes_.end(), value.begin(), value.end());
+    }
+
+    const std::vector<char>& bytes() const { return bytes_; }
+};
+
+// Bounds-checked reader over a ByteWriter stream; every get fails once the
+// stream runs out
+class ByteReader {
+private:
+    const char* data_;
+    const char* end_;
+
+public:
+    ByteReader(const char* data, size_t size) : data_(data), end_(data + size) {}
+
+    template<typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end_ - data_) < sizeof(T)) return false;
+        std::memcpy(&value, data_, sizeof(T));
+        data_ += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint32_t length = 0;
+        if (!get(length) || static_cast<size_t>(end_ - data_) < length) return false;
+        value.assign(data_, length);
+        data_ += length;
+        return true;
+    }
+};
+
+bool fileStamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+    std::error_code ec;
+    size = static_cast<uint64_t>(std::filesystem::file_size(path, ec));
+    if (ec) return false;
+    mtime = static_cast<int64_t>(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+    return !ec;
+}
+
+uint64_t fileHash(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) return 0;
+    file.adviseSequential();
+    return snapshotChecksum(file.data(), file.size());
+}
+
+// Shapefile paths are kept absolute so a snapshot still matches when the
+// same files are named relative to another working directory
+std::vector<std::string> absolutePaths(const std::vector<std::string>& paths) {
+    std::vector<std::string> absolute;
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        std::filesystem::path resolved = std::filesystem::absolute(path, ec);
+        absolute.push_back(ec ? path : resolved.lexically_normal().string());
+    }
+    return absolute;
+}
+
+std::vector<std::string> sourceFiles(const std::vector<std::string>& shapefiles) {
+    std::vector<std::string> files;
+    for (const std::string& shapefile : shapefiles) {
+        files.push_back(shapefile + ".shp");
+        files.push_back(shapefile + ".dbf");
+    }
+    return files;
+}
+
+// Streams sections to the file and collects the section table
+class SectionWriter {
+private:
+    std::ofstream& file_;
+    uint64_t offset_;
+    std::vector<SectionEntry> entries_;
+
+public:
+    SectionWriter(std::ofstream& file, uint64_t offset) : file_(file), offset_(offset) {}
+
+    void add(uint32_t id, const void* data, size_t size) {
+        static const char padding[kSectionAlignment] = {};
+        size_t pad = (kSectionAlignment - offset_ % kSectionAlignment) % kSectionAlignment;
+        file_.write(padding, static_cast<std::streamsize>(pad));
+        offset_ += pad;
+
+        const char* bytes = static_cast<const char*>(data);
+        entries_.push_back({id, 0, offset_, size, snapshotChecksum(bytes, size)});
+        file_.write(bytes, static_cast<std::streamsize>(size));
+        offset_ += size;
+    }
+
+    template<typename T>
+    void add(uint32_t id, const std::vector<T>& values) {
+        add(id, values.data(), values.size() * sizeof(T));
+    }
+
+    template<typename T>
+    void add(uint32_t id, const Buffer<T>& values) {
+        add(id, values.data(), values.size() * sizeof(T));
+    }
+
+    const std::vector<SectionEntry>& entries() const { return entries_; }
+    uint64_t size() const { return offset_; }
+};
+
+} // namespace
+
+uint64_t snapshotChecksum(const char* data, size_t size) {
+    constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+
+    auto round = [](uint64_t lane, uint64_t word) {
+        return rotateLeft(lane + word * kPrime2, 31) * kPrime1;
+    };
+
+    const char* end = data + size;
+    uint64_t hash;
+    if (size >= 32) {
+        // Independent lanes keep several multiplies in flight per block
+        uint64_t lane0 = kPrime1 + kPrime2;
+        uint64_t lane1 = kPrime2;
+        uint64_t lane2 = 0;
+        uint64_t lane3 = 0 - kPrime1;
+        for (; end - data >= 32; data += 32) {
+            lane0 = round(lane0, loadWord(data));
+            lane1 = round(lane1, loadWord(data + 8));
+            lane2 = round(lane2, loadWord(data + 16));
+            lane3 = round(lane3, loadWord(data + 24));
+        }
+        hash = rotateLeft(lane0, 1) + rotateLeft(lane1, 7) + rotateLeft(lane2, 12) + rotateLeft(lane3, 18);
+        for (uint64_t lane : {lane0, lane1, lane2, lane3}) {
+            hash = (hash ^ round(0, lane)) * kPrime1 + kPrime3;
+        }
+    } else {
+        hash = kPrime3;
+    }
+    hash += static_cast<uint64_t>(size);
+
+    for (; end - data >= 8; data += 8) {
+        hash = rotateLeft(hash ^ round(0, loadWord(data)), 27) * kPrime1 + kPrime3;
+    }
+    for (; data < end; ++data) {
+        hash = rotateLeft(hash ^ (static_cast<unsigned char>(*data) * kPrime3), 11) * kPrime1;
+    }
+
+    // Final avalanche so every input bit reaches every output bit
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+SourceStamp SourceStamp::capture(const std::string& path) {
+    SourceStamp stamp;
+    stamp.path = path;
+    if (fileStamp(path, stamp.size, stamp.mtime)) {
+        stamp.hash = fileHash(path);
+    }
+    return stamp;
+}
+
+bool SourceStamp::isCurrent() const {
+    uint64_t current_size = 0;
+    int64_t current_mtime = 0;
+    if (!fileStamp(path, current_size, current_mtime)) {
+        return size == 0 && mtime == 0 && hash == 0;  // Still missing
+    }
+    if (current_size != size) return false;
+    if (current_mtime == mtime) return true;
+
+    // Touched but possibly unchanged (copied, checked out again)
+    return fileHash(path) == hash;
+}
+
+bool IndexSnapshot::write(const std::string& path, const std::vector<std::string>& shapefiles,
+                          const std::vector<std::unique_ptr<ShapeRecord>>& records,
+                          const SpatialIndex& spatial_index,
+                          const std::vector<std::unique_ptr<AttributeTable>>& attribute_tables,
+                          const std::vector<AttributeRef>& attribute_refs) {
+    const std::vector<PreparedPolygon>& prepared = spatial_index.getPreparedPolygons();
+    const RTree& tree = spatial_index.getTree();
+    if (!tree.isFrozen() || prepared.size() != records.size() ||
+        tree.getObjectBounds().size() != records.size()) {
+        return false;  // Not an index built by buildIndex() over these records
+    }
+    if (attribute_refs.size() != records.size()) {
+        return false;
+    }
+
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Header and section table are filled in once the sections are written
+    const uint64_t table_offset = sizeof(FileHeader);
+    const uint64_t table_size = kSectionCount * sizeof(SectionEntry);
+    std::vector<char> placeholder(table_offset + table_size, 0);
+    file.write(placeholder.data(), static_cast<std::streamsize>(placeholder.size()));
+    SectionWriter sections(file, table_offset + table_size);
+
+    ByteWriter sources;
+    std::vector<std::string> absolute = absolutePaths(shapefiles);
+    sources.put(static_cast<uint32_t>(absolute.size()));
+    for (const std::string& shapefile : absolute) {
+        sources.putString(shapefile);
+    }
+    std::vector<std::string> files = sourceFiles(absolute);
+    sources.put(static_cast<uint32_t>(files.size()));
+    for (const std::string& source : files) {
+        SourceStamp stamp = SourceStamp::capture(source);
+        sources.putString(stamp.path);
+        sources.put(stamp.size);
+        sources.put(stamp.mtime);
+        sources.put(stamp.hash);
+    }
+    sections.add(kSources, sources.bytes());
+
+    // Record table first, then each shared array in its own pass so only
+    // one of them is held in memory at a time
+    std::vector<RecordEntry> entries(records.size());
+    uint64_t point_total = 0, offset_total = 0, bounds_total = 0, band_total = 0, edge_total = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        RecordEntry& entry = entries[i];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.shape_type = static_cast<int32_t>(ShapeType::NullShape);
+        if (!records[i]) continue;
+
+        const ShapeRecord& record = *records[i];
+        entry.flags = kRecordPresent;
+        entry.record_number = record.record_number;
+        entry.index = record.index;
+        if (!record.geometry) continue;
+
+        ShapeType type = record.geometry->getType();
+        entry.point_begin = point_total;
+        if (type == ShapeType::Point) {
+            entry.shape_type = static_cast<int32_t>(type);
+            entry.point_count = 1;
+        } else if (type == ShapeType::PolyLine || type == ShapeType::Polygon) {
+            const auto& multipart = static_cast<const MultiPartGeometry&>(*record.geometry);
+            entry.shape_type = static_cast<int32_t>(type);
+            entry.point_count = multipart.getPoints().size();
+            entry.part_count = static_cast<uint32_t>(multipart.getNumParts());
+            entry.offset_begin = offset_total;
+            entry.bounds_begin = bounds_total;
+            offset_total += entry.part_count + 1;
+            bounds_total += entry.part_count;
+
+            if (!prepared[i].isEmpty()) {
+                entry.flags |= kRecordPrepared;
+                entry.band_scale = prepared[i].getBandScale();
+                entry.band_begin = band_total;
+                entry.band_count = prepared[i].getBandOffsets().size();
+                entry.edge_begin = edge_total;
+                entry.edge_count = prepared[i].getBandEdges().size();
+                entry.level_count = static_cast<uint32_t>(prepared[i].getDetailLevels().size());
+                band_total += entry.band_count;
+                edge_total += entry.edge_count;
+            }
+        }
+        point_total += entry.point_count;
+    }
+    sections.add(kRecords, entries);
+
+    {
+        std::vector<Point2D> points;
+        points.reserve(point_total);
+        for (const auto& record : records) {
+            if (!record || !record->geometry) continue;
+            ShapeType type = record->geometry->getType();
+            if (type == ShapeType::Point) {
+                points.push_back(static_cast<const PointGeometry&>(*record->geometry).getPoint());
+            } else if (type == ShapeType::PolyLine || type == ShapeType::Polygon) {
+                const auto& multipart = static_cast<const MultiPartGeometry&>(*record->geometry);
+                points.insert(points.end(), multipart.getPoints().begin(), multipart.getPoints().end());
+            }
+        }
+        sections.add(kPoints, points);
+    }
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<BoundingBox> bounds;
+        offsets.reserve(offset_total);
+        bounds.reserve(bounds_total);
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (entries[i].shape_type == static_cast<int32_t>(ShapeType::PolyLine) ||
+                entries[i].shape_type == static_cast<int32_t>(ShapeType::Polygon)) {
+                const auto& multipart = static_cast<const MultiPartGeometry&>(*records[i]->geometry);
+                offsets.insert(offsets.end(), multipart.getPartOffsets().begin(), multipart.getPartOffsets().end());
+                bounds.insert(bounds.end(), multipart.getAllPartBounds().begin(), multipart.getAllPartBounds().end());
+            }
+        }
+        sections.add(kPartOffsets, offsets);
+        sections.add(kPartBounds, bounds);
+    }
+    {
+        std::vector<uint32_t> band_offsets;
+        std::vector<PreparedPolygon::Edge> band_edges;
+        band_offsets.reserve(band_total);
+        band_edges.reserve(edge_total);
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (entries[i].flags & kRecordPrepared) {
+                const PreparedPolygon& polygon = prepared[i];
+                band_offsets.insert(band_offsets.end(), polygon.getBandOffsets().begin(), polygon.getBandOffsets().end());
+                band_edges.insert(band_edges.end(), polygon.getBandEdges().begin(), polygon.getBandEdges().end());
+            }
+        }
+        sections.add(kBandOffsets, band_offsets);
+        sections.add(kBandEdges, band_edges);
+    }
+
+    // Attribute tables keep their .dbf bytes verbatim and decode lazily
+    // over the mapping once restored
+    {
+        std::vector<TableEntry> tables;
+        uint64_t data_size = 0;
+        for (const auto& table : attribute_tables) {
+            uint64_t size = table && table->isOpen() ? table->size() : 0;
+            tables.push_back({data_size, size});
+            data_size += size;
+        }
+        sections.add(kAttributeTables, tables);
+
+        std::vector<char> data;
+        data.reserve(data_size);
+        for (const auto& table : attribute_tables) {
+            if (table && table->isOpen()) {
+                data.insert(data.end(), table->data(), table->data() + table->size());
+            }
+        }
+        sections.add(kAttributeData, data);
+        sections.add(kAttributeRefs, attribute_refs);
+    }
+
+    const FlatRTree& flat = tree.getFlatTree();
+    sections.add(kTreeNodes, flat.nodes);
+    sections.add(kTreeMinX, flat.min_x);
+    sections.add(kTreeMinY, flat.min_y);
+    sections.add(kTreeMaxX, flat.max_x);
+    sections.add(kTreeMaxY, flat.max_y);
+    sections.add(kTreeRefs, flat.refs);
+    sections.add(kObjectBounds, tree.getObjectBounds());
+
+    {
+        std::vector<LevelEntry> levels;
+        std::vector<uint32_t> band_offsets;
+        std::vector<PreparedPolygon::Segment> segments;
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (!(entries[i].flags & kRecordPrepared)) continue;
+            for (const auto& level : prepared[i].getDetailLevels()) {
+                levels.push_back({level.tolerance, level.band_scale, band_offsets.size(), level.band_offsets.size(),
+                                  segments.size(), level.band_segments.size()});
+                band_offsets.insert(band_offsets.end(), level.band_offsets.begin(), level.band_offsets.end());
+                segments.insert(segments.end(), level.band_segments.begin(), level.band_segments.end());
+            }
+        }
+        sections.add(kDetailLevels, levels);
+        sections.add(kLevelBandOffsets, band_offsets);
+        sections.add(kLevelSegments, segments);
+    }
+
+    const CellGrid& grid = spatial_index.getCellGrid();
+    std::vector<GridEntry> grid_layout;
+    if (!grid.isEmpty()) {
+        grid_layout.push_back({grid.getBounds(), grid.getColumns(), grid.getRows()});
+    }
+    sections.add(kGridLayout, grid_layout);
+    sections.add(kGridCells, grid.getCells());
+    sections.add(kGridCandidates, grid.getCandidates());
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.byte_order = kByteOrderMark;
+    header.struct_sizes[0] = sizeof(Point2D);
+    header.struct_sizes[1] = sizeof(BoundingBox);
+    header.struct_sizes[2] = sizeof(PreparedPolygon::Edge);
+    header.struct_sizes[3] = sizeof(FlatRTree::Node);
+    header.section_count = static_cast<uint32_t>(sections.entries().size());
+    header.file_size = sections.size();
+    header.table_checksum = snapshotChecksum(reinterpret_cast<const char*>(sections.entries().data()),
+                                             sections.entries().size() * sizeof(SectionEntry));
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(sections.entries().data()),
+               static_cast<std::streamsize>(sections.entries().size() * sizeof(SectionEntry)));
+    file.close();
+    if (!file) {
+        std::filesystem::remove(temp_path);
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool IndexSnapshot::open(const std::string& path) {
+    close();
+    if (!file_.open(path)) {
+        return false;
+    }
+
+    FileHeader header;
+    bool valid = file_.size() >= sizeof(FileHeader);
+    if (valid) {
+        std::memcpy(&header, file_.data(), sizeof(header));
+        valid = std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) == 0 &&
+                header.version == kSnapshotVersion &&
+                header.byte_order == kByteOrderMark &&
+                header.struct_sizes[0] == sizeof(Point2D) &&
+                header.struct_sizes[1] == sizeof(BoundingBox) &&
+                header.struct_sizes[2] == sizeof(PreparedPolygon::Edge) &&
+                header.struct_sizes[3] == sizeof(FlatRTree::Node) &&
+                header.section_count == kSectionCount &&
+                header.file_size == file_.size() &&
+                file_.size() >= sizeof(FileHeader) + kSectionCount * sizeof(SectionEntry);
+    }
+    if (!valid) {
+        std::cerr << "Not a compatible snapshot: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    const char* table = file_.data() + sizeof(FileHeader);
+    if (snapshotChecksum(table, kSectionCount * sizeof(SectionEntry)) != header.table_checksum) {
+        valid = false;
+    }
+    for (uint32_t i = 0; valid && i < kSectionCount; ++i) {
+        SectionEntry entry;
+        std::memcpy(&entry, table + i * sizeof(SectionEntry), sizeof(entry));
+        valid = entry.id == i + 1 && entry.offset % kSectionAlignment == 0 &&
+                entry.offset <= file_.size() && entry.size <= file_.size() - entry.offset;
+    }
+    
+    // The bulk sections are verified by restore(), so checking a stale
+    // snapshot against its sources does not read the whole file
+    valid = valid && verifySection(kSources);
+
+    size_t sources_size = 0;
+    const char* sources = valid ? section(kSources, 1, 1, sources_size) : nullptr;
+    if (sources) {
+        ByteReader reader(sources, sources_size);
+        uint32_t count = 0;
+        valid = reader.get(count);
+        shapefiles_.resize(valid ? count : 0);
+        for (std::string& shapefile : shapefiles_) {
+            valid = valid && reader.getString(shapefile);
+        }
+        valid = valid && reader.get(count);
+        sources_.resize(valid ? count : 0);
+        for (SourceStamp& stamp : sources_) {
+            valid = valid && reader.getString(stamp.path) && reader.get(stamp.size) &&
+                    reader.get(stamp.mtime) && reader.get(stamp.hash);
+        }
+    }
+
+    if (!valid) {
+        std::cerr << "Corrupt snapshot: " << path << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void IndexSnapshot::close() {
+    file_.close();
+    shapefiles_.clear();
+    sources_.clear();
+}
+
+bool IndexSnapshot::verifySection(uint32_t id) const {
+    SectionEntry entry;
+    std::memcpy(&entry, file_.data() + sizeof(FileHeader) + (id - 1) * sizeof(SectionEntry), sizeof(entry));
+    return snapshotChecksum(file_.data() + entry.offset, entry.size) == entry.checksum;
+}
+
+const char* IndexSnapshot::section(uint32_t id, size_t alignment, size_t element_size, size_t& count) const {
+    count = 0;
+    if (!file_.isOpen() || id == 0 || id > kSectionCount) return nullptr;
+
+    SectionEntry entry;
+    std::memcpy(&entry, file_.data() + sizeof(FileHeader) + (id - 1) * sizeof(SectionEntry), sizeof(entry));
+    if (entry.offset % alignment != 0 || entry.size % element_size != 0) return nullptr;
+
+    count = entry.size / element_size;
+    return file_.data() + entry.offset;
+}
+
+bool IndexSnapshot::matchesSources(const std::vector<std::string>& shapefiles) const {
+    std::vector<std::string> absolute = absolutePaths(shapefiles);
+    if (!file_.isOpen() || absolute != shapefiles_ || sources_.size() != 2 * absolute.size()) {
+        return false;
+    }
+    std::vector<std::string> files = sourceFiles(absolute);
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        if (sources_[i].path != files[i] || !sources_[i].isCurrent()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IndexSnapshot::restore(std::vector<std::unique_ptr<ShapeRecord>>& records, SpatialIndex& spatial_index,
+                            std::vector<std::unique_ptr<AttributeTable>>& attribute_tables,
+                            std::vector<AttributeRef>& attribute_refs) const {
+    records.clear();
+    attribute_tables.clear();
+    attribute_refs.clear();
+    if (!file_.isOpen()) {
+        return false;
+    }
+    for (uint32_t id = 1; id <= kSectionCount; ++id) {
+        if (id != kSources && !verifySection(id)) {
+            std::cerr << "Snapshot checksum mismatch in section " << id << std::endl;
+            return false;
+        }
+    }
+
+    size_t record_count = 0, point_count = 0, offset_count = 0, bounds_count = 0, band_count = 0, edge_count = 0;
+    const auto* entries = reinterpret_cast<const RecordEntry*>(
+        section(kRecords, alignof(RecordEntry), sizeof(RecordEntry), record_count));
+    const auto* points = reinterpret_cast<const Point2D*>(
+        section(kPoints, alignof(Point2D), sizeof(Point2D), point_count));
+    const auto* offsets = reinterpret_cast<const uint32_t*>(
+        section(kPartOffsets, alignof(uint32_t), sizeof(uint32_t), offset_count));
+    const auto* part_bounds = reinterpret_cast<const BoundingBox*>(
+        section(kPartBounds, alignof(BoundingBox), sizeof(BoundingBox), bounds_count));
+    const auto* band_offsets = reinterpret_cast<const uint32_t*>(
+        section(kBandOffsets, alignof(uint32_t), sizeof(uint32_t), band_count));
+    const auto* band_edges = reinterpret_cast<const PreparedPolygon::Edge*>(
+        section(kBandEdges, alignof(PreparedPolygon::Edge), sizeof(PreparedPolygon::Edge), edge_count));
+    size_t level_count = 0, level_band_count = 0, segment_count = 0;
+    const auto* levels = reinterpret_cast<const LevelEntry*>(
+        section(kDetailLevels, alignof(LevelEntry), sizeof(LevelEntry), level_count));
+    const auto* level_bands = reinterpret_cast<const uint32_t*>(
+        section(kLevelBandOffsets, alignof(uint32_t), sizeof(uint32_t), level_band_count));
+    const auto* segments = reinterpret_cast<const PreparedPolygon::Segment*>(
+        section(kLevelSegments, alignof(PreparedPolygon::Segment), sizeof(PreparedPolygon::Segment), segment_count));
+    if (!entries || !points || !offsets || !part_bounds || !band_offsets || !band_edges ||
+        !levels || !level_bands || !segments) {
+        return false;
+    }
+
+    auto inRange = [](uint64_t begin, uint64_t count, size_t total) {
+        return begin <= total && count <= total - begin;
+    };
+
+    // Band offsets must run from 0 to the item count without going back
+    auto validBands = [](const uint32_t* bands, uint64_t count, uint64_t items) {
+        if (count < 2 || bands[0] != 0 || bands[count - 1] != items) return false;
+        for (uint64_t b = 0; b + 1 < count; ++b) {
+            if (bands[b] > bands[b + 1]) return false;
+        }
+        return true;
+    };
+    size_t next_level = 0;
+
+    std::vector<PreparedPolygon> prepared(record_count);
+    records.resize(record_count);
+    for (size_t i = 0; i < record_count; ++i) {
+        const RecordEntry& entry = entries[i];
+        if (!(entry.flags & kRecordPresent)) continue;
+
+        auto record = std::make_unique<ShapeRecord>();
+        record->record_number = entry.record_number;
+        record->index = entry.index;
+
+        ShapeType type = static_cast<ShapeType>(entry.shape_type);
+        if (!inRange(entry.point_begin, entry.point_count, point_count)) return false;
+        if (type == ShapeType::Point) {
+            if (entry.point_count != 1) return false;
+            record->geometry = std::make_unique<PointGeometry>(points[entry.point_begin]);
+        } else if (type == ShapeType::PolyLine || type == ShapeType::Polygon) {
+            if (!inRange(entry.offset_begin, uint64_t(entry.part_count) + 1, offset_count) ||
+                !inRange(entry.bounds_begin, entry.part_count, bounds_count)) {
+                return false;
+            }
+
+            // Part offsets must run from 0 to the point count without going back
+            const uint32_t* part = offsets + entry.offset_begin;
+            if (part[0] != 0 || part[entry.part_count] != entry.point_count) return false;
+            for (uint32_t p = 0; p < entry.part_count; ++p) {
+                if (part[p] > part[p + 1]) return false;
+            }
+
+            auto coordinates = Buffer<Point2D>::borrow(points + entry.point_begin, entry.point_count);
+            auto part_offsets = Buffer<uint32_t>::borrow(part, entry.part_count + 1);
+            auto bounds = Buffer<BoundingBox>::borrow(part_bounds + entry.bounds_begin, entry.part_count);
+            if (type == ShapeType::PolyLine) {
+                record->geometry = std::make_unique<PolylineGeometry>(
+                    std::move(coordinates), std::move(part_offsets), std::move(bounds));
+            } else {
+                record->geometry = std::make_unique<PolygonGeometry>(
+                    std::move(coordinates), std::move(part_offsets), std::move(bounds));
+            }
+        } else if (type != ShapeType::NullShape) {
+            return false;
+        }
+
+        if (entry.flags & kRecordPrepared) {
+            if (type != ShapeType::Polygon ||
+                !inRange(entry.band_begin, entry.band_count, band_count) ||
+                !inRange(entry.edge_begin, entry.edge_count, edge_count) ||
+                !inRange(next_level, entry.level_count, level_count)) {
+                return false;
+            }
+
+            // Band lists must stay inside the record's edges, and edges inside its points
+            const uint32_t* bands = band_offsets + entry.band_begin;
+            if (!validBands(bands, entry.band_count, entry.edge_count)) return false;
+            const PreparedPolygon::Edge* edges = band_edges + entry.edge_begin;
+            for (uint64_t e = 0; e < entry.edge_count; ++e) {
+                if (edges[e].from >= entry.point_count || edges[e].to >= entry.point_count) return false;
+            }
+
+            std::vector<PreparedPolygon::DetailLevel> detail(entry.level_count);
+            for (PreparedPolygon::DetailLevel& level : detail) {
+                const LevelEntry& stored = levels[next_level++];
+                if (!inRange(stored.band_begin, stored.band_count, level_band_count) ||
+                    !inRange(stored.segment_begin, stored.segment_count, segment_count) ||
+                    !validBands(level_bands + stored.band_begin, stored.band_count, stored.segment_count)) {
+                    return false;
+                }
+                level.tolerance = stored.tolerance;
+                level.band_scale = stored.band_scale;
+                level.band_offsets = Buffer<uint32_t>::borrow(level_bands + stored.band_begin, stored.band_count);
+                level.band_segments = Buffer<PreparedPolygon::Segment>::borrow(segments + stored.segment_begin,
+                                                                               stored.segment_count);
+            }
+
+            prepared[i] = PreparedPolygon(static_cast<const PolygonGeometry&>(*record->geometry), entry.band_scale,
+                                          Buffer<uint32_t>::borrow(bands, entry.band_count),
+                                          Buffer<PreparedPolygon::Edge>::borrow(edges, entry.edge_count),
+                                          std::move(detail));
+        }
+
+        records[i] = std::move(record);
+    }
+
+    size_t table_count = 0, data_size = 0, attribute_ref_count = 0;
+    const auto* tables = reinterpret_cast<const TableEntry*>(
+        section(kAttributeTables, alignof(TableEntry), sizeof(TableEntry), table_count));
+    const char* attribute_data = section(kAttributeData, 1, 1, data_size);
+    const auto* refs_data = reinterpret_cast<const AttributeRef*>(
+        section(kAttributeRefs, alignof(AttributeRef), sizeof(AttributeRef), attribute_ref_count));
+    if (!tables || !attribute_data || !refs_data || attribute_ref_count != record_count) {
+        return false;
+    }
+    for (size_t t = 0; t < table_count; ++t) {
+        if (!inRange(tables[t].offset, tables[t].size, data_size)) return false;
+        auto table = std::make_unique<AttributeTable>();
+        if (tables[t].size != 0 && !table->openBuffer(attribute_data + tables[t].offset, tables[t].size)) {
+            return false;
+        }
+        attribute_tables.push_back(std::move(table));
+    }
+    for (size_t i = 0; i < attribute_ref_count; ++i) {
+        if (refs_data[i].table >= table_count) return false;
+    }
+    attribute_refs.assign(refs_data, refs_data + attribute_ref_count);
+
+    size_t node_count = 0, min_x_count = 0, min_y_count = 0, max_x_count = 0, max_y_count = 0;
+    size_t ref_count = 0, object_count = 0;
+    const auto* nodes = reinterpret_cast<const FlatRTree::Node*>(
+        section(kTreeNodes, alignof(FlatRTree::Node), sizeof(FlatRTree::Node), node_count));
+    const auto* min_x = reinterpret_cast<const double*>(section(kTreeMinX, alignof(double), sizeof(double), min_x_count));
+    const auto* min_y = reinterpret_cast<const double*>(section(kTreeMinY, alignof(double), sizeof(double), min_y_count));
+    const auto* max_x = reinterpret_cast<const double*>(section(kTreeMaxX, alignof(double), sizeof(double), max_x_count));
+    const auto* max_y = reinterpret_cast<const double*>(section(kTreeMaxY, alignof(double), sizeof(double), max_y_count));
+    const auto* refs = reinterpret_cast<const uint32_t*>(section(kTreeRefs, alignof(uint32_t), sizeof(uint32_t), ref_count));
+    const auto* object_bounds = reinterpret_cast<const BoundingBox*>(
+        section(kObjectBounds, alignof(BoundingBox), sizeof(BoundingBox), object_count));
+    if (!nodes || !min_x || !min_y || !max_x || !max_y || !refs || !object_bounds) {
+        return false;
+    }
+
+    // The tree arrays are small next to the geometry; copying them keeps
+    // FlatRTree a plain owning struct
+    FlatRTree flat;
+    flat.nodes.assign(nodes, nodes + node_count);
+    flat.min_x.assign(min_x, min_x + min_x_count);
+    flat.min_y.assign(min_y, min_y + min_y_count);
+    flat.max_x.assign(max_x, max_x + max_x_count);
+    flat.max_y.assign(max_y, max_y + max_y_count);
+    flat.refs.assign(refs, refs + ref_count);
+    flat.root_bounds = BoundingBox::empty();
+    for (size_t i = 0; i < object_count; ++i) {
+        flat.root_bounds.expand(object_bounds[i]);
+    }
+
+    size_t grid_count = 0, cell_count = 0, candidate_count = 0;
+    const auto* grid_layout = reinterpret_cast<const GridEntry*>(
+        section(kGridLayout, alignof(GridEntry), sizeof(GridEntry), grid_count));
+    const auto* cells = reinterpret_cast<const CellGrid::Cell*>(
+        section(kGridCells, alignof(CellGrid::Cell), sizeof(CellGrid::Cell), cell_count));
+    const auto* candidates = reinterpret_cast<const uint32_t*>(
+        section(kGridCandidates, alignof(uint32_t), sizeof(uint32_t), candidate_count));
+    if (!grid_layout || !cells || !candidates || grid_count > 1 || (grid_count == 0 && cell_count != 0)) {
+        return false;
+    }
+    CellGrid grid;
+    if (grid_count == 1) {
+        grid = CellGrid(grid_layout->bounds, grid_layout->columns, grid_layout->rows,
+                        Buffer<CellGrid::Cell>::borrow(cells, cell_count),
+                        Buffer<uint32_t>::borrow(candidates, candidate_count));
+    }
+
+    return spatial_index.restoreIndex(records, std::move(flat),
+                                      std::vector<BoundingBox>(object_bounds, object_bounds + object_count),
+                                      std::move(prepared), std::move(grid));
+}
+
+} // namespace gis
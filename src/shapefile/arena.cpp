@@ -0,0 +1,93 @@
+#include "gis/arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace gis {
+
+DatasetArena::DatasetArena(size_t block_size, std::pmr::memory_resource* upstream)
+    : upstream_(upstream ? upstream : std::pmr::get_default_resource())
+    , block_size_(std::max<size_t>(block_size, 4 * kBlockAlignment))
+    , cursor_(nullptr)
+    , block_end_(nullptr)
+    , bytes_reserved_(0)
+    , bytes_used_(0)
+    , allocation_count_(0) {
+}
+
+DatasetArena::~DatasetArena() {
+    release();
+}
+
+void DatasetArena::release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Block& block : blocks_) {
+        upstream_->deallocate(block.data, block.size, block.alignment);
+    }
+    blocks_.clear();
+    blocks_.shrink_to_fit();
+    cursor_ = nullptr;
+    block_end_ = nullptr;
+    bytes_reserved_ = 0;
+    bytes_used_ = 0;
+    allocation_count_ = 0;
+}
+
+size_t DatasetArena::bytesUsed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_used_;
+}
+
+size_t DatasetArena::bytesReserved() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_reserved_;
+}
+
+size_t DatasetArena::blockCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blocks_.size();
+}
+
+size_t DatasetArena::allocationCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocation_count_;
+}
+
+void* DatasetArena::allocateBlock(size_t size, size_t alignment) {
+    blocks_.reserve(blocks_.size() + 1);  // So the push below cannot throw and leak the block
+    void* data = upstream_->allocate(size, alignment);
+    blocks_.push_back({data, size, alignment});
+    bytes_reserved_ += size;
+    return data;
+}
+
+void* DatasetArena::do_allocate(size_t bytes, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++allocation_count_;
+    bytes_used_ += bytes;
+
+    // Large arrays get their own block rather than wasting the rest of a shared one
+    if (bytes > block_size_ / 4 || alignment > kBlockAlignment) {
+        return allocateBlock(std::max<size_t>(bytes, 1), std::max(alignment, kBlockAlignment));
+    }
+
+    auto address = reinterpret_cast<uintptr_t>(cursor_);
+    size_t padding = (alignment - address % alignment) % alignment;
+    if (!cursor_ || padding + bytes > static_cast<size_t>(block_end_ - cursor_)) {
+        cursor_ = static_cast<char*>(allocateBlock(block_size_, kBlockAlignment));
+        block_end_ = cursor_ + block_size_;
+        padding = 0;
+    }
+    void* p = cursor_ + padding;
+    cursor_ += padding + bytes;
+    return p;
+}
+
+void DatasetArena::do_deallocate(void*, size_t, size_t) {
+    // Memory comes back all at once in release()
+}
+
+bool DatasetArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+} // namespace gis
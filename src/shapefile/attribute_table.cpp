@@ -0,0 +1,180 @@
+#include "gis/attribute_table.h"
+#include <unordered_map>
+
+namespace gis {
+
+AttributeTable::AttributeTable()
+    : data_(nullptr)
+    , size_(0) {
+}
+
+AttributeTable::~AttributeTable() = default;
+
+bool AttributeTable::open(const std::string& filename) {
+    close();
+    if (!file_.open(filename)) {
+        return false;
+    }
+    data_ = file_.data();
+    size_ = file_.size();
+    if (!readHeader()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool AttributeTable::openBuffer(const char* data, size_t size) {
+    close();
+    data_ = data;
+    size_ = size;
+    if (!data_ || !readHeader()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void AttributeTable::close() {
+    columns_.clear();
+    layout_ = DBFLayout();
+    data_ = nullptr;
+    size_ = 0;
+    file_.close();
+}
+
+bool AttributeTable::readHeader() {
+    if (!layout_.parse(data_, size_)) {
+        return false;
+    }
+    columns_.clear();
+    for (size_t f = 0; f < layout_.fields.size(); ++f) {
+        columns_.push_back(std::make_unique<Column>());
+    }
+    return true;
+}
+
+const char* AttributeTable::rowData(uint32_t row) const {
+    return data_ + layout_.rowOffset(row);
+}
+
+bool AttributeTable::isDeleted(uint32_t row) const {
+    return row < layout_.record_count && rowData(row)[0] == '*';
+}
+
+const AttributeTable::Column& AttributeTable::column(size_t field) const {
+    Column& column = *columns_[field];
+    std::call_once(column.decoded, [&]() {
+        decodeColumn(field, column);
+        column.ready.store(true, std::memory_order_release);
+    });
+    return column;
+}
+
+void AttributeTable::decodeColumn(size_t field, Column& column) const {
+    const FieldDefinition& definition = layout_.fields[field];
+    const size_t offset = layout_.field_offsets[field];
+    const uint32_t record_count = layout_.record_count;
+
+    switch (definition.type) {
+        case FieldType::Numeric:
+        case FieldType::Float:
+            column.numbers.resize(record_count, 0.0);
+            for (uint32_t row = 0; row < record_count; ++row) {
+                const char* data = rowData(row);
+                if (data[0] != '*') {
+                    column.numbers[row] = parseDBFNumber(data + offset, definition.length);
+                }
+            }
+            break;
+
+        case FieldType::Logical:
+            column.flags.resize(record_count, 0);
+            for (uint32_t row = 0; row < record_count; ++row) {
+                const char* data = rowData(row);
+                if (data[0] != '*') {
+                    column.flags[row] = parseDBFLogical(data + offset, definition.length);
+                }
+            }
+            break;
+
+        case FieldType::Character:
+        case FieldType::Date:
+        default: {
+            // Intern while the views still point into the mapped rows
+            std::unordered_map<std::string_view, uint32_t> ids;
+            column.strings.emplace_back();
+            ids.emplace(std::string_view(), 0);
+            column.string_ids.resize(record_count, 0);
+            for (uint32_t row = 0; row < record_count; ++row) {
+                const char* data = rowData(row);
+                if (data[0] == '*') continue;
+
+                std::string_view value = trimDBFField(data + offset, definition.length);
+                auto inserted = ids.emplace(value, static_cast<uint32_t>(column.strings.size()));
+                if (inserted.second) {
+                    column.strings.emplace_back(value);
+                }
+                column.string_ids[row] = inserted.first->second;
+            }
+            column.strings.shrink_to_fit();
+            break;
+        }
+    }
+}
+
+std::string_view AttributeTable::getString(uint32_t row, size_t field) const {
+    if (row >= layout_.record_count || field >= layout_.fields.size()) return std::string_view();
+    const Column& values = column(field);
+    if (values.string_ids.empty()) return std::string_view();
+    return values.strings[values.string_ids[row]];
+}
+
+double AttributeTable::getNumber(uint32_t row, size_t field) const {
+    if (row >= layout_.record_count || field >= layout_.fields.size()) return 0.0;
+    const Column& values = column(field);
+    return values.numbers.empty() ? 0.0 : values.numbers[row];
+}
+
+bool AttributeTable::getLogical(uint32_t row, size_t field) const {
+    if (row >= layout_.record_count || field >= layout_.fields.size()) return false;
+    const Column& values = column(field);
+    return !values.flags.empty() && values.flags[row] != 0;
+}
+
+FieldValue AttributeTable::getValue(uint32_t row, size_t field) const {
+    if (field >= layout_.fields.size()) return FieldValue();
+    switch (layout_.fields[field].type) {
+        case FieldType::Numeric:
+        case FieldType::Float:
+            return getNumber(row, field);
+        case FieldType::Logical:
+            return getLogical(row, field);
+        default:
+            return std::string(getString(row, field));
+    }
+}
+
+size_t AttributeTable::getDecodedFieldCount() const {
+    size_t decoded = 0;
+    for (const auto& column : columns_) {
+        if (column->ready.load(std::memory_order_acquire)) ++decoded;
+    }
+    return decoded;
+}
+
+size_t AttributeTable::memoryUsage() const {
+    size_t bytes = 0;
+    for (const auto& column : columns_) {
+        if (!column->ready.load(std::memory_order_acquire)) continue;
+        bytes += column->string_ids.capacity() * sizeof(uint32_t) +
+                 column->numbers.capacity() * sizeof(double) +
+                 column->flags.capacity();
+        for (const std::string& value : column->strings) {
+            bytes += sizeof(std::string) + (value.capacity() > 15 ? value.capacity() : 0);
+        }
+    }
+    return bytes;
+}
+
+} // namespace gis
@@ -1,69 +1,172 @@
 #include "gis/dbf_reader.h"
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
 namespace gis {
 
-DBFReader::DBFReader(const std::string& filename) 
-    : record_count_(0), header_length_(0), record_length_(0), is_open_(false) {
-    file_.open(filename + ".dbf", std::ios::binary);
+namespace {
+
+// Powers of ten that are exact doubles
+const double kExactPowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+constexpr int kMaxExactPower = 22;
+constexpr int kMaxExactDigits = 15;  // Any 15-digit integer is an exact double
+
+// Target size of one block read; large enough that a column scan is
+// bandwidth-bound, small enough to stay in cache while it is decoded
+constexpr size_t kBlockBytes = 1 << 20;
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t';
 }
 
-DBFReader::~DBFReader() {
-    close();
+template<typename T>
+T readValue(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
 }
 
-bool DBFReader::open() {
-    if (!file_.is_open()) {
-        return false;
+void decodeRow(const DBFLayout& layout, const char* row, const std::vector<size_t>& fields,
+               std::unordered_map<std::string, FieldValue>& attributes) {
+    for (size_t f : fields) {
+        const FieldDefinition& field = layout.fields[f];
+        decodeDBFField(row + layout.field_offsets[f], field.length, field.type, attributes[field.name]);
     }
-    
-    if (!readHeader()) {
-        return false;
+}
+
+} // namespace
+
+std::string_view trimDBFField(const char* data, size_t length) {
+    const char* begin = data;
+    const char* end = data + length;
+    while (begin < end && isBlank(*begin)) ++begin;
+    while (end > begin && isBlank(end[-1])) --end;
+    return std::string_view(begin, static_cast<size_t>(end - begin));
+}
+
+double parseDBFNumber(const char* data, size_t length) {
+    std::string_view text = trimDBFField(data, length);
+    if (text.empty()) return 0.0;
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+
+    // Fast path: [sign] digits [. digits], with few enough significant digits
+    // that mantissa and power of ten are both exact, so a single rounding
+    // gives the correctly rounded result (the same value strtod returns)
+    const char* p = begin;
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        ++p;
     }
-    
-    is_open_ = true;
-    return true;
+
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    bool seen_point = false;
+    for (; p < end; ++p) {
+        if (*p >= '0' && *p <= '9') {
+            any_digit = true;
+            if (mantissa != 0 || *p != '0') {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                ++significant;
+            }
+            if (seen_point) --exponent;
+            if (significant > kMaxExactDigits) break;
+        } else if (*p == '.' && !seen_point) {
+            seen_point = true;
+        } else {
+            break;
+        }
+    }
+
+    if (p == end && any_digit && exponent >= -kMaxExactPower) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / kExactPowers[-exponent] : value;
+        return negative ? -value : value;
+    }
+
+    // Exponents, long mantissas and junk: DBF fields are at most 255 bytes,
+    // so a stack copy gives strtod its terminator
+    char buffer[256];
+    size_t trimmed_length = std::min<size_t>(text.size(), sizeof(buffer) - 1);
+    std::memcpy(buffer, begin, trimmed_length);
+    buffer[trimmed_length] = '\0';
+    return std::strtod(buffer, nullptr);
 }
 
-void DBFReader::close() {
-    if (file_.is_open()) {
-        file_.close();
+bool parseDBFLogical(const char* data, size_t length) {
+    std::string_view text = trimDBFField(data, length);
+    return text.size() == 1 && (text[0] == 'T' || text[0] == 't' || text[0] == 'Y' || text[0] == 'y');
+}
+
+int32_t parseDBFDate(const char* data, size_t length) {
+    std::string_view text = trimDBFField(data, length);
+    if (text.size() != 8) return 0;
+    int32_t date = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return 0;
+        date = date * 10 + (c - '0');
     }
-    is_open_ = false;
+    return date;
+}
+
+void decodeDBFField(const char* data, size_t length, FieldType type, FieldValue& value) {
+    switch (type) {
+        case FieldType::Numeric:
+        case FieldType::Float:
+            value = parseDBFNumber(data, length);
+            break;
+        case FieldType::Logical:
+            value = parseDBFLogical(data, length);
+            break;
+        case FieldType::Character:
+        default: {
+            std::string_view text = trimDBFField(data, length);
+            // Assign into an existing string to keep its capacity
+            if (auto* str = std::get_if<std::string>(&value)) {
+                str->assign(text.data(), text.size());
+            } else {
+                value = std::string(text);
+            }
+            break;
+        }
+    }
+}
+
+bool DBFLayout::parseFixedHeader(const char* data) {
+    // Byte 0 is the version, bytes 1-3 the last update date
+    record_count = readValue<uint32_t>(data + 4);
+    header_length = readValue<uint16_t>(data + 8);
+    record_length = readValue<uint16_t>(data + 10);
+    return header_length >= kFixedHeaderSize && record_length != 0;
 }
 
-bool DBFReader::readHeader() {
-    file_.seekg(0);
-    
-    // Read DBF header (32 bytes)
-    uint8_t version = readValue<uint8_t>();
-    
-    // Skip date (3 bytes)
-    file_.seekg(3, std::ios::cur);
-    
-    record_count_ = readValue<uint32_t>();
-    header_length_ = readValue<uint16_t>();
-    record_length_ = readValue<uint16_t>();
-    
-    // Skip reserved fields (20 bytes)
-    file_.seekg(20, std::ios::cur);
-    
-    // Read field definitions
-    fields_.clear();
-    size_t field_offset = 32;
-    
-    while (field_offset < header_length_ - 1) {
+bool DBFLayout::parseFieldDescriptors(const char* data) {
+    fields.clear();
+    field_offsets.clear();
+
+    // Field descriptors follow, 32 bytes each, terminated by 0x0D
+    size_t descriptor_offset = kFixedHeaderSize;
+    size_t row_offset = 1;  // Fields follow the deletion flag
+    while (descriptor_offset + 32 <= header_length && data[descriptor_offset] != 0x0D) {
+        const char* descriptor = data + descriptor_offset;
         FieldDefinition field;
-        
-        // Read field name (11 bytes)
+
+        // Field name (11 bytes, null-terminated)
         char field_name[12] = {0};
-        file_.read(field_name, 11);
+        std::memcpy(field_name, descriptor, 11);
         field.name = std::string(field_name);
-        
-        // Read field type
-        char type_char = readValue<char>();
-        switch (type_char) {
+
+        // Field type
+        switch (descriptor[11]) {
             case 'C': field.type = FieldType::Character; break;
             case 'N': field.type = FieldType::Numeric; break;
             case 'L': field.type = FieldType::Logical; break;
@@ -71,87 +174,326 @@ bool DBFReader::readHeader() {
             case 'F': field.type = FieldType::Float; break;
             default: field.type = FieldType::Unknown; break;
         }
-        
-        // Skip field data address (4 bytes)
-        file_.seekg(4, std::ios::cur);
-        
-        field.length = readValue<uint8_t>();
-        field.decimal_count = readValue<uint8_t>();
-        
-        // Skip reserved fields (14 bytes)
-        file_.seekg(14, std::ios::cur);
-        
-        fields_.push_back(field);
-        field_offset += 32;
-    }
-    
+
+        // Bytes 12-15 are the field data address, 18-31 reserved
+        field.length = readValue<uint8_t>(descriptor + 16);
+        field.decimal_count = readValue<uint8_t>(descriptor + 17);
+
+        // Fields running past the row are never read
+        if (row_offset + field.length <= record_length) {
+            fields.push_back(field);
+            field_offsets.push_back(row_offset);
+        }
+        row_offset += field.length;
+        descriptor_offset += 32;
+    }
+
+    return true;
+}
+
+bool DBFLayout::parse(const char* data, size_t file_size) {
+    if (file_size < kFixedHeaderSize || !parseFixedHeader(data) || header_length > file_size) {
+        return false;
+    }
+    if (!parseFieldDescriptors(data)) {
+        return false;
+    }
+    clampToFileSize(file_size);
+    return true;
+}
+
+void DBFLayout::clampToFileSize(size_t file_size) {
+    size_t available = file_size > header_length ? (file_size - header_length) / record_length : 0;
+    record_count = static_cast<uint32_t>(std::min<size_t>(record_count, available));
+}
+
+size_t DBFLayout::findField(std::string_view name) const {
+    for (size_t f = 0; f < fields.size(); ++f) {
+        if (fields[f].name == name) {
+            return f;
+        }
+    }
+    return SIZE_MAX;
+}
+
+DBFReader::DBFReader(const std::string& filename)
+    : filename_(filename + ".dbf")
+    , io_mode_(IOMode::Buffered)
+    , is_open_(false) {
+}
+
+DBFReader::~DBFReader() {
+    close();
+}
+
+bool DBFReader::open(IOMode mode) {
+    close();
+    io_mode_ = mode;
+
+    if (io_mode_ == IOMode::MemoryMapped) {
+        if (!map_.open(filename_)) {
+            return false;
+        }
+        if (!layout_.parse(map_.data(), map_.size())) {
+            close();
+            return false;
+        }
+    } else {
+        if (!openCursor(cursor_)) {
+            return false;
+        }
+        cursor_.file.seekg(0, std::ios::end);
+        size_t file_size = static_cast<size_t>(cursor_.file.tellg());
+
+        // Fixed part first, then the whole header with the field descriptors
+        std::vector<char>& header = cursor_.buffer;
+        header.resize(DBFLayout::kFixedHeaderSize);
+        cursor_.file.seekg(0);
+        bool valid = file_size >= DBFLayout::kFixedHeaderSize &&
+                     cursor_.file.read(header.data(), static_cast<std::streamsize>(header.size())) &&
+                     layout_.parseFixedHeader(header.data()) && layout_.header_length <= file_size;
+        if (valid) {
+            header.resize(layout_.header_length);
+            cursor_.file.seekg(0);
+            valid = cursor_.file.read(header.data(), static_cast<std::streamsize>(header.size())) &&
+                    layout_.parseFieldDescriptors(header.data());
+        }
+        if (!valid) {
+            close();
+            return false;
+        }
+        layout_.clampToFileSize(file_size);
+    }
+
+    is_open_ = true;
     return true;
 }
 
+void DBFReader::close() {
+    if (cursor_.file.is_open()) {
+        cursor_.file.close();
+    }
+    cursor_.block_first = 0;
+    cursor_.block_count = 0;
+    map_.close();
+    layout_ = DBFLayout();
+    is_open_ = false;
+}
+
+bool DBFReader::openCursor(Cursor& cursor) const {
+    cursor.block_first = 0;
+    cursor.block_count = 0;
+    if (io_mode_ == IOMode::MemoryMapped) {
+        return true;  // Cursors read straight from the shared mapping
+    }
+    cursor.file.open(filename_, std::ios::binary);
+    return cursor.file.is_open();
+}
+
+uint32_t DBFReader::blockRows() const {
+    return static_cast<uint32_t>(std::max<size_t>(1, kBlockBytes / layout_.record_length));
+}
+
+bool DBFReader::readBlock(uint32_t first, uint32_t count, Block& block) {
+    return readBlock(first, count, cursor_, block);
+}
+
+bool DBFReader::readBlock(uint32_t first, uint32_t count, Cursor& cursor, Block& block) const {
+    if (!is_open_ || first >= layout_.record_count || count == 0) {
+        return false;
+    }
+    count = std::min(count, layout_.record_count - first);
+    size_t offset = layout_.rowOffset(first);
+    size_t size = static_cast<size_t>(count) * layout_.record_length;
+
+    const char* data = nullptr;
+    if (io_mode_ == IOMode::MemoryMapped) {
+        if (offset > map_.size() || size > map_.size() - offset) {
+            return false;
+        }
+        data = map_.data() + offset;
+    } else {
+        // One seek and one read for the whole block
+        if (cursor.buffer.size() < size) {
+            cursor.buffer.resize(size);
+        }
+        cursor.block_count = 0;
+        cursor.file.clear();
+        cursor.file.seekg(static_cast<std::streamoff>(offset));
+        if (!cursor.file.read(cursor.buffer.data(), static_cast<std::streamsize>(size))) {
+            return false;
+        }
+        cursor.block_first = first;
+        cursor.block_count = count;
+        data = cursor.buffer.data();
+    }
+
+    block.data = data;
+    block.first = first;
+    block.count = count;
+    block.record_length = layout_.record_length;
+    return true;
+}
+
+const char* DBFReader::fetchRow(uint32_t index, Cursor& cursor) const {
+    if (!is_open_ || index >= layout_.record_count) {
+        return nullptr;
+    }
+    if (io_mode_ == IOMode::MemoryMapped) {
+        return map_.data() + layout_.rowOffset(index);
+    }
+    if (index >= cursor.block_first && index - cursor.block_first < cursor.block_count) {
+        return cursor.buffer.data() + static_cast<size_t>(index - cursor.block_first) * layout_.record_length;
+    }
+
+    // The row right after the current block continues a scan: prefetch a
+    // whole block rather than seeking once per record
+    bool scanning = cursor.block_count != 0 && index == cursor.block_first + cursor.block_count;
+    Block block;
+    if (!readBlock(index, scanning ? blockRows() : 1, cursor, block)) {
+        return nullptr;
+    }
+    return block.data;
+}
+
 std::unordered_map<std::string, FieldValue> DBFReader::readRecord(uint32_t index) {
     std::unordered_map<std::string, FieldValue> record;
-    
-    if (!is_open_ || index >= record_count_) {
-        return record;
-    }
-    
-    // Calculate record position
-    size_t record_pos = header_length_ + index * record_length_;
-    file_.seekg(record_pos);
-    
-    // Skip deletion flag
-    char deletion_flag = readValue<char>();
-    if (deletion_flag == '*') {
-        return record; // Record is deleted
-    }
-    
-    // Read field values
-    for (const auto& field : fields_) {
-        std::vector<char> field_data(field.length);
-        file_.read(field_data.data(), field.length);
-        
-        std::string field_str(field_data.begin(), field_data.end());
-        FieldValue value = parseFieldValue(field_str, field);
-        record[field.name] = value;
-    }
-    
+    std::vector<size_t> fields(layout_.fields.size());
+    for (size_t f = 0; f < fields.size(); ++f) {
+        fields[f] = f;
+    }
+    if (!readRecord(index, cursor_, fields, record)) {
+        record.clear();
+    }
     return record;
 }
 
-FieldValue DBFReader::parseFieldValue(const std::string& data, const FieldDefinition& field) {
-    // Trim whitespace
-    std::string trimmed = data;
-    trimmed.erase(0, trimmed.find_first_not_of(" \t"));
-    trimmed.erase(trimmed.find_last_not_of(" \t") + 1);
-    
-    switch (field.type) {
-        case FieldType::Character:
-            return trimmed;
-            
-        case FieldType::Numeric:
-        case FieldType::Float:
-            if (!trimmed.empty()) {
-                try {
-                    return std::stod(trimmed);
-                } catch (...) {
-                    return 0.0;
-                }
+bool DBFReader::readRecord(uint32_t index, Cursor& cursor, const std::vector<size_t>& fields,
+                           std::unordered_map<std::string, FieldValue>& attributes) const {
+    const char* row = fetchRow(index, cursor);
+
+    // Check deletion flag
+    if (!row || row[0] == '*') {
+        return false;
+    }
+
+    decodeRow(layout_, row, fields, attributes);
+    return true;
+}
+
+std::vector<std::unordered_map<std::string, FieldValue>> DBFReader::readRecords(uint32_t first, uint32_t count) {
+    std::vector<std::unordered_map<std::string, FieldValue>> records;
+    if (!is_open_ || first >= layout_.record_count) {
+        return records;
+    }
+    count = std::min(count, layout_.record_count - first);
+    records.reserve(count);
+    if (io_mode_ == IOMode::MemoryMapped) {
+        map_.adviseSequential();
+    }
+
+    std::vector<size_t> fields(layout_.fields.size());
+    for (size_t f = 0; f < fields.size(); ++f) {
+        fields[f] = f;
+    }
+
+    const uint32_t end = first + count;
+    Block block;
+    for (uint32_t next = first; next < end; next += block.count) {
+        if (!readBlock(next, std::min(blockRows(), end - next), cursor_, block)) {
+            break;
+        }
+        for (uint32_t i = block.first; i < block.first + block.count; ++i) {
+            records.emplace_back();
+            if (!block.isDeleted(i)) {
+                decodeRow(layout_, block.row(i), fields, records.back());
             }
-            return 0.0;
-            
-        case FieldType::Logical:
-            return (trimmed == "T" || trimmed == "t" || trimmed == "Y" || trimmed == "y");
-            
-        default:
-            return trimmed;
+        }
     }
+    return records;
 }
 
-template<typename T>
-T DBFReader::readValue() {
-    T value;
-    file_.read(reinterpret_cast<char*>(&value), sizeof(T));
-    return value;
+template<typename T, typename Decode>
+size_t DBFReader::readColumnWith(size_t field, T* out, size_t count, uint32_t first, Decode decode) {
+    if (!is_open_ || !out || field >= layout_.fields.size() || first >= layout_.record_count) {
+        return 0;
+    }
+    count = std::min<size_t>(count, layout_.record_count - first);
+    if (io_mode_ == IOMode::MemoryMapped) {
+        map_.adviseSequential();
+    }
+
+    const size_t offset = layout_.field_offsets[field];
+    const size_t length = layout_.fields[field].length;
+    size_t written = 0;
+    Block block;
+    while (written < count) {
+        uint32_t rows = static_cast<uint32_t>(std::min<size_t>(blockRows(), count - written));
+        if (!readBlock(first + static_cast<uint32_t>(written), rows, cursor_, block)) {
+            break;
+        }
+        const char* row = block.data;
+        for (uint32_t r = 0; r < block.count; ++r, row += block.record_length) {
+            // A deleted row decodes like an empty field
+            decode(row + offset, row[0] == '*' ? 0 : length, out[written + r]);
+        }
+        written += block.count;
+    }
+    return written;
+}
+
+size_t DBFReader::readColumn(size_t field, double* out, size_t count, uint32_t first) {
+    return readColumnWith(field, out, count, first, [](const char* data, size_t length, double& value) {
+        value = parseDBFNumber(data, length);
+    });
+}
+
+size_t DBFReader::readColumn(size_t field, int32_t* out, size_t count, uint32_t first) {
+    if (field < layout_.fields.size() && layout_.fields[field].type == FieldType::Date) {
+        return readColumnWith(field, out, count, first, [](const char* data, size_t length, int32_t& value) {
+            value = parseDBFDate(data, length);
+        });
+    }
+    return readColumnWith(field, out, count, first, [](const char* data, size_t length, int32_t& value) {
+        double number = parseDBFNumber(data, length);
+        bool representable = number >= std::numeric_limits<int32_t>::min() &&
+                             number <= std::numeric_limits<int32_t>::max();
+        value = representable ? static_cast<int32_t>(number) : 0;
+    });
+}
+
+size_t DBFReader::readColumn(size_t field, bool* out, size_t count, uint32_t first) {
+    return readColumnWith(field, out, count, first, [](const char* data, size_t length, bool& value) {
+        value = parseDBFLogical(data, length);
+    });
+}
+
+size_t DBFReader::readColumn(size_t field, std::string* out, size_t count, uint32_t first) {
+    return readColumnWith(field, out, count, first, [](const char* data, size_t length, std::string& value) {
+        std::string_view text = trimDBFField(data, length);
+        value.assign(text.data(), text.size());
+    });
+}
+
+size_t DBFReader::readDeletionFlags(bool* out, size_t count, uint32_t first) {
+    if (!is_open_ || !out || first >= layout_.record_count) {
+        return 0;
+    }
+    count = std::min<size_t>(count, layout_.record_count - first);
+
+    size_t written = 0;
+    Block block;
+    while (written < count) {
+        uint32_t rows = static_cast<uint32_t>(std::min<size_t>(blockRows(), count - written));
+        if (!readBlock(first + static_cast<uint32_t>(written), rows, cursor_, block)) {
+            break;
+        }
+        for (uint32_t r = 0; r < block.count; ++r) {
+            out[written + r] = block.isDeleted(block.first + r);
+        }
+        written += block.count;
+    }
+    return written;
 }
 
 } // namespace gis
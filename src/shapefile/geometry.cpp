@@ -1,4 +1,5 @@
 #include "gis/geometry.h"
+#include "gis/geometry_kernels.h"
 #include <algorithm>
 #include <cmath>
 #include <limits>
@@ -16,6 +17,24 @@ bool BoundingBox::intersects(const BoundingBox& other) const {
              other.min_y > max_y || other.max_y < min_y);
 }
 
+double BoundingBox::distanceTo(const Point2D& point) const {
+    double dx = std::max({min_x - point.x, 0.0, point.x - max_x});
+    double dy = std::max({min_y - point.y, 0.0, point.y - max_y});
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+BoundingBox BoundingBox::empty() {
+    return BoundingBox(std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+                       -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity());
+}
+
+void BoundingBox::expand(const BoundingBox& other) {
+    min_x = std::min(min_x, other.min_x);
+    min_y = std::min(min_y, other.min_y);
+    max_x = std::max(max_x, other.max_x);
+    max_y = std::max(max_y, other.max_y);
+}
+
 // PointGeometry methods
 BoundingBox PointGeometry::getBounds() const {
     return BoundingBox(point_.x, point_.y, point_.x, point_.y);
@@ -25,97 +44,145 @@ std::unique_ptr<Geometry> PointGeometry::clone() const {
     return std::make_unique<PointGeometry>(point_);
 }
 
-// PolylineGeometry methods
-BoundingBox PolylineGeometry::getBounds() const {
-    if (parts_.empty()) {
-        return BoundingBox();
+double PointGeometry::distanceTo(const Point2D& point) const {
+    return std::hypot(point.x - point_.x, point.y - point_.y);
+}
+
+// MultiPartGeometry methods
+MultiPartGeometry::MultiPartGeometry(std::vector<Point2D> points, std::vector<uint32_t> part_offsets) {
+    if (part_offsets.empty()) {
+        part_offsets.push_back(0);
     }
-    
-    double min_x = std::numeric_limits<double>::max();
-    double min_y = std::numeric_limits<double>::max();
-    double max_x = std::numeric_limits<double>::lowest();
-    double max_y = std::numeric_limits<double>::lowest();
-    
-    for (const auto& part : parts_) {
-        for (const auto& point : part) {
-            min_x = std::min(min_x, point.x);
-            min_y = std::min(min_y, point.y);
-            max_x = std::max(max_x, point.x);
-            max_y = std::max(max_y, point.y);
-        }
+    points_ = Buffer<Point2D>(std::move(points));
+    part_offsets_ = Buffer<uint32_t>(std::move(part_offsets));
+    updateBounds();
+}
+
+MultiPartGeometry::MultiPartGeometry(Buffer<Point2D> points, Buffer<uint32_t> part_offsets,
+                                     Buffer<BoundingBox> part_bounds)
+    : points_(std::move(points))
+    , part_offsets_(std::move(part_offsets))
+    , part_bounds_(std::move(part_bounds)) {
+    bounds_ = BoundingBox::empty();
+    for (const BoundingBox& part : part_bounds_) {
+        bounds_.expand(part);
+    }
+    if (bounds_.isEmpty()) {
+        bounds_ = BoundingBox();  // No coordinates
     }
-    
-    return BoundingBox(min_x, min_y, max_x, max_y);
 }
 
-std::unique_ptr<Geometry> PolylineGeometry::clone() const {
-    return std::make_unique<PolylineGeometry>(parts_);
+MultiPartGeometry::MultiPartGeometry(const std::vector<std::vector<Point2D>>& parts) {
+    size_t total = 0;
+    for (const auto& part : parts) {
+        total += part.size();
+    }
+    
+    std::vector<Point2D> points;
+    std::vector<uint32_t> part_offsets;
+    points.reserve(total);
+    part_offsets.reserve(parts.size() + 1);
+    part_offsets.push_back(0);
+    for (const auto& part : parts) {
+        points.insert(points.end(), part.begin(), part.end());
+        part_offsets.push_back(static_cast<uint32_t>(points.size()));
+    }
+    points_ = Buffer<Point2D>(std::move(points));
+    part_offsets_ = Buffer<uint32_t>(std::move(part_offsets));
+    updateBounds();
 }
 
-// PolygonGeometry methods
-BoundingBox PolygonGeometry::getBounds() const {
-    if (rings_.empty()) {
-        return BoundingBox();
+void MultiPartGeometry::updateBounds() {
+    bounds_ = BoundingBox::empty();
+    std::vector<BoundingBox> part_bounds(getNumParts());
+    
+    for (size_t i = 0; i < getNumParts(); ++i) {
+        PointSpan part = getPart(i);
+        part_bounds[i] = computePointBounds(part.data(), part.size());
+        bounds_.expand(part_bounds[i]);
     }
+    part_bounds_ = Buffer<BoundingBox>(std::move(part_bounds));
     
-    double min_x = std::numeric_limits<double>::max();
-    double min_y = std::numeric_limits<double>::max();
-    double max_x = std::numeric_limits<double>::lowest();
-    double max_y = std::numeric_limits<double>::lowest();
+    if (bounds_.isEmpty()) {
+        bounds_ = BoundingBox();  // No coordinates
+    }
+}
+
+double MultiPartGeometry::distanceToParts(const Point2D& point, bool closed) const {
+    auto squaredSegmentDistance = [&point](const Point2D& a, const Point2D& b) {
+        double dx = b.x - a.x;
+        double dy = b.y - a.y;
+        double length_sq = dx * dx + dy * dy;
+        double t = 0.0;
+        if (length_sq > 0.0) {
+            t = std::clamp(((point.x - a.x) * dx + (point.y - a.y) * dy) / length_sq, 0.0, 1.0);
+        }
+        double px = a.x + t * dx - point.x;
+        double py = a.y + t * dy - point.y;
+        return px * px + py * py;
+    };
     
-    for (const auto& ring : rings_) {
-        for (const auto& point : ring) {
-            min_x = std::min(min_x, point.x);
-            min_y = std::min(min_y, point.y);
-            max_x = std::max(max_x, point.x);
-            max_y = std::max(max_y, point.y);
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < getNumParts(); i++) {
+        PointSpan part = getPart(i);
+        if (part.empty()) continue;
+        
+        // A part whose bbox is already farther than the best segment cannot improve it
+        double box_distance = part_bounds_[i].distanceTo(point);
+        if (box_distance * box_distance >= best) continue;
+        
+        if (part.size() == 1) {
+            best = std::min(best, squaredSegmentDistance(part[0], part[0]));
+            continue;
+        }
+        for (size_t j = 1; j < part.size(); j++) {
+            best = std::min(best, squaredSegmentDistance(part[j - 1], part[j]));
+        }
+        if (closed) {
+            best = std::min(best, squaredSegmentDistance(part[part.size() - 1], part[0]));
         }
     }
     
-    return BoundingBox(min_x, min_y, max_x, max_y);
+    return std::sqrt(best);
+}
+
+// PolylineGeometry methods
+std::unique_ptr<Geometry> PolylineGeometry::clone() const {
+    return std::make_unique<PolylineGeometry>(points_, part_offsets_, part_bounds_);
 }
 
+// PolygonGeometry methods
 std::unique_ptr<Geometry> PolygonGeometry::clone() const {
-    return std::make_unique<PolygonGeometry>(rings_);
+    return std::make_unique<PolygonGeometry>(points_, part_offsets_, part_bounds_);
+}
+
+double PolygonGeometry::distanceTo(const Point2D& point) const {
+    if (contains(point)) {
+        return 0.0;
+    }
+    return distanceToParts(point, true);
 }
 
 bool PolygonGeometry::contains(const Point2D& point) const {
-    if (rings_.empty()) {
+    if (getNumRings() == 0 || !bounds_.contains(point)) {
         return false;
     }
     
     // Point-in-polygon test using ray casting algorithm
-    auto pointInRing = [](const std::vector<Point2D>& ring, const Point2D& point) -> bool {
-        bool inside = false;
-        size_t j = ring.size() - 1;
-        
-        for (size_t i = 0; i < ring.size(); i++) {
-            const Point2D& pi = ring[i];
-            const Point2D& pj = ring[j];
-            
-            if (((pi.y > point.y) != (pj.y > point.y)) &&
-                (point.x < (pj.x - pi.x) * (point.y - pi.y) / (pj.y - pi.y) + pi.x)) {
-                inside = !inside;
-            }
-            j = i;
-        }
-        
-        return inside;
+    auto pointInRing = [](PointSpan ring, const Point2D& point) -> bool {
+        return (countRingCrossings(ring.data(), ring.size(), point) & 1) != 0;
     };
     
-    // Check if point is in outer ring (first ring)
-    if (!pointInRing(rings_[0], point)) {
-        return false;
-    }
-    
-    // Check if point is in any hole (subsequent rings)
-    for (size_t i = 1; i < rings_.size(); i++) {
-        if (pointInRing(rings_[i], point)) {
-            return false;  // Point is in a hole
+    // Even-odd over all rings: a point outside a ring's bbox crosses it an
+    // even number of times, so that ring cannot change the answer
+    bool inside = false;
+    for (size_t i = 0; i < getNumRings(); i++) {
+        if (part_bounds_[i].contains(point) && pointInRing(getRing(i), point)) {
+            inside = !inside;
         }
     }
     
-    return true;
+    return inside;
 }
 
 } // namespace gis
@@ -1,21 +1,279 @@
 #include "gis/shapefile_reader.h"
+#include "gis/parallel.h"
+#include "gis/spatial_index.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <cstring>
+#include <cstdlib>
+#include <atomic>
 #include <chrono>
+#include <filesystem>
 
 namespace gis {
 
+namespace {
+
+template<typename T>
+T load(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+// The 2D geometry a shape type decodes to; Z and M only add arrays
+constexpr ShapeType baseShapeType(ShapeType type) {
+    switch (type) {
+        case ShapeType::PointZ:
+        case ShapeType::PointM:
+            return ShapeType::Point;
+        case ShapeType::PolyLineZ:
+        case ShapeType::PolyLineM:
+            return ShapeType::PolyLine;
+        case ShapeType::PolygonZ:
+        case ShapeType::PolygonM:
+            return ShapeType::Polygon;
+        case ShapeType::MultiPointZ:
+        case ShapeType::MultiPointM:
+            return ShapeType::MultiPoint;
+        default:
+            return type;
+    }
+}
+
+constexpr bool hasMeasures(ShapeType type) {
+    return type != baseShapeType(type);
+}
+
+/**
+ * Decoder specialised on one shape type, so the per-record work is a
+ * straight-line read with the layout known at compile time.
+ *
+ * Z and M records store their XY data exactly like the 2D types and
+ * append the extra values after it: a Z value (Z types) or M value
+ * (M types) per point, preceded by a range for multipart shapes. Those
+ * must be present and are skipped; the optional M values of Z types
+ * may be absent. Types without a geometry class (MultiPoint, MultiPatch)
+ * decode to nothing.
+ */
+template<ShapeType Type>
+struct ShapeDecoder {
+    static constexpr ShapeType kBaseType = baseShapeType(Type);
+    
+    static constexpr size_t extraBytes(size_t num_points) {
+        if constexpr (!hasMeasures(Type)) {
+            return 0;
+        } else if constexpr (kBaseType == ShapeType::Point) {
+            return 8;
+        } else {
+            return 16 + 8 * num_points;
+        }
+    }
+    
+    static bool decodePoint(const char* data, size_t size, Point2D& point) {
+        if (size < 16 + extraBytes(1)) {
+            return false;
+        }
+        point = Point2D(load<double>(data), load<double>(data + 8));
+        return true;
+    }
+    
+    // Validated position of the part indices and XY points of a multipart record
+    struct PartsLayout {
+        uint32_t num_parts;
+        uint32_t num_points;
+        const char* parts;
+        const char* points;
+    };
+    
+    static bool readPartsLayout(const char* data, size_t size, PartsLayout& layout) {
+        static_assert(sizeof(Point2D) == 2 * sizeof(double), "Point2D must match the on-disk XY layout");
+        
+        // Layout: bbox (4 doubles), num_parts, num_points, part indices, XY points
+        if (size < 40) {
+            return false;
+        }
+        int32_t num_parts = load<int32_t>(data + 32);
+        int32_t num_points = load<int32_t>(data + 36);
+        if (num_parts < 0 || num_points < 0) {
+            return false;
+        }
+        
+        size_t parts_offset = 40;
+        size_t points_offset = parts_offset + static_cast<size_t>(num_parts) * 4;
+        size_t points_end = points_offset + static_cast<size_t>(num_points) * sizeof(Point2D);
+        if (points_end + extraBytes(static_cast<size_t>(num_points)) > size) {
+            return false;
+        }
+        
+        layout.num_parts = static_cast<uint32_t>(num_parts);
+        layout.num_points = static_cast<uint32_t>(num_points);
+        layout.parts = data + parts_offset;
+        layout.points = data + points_offset;
+        return true;
+    }
+    
+    // Part start indices plus a closing offset (num_parts + 1 entries); they
+    // must be non-decreasing
+    static bool readPartOffsets(const PartsLayout& layout, uint32_t* part_offsets) {
+        for (uint32_t i = 0; i < layout.num_parts; ++i) {
+            int32_t start = load<int32_t>(layout.parts + i * 4);
+            if (start < 0 || static_cast<uint32_t>(start) > layout.num_points ||
+                (i > 0 && static_cast<uint32_t>(start) < part_offsets[i - 1])) {
+                return false;
+            }
+            part_offsets[i] = static_cast<uint32_t>(start);
+        }
+        part_offsets[0] = 0;  // The spec requires it; leading points join the first part
+        if (layout.num_parts > 0) {
+            part_offsets[layout.num_parts] = layout.num_points;
+        }
+        return true;
+    }
+    
+    static bool decodeParts(const char* data, size_t size, std::vector<Point2D>& points,
+                            std::vector<uint32_t>& part_offsets) {
+        PartsLayout layout;
+        if (!readPartsLayout(data, size, layout)) {
+            return false;
+        }
+        part_offsets.resize(static_cast<size_t>(layout.num_parts) + 1);
+        if (!readPartOffsets(layout, part_offsets.data())) {
+            return false;
+        }
+        
+        // One bulk copy of the whole coordinate array, reusing the caller's capacity
+        points.resize(layout.num_points);
+        if (layout.num_points > 0) {
+            std::memcpy(points.data(), layout.points, points.size() * sizeof(Point2D));
+        }
+        
+        return true;
+    }
+    
+    template<typename Multipart>
+    static std::unique_ptr<Geometry> decodeIntoArena(const char* data, size_t size, DatasetArena& arena) {
+        PartsLayout layout;
+        if (!readPartsLayout(data, size, layout)) {
+            return nullptr;
+        }
+        
+        // One arena allocation per record: points, ring bounds, then part
+        // offsets, each size a multiple of the next one's alignment. A
+        // malformed record leaves its room unused until the arena goes.
+        const size_t num_parts = layout.num_parts;
+        const size_t num_points = layout.num_points;
+        static_assert(sizeof(Point2D) % alignof(BoundingBox) == 0 && sizeof(BoundingBox) % alignof(uint32_t) == 0 &&
+                      alignof(Point2D) >= alignof(BoundingBox), "Arrays are packed back to back");
+        char* block = static_cast<char*>(arena.allocate(
+            num_points * sizeof(Point2D) + num_parts * sizeof(BoundingBox) + (num_parts + 1) * sizeof(uint32_t),
+            alignof(Point2D)));
+        auto* points = reinterpret_cast<Point2D*>(block);
+        auto* part_bounds = reinterpret_cast<BoundingBox*>(block + num_points * sizeof(Point2D));
+        auto* part_offsets = reinterpret_cast<uint32_t*>(block + num_points * sizeof(Point2D) +
+                                                         num_parts * sizeof(BoundingBox));
+        
+        if (!readPartOffsets(layout, part_offsets)) {
+            return nullptr;
+        }
+        if (num_points > 0) {
+            std::memcpy(static_cast<void*>(points), layout.points, num_points * sizeof(Point2D));
+        }
+        for (size_t i = 0; i < num_parts; ++i) {
+            part_bounds[i] = computePointBounds(points + part_offsets[i], part_offsets[i + 1] - part_offsets[i]);
+        }
+        
+        return std::make_unique<Multipart>(Buffer<Point2D>::borrow(points, num_points),
+                                           Buffer<uint32_t>::borrow(part_offsets, num_parts + 1),
+                                           Buffer<BoundingBox>::borrow(part_bounds, num_parts));
+    }
+    
+    static std::unique_ptr<Geometry> decode(const char* data, size_t size, DatasetArena* arena) {
+        if constexpr (kBaseType == ShapeType::Point) {
+            (void)arena;
+            Point2D point;
+            if (!decodePoint(data, size, point)) {
+                return nullptr;
+            }
+            return std::make_unique<PointGeometry>(point);
+        } else if constexpr (kBaseType == ShapeType::PolyLine || kBaseType == ShapeType::Polygon) {
+            using Multipart = std::conditional_t<kBaseType == ShapeType::PolyLine, PolylineGeometry, PolygonGeometry>;
+            if (arena) {
+                return decodeIntoArena<Multipart>(data, size, *arena);
+            }
+            std::vector<Point2D> points;
+            std::vector<uint32_t> part_offsets;
+            if (!decodeParts(data, size, points, part_offsets)) {
+                return nullptr;
+            }
+            return std::make_unique<Multipart>(std::move(points), std::move(part_offsets));
+        } else {
+            (void)data;
+            (void)size;
+            (void)arena;
+            return nullptr;
+        }
+    }
+    
+    // Decode into a geometry of kBaseType left by the previous record
+    static bool refill(const char* data, size_t size, Geometry& geometry) {
+        if constexpr (kBaseType == ShapeType::Point) {
+            Point2D point;
+            if (!decodePoint(data, size, point)) {
+                return false;
+            }
+            static_cast<PointGeometry&>(geometry).setPoint(point);
+            return true;
+        } else if constexpr (kBaseType == ShapeType::PolyLine || kBaseType == ShapeType::Polygon) {
+            auto& multipart = static_cast<MultiPartGeometry&>(geometry);
+            std::vector<Point2D> points;
+            std::vector<uint32_t> part_offsets;
+            multipart.swapStorage(points, part_offsets);
+            bool decoded = decodeParts(data, size, points, part_offsets);
+            multipart.swapStorage(points, part_offsets);
+            return decoded;
+        } else {
+            (void)data;
+            (void)size;
+            (void)geometry;
+            return false;
+        }
+    }
+};
+
+template<ShapeType Type>
+ShapefileReader::GeometryCodec codecFor() {
+    return {ShapeDecoder<Type>::kBaseType, &ShapeDecoder<Type>::decode, &ShapeDecoder<Type>::refill};
+}
+
+} // namespace
+
+ShapefileReader::GeometryCodec ShapefileReader::selectCodec(ShapeType type) {
+    switch (type) {
+        case ShapeType::Point:     return codecFor<ShapeType::Point>();
+        case ShapeType::PolyLine:  return codecFor<ShapeType::PolyLine>();
+        case ShapeType::Polygon:   return codecFor<ShapeType::Polygon>();
+        case ShapeType::PointZ:    return codecFor<ShapeType::PointZ>();
+        case ShapeType::PolyLineZ: return codecFor<ShapeType::PolyLineZ>();
+        case ShapeType::PolygonZ:  return codecFor<ShapeType::PolygonZ>();
+        case ShapeType::PointM:    return codecFor<ShapeType::PointM>();
+        case ShapeType::PolyLineM: return codecFor<ShapeType::PolyLineM>();
+        case ShapeType::PolygonM:  return codecFor<ShapeType::PolygonM>();
+        default:                   return codecFor<ShapeType::NullShape>();
+    }
+}
+
 ShapefileReader::ShapefileReader(const std::string& filename)
     : base_filename_(filename)
+    , io_mode_(IOMode::Buffered)
     , file_code_(0)
     , file_length_(0)
     , version_(0)
     , shape_type_(ShapeType::NullShape)
+    , codec_(selectCodec(ShapeType::NullShape))
+    , dbf_(filename)
     , record_count_(0)
-    , header_length_(0)
-    , record_length_(0)
+    , has_dbf_(false)
     , is_open_(false) {
 }
 
@@ -23,26 +281,31 @@ ShapefileReader::~ShapefileReader() {
     close();
 }
 
-bool ShapefileReader::open() {
-    // Open .shp file
+bool ShapefileReader::open(IOMode mode) {
+    close();
+    io_mode_ = mode;
+    
     std::string shp_filename = base_filename_ + ".shp";
-    shp_file_.open(shp_filename, std::ios::binary);
-    if (!shp_file_.is_open()) {
-        std::cerr << "Failed to open " << shp_filename << std::endl;
-        return false;
-    }
-
-    // Open .shx file
     std::string shx_filename = base_filename_ + ".shx";
-    shx_file_.open(shx_filename, std::ios::binary);
-    if (!shx_file_.is_open()) {
-        std::cerr << "Failed to open " << shx_filename << std::endl;
-        return false;
+    size_t shx_size = 0;
+    
+    if (io_mode_ == IOMode::MemoryMapped) {
+        if (!shp_map_.open(shp_filename)) {
+            std::cerr << "Failed to map " << shp_filename << std::endl;
+            return false;
+        }
+        if (!shx_map_.open(shx_filename)) {
+            std::cerr << "Failed to map " << shx_filename << std::endl;
+            return false;
+        }
+        shx_size = shx_map_.size();
+    } else {
+        if (!openCursor(cursor_)) {
+            return false;
+        }
+        cursor_.shx_file.seekg(0, std::ios::end);
+        shx_size = static_cast<size_t>(cursor_.shx_file.tellg());
     }
-
-    // Open .dbf file (optional)
-    std::string dbf_filename = base_filename_ + ".dbf";
-    dbf_file_.open(dbf_filename, std::ios::binary);
     
     // Read headers
     if (!readShapefileHeader()) {
@@ -50,135 +313,173 @@ bool ShapefileReader::open() {
         return false;
     }
     
-    if (dbf_file_.is_open() && !readDBFHeader()) {
+    // .dbf file is optional, but one that is there must be readable
+    has_dbf_ = dbf_.open(io_mode_);
+    if (!has_dbf_ && std::filesystem::exists(dbf_.getFilename())) {
         std::cerr << "Failed to read DBF header" << std::endl;
         return false;
     }
+    if (has_dbf_) {
+        record_count_ = dbf_.getRecordCount();
+        dbf_.openCursor(cursor_.dbf);
+    }
+    
+    // Without attributes the record count comes from the index file
+    if (!has_dbf_ && shx_size >= 100) {
+        record_count_ = static_cast<uint32_t>((shx_size - 100) / 8);
+    }
     
     is_open_ = true;
     return true;
 }
 
+bool ShapefileReader::openCursor(RecordCursor& cursor) const {
+    if (io_mode_ == IOMode::MemoryMapped) {
+        return true;  // Cursors read straight from the shared mappings
+    }
+    
+    std::string shp_filename = base_filename_ + ".shp";
+    cursor.shp_file.open(shp_filename, std::ios::binary);
+    if (!cursor.shp_file.is_open()) {
+        std::cerr << "Failed to open " << shp_filename << std::endl;
+        return false;
+    }
+    
+    std::string shx_filename = base_filename_ + ".shx";
+    cursor.shx_file.open(shx_filename, std::ios::binary);
+    if (!cursor.shx_file.is_open()) {
+        std::cerr << "Failed to open " << shx_filename << std::endl;
+        return false;
+    }
+    
+    // .dbf file is optional
+    if (has_dbf_) {
+        dbf_.openCursor(cursor.dbf);
+    }
+    return true;
+}
+
 void ShapefileReader::close() {
-    if (shp_file_.is_open()) shp_file_.close();
-    if (shx_file_.is_open()) shx_file_.close();
-    if (dbf_file_.is_open()) dbf_file_.close();
+    if (cursor_.shp_file.is_open()) cursor_.shp_file.close();
+    if (cursor_.shx_file.is_open()) cursor_.shx_file.close();
+    if (cursor_.dbf.file.is_open()) cursor_.dbf.file.close();
+    shp_map_.close();
+    shx_map_.close();
+    dbf_.close();
+    record_bounds_.clear();
+    bounds_index_.reset();
+    has_dbf_ = false;
     is_open_ = false;
 }
 
+const char* ShapefileReader::fetchBytes(std::ifstream& file, const MappedFile& map, size_t offset,
+                                        size_t size, std::vector<char>& buffer) const {
+    if (io_mode_ == IOMode::MemoryMapped) {
+        if (offset > map.size() || size > map.size() - offset) {
+            return nullptr;
+        }
+        return map.data() + offset;
+    }
+    
+    // Buffered mode: one seek and one read per request instead of per scalar
+    if (buffer.size() < size) {
+        buffer.resize(size);
+    }
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(offset));
+    if (!file.read(buffer.data(), static_cast<std::streamsize>(size))) {
+        return nullptr;
+    }
+    return buffer.data();
+}
+
 bool ShapefileReader::readShapefileHeader() {
-    shp_file_.seekg(0);
+    // Main file header (100 bytes)
+    const char* header = fetchBytes(cursor_.shp_file, shp_map_, 0, 100, cursor_.record_buffer);
+    if (!header) {
+        return false;
+    }
     
-    // Read main file header (100 bytes)
-    file_code_ = readValue<int32_t>(shp_file_, true);  // Big endian
+    file_code_ = readValue<int32_t>(header, true);  // Big endian
     if (file_code_ != 9994) {
         std::cerr << "Invalid shapefile file code: " << file_code_ << std::endl;
         return false;
     }
     
-    // Skip unused fields (5 * 4 bytes)
-    shp_file_.seekg(20, std::ios::cur);
-    
-    file_length_ = readValue<int32_t>(shp_file_, true);  // Big endian, in 16-bit words
-    version_ = readValue<int32_t>(shp_file_);            // Little endian
-    shape_type_ = static_cast<ShapeType>(readValue<int32_t>(shp_file_));
+    // Bytes 4-23 are unused
+    file_length_ = readValue<int32_t>(header + 24, true);  // Big endian, in 16-bit words
+    version_ = readValue<int32_t>(header + 28);            // Little endian
+    shape_type_ = static_cast<ShapeType>(readValue<int32_t>(header + 32));
+    codec_ = selectCodec(shape_type_);
     
     // Read bounding box
-    bounds_.min_x = readValue<double>(shp_file_);
-    bounds_.min_y = readValue<double>(shp_file_);
-    bounds_.max_x = readValue<double>(shp_file_);
-    bounds_.max_y = readValue<double>(shp_file_);
+    bounds_.min_x = readValue<double>(header + 36);
+    bounds_.min_y = readValue<double>(header + 44);
+    bounds_.max_x = readValue<double>(header + 52);
+    bounds_.max_y = readValue<double>(header + 60);
     
-    // Skip Z and M ranges (4 * 8 bytes)
-    shp_file_.seekg(32, std::ios::cur);
+    // Z and M ranges (bytes 68-99) are not used
     
     return true;
 }
 
-bool ShapefileReader::readDBFHeader() {
-    if (!dbf_file_.is_open()) return false;
-    
-    dbf_file_.seekg(0);
-    
-    // Read DBF header
-    uint8_t version = readValue<uint8_t>(dbf_file_);
-    
-    // Skip date (3 bytes)
-    dbf_file_.seekg(3, std::ios::cur);
-    
-    record_count_ = readValue<uint32_t>(dbf_file_);
-    header_length_ = readValue<uint16_t>(dbf_file_);
-    record_length_ = readValue<uint16_t>(dbf_file_);
-    
-    // Skip reserved fields (20 bytes)
-    dbf_file_.seekg(20, std::ios::cur);
-    
-    // Read field definitions
-    field_definitions_.clear();
-    size_t field_offset = 32;  // DBF header size
-    
-    while (field_offset < header_length_ - 1) {  // -1 for field terminator
-        FieldDefinition field;
-        
-        // Read field name (11 bytes, null-terminated)
-        char field_name[12] = {0};
-        dbf_file_.read(field_name, 11);
-        field.name = std::string(field_name);
-        
-        // Read field type
-        char type_char = readValue<char>(dbf_file_);
-        switch (type_char) {
-            case 'C': field.type = FieldType::Character; break;
-            case 'N': field.type = FieldType::Numeric; break;
-            case 'L': field.type = FieldType::Logical; break;
-            case 'D': field.type = FieldType::Date; break;
-            case 'F': field.type = FieldType::Float; break;
-            default: field.type = FieldType::Unknown; break;
+std::unique_ptr<ShapeRecord> ShapefileReader::readRecord(uint32_t index) {
+    return readRecord(index, cursor_, ReadOptions(), resolveFields(ReadOptions()));
+}
+
+std::vector<size_t> ShapefileReader::resolveFields(const ReadOptions& options) const {
+    std::vector<size_t> field_indices;
+    if (options.read_attributes && has_dbf_) {
+        const std::vector<FieldDefinition>& fields = dbf_.getFields();
+        for (size_t f = 0; f < fields.size(); ++f) {
+            if (options.fields.empty() ||
+                std::find(options.fields.begin(), options.fields.end(), fields[f].name) != options.fields.end()) {
+                field_indices.push_back(f);
+            }
         }
-        
-        // Skip field data address (4 bytes)
-        dbf_file_.seekg(4, std::ios::cur);
-        
-        field.length = readValue<uint8_t>(dbf_file_);
-        field.decimal_count = readValue<uint8_t>(dbf_file_);
-        
-        // Skip reserved fields (14 bytes)
-        dbf_file_.seekg(14, std::ios::cur);
-        
-        field_definitions_.push_back(field);
-        field_offset += 32;
     }
+    return field_indices;
+}
+
+const char* ShapefileReader::fetchShape(uint32_t index, RecordCursor& cursor, size_t& content_length) const {
+    // Read from .shx file to get record offset and length
+    const char* index_entry = fetchBytes(cursor.shx_file, shx_map_, 100 + static_cast<size_t>(index) * 8, 8,
+                                         cursor.index_buffer);
+    if (!index_entry) {
+        return nullptr;
+    }
+    size_t offset = static_cast<size_t>(readValue<int32_t>(index_entry, true)) * 2;  // Words to bytes
+    content_length = static_cast<size_t>(readValue<int32_t>(index_entry + 4, true)) * 2;
     
-    return true;
+    // Read the whole shape record (8-byte header + content) from .shp file
+    return fetchBytes(cursor.shp_file, shp_map_, offset, 8 + content_length, cursor.record_buffer);
 }
 
-std::unique_ptr<ShapeRecord> ShapefileReader::readRecord(uint32_t index) {
+std::unique_ptr<ShapeRecord> ShapefileReader::readRecord(uint32_t index, RecordCursor& cursor,
+                                                         const ReadOptions& options,
+                                                         const std::vector<size_t>& field_indices) const {
     if (!is_open_ || index >= record_count_) {
         return nullptr;
     }
     
-    // Read from .shx file to get record offset and length
-    shx_file_.seekg(100 + index * 8);  // Skip header + index * record_size
-    int32_t offset = readValue<int32_t>(shx_file_, true) * 2;  // Convert from words to bytes
-    int32_t length = readValue<int32_t>(shx_file_, true) * 2;
-    
-    // Read shape record from .shp file
-    shp_file_.seekg(offset);
-    int32_t record_number = readValue<int32_t>(shp_file_, true);
-    int32_t content_length = readValue<int32_t>(shp_file_, true);
-    
     auto record = std::make_unique<ShapeRecord>();
-    record->record_number = record_number;
+    record->record_number = static_cast<int32_t>(index) + 1;
+    record->index = index;
     
-    // Read geometry
-    ShapeType record_shape_type = static_cast<ShapeType>(readValue<int32_t>(shp_file_));
-    if (record_shape_type != ShapeType::NullShape) {
-        record->geometry = readGeometry(shp_file_, record_shape_type);
+    if (options.read_geometry) {
+        size_t length = 0;
+        const char* shape = fetchShape(index, cursor, length);
+        if (!shape) {
+            return nullptr;
+        }
+        record->record_number = readValue<int32_t>(shape, true);
+        
+        record->geometry = decodeShape(shape + 8, length, options.arena);
     }
     
     // Read DBF attributes
-    if (dbf_file_.is_open()) {
-        record->attributes = readDBFRecord(index);
+    if (!field_indices.empty() && !dbf_.readRecord(index, cursor.dbf, field_indices, record->attributes)) {
+        record->attributes.clear();
     }
     
     return record;
@@ -188,8 +489,15 @@ std::vector<std::unique_ptr<ShapeRecord>> ShapefileReader::readAllRecords() {
     std::vector<std::unique_ptr<ShapeRecord>> records;
     records.reserve(record_count_);
     
+    // Records are stored in index order, so this is a linear pass over the files
+    if (io_mode_ == IOMode::MemoryMapped) {
+        shp_map_.adviseSequential();
+        dbf_.adviseSequential();
+    }
+    
+    std::vector<size_t> field_indices = resolveFields(ReadOptions());
     for (uint32_t i = 0; i < record_count_; ++i) {
-        auto record = readRecord(i);
+        auto record = readRecord(i, cursor_, ReadOptions(), field_indices);
         if (record) {
             records.push_back(std::move(record));
         }
@@ -198,174 +506,321 @@ std::vector<std::unique_ptr<ShapeRecord>> ShapefileReader::readAllRecords() {
     return records;
 }
 
+std::vector<std::unique_ptr<ShapeRecord>> ShapefileReader::readAllRecordsParallel(size_t num_threads,
+                                                                                 const ReadOptions& options) {
+    if (!is_open_) return {};
+    
+    std::vector<std::unique_ptr<ShapeRecord>> records(record_count_);
+    std::vector<size_t> field_indices = resolveFields(options);
+    
+    if (io_mode_ == IOMode::MemoryMapped) {
+        if (options.read_geometry) shp_map_.adviseSequential();
+        if (!field_indices.empty()) dbf_.adviseSequential();
+    }
+    
+    // Each worker keeps one cursor for all the index ranges it claims
+    std::vector<std::unique_ptr<RecordCursor>> cursors(resolveThreadCount(num_threads));
+    std::atomic<bool> cursor_failed(false);
+    
+    parallelFor(record_count_, cursors.size(), [&](size_t begin, size_t end, size_t worker) {
+        if (cursor_failed.load(std::memory_order_relaxed)) return;
+        auto& cursor = cursors[worker];
+        if (!cursor) {
+            cursor = std::make_unique<RecordCursor>();
+            if (!openCursor(*cursor)) {
+                // Its ranges would go unread; fail the whole load rather than
+                // hand back a silently short result
+                cursor.reset();
+                cursor_failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+        for (size_t i = begin; i < end; ++i) {
+            records[i] = readRecord(static_cast<uint32_t>(i), *cursor, options, field_indices);
+        }
+    });
+    
+    if (cursor_failed) {
+        std::cerr << "Failed to read " << base_filename_ << ": a worker could not open its files" << std::endl;
+        return {};
+    }
+    
+    // Drop unreadable records like the sequential path does
+    records.erase(std::remove(records.begin(), records.end(), nullptr), records.end());
+    
+    return records;
+}
+
+size_t ShapefileReader::forEachRecord(const RecordVisitor& visitor, const ReadOptions& options) {
+    if (!is_open_ || !visitor) return 0;
+    
+    // Resolve the requested attribute subset to field indices once
+    std::vector<size_t> field_indices = resolveFields(options);
+    bool read_attributes = !field_indices.empty();
+    
+    if (io_mode_ == IOMode::MemoryMapped) {
+        if (options.read_geometry) shp_map_.adviseSequential();
+        if (read_attributes) dbf_.adviseSequential();
+    }
+    
+    ShapeRecord record;
+    std::unique_ptr<Geometry> spare;  // Holds the scratch geometry while a record has none
+    size_t visited = 0;
+    
+    for (uint32_t i = 0; i < record_count_; ++i) {
+        record.record_number = static_cast<int32_t>(i) + 1;
+        record.index = i;
+        
+        if (options.read_geometry) {
+            size_t length = 0;
+            const char* shape = fetchShape(i, cursor_, length);
+            if (!shape) {
+                continue;  // Unreadable records are skipped like readAllRecords does
+            }
+            record.record_number = readValue<int32_t>(shape, true);
+            readGeometryInto(shape + 8, length, record.geometry, spare);
+        }
+        
+        if (read_attributes && !dbf_.readRecord(i, cursor_.dbf, field_indices, record.attributes)) {
+            record.attributes.clear();
+        }
+        
+        ++visited;
+        if (!visitor(record)) {
+            break;
+        }
+    }
+    
+    return visited;
+}
+
 std::vector<std::unique_ptr<ShapeRecord>> ShapefileReader::readRecordsInBounds(const BoundingBox& bbox) {
     std::vector<std::unique_ptr<ShapeRecord>> records;
     
     if (!is_open_) return records;
     
-    // Read all records and filter by bounding box
-    for (uint32_t i = 0; i < record_count_; ++i) {
-        auto record = readRecord(i);
-        if (record && record->geometry) {
-            BoundingBox record_bounds = record->geometry->getBounds();
-            
-            // Check if the record's bounding box intersects with the query bbox
-            if (bbox.intersects(record_bounds)) {
-                records.push_back(std::move(record));
+    // Filter on the stored record bboxes first; decode only the hits
+    std::vector<size_t> hits;
+    if (bounds_index_) {
+        hits = bounds_index_->query(bbox);
+        std::sort(hits.begin(), hits.end());
+    } else {
+        for (uint32_t i = 0; i < record_count_; ++i) {
+            BoundingBox record_bounds;
+            if (readRecordBounds(i, cursor_, record_bounds) && bbox.intersects(record_bounds)) {
+                hits.push_back(i);
             }
         }
     }
     
+    std::vector<size_t> field_indices = resolveFields(ReadOptions());
+    for (size_t index : hits) {
+        auto record = readRecord(static_cast<uint32_t>(index), cursor_, ReadOptions(), field_indices);
+        if (record && record->geometry) {
+            records.push_back(std::move(record));
+        }
+    }
+    
     return records;
 }
 
-std::unique_ptr<Geometry> ShapefileReader::readGeometry(std::ifstream& file, ShapeType type) {
-    switch (type) {
+bool ShapefileReader::readRecordBounds(uint32_t index, BoundingBox& bounds) {
+    return readRecordBounds(index, cursor_, bounds);
+}
+
+bool ShapefileReader::readRecordBounds(uint32_t index, RecordCursor& cursor, BoundingBox& bounds) const {
+    if (!is_open_ || index >= record_count_) {
+        return false;
+    }
+    
+    const char* index_entry = fetchBytes(cursor.shx_file, shx_map_, 100 + static_cast<size_t>(index) * 8, 8,
+                                         cursor.index_buffer);
+    if (!index_entry) {
+        return false;
+    }
+    size_t offset = static_cast<size_t>(readValue<int32_t>(index_entry, true)) * 2;
+    size_t length = static_cast<size_t>(readValue<int32_t>(index_entry + 4, true)) * 2;
+    if (length < 4) {
+        return false;
+    }
+    
+    // Shape type followed by the bbox (or XY for point types); nothing else is read
+    const char* content = fetchBytes(cursor.shp_file, shp_map_, offset + 8, std::min<size_t>(length, 36),
+                                     cursor.record_buffer);
+    if (!content) {
+        return false;
+    }
+    
+    switch (static_cast<ShapeType>(readValue<int32_t>(content))) {
+        case ShapeType::NullShape:
+            return false;
         case ShapeType::Point:
-            return readPoint(file);
-        case ShapeType::PolyLine:
-            return readPolyline(file);
-        case ShapeType::Polygon:
-            return readPolygon(file);
+        case ShapeType::PointZ:
+        case ShapeType::PointM: {
+            if (length < 20) return false;
+            double x = readValue<double>(content + 4);
+            double y = readValue<double>(content + 12);
+            bounds = BoundingBox(x, y, x, y);
+            return true;
+        }
         default:
-            // Skip unsupported geometry types
-            return nullptr;
+            if (length < 36) return false;
+            bounds.min_x = readValue<double>(content + 4);
+            bounds.min_y = readValue<double>(content + 12);
+            bounds.max_x = readValue<double>(content + 20);
+            bounds.max_y = readValue<double>(content + 28);
+            return true;
     }
 }
 
-std::unique_ptr<PointGeometry> ShapefileReader::readPoint(std::ifstream& file) {
-    double x = readValue<double>(file);
-    double y = readValue<double>(file);
-    return std::make_unique<PointGeometry>(Point2D(x, y));
+namespace {
+
+const char kBoundsSidecarMagic[8] = {'G', 'I', 'S', 'B', 'B', 'X', '\0', '\0'};
+const uint32_t kBoundsSidecarVersion = 1;
+
+struct BoundsSidecarHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_count;
+    uint64_t shp_size;
+    int64_t shp_mtime;
+};
+
+bool shapefileStamp(const std::string& shp_filename, uint64_t& size, int64_t& mtime) {
+    std::error_code ec;
+    size = static_cast<uint64_t>(std::filesystem::file_size(shp_filename, ec));
+    if (ec) return false;
+    mtime = static_cast<int64_t>(std::filesystem::last_write_time(shp_filename, ec).time_since_epoch().count());
+    return !ec;
 }
 
-std::unique_ptr<PolylineGeometry> ShapefileReader::readPolyline(std::ifstream& file) {
-    // Skip bounding box (4 * 8 bytes)
-    file.seekg(32, std::ios::cur);
-    
-    int32_t num_parts = readValue<int32_t>(file);
-    int32_t num_points = readValue<int32_t>(file);
-    
-    // Read part indices
-    std::vector<int32_t> parts(num_parts);
-    for (int32_t i = 0; i < num_parts; ++i) {
-        parts[i] = readValue<int32_t>(file);
+} // namespace
+
+bool ShapefileReader::loadBoundsSidecar(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
     }
     
-    // Read all points
-    std::vector<Point2D> all_points(num_points);
-    for (int32_t i = 0; i < num_points; ++i) {
-        all_points[i].x = readValue<double>(file);
-        all_points[i].y = readValue<double>(file);
+    BoundsSidecarHeader header;
+    uint64_t shp_size = 0;
+    int64_t shp_mtime = 0;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kBoundsSidecarMagic, sizeof(header.magic)) != 0 ||
+        header.version != kBoundsSidecarVersion ||
+        header.record_count != record_count_ ||
+        !shapefileStamp(base_filename_ + ".shp", shp_size, shp_mtime) ||
+        header.shp_size != shp_size || header.shp_mtime != shp_mtime) {
+        return false;  // Stale or foreign sidecar
     }
     
-    // Split points into parts
-    std::vector<std::vector<Point2D>> polyline_parts;
-    for (int32_t i = 0; i < num_parts; ++i) {
-        int32_t start = parts[i];
-        int32_t end = (i == num_parts - 1) ? num_points : parts[i + 1];
-        
-        std::vector<Point2D> part(all_points.begin() + start, all_points.begin() + end);
-        polyline_parts.push_back(std::move(part));
+    static_assert(sizeof(BoundingBox) == 4 * sizeof(double), "BoundingBox must be four packed doubles");
+    std::vector<BoundingBox> bounds(record_count_);
+    if (!file.read(reinterpret_cast<char*>(bounds.data()),
+                   static_cast<std::streamsize>(bounds.size() * sizeof(BoundingBox)))) {
+        return false;
     }
     
-    return std::make_unique<PolylineGeometry>(std::move(polyline_parts));
+    record_bounds_ = std::move(bounds);
+    return true;
 }
 
-std::unique_ptr<PolygonGeometry> ShapefileReader::readPolygon(std::ifstream& file) {
-    // Skip bounding box (4 * 8 bytes)
-    file.seekg(32, std::ios::cur);
-    
-    int32_t num_parts = readValue<int32_t>(file);
-    int32_t num_points = readValue<int32_t>(file);
-    
-    // Read part indices
-    std::vector<int32_t> parts(num_parts);
-    for (int32_t i = 0; i < num_parts; ++i) {
-        parts[i] = readValue<int32_t>(file);
+bool ShapefileReader::saveBoundsSidecar(const std::string& filename) const {
+    BoundsSidecarHeader header;
+    std::memcpy(header.magic, kBoundsSidecarMagic, sizeof(header.magic));
+    header.version = kBoundsSidecarVersion;
+    header.record_count = static_cast<uint32_t>(record_bounds_.size());
+    if (!shapefileStamp(base_filename_ + ".shp", header.shp_size, header.shp_mtime)) {
+        return false;
     }
     
-    // Read all points
-    std::vector<Point2D> all_points(num_points);
-    for (int32_t i = 0; i < num_points; ++i) {
-        all_points[i].x = readValue<double>(file);
-        all_points[i].y = readValue<double>(file);
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
     }
-    
-    // Split points into rings
-    std::vector<std::vector<Point2D>> rings;
-    for (int32_t i = 0; i < num_parts; ++i) {
-        int32_t start = parts[i];
-        int32_t end = (i == num_parts - 1) ? num_points : parts[i + 1];
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(record_bounds_.data()),
+               static_cast<std::streamsize>(record_bounds_.size() * sizeof(BoundingBox)));
+    return static_cast<bool>(file);
+}
+
+bool ShapefileReader::buildBoundsIndex(bool persist) {
+    if (!is_open_) return false;
+    
+    std::string sidecar_filename = base_filename_ + ".bbx";
+    if (!loadBoundsSidecar(sidecar_filename)) {
+        record_bounds_.assign(record_count_, BoundingBox::empty());
+        for (uint32_t i = 0; i < record_count_; ++i) {
+            if (!readRecordBounds(i, cursor_, record_bounds_[i])) {
+                record_bounds_[i] = BoundingBox::empty();
+            }
+        }
         
-        std::vector<Point2D> ring(all_points.begin() + start, all_points.begin() + end);
-        rings.push_back(std::move(ring));
+        if (persist && !saveBoundsSidecar(sidecar_filename)) {
+            std::cerr << "Failed to write " << sidecar_filename << std::endl;
+        }
     }
     
-    return std::make_unique<PolygonGeometry>(std::move(rings));
+    bounds_index_ = std::make_unique<RTree>();
+    bounds_index_->bulkLoad(record_bounds_);
+    bounds_index_->freeze();
+    
+    return true;
 }
 
-std::unordered_map<std::string, FieldValue> ShapefileReader::readDBFRecord(uint32_t record_index) {
-    std::unordered_map<std::string, FieldValue> attributes;
-    
-    if (!dbf_file_.is_open() || record_index >= record_count_) {
-        return attributes;
+std::unique_ptr<Geometry> ShapefileReader::readGeometry(const char* data, size_t size, ShapeType type,
+                                                        DatasetArena* arena) {
+    return selectCodec(type).decode(data, size, arena);
+}
+
+std::unique_ptr<Geometry> ShapefileReader::decodeShape(const char* content, size_t length,
+                                                       DatasetArena* arena) const {
+    if (length < 4) {
+        return nullptr;
+    }
+    ShapeType type = static_cast<ShapeType>(readValue<int32_t>(content));
+    if (type == shape_type_) {
+        return codec_.decode(content + 4, length - 4, arena);
+    }
+    if (type == ShapeType::NullShape) {
+        return nullptr;
     }
     
-    // Calculate record position
-    size_t record_pos = header_length_ + record_index * record_length_;
-    dbf_file_.seekg(record_pos);
+    // Records are meant to share the header's type; decode strays generically
+    return readGeometry(content + 4, length - 4, type, arena);
+}
+
+void ShapefileReader::readGeometryInto(const char* data, size_t size, std::unique_ptr<Geometry>& geometry,
+                                       std::unique_ptr<Geometry>& spare) const {
+    if (!geometry) {
+        geometry = std::move(spare);
+    }
     
-    // Skip deletion flag
-    char deletion_flag = readValue<char>(dbf_file_);
-    if (deletion_flag == '*') {
-        return attributes;  // Record is deleted
+    ShapeType type = size >= 4 ? static_cast<ShapeType>(readValue<int32_t>(data)) : ShapeType::NullShape;
+    data += 4;
+    size = size >= 4 ? size - 4 : 0;
+    
+    bool decoded = false;
+    if (type == shape_type_ && geometry && geometry->getType() == codec_.geometry_type) {
+        // Same type as the previous record: refill the existing buffers in place
+        decoded = codec_.refill(data, size, *geometry);
+    } else if (type != ShapeType::NullShape) {
+        if (auto fresh = readGeometry(data, size, type)) {
+            geometry = std::move(fresh);
+            decoded = true;
+        }
     }
     
-    // Read field values
-    for (const auto& field : field_definitions_) {
-        std::vector<char> field_data(field.length);
-        dbf_file_.read(field_data.data(), field.length);
-        
-        std::string field_str(field_data.begin(), field_data.end());
-        
-        // Trim whitespace
-        field_str.erase(0, field_str.find_first_not_of(" \t"));
-        field_str.erase(field_str.find_last_not_of(" \t") + 1);
-        
-        // Convert based on field type
-        switch (field.type) {
-            case FieldType::Character:
-                attributes[field.name] = field_str;
-                break;
-            case FieldType::Numeric:
-            case FieldType::Float:
-                if (!field_str.empty()) {
-                    try {
-                        attributes[field.name] = std::stod(field_str);
-                    } catch (...) {
-                        attributes[field.name] = 0.0;
-                    }
-                } else {
-                    attributes[field.name] = 0.0;
-                }
-                break;
-            case FieldType::Logical:
-                attributes[field.name] = (field_str == "T" || field_str == "t" || field_str == "Y" || field_str == "y");
-                break;
-            default:
-                attributes[field.name] = field_str;
-                break;
-        }
-    }
-    
-    return attributes;
+    // Null, unsupported or malformed shape: keep the buffers for later records
+    if (!decoded && geometry) {
+        spare = std::move(geometry);
+    }
 }
 
 template<typename T>
-T ShapefileReader::readValue(std::ifstream& file, bool swap_endian) {
+T ShapefileReader::readValue(const char* data, bool swap_endian) {
     T value;
-    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    std::memcpy(&value, data, sizeof(T));
     
     if (swap_endian && sizeof(T) > 1) {
         swapEndian(&value, sizeof(T));
@@ -390,9 +845,9 @@ std::string ShapefileReader::getInfo() const {
     oss << "  Bounds: (" << bounds_.min_x << ", " << bounds_.min_y 
         << ") to (" << bounds_.max_x << ", " << bounds_.max_y << ")\n";
     
-    if (!field_definitions_.empty()) {
+    if (!dbf_.getFields().empty()) {
         oss << "  Fields:\n";
-        for (const auto& field : field_definitions_) {
+        for (const auto& field : dbf_.getFields()) {
             oss << "    " << field.name << " (" << static_cast<int>(field.type) 
                 << ", " << static_cast<int>(field.length) << ")\n";
         }
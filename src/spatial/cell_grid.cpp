@@ -0,0 +1,256 @@
+#include "gis/cell_grid.h"
+#include "gis/query_metrics.h"
+#include <cmath>
+#include <sstream>
+#include <utility>
+
+namespace gis {
+
+namespace {
+
+// Keeps a fine resolution over a wide extent from taking all memory
+constexpr size_t kMaxCells = size_t(1) << 26;
+
+// Slack, in cells, by which boundary edges are widened when rasterised so
+// that rounding in the point -> cell mapping never puts a point on the
+// wrong side of an edge the grid believes is elsewhere
+constexpr double kEdgeSlack = 1e-6;
+
+size_t cellIndex(double coordinate, size_t count) {
+    double cell = std::floor(coordinate);
+    if (!(cell > 0.0)) return 0;
+    return std::min(static_cast<size_t>(cell), count - 1);
+}
+
+} // namespace
+
+CellGrid::CellGrid()
+    : bounds_(BoundingBox::empty())
+    , columns_(0)
+    , rows_(0)
+    , scale_x_(0.0)
+    , scale_y_(0.0) {
+}
+
+CellGrid::CellGrid(const std::vector<PreparedPolygon>& polygons, size_t resolution) : CellGrid() {
+    BoundingBox bounds = BoundingBox::empty();
+    for (const PreparedPolygon& polygon : polygons) {
+        if (!polygon.isEmpty()) {
+            bounds.expand(polygon.getPolygon()->getBounds());
+        }
+    }
+    if (resolution == 0 || bounds.isEmpty() || polygons.size() >= kNoRecord) {
+        return;
+    }
+
+    // Square cells: the longer side gets resolution cells, the other as many as fit
+    double width = bounds.max_x - bounds.min_x;
+    double height = bounds.max_y - bounds.min_y;
+    double longer = std::max(width, height);
+    resolution = std::min(resolution, kMaxCells);
+    auto cellsAlong = [&](double side) {
+        if (!(longer > 0.0)) return size_t(1);
+        return std::clamp<size_t>(static_cast<size_t>(std::ceil(side / longer * resolution)), 1, resolution);
+    };
+    size_t columns = cellsAlong(width);
+    size_t rows = cellsAlong(height);
+    while (columns * rows > kMaxCells) {
+        columns = std::max<size_t>(1, columns / 2);
+        rows = std::max<size_t>(1, rows / 2);
+    }
+    setLayout(bounds, static_cast<uint32_t>(columns), static_cast<uint32_t>(rows));
+
+    // Polygons in index order, so the first to claim a cell is the lowest
+    std::vector<uint32_t> inside(columns * rows, kNoRecord);
+    std::vector<std::pair<uint32_t, uint32_t>> crossings;  // (cell, polygon), polygon ascending
+    std::vector<uint8_t> touched;
+    for (size_t i = 0; i < polygons.size(); ++i) {
+        if (polygons[i].isEmpty()) continue;
+        const PolygonGeometry& polygon = *polygons[i].getPolygon();
+        const BoundingBox& box = polygon.getBounds();
+        size_t c0 = columnOf(box.min_x), c1 = columnOf(box.max_x);
+        size_t r0 = rowOf(box.min_y), r1 = rowOf(box.max_y);
+        size_t span = c1 - c0 + 1;
+        touched.assign(span * (r1 - r0 + 1), 0);
+
+        // Mark every cell an edge passes through, row by row: within a row
+        // the edge covers one x-range, widened by the slack
+        const Buffer<Point2D>& points = polygon.getPoints();
+        const Buffer<uint32_t>& offsets = polygon.getPartOffsets();
+        for (size_t ring = 0; ring < polygon.getNumRings(); ++ring) {
+            uint32_t begin = offsets[ring];
+            uint32_t end = offsets[ring + 1];
+            if (begin == end) continue;
+
+            uint32_t prev = end - 1;
+            for (uint32_t cur = begin; cur < end; prev = cur++) {
+                double u0 = (points[prev].x - bounds_.min_x) * scale_x_;
+                double v0 = (points[prev].y - bounds_.min_y) * scale_y_;
+                double u1 = (points[cur].x - bounds_.min_x) * scale_x_;
+                double v1 = (points[cur].y - bounds_.min_y) * scale_y_;
+                if (v0 > v1) {
+                    std::swap(u0, u1);
+                    std::swap(v0, v1);
+                }
+                size_t first_row = std::max(r0, cellIndex(v0 - kEdgeSlack, rows_));
+                size_t last_row = std::min(r1, cellIndex(v1 + kEdgeSlack, rows_));
+                for (size_t r = first_row; r <= last_row; ++r) {
+                    double lo = u0, hi = u1;
+                    if (v1 > v0) {
+                        double slope = (u1 - u0) / (v1 - v0);
+                        double a = std::clamp(static_cast<double>(r) - kEdgeSlack, v0, v1);
+                        double b = std::clamp(static_cast<double>(r + 1) + kEdgeSlack, v0, v1);
+                        lo = u0 + (a - v0) * slope;
+                        hi = u0 + (b - v0) * slope;
+                    }
+                    if (lo > hi) std::swap(lo, hi);
+                    size_t first_column = std::max(c0, cellIndex(lo - kEdgeSlack, columns_));
+                    size_t last_column = std::min(c1, cellIndex(hi + kEdgeSlack, columns_));
+                    uint8_t* row = touched.data() + (r - r0) * span;
+                    for (size_t c = first_column; c <= last_column; ++c) {
+                        row[c - c0] = 1;
+                    }
+                }
+            }
+        }
+
+        // Untouched cells next to each other in a row share one side of every
+        // edge, so one test decides the whole run
+        for (size_t r = r0; r <= r1; ++r) {
+            const uint8_t* row = touched.data() + (r - r0) * span;
+            for (size_t c = c0; c <= c1;) {
+                size_t cell = r * columns_ + c;
+                if (row[c - c0]) {
+                    crossings.emplace_back(static_cast<uint32_t>(cell), static_cast<uint32_t>(i));
+                    ++c;
+                    continue;
+                }
+                size_t run_end = c;
+                while (run_end <= c1 && !row[run_end - c0]) ++run_end;
+                double x = scale_x_ > 0.0 ? bounds_.min_x + (static_cast<double>(c) + 0.5) / scale_x_ : box.min_x;
+                double y = scale_y_ > 0.0 ? bounds_.min_y + (static_cast<double>(r) + 0.5) / scale_y_ : box.min_y;
+                if (polygons[i].contains(Point2D(x, y))) {
+                    for (size_t k = c; k < run_end; ++k) {
+                        if (inside[r * columns_ + k] == kNoRecord) {
+                            inside[r * columns_ + k] = static_cast<uint32_t>(i);
+                        }
+                    }
+                }
+                c = run_end;
+            }
+        }
+    }
+
+    // Keep only the crossings that can beat the cell's inside polygon; a
+    // stable counting sort by cell keeps them in index order
+    std::vector<Cell> cells(columns * rows + 1, Cell{0, kNoRecord});
+    for (const auto& [cell, polygon] : crossings) {
+        if (polygon < inside[cell]) ++cells[cell + 1].first_candidate;
+    }
+    for (size_t cell = 0; cell < columns * rows; ++cell) {
+        cells[cell].inside = inside[cell];
+        cells[cell + 1].first_candidate += cells[cell].first_candidate;
+    }
+    std::vector<uint32_t> candidates(cells.back().first_candidate);
+    std::vector<uint32_t> fill(columns * rows);
+    for (size_t cell = 0; cell < columns * rows; ++cell) {
+        fill[cell] = cells[cell].first_candidate;
+    }
+    for (const auto& [cell, polygon] : crossings) {
+        if (polygon < inside[cell]) candidates[fill[cell]++] = polygon;
+    }
+
+    cells_ = Buffer<Cell>(std::move(cells));
+    candidates_ = Buffer<uint32_t>(std::move(candidates));
+}
+
+CellGrid::CellGrid(const BoundingBox& bounds, uint32_t columns, uint32_t rows,
+                   Buffer<Cell> cells, Buffer<uint32_t> candidates)
+    : CellGrid() {
+    setLayout(bounds, columns, rows);
+    cells_ = std::move(cells);
+    candidates_ = std::move(candidates);
+}
+
+void CellGrid::setLayout(const BoundingBox& bounds, uint32_t columns, uint32_t rows) {
+    bounds_ = bounds;
+    columns_ = columns;
+    rows_ = rows;
+    double width = bounds.max_x - bounds.min_x;
+    double height = bounds.max_y - bounds.min_y;
+    scale_x_ = width > 0.0 ? columns / width : 0.0;
+    scale_y_ = height > 0.0 ? rows / height : 0.0;
+}
+
+size_t CellGrid::columnOf(double x) const {
+    return cellIndex((x - bounds_.min_x) * scale_x_, columns_);
+}
+
+size_t CellGrid::rowOf(double y) const {
+    return cellIndex((y - bounds_.min_y) * scale_y_, rows_);
+}
+
+size_t CellGrid::findContaining(const Point2D& point, const std::vector<PreparedPolygon>& polygons) const {
+    if (cells_.empty() || !bounds_.contains(point)) {
+        return SIZE_MAX;
+    }
+
+    size_t cell = rowOf(point.y) * columns_ + columnOf(point.x);
+    uint32_t first = cells_[cell].first_candidate;
+    uint32_t last = cells_[cell + 1].first_candidate;
+    for (uint32_t k = first; k < last; ++k) {
+        StageTimer refine(QueryStage::Refine);
+        if (polygons[candidates_[k]].contains(point)) {
+            return candidates_[k];
+        }
+    }
+
+    uint32_t inside = cells_[cell].inside;
+    return inside != kNoRecord ? inside : SIZE_MAX;
+}
+
+bool CellGrid::fits(const std::vector<PreparedPolygon>& polygons) const {
+    if (isEmpty()) {
+        return true;
+    }
+    if (columns_ == 0 || rows_ == 0 || bounds_.isEmpty() ||
+        static_cast<size_t>(columns_) * rows_ > kMaxCells ||
+        cells_.size() != static_cast<size_t>(columns_) * rows_ + 1 ||
+        cells_[0].first_candidate != 0 || cells_[cells_.size() - 1].first_candidate != candidates_.size()) {
+        return false;
+    }
+
+    auto isPolygon = [&polygons](uint32_t index) {
+        return index < polygons.size() && !polygons[index].isEmpty();
+    };
+    for (size_t cell = 0; cell + 1 < cells_.size(); ++cell) {
+        if (cells_[cell].first_candidate > cells_[cell + 1].first_candidate) return false;
+        if (cells_[cell].inside != kNoRecord && !isPolygon(cells_[cell].inside)) return false;
+    }
+    for (uint32_t candidate : candidates_) {
+        if (!isPolygon(candidate)) return false;
+    }
+    return true;
+}
+
+size_t CellGrid::memoryUsage() const {
+    return cells_.memoryUsage() + candidates_.memoryUsage();
+}
+
+std::string CellGrid::getStats() const {
+    size_t interior = 0, boundary = 0;
+    for (size_t cell = 0; cell + 1 < cells_.size(); ++cell) {
+        if (cells_[cell].first_candidate != cells_[cell + 1].first_candidate) {
+            ++boundary;
+        } else if (cells_[cell].inside != kNoRecord) {
+            ++interior;
+        }
+    }
+
+    std::ostringstream oss;
+    oss << columns_ << "x" << rows_ << " cells (" << interior << " interior, " << boundary
+        << " boundary, " << candidates_.size() << " candidates)";
+    return oss.str();
+}
+
+} // namespace gis
@@ -0,0 +1,236 @@
+#include "gis/geometry_kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <type_traits>
+
+#if !defined(GIS_DISABLE_SIMD) && (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define GIS_KERNELS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace gis {
+
+namespace {
+
+static_assert(sizeof(Point2D) == 2 * sizeof(double) && std::is_standard_layout<Point2D>::value,
+              "Points are loaded as interleaved x, y pairs");
+
+inline bool crossesRay(const Point2D& pi, const Point2D& pj, const Point2D& point) {
+    return ((pi.y > point.y) != (pj.y > point.y)) &&
+           (point.x < (pj.x - pi.x) * (point.y - pi.y) / (pj.y - pi.y) + pi.x);
+}
+
+size_t countRingCrossingsScalar(const Point2D* ring, size_t count, const Point2D& point) {
+    size_t crossings = 0;
+    if (count == 0) {
+        return crossings;
+    }
+    size_t j = count - 1;
+    for (size_t i = 0; i < count; i++) {
+        crossings += crossesRay(ring[i], ring[j], point);
+        j = i;
+    }
+    return crossings;
+}
+
+BoundingBox computePointBoundsScalar(const Point2D* points, size_t count) {
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    for (size_t i = 0; i < count; ++i) {
+        min_x = std::min(min_x, points[i].x);
+        min_y = std::min(min_y, points[i].y);
+        max_x = std::max(max_x, points[i].x);
+        max_y = std::max(max_y, points[i].y);
+    }
+    return BoundingBox(min_x, min_y, max_x, max_y);
+}
+
+uint64_t intersectingBoxMaskScalar(const double* min_x, const double* min_y, const double* max_x,
+                                   const double* max_y, size_t count, const BoundingBox& query) {
+    uint64_t mask = 0;
+    for (size_t e = 0; e < count; ++e) {
+        if (!(min_x[e] > query.max_x || max_x[e] < query.min_x ||
+              min_y[e] > query.max_y || max_y[e] < query.min_y)) {
+            mask |= uint64_t(1) << e;
+        }
+    }
+    return mask;
+}
+
+#ifdef GIS_KERNELS_AVX2
+
+__attribute__((target("avx2")))
+size_t countRingCrossingsAVX2(const Point2D* ring, size_t count, const Point2D& point) {
+    if (count == 0) {
+        return 0;
+    }
+
+    // Closing edge first, then edge (i, i - 1) for i = 1..count-1, four at a time
+    size_t crossings = crossesRay(ring[0], ring[count - 1], point);
+    const __m256d px = _mm256_set1_pd(point.x);
+    const __m256d py = _mm256_set1_pd(point.y);
+    const double* coords = reinterpret_cast<const double*>(ring);
+
+    size_t i = 1;
+    for (; i + 4 <= count; i += 4) {
+        // Unpacking interleaved pairs gives lane order 0, 2, 1, 3 for both
+        // ends alike, so every lane still holds one whole edge
+        __m256d a = _mm256_loadu_pd(coords + 2 * i);
+        __m256d b = _mm256_loadu_pd(coords + 2 * i + 4);
+        __m256d c = _mm256_loadu_pd(coords + 2 * i - 2);
+        __m256d d = _mm256_loadu_pd(coords + 2 * i + 2);
+        __m256d xi = _mm256_unpacklo_pd(a, b);
+        __m256d yi = _mm256_unpackhi_pd(a, b);
+        __m256d xj = _mm256_unpacklo_pd(c, d);
+        __m256d yj = _mm256_unpackhi_pd(c, d);
+
+        __m256d straddles = _mm256_xor_pd(_mm256_cmp_pd(yi, py, _CMP_GT_OQ), _mm256_cmp_pd(yj, py, _CMP_GT_OQ));
+
+        // Lanes that do not straddle may divide by zero; they are masked off
+        __m256d x_cross = _mm256_add_pd(
+            _mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(xj, xi), _mm256_sub_pd(py, yi)), _mm256_sub_pd(yj, yi)), xi);
+        __m256d hits = _mm256_and_pd(straddles, _mm256_cmp_pd(px, x_cross, _CMP_LT_OQ));
+        crossings += static_cast<size_t>(__builtin_popcount(static_cast<unsigned>(_mm256_movemask_pd(hits))));
+    }
+    for (; i < count; ++i) {
+        crossings += crossesRay(ring[i], ring[i - 1], point);
+    }
+    return crossings;
+}
+
+__attribute__((target("avx2")))
+BoundingBox computePointBoundsAVX2(const Point2D* points, size_t count) {
+    if (count < 8) {
+        return computePointBoundsScalar(points, count);
+    }
+
+    // Lanes hold x, y, x, y; operand order matches std::min(acc, v) and
+    // std::max(acc, v), including NaN coordinates being skipped
+    const double* coords = reinterpret_cast<const double*>(points);
+    __m256d lo0 = _mm256_set1_pd(std::numeric_limits<double>::max());
+    __m256d hi0 = _mm256_set1_pd(std::numeric_limits<double>::lowest());
+    __m256d lo1 = lo0;
+    __m256d hi1 = hi0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d a = _mm256_loadu_pd(coords + 2 * i);
+        __m256d b = _mm256_loadu_pd(coords + 2 * i + 4);
+        lo0 = _mm256_min_pd(a, lo0);
+        hi0 = _mm256_max_pd(a, hi0);
+        lo1 = _mm256_min_pd(b, lo1);
+        hi1 = _mm256_max_pd(b, hi1);
+    }
+    alignas(32) double lo[4];
+    alignas(32) double hi[4];
+    _mm256_store_pd(lo, _mm256_min_pd(lo1, lo0));
+    _mm256_store_pd(hi, _mm256_max_pd(hi1, hi0));
+
+    double min_x = std::min(lo[0], lo[2]);
+    double min_y = std::min(lo[1], lo[3]);
+    double max_x = std::max(hi[0], hi[2]);
+    double max_y = std::max(hi[1], hi[3]);
+    for (; i < count; ++i) {
+        min_x = std::min(min_x, points[i].x);
+        min_y = std::min(min_y, points[i].y);
+        max_x = std::max(max_x, points[i].x);
+        max_y = std::max(max_y, points[i].y);
+    }
+
+    // Only +0 and -0 compare equal with different bits, and which of them
+    // a sequential fold keeps depends on order: redo those sequentially
+    if (min_x == 0.0 || min_y == 0.0 || max_x == 0.0 || max_y == 0.0) {
+        return computePointBoundsScalar(points, count);
+    }
+    return BoundingBox(min_x, min_y, max_x, max_y);
+}
+
+__attribute__((target("avx2")))
+uint64_t intersectingBoxMaskAVX2(const double* min_x, const double* min_y, const double* max_x,
+                                 const double* max_y, size_t count, const BoundingBox& query) {
+    const __m256d q_min_x = _mm256_set1_pd(query.min_x);
+    const __m256d q_min_y = _mm256_set1_pd(query.min_y);
+    const __m256d q_max_x = _mm256_set1_pd(query.max_x);
+    const __m256d q_max_y = _mm256_set1_pd(query.max_y);
+
+    uint64_t mask = 0;
+    size_t e = 0;
+    for (; e + 4 <= count; e += 4) {
+        // Ordered compares are false for NaN, like the scalar test
+        __m256d outside = _mm256_or_pd(
+            _mm256_or_pd(_mm256_cmp_pd(_mm256_loadu_pd(min_x + e), q_max_x, _CMP_GT_OQ),
+                         _mm256_cmp_pd(_mm256_loadu_pd(max_x + e), q_min_x, _CMP_LT_OQ)),
+            _mm256_or_pd(_mm256_cmp_pd(_mm256_loadu_pd(min_y + e), q_max_y, _CMP_GT_OQ),
+                         _mm256_cmp_pd(_mm256_loadu_pd(max_y + e), q_min_y, _CMP_LT_OQ)));
+        uint64_t inside = ~static_cast<unsigned>(_mm256_movemask_pd(outside)) & 0xFu;
+        mask |= inside << e;
+    }
+    if (e < count) {
+        mask |= intersectingBoxMaskScalar(min_x + e, min_y + e, max_x + e, max_y + e, count - e, query) << e;
+    }
+    return mask;
+}
+
+#endif // GIS_KERNELS_AVX2
+
+struct KernelSet {
+    const char* name;
+    size_t (*ring_crossings)(const Point2D*, size_t, const Point2D&);
+    BoundingBox (*point_bounds)(const Point2D*, size_t);
+    uint64_t (*box_mask)(const double*, const double*, const double*, const double*, size_t, const BoundingBox&);
+};
+
+const KernelSet kScalarKernels = {
+    "scalar", countRingCrossingsScalar, computePointBoundsScalar, intersectingBoxMaskScalar
+};
+
+#ifdef GIS_KERNELS_AVX2
+const KernelSet kAVX2Kernels = {
+    "avx2", countRingCrossingsAVX2, computePointBoundsAVX2, intersectingBoxMaskAVX2
+};
+#endif
+
+const KernelSet* bestKernels() {
+#ifdef GIS_KERNELS_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return &kAVX2Kernels;
+    }
+#endif
+    return &kScalarKernels;
+}
+
+std::atomic<const KernelSet*>& activeKernels() {
+    static std::atomic<const KernelSet*> kernels{bestKernels()};
+    return kernels;
+}
+
+inline const KernelSet& kernels() {
+    return *activeKernels().load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+size_t countRingCrossings(const Point2D* ring, size_t count, const Point2D& point) {
+    return kernels().ring_crossings(ring, count, point);
+}
+
+BoundingBox computePointBounds(const Point2D* points, size_t count) {
+    return kernels().point_bounds(points, count);
+}
+
+uint64_t intersectingBoxMask(const double* min_x, const double* min_y, const double* max_x,
+                             const double* max_y, size_t count, const BoundingBox& query) {
+    return kernels().box_mask(min_x, min_y, max_x, max_y, count, query);
+}
+
+const char* activeKernelSet() {
+    return kernels().name;
+}
+
+void setSimdKernelsEnabled(bool enabled) {
+    activeKernels().store(enabled ? bestKernels() : &kScalarKernels, std::memory_order_relaxed);
+}
+
+} // namespace gis
@@ -0,0 +1,329 @@
+#include "gis/prepared_polygon.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace gis {
+
+namespace {
+
+// Target number of edges per band; more bands means fewer edges per test
+// but long edges get listed in more bands
+constexpr size_t kEdgesPerBand = 4;
+constexpr size_t kMaxBands = 1 << 16;
+
+// Detail levels: only worth it for polygons whose bands get long. The
+// finest level simplifies by a fixed fraction of the polygon's extent and
+// each coarser one by kLevelStep times more; a level is only kept if it
+// has at most a quarter of the edges of the next finer one.
+constexpr size_t kMinDetailPoints = 4096;
+constexpr size_t kMinBandEdges = 32;  // Average full-resolution band length
+constexpr size_t kMaxDetailLevels = 3;
+constexpr double kFinestTolerance = 1.0 / 16384;
+constexpr double kLevelStep = 8.0;
+constexpr size_t kLevelReduction = 4;
+
+using Edge = PreparedPolygon::Edge;
+using Segment = PreparedPolygon::Segment;
+
+size_t bandIndex(double y, double min_y, double band_scale, size_t num_bands) {
+    // Monotone in y, so an edge spanning [lo, hi] is listed in the band of
+    // every y it can cross
+    double band = std::floor((y - min_y) * band_scale);
+    if (!(band > 0.0)) return 0;
+    return std::min(static_cast<size_t>(band), num_bands - 1);
+}
+
+double segmentDistanceSquared(const Point2D& point, const Point2D& a, const Point2D& b) {
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double length_sq = dx * dx + dy * dy;
+    double t = 0.0;
+    if (length_sq > 0.0) {
+        t = std::clamp(((point.x - a.x) * dx + (point.y - a.y) * dy) / length_sq, 0.0, 1.0);
+    }
+    double px = a.x + t * dx - point.x;
+    double py = a.y + t * dy - point.y;
+    return px * px + py * py;
+}
+
+template<typename T>
+Buffer<T> store(std::vector<T>& values, DatasetArena* arena) {
+    if (!arena) {
+        return Buffer<T>(std::move(values));
+    }
+    T* copy = arena->allocateArray<T>(values.size());
+    std::copy(values.begin(), values.end(), copy);
+    return Buffer<T>::borrow(copy, values.size());
+}
+
+/**
+ * Lay the per-band item lists out contiguously (CSR). An item is listed in
+ * every band its y-range, widened by pad on both sides, overlaps.
+ */
+template<typename Item, typename YRange>
+void layoutBands(const std::vector<Item>& items, YRange y_range, double pad, double min_y, double band_scale,
+                 size_t num_bands, DatasetArena* arena, Buffer<uint32_t>& band_offsets_out,
+                 Buffer<Item>& band_items_out) {
+    std::vector<uint32_t> band_offsets(num_bands + 1, 0);
+
+    // Two passes: count per band, then fill
+    for (const Item& item : items) {
+        auto [lo, hi] = y_range(item);
+        for (size_t b = bandIndex(lo - pad, min_y, band_scale, num_bands),
+                    last = bandIndex(hi + pad, min_y, band_scale, num_bands); b <= last; ++b) {
+            ++band_offsets[b + 1];
+        }
+    }
+    for (size_t b = 0; b < num_bands; ++b) {
+        band_offsets[b + 1] += band_offsets[b];
+    }
+
+    std::vector<Item> owned_items;
+    Item* band_items;
+    const size_t item_count = band_offsets.back();
+    if (arena) {
+        band_items = arena->allocateArray<Item>(item_count);
+    } else {
+        owned_items.resize(item_count);
+        band_items = owned_items.data();
+    }
+    std::vector<uint32_t> fill(band_offsets.begin(), band_offsets.end() - 1);
+    for (const Item& item : items) {
+        auto [lo, hi] = y_range(item);
+        for (size_t b = bandIndex(lo - pad, min_y, band_scale, num_bands),
+                    last = bandIndex(hi + pad, min_y, band_scale, num_bands); b <= last; ++b) {
+            band_items[fill[b]++] = item;
+        }
+    }
+
+    band_offsets_out = store(band_offsets, arena);
+    band_items_out = arena ? Buffer<Item>::borrow(band_items, item_count) : Buffer<Item>(std::move(owned_items));
+}
+
+/**
+ * Douglas-Peucker for all tolerances at once. After the call, vertex i of
+ * the run survives simplification with tolerance t iff importance[i] > t:
+ * a vertex's importance is its distance from the chord of the span it
+ * splits, capped by the importance of the spans containing that one. Spans
+ * are not split below min_tolerance. The end points are always kept.
+ */
+void simplificationImportance(const Point2D* points, size_t count, double min_tolerance, double* importance) {
+    std::fill(importance, importance + count, 0.0);
+    if (count == 0) return;
+    importance[0] = importance[count - 1] = std::numeric_limits<double>::infinity();
+
+    struct Span {
+        size_t first;
+        size_t last;
+        double limit;
+    };
+    std::vector<Span> stack = {{0, count - 1, std::numeric_limits<double>::infinity()}};
+    while (!stack.empty()) {
+        Span span = stack.back();
+        stack.pop_back();
+        if (span.last - span.first < 2) continue;
+
+        size_t farthest = span.first + 1;
+        double farthest_sq = -1.0;
+        for (size_t i = span.first + 1; i < span.last; ++i) {
+            double distance_sq = segmentDistanceSquared(points[i], points[span.first], points[span.last]);
+            if (distance_sq > farthest_sq) {
+                farthest_sq = distance_sq;
+                farthest = i;
+            }
+        }
+
+        double distance = std::sqrt(farthest_sq);
+        if (distance <= min_tolerance) continue;
+
+        double value = std::min(distance, span.limit);
+        importance[farthest] = value;
+        stack.push_back({span.first, farthest, value});
+        stack.push_back({farthest, span.last, value});
+    }
+}
+
+} // namespace
+
+PreparedPolygon::PreparedPolygon()
+    : polygon_(nullptr)
+    , band_scale_(0.0) {
+}
+
+PreparedPolygon::PreparedPolygon(const PolygonGeometry& polygon, DatasetArena* arena)
+    : polygon_(&polygon)
+    , bounds_(polygon.getBounds())
+    , band_scale_(0.0) {
+    const Buffer<Point2D>& points = polygon.getPoints();
+    const Buffer<uint32_t>& offsets = polygon.getPartOffsets();
+
+    // Collect the edges of every ring, closing each ring implicitly the way
+    // PolygonGeometry::contains() does; horizontal edges never cross the ray
+    std::vector<Edge> edges;
+    edges.reserve(points.size());
+    for (size_t i = 0; i < polygon.getNumRings(); ++i) {
+        uint32_t begin = offsets[i];
+        uint32_t end = offsets[i + 1];
+        if (begin == end) continue;
+
+        uint32_t prev = end - 1;
+        for (uint32_t cur = begin; cur < end; ++cur) {
+            if (points[cur].y != points[prev].y) {
+                edges.push_back({cur, prev});
+            }
+            prev = cur;
+        }
+    }
+
+    size_t num_bands = std::clamp<size_t>(edges.size() / kEdgesPerBand, 1, kMaxBands);
+    double height = bounds_.max_y - bounds_.min_y;
+    band_scale_ = height > 0.0 ? static_cast<double>(num_bands) / height : 0.0;
+    auto edgeRange = [&points](const Edge& edge) { return std::minmax(points[edge.from].y, points[edge.to].y); };
+    layoutBands(edges, edgeRange, 0.0, bounds_.min_y, band_scale_, num_bands, arena, band_offsets_, band_edges_);
+
+    buildDetailLevels(arena);
+}
+
+PreparedPolygon::PreparedPolygon(const PolygonGeometry& polygon, double band_scale,
+                                 Buffer<uint32_t> band_offsets, Buffer<Edge> band_edges,
+                                 std::vector<DetailLevel> levels)
+    : polygon_(&polygon)
+    , bounds_(polygon.getBounds())
+    , band_scale_(band_scale)
+    , band_offsets_(std::move(band_offsets))
+    , band_edges_(std::move(band_edges))
+    , levels_(std::move(levels)) {
+}
+
+void PreparedPolygon::buildDetailLevels(DatasetArena* arena) {
+    const Buffer<Point2D>& points = polygon_->getPoints();
+    const Buffer<uint32_t>& offsets = polygon_->getPartOffsets();
+    double extent = std::max(bounds_.max_x - bounds_.min_x, bounds_.max_y - bounds_.min_y);
+    if (points.size() < kMinDetailPoints || !(extent > 0.0) ||
+        band_edges_.size() < kMinBandEdges * getNumBands()) {
+        return;
+    }
+
+    double finest = extent * kFinestTolerance;
+    std::vector<double> importance(points.size());
+    for (size_t i = 0; i < polygon_->getNumRings(); ++i) {
+        simplificationImportance(points.data() + offsets[i], offsets[i + 1] - offsets[i], finest,
+                                 importance.data() + offsets[i]);
+    }
+
+    // Finest first, so each level can be checked against the next finer one
+    size_t finer_count = points.size();
+    double simplification = finest;
+    for (size_t k = 0; k < kMaxDetailLevels; ++k, simplification *= kLevelStep) {
+
+        // Kept vertices of each ring, closed implicitly like the full rings.
+        // A repeated closing vertex only adds a zero-length edge, so rings
+        // smaller than the tolerance shrink to a single point. Horizontal
+        // edges count here, since they can be close to a point.
+        std::vector<Point2D> ring;
+        std::vector<Segment> segments;
+        for (size_t i = 0; i < polygon_->getNumRings(); ++i) {
+            ring.clear();
+            for (uint32_t p = offsets[i]; p < offsets[i + 1]; ++p) {
+                if (importance[p] > simplification) {
+                    ring.push_back(points[p]);
+                }
+            }
+            if (ring.size() > 1 && ring.back().x == ring.front().x && ring.back().y == ring.front().y) {
+                ring.pop_back();
+            }
+            if (ring.empty()) continue;
+
+            const Point2D* prev = &ring.back();
+            for (const Point2D& cur : ring) {
+                segments.push_back({cur, *prev});
+                prev = &cur;
+            }
+        }
+        if (segments.size() * kLevelReduction > finer_count) continue;
+        finer_count = segments.size();
+
+        DetailLevel level;
+        level.tolerance = 2.0 * simplification;
+
+        // Bands no thinner than the tolerance, or edges repeat across many
+        double height = bounds_.max_y - bounds_.min_y;
+        size_t num_bands = std::clamp<size_t>(segments.size() / kEdgesPerBand, 1, kMaxBands);
+        num_bands = std::min(num_bands, std::max<size_t>(1, static_cast<size_t>(height / level.tolerance)));
+        level.band_scale = height > 0.0 ? static_cast<double>(num_bands) / height : 0.0;
+        auto segmentRange = [](const Segment& segment) { return std::minmax(segment.from.y, segment.to.y); };
+        layoutBands(segments, segmentRange, level.tolerance, bounds_.min_y, level.band_scale, num_bands, arena,
+                    level.band_offsets, level.band_segments);
+        levels_.push_back(std::move(level));
+    }
+
+    std::reverse(levels_.begin(), levels_.end());
+}
+
+size_t PreparedPolygon::bandOf(double y) const {
+    return bandIndex(y, bounds_.min_y, band_scale_, getNumBands());
+}
+
+int PreparedPolygon::classify(const DetailLevel& level, const Point2D& point) const {
+    size_t band = bandIndex(point.y, bounds_.min_y, level.band_scale, level.band_offsets.size() - 1);
+    const double limit = level.tolerance * level.tolerance;
+
+    bool inside = false;
+    for (uint32_t e = level.band_offsets[band]; e < level.band_offsets[band + 1]; ++e) {
+        const Point2D& pi = level.band_segments[e].from;
+        const Point2D& pj = level.band_segments[e].to;
+
+        if (segmentDistanceSquared(point, pi, pj) <= limit) {
+            return -1;
+        }
+        if (((pi.y > point.y) != (pj.y > point.y)) &&
+            (point.x < (pj.x - pi.x) * (point.y - pi.y) / (pj.y - pi.y) + pi.x)) {
+            inside = !inside;
+        }
+    }
+
+    return inside ? 1 : 0;
+}
+
+bool PreparedPolygon::contains(const Point2D& point) const {
+    if (!polygon_ || !bounds_.contains(point)) {
+        return false;
+    }
+
+    // Coarsest level first; a point near the simplified boundary falls
+    // through to the next finer level and finally to the full bands
+    for (const DetailLevel& level : levels_) {
+        int side = classify(level, point);
+        if (side >= 0) {
+            return side == 1;
+        }
+    }
+
+    const Point2D* points = polygon_->getPoints().data();
+    size_t band = bandOf(point.y);
+
+    // Same crossing rule as PolygonGeometry::contains(), restricted to the band
+    bool inside = false;
+    for (uint32_t e = band_offsets_[band]; e < band_offsets_[band + 1]; ++e) {
+        const Point2D& pi = points[band_edges_[e].from];
+        const Point2D& pj = points[band_edges_[e].to];
+
+        if (((pi.y > point.y) != (pj.y > point.y)) &&
+            (point.x < (pj.x - pi.x) * (point.y - pi.y) / (pj.y - pi.y) + pi.x)) {
+            inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+size_t PreparedPolygon::memoryUsage() const {
+    size_t bytes = band_offsets_.memoryUsage() + band_edges_.memoryUsage();
+    for (const DetailLevel& level : levels_) {
+        bytes += level.band_offsets.memoryUsage() + level.band_segments.memoryUsage();
+    }
+    return bytes;
+}
+
+} // namespace gis
@@ -1,23 +1,127 @@
 #include "gis/spatial_index.h"
+#include "gis/query_metrics.h"
 #include <algorithm>
 #include <queue>
 #include <cmath>
 #include <sstream>
+#include <chrono>
+#include <limits>
 
 namespace gis {
 
 // R-Tree Implementation
 RTree::RTree(size_t max_entries) 
-    : max_entries_(max_entries)
+    : root_(std::make_unique<RTreeNode>(true))
+    , max_entries_(max_entries)
     , min_entries_(max_entries / 2)
-    , root_(std::make_unique<RTreeNode>(true)) {
+    , object_count_(0)
+    , frozen_(false)
+    , build_time_ms_(0.0)
+    , query_count_(0)
+    , nodes_visited_(0) {
 }
 
 RTree::~RTree() = default;
 
 void RTree::insert(const BoundingBox& bounds, size_t data_index) {
-    object_bounds_.push_back(bounds);
+    if (frozen_) {
+        thaw();
+    }
+    
+    auto start_time = std::chrono::steady_clock::now();
+    
+    // Bounds are looked up by data index, which need not be dense
+    if (data_index >= object_bounds_.size()) {
+        object_bounds_.resize(data_index + 1, BoundingBox::empty());
+    }
+    object_bounds_[data_index] = bounds;
+    ++object_count_;
     insertHelper(root_.get(), bounds, data_index);
+    
+    build_time_ms_ += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_time).count();
+}
+
+void RTree::bulkLoad(const std::vector<BoundingBox>& bounds) {
+    auto start_time = std::chrono::steady_clock::now();
+    clear();
+    
+    object_bounds_ = bounds;
+    
+    struct Entry {
+        BoundingBox bounds;
+        double center_x;
+        double center_y;
+        size_t data_index;
+        std::unique_ptr<RTreeNode> node;  // Set above leaf level
+    };
+    
+    std::vector<Entry> entries;
+    entries.reserve(bounds.size());
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        if (bounds[i].isEmpty()) continue;
+        const BoundingBox& b = bounds[i];
+        entries.push_back({b, (b.min_x + b.max_x) / 2.0, (b.min_y + b.max_y) / 2.0, i, nullptr});
+    }
+    object_count_ = entries.size();
+    
+    if (entries.empty()) {
+        build_time_ms_ = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start_time).count();
+        return;
+    }
+    
+    const size_t capacity = std::max<size_t>(2, max_entries_);
+    bool leaf_level = true;
+    
+    // Pack one level at a time until a single node remains
+    while (leaf_level || entries.size() > 1) {
+        size_t node_count = (entries.size() + capacity - 1) / capacity;
+        size_t slice_count = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(node_count))));
+        size_t slice_size = slice_count * capacity;
+        
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.center_x < b.center_x;
+        });
+        
+        std::vector<Entry> parents;
+        parents.reserve(node_count);
+        
+        for (size_t slice_begin = 0; slice_begin < entries.size(); slice_begin += slice_size) {
+            size_t slice_end = std::min(entries.size(), slice_begin + slice_size);
+            std::sort(entries.begin() + slice_begin, entries.begin() + slice_end,
+                      [](const Entry& a, const Entry& b) { return a.center_y < b.center_y; });
+            
+            for (size_t node_begin = slice_begin; node_begin < slice_end; node_begin += capacity) {
+                size_t node_end = std::min(slice_end, node_begin + capacity);
+                auto node = std::make_unique<RTreeNode>(leaf_level);
+                node->bounds = BoundingBox::empty();
+                
+                for (size_t i = node_begin; i < node_end; ++i) {
+                    node->bounds.expand(entries[i].bounds);
+                    if (leaf_level) {
+                        node->data_indices.push_back(entries[i].data_index);
+                    } else {
+                        entries[i].node->parent = node.get();
+                        node->children.push_back(std::move(entries[i].node));
+                    }
+                }
+                
+                BoundingBox node_bounds = node->bounds;
+                parents.push_back({node_bounds, (node_bounds.min_x + node_bounds.max_x) / 2.0,
+                                   (node_bounds.min_y + node_bounds.max_y) / 2.0, 0, std::move(node)});
+            }
+        }
+        
+        entries = std::move(parents);
+        leaf_level = false;
+    }
+    
+    root_ = std::move(entries[0].node);
+    root_->parent = nullptr;
+    
+    build_time_ms_ = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_time).count();
 }
 
 void RTree::insertHelper(RTreeNode* node, const BoundingBox& bounds, size_t data_index) {
@@ -63,60 +167,152 @@ void RTree::insertHelper(RTreeNode* node, const BoundingBox& bounds, size_t data
 
 std::vector<size_t> RTree::query(const BoundingBox& query_bounds) const {
     std::vector<size_t> results;
-    queryHelper(root_.get(), query_bounds, results);
+    search(query_bounds, [&results](size_t idx) { results.push_back(idx); });
     return results;
 }
 
-void RTree::queryHelper(const RTreeNode* node, const BoundingBox& query_bounds, 
-                       std::vector<size_t>& results) const {
-    if (!node->bounds.intersects(query_bounds)) {
-        return;
+std::vector<size_t> RTree::nearestNeighbors(const Point2D& point, size_t k,
+                                           const DistanceFunction& object_distance,
+                                           double max_distance) const {
+    if (frozen_) {
+        return nearestNeighborsFlat(point, k, object_distance, max_distance);
     }
     
-    if (node->is_leaf) {
-        // Check each data item in leaf
-        for (size_t idx : node->data_indices) {
-            if (idx < object_bounds_.size() && object_bounds_[idx].intersects(query_bounds)) {
-                results.push_back(idx);
-            }
+    std::vector<size_t> results;
+    if (k == 0 || !root_ || object_count_ == 0) {
+        return results;
+    }
+    results.reserve(std::min(k, object_count_));
+    
+    // Best-first: the queue is ordered by a lower bound on distance, so an
+    // object popped with its final distance is closer than anything left
+    std::priority_queue<DistanceItem, std::vector<DistanceItem>, std::greater<DistanceItem>> pq;
+    pq.push({root_->bounds.distanceTo(point), DistanceItem::Node, 0, root_.get()});
+    uint64_t visited = 0;
+    
+    while (!pq.empty() && results.size() < k) {
+        DistanceItem item = pq.top();
+        pq.pop();
+        
+        if (item.distance > max_distance) {
+            break;  // Every remaining entry is at least this far
         }
-    } else {
-        // Recursively search children
-        for (const auto& child : node->children) {
-            queryHelper(child.get(), query_bounds, results);
+        
+        if (item.kind == DistanceItem::RefinedObject) {
+            results.push_back(item.index);
+        } else if (item.kind == DistanceItem::Object) {
+            // The bbox distance was only a bound; requeue with the exact distance
+            pq.push({std::max(item.distance, object_distance(item.index)),
+                     DistanceItem::RefinedObject, item.index, nullptr});
+        } else {
+            const RTreeNode* node = item.node;
+            ++visited;
+            if (node->is_leaf) {
+                DistanceItem::Kind kind = object_distance ? DistanceItem::Object : DistanceItem::RefinedObject;
+                for (size_t idx : node->data_indices) {
+                    pq.push({object_bounds_[idx].distanceTo(point), kind, idx, nullptr});
+                }
+            } else {
+                for (const auto& child : node->children) {
+                    pq.push({child->bounds.distanceTo(point), DistanceItem::Node, 0, child.get()});
+                }
+            }
         }
     }
+    
+    query_count_.fetch_add(1, std::memory_order_relaxed);
+    nodes_visited_.fetch_add(visited, std::memory_order_relaxed);
+    return results;
 }
 
-std::vector<size_t> RTree::nearestNeighbors(const Point2D& point, size_t k) const {
-    std::priority_queue<DistanceItem, std::vector<DistanceItem>, std::greater<DistanceItem>> pq;
-    
-    // For simplicity, this is a basic implementation
-    // Production code would use a more sophisticated algorithm
-    std::vector<DistanceItem> all_items;
+std::vector<size_t> RTree::nearestNeighborsFlat(const Point2D& point, size_t k,
+                                               const DistanceFunction& object_distance,
+                                               double max_distance) const {
+    std::vector<size_t> results;
+    if (k == 0 || flat_.nodes.empty() || object_count_ == 0) {
+        return results;
+    }
     
-    for (size_t i = 0; i < object_bounds_.size(); ++i) {
-        const BoundingBox& bounds = object_bounds_[i];
-        Point2D center((bounds.min_x + bounds.max_x) / 2.0, 
-                      (bounds.min_y + bounds.max_y) / 2.0);
+    auto minDist = [&point](double min_x, double min_y, double max_x, double max_y) {
+        double dx = std::max({min_x - point.x, 0.0, point.x - max_x});
+        double dy = std::max({min_y - point.y, 0.0, point.y - max_y});
+        return std::sqrt(dx * dx + dy * dy);
+    };
+    
+    // Depth-first branch and bound; best is kept as a max-heap of the k
+    // closest objects so far, ordered like DistanceItem
+    std::vector<DistanceItem> best;
+    best.reserve(std::min(k, object_count_));
+    auto closer = [](const DistanceItem& a, const DistanceItem& b) { return b > a; };
+    
+    struct StackItem {
+        uint32_t node;
+        double min_dist;
+    };
+    StackItem stack[kMaxFlatStack];
+    size_t top = 0;
+    stack[top++] = {0, flat_.root_bounds.distanceTo(point)};
+    uint64_t visited = 0;
+    
+    // Pruning bound: max_distance until k objects are known, then the k-th distance
+    auto bound = [&]() { return best.size() == k ? best.front().distance : max_distance; };
+    
+    while (top > 0) {
+        StackItem item = stack[--top];
+        if (item.min_dist > bound()) {
+            continue;
+        }
         
-        double dx = point.x - center.x;
-        double dy = point.y - center.y;
-        double distance = std::sqrt(dx * dx + dy * dy);
+        const FlatRTree::Node& node = flat_.nodes[item.node];
+        ++visited;
+        uint32_t end = node.first_entry + node.entry_count;
         
-        all_items.push_back({i, distance});
+        if (node.is_leaf) {
+            for (uint32_t e = node.first_entry; e < end; ++e) {
+                double distance = minDist(flat_.min_x[e], flat_.min_y[e], flat_.max_x[e], flat_.max_y[e]);
+                if (distance > bound()) {
+                    continue;  // Even the bbox is too far; skip the exact distance
+                }
+                if (object_distance) {
+                    distance = std::max(distance, object_distance(flat_.refs[e]));
+                    if (distance > max_distance) continue;
+                }
+                
+                DistanceItem candidate{distance, DistanceItem::RefinedObject, flat_.refs[e], nullptr};
+                if (best.size() < k) {
+                    best.push_back(candidate);
+                    std::push_heap(best.begin(), best.end(), closer);
+                } else if (best.front() > candidate) {
+                    std::pop_heap(best.begin(), best.end(), closer);
+                    best.back() = candidate;
+                    std::push_heap(best.begin(), best.end(), closer);
+                }
+            }
+        } else {
+            // Push children farthest first so the nearest is explored next
+            StackItem children[kMaxFlatFanout];
+            size_t count = 0;
+            for (uint32_t e = node.first_entry; e < end; ++e) {
+                children[count++] = {flat_.refs[e],
+                                     minDist(flat_.min_x[e], flat_.min_y[e], flat_.max_x[e], flat_.max_y[e])};
+            }
+            std::sort(children, children + count, [](const StackItem& a, const StackItem& b) {
+                return a.min_dist > b.min_dist;
+            });
+            for (size_t c = 0; c < count; ++c) {
+                stack[top++] = children[c];
+            }
+        }
     }
     
-    std::sort(all_items.begin(), all_items.end(), 
-              [](const DistanceItem& a, const DistanceItem& b) {
-                  return a.distance < b.distance;
-              });
-    
-    std::vector<size_t> results;
-    for (size_t i = 0; i < std::min(k, all_items.size()); ++i) {
-        results.push_back(all_items[i].index);
+    std::sort_heap(best.begin(), best.end(), closer);
+    results.reserve(best.size());
+    for (const auto& item : best) {
+        results.push_back(item.index);
     }
     
+    query_count_.fetch_add(1, std::memory_order_relaxed);
+    nodes_visited_.fetch_add(visited, std::memory_order_relaxed);
     return results;
 }
 
@@ -125,27 +321,137 @@ std::vector<size_t> RTree::withinDistance(const Point2D& point, double distance)
     BoundingBox query_bounds(point.x - distance, point.y - distance,
                             point.x + distance, point.y + distance);
     
-    std::vector<size_t> candidates = query(query_bounds);
+    // Filter candidates by exact centroid distance as they are found
     std::vector<size_t> results;
+    search(query_bounds, [&](size_t idx) {
+        const BoundingBox& bounds = object_bounds_[idx];
+        double dx = point.x - (bounds.min_x + bounds.max_x) / 2.0;
+        double dy = point.y - (bounds.min_y + bounds.max_y) / 2.0;
+        if (std::sqrt(dx * dx + dy * dy) <= distance) {
+            results.push_back(idx);
+        }
+    });
     
-    // Filter by exact distance
-    for (size_t idx : candidates) {
-        if (idx < object_bounds_.size()) {
-            const BoundingBox& bounds = object_bounds_[idx];
-            Point2D center((bounds.min_x + bounds.max_x) / 2.0, 
-                          (bounds.min_y + bounds.max_y) / 2.0);
-            
-            double dx = point.x - center.x;
-            double dy = point.y - center.y;
-            double actual_distance = std::sqrt(dx * dx + dy * dy);
-            
-            if (actual_distance <= distance) {
-                results.push_back(idx);
+    return results;
+}
+
+bool RTree::freeze() {
+    if (frozen_) return true;
+    
+    if (object_bounds_.size() > std::numeric_limits<uint32_t>::max() || max_entries_ > kMaxFlatFanout) {
+        return false;
+    }
+    
+    FlatRTree flat;
+    flat.root_bounds = root_->bounds;
+    
+    // BFS over the pointer tree; a child's node index is its position in the order
+    std::vector<std::pair<const RTreeNode*, uint32_t>> order = {{root_.get(), 1}};
+    for (size_t i = 0; i < order.size(); ++i) {
+        const RTreeNode* node = order[i].first;
+        uint32_t depth = order[i].second;
+        flat.height = std::max(flat.height, depth);
+        
+        FlatRTree::Node flat_node;
+        flat_node.first_entry = static_cast<uint32_t>(flat.refs.size());
+        flat_node.is_leaf = node->is_leaf ? 1 : 0;
+        
+        auto addEntry = [&flat](const BoundingBox& bounds, uint32_t ref) {
+            flat.min_x.push_back(bounds.min_x);
+            flat.min_y.push_back(bounds.min_y);
+            flat.max_x.push_back(bounds.max_x);
+            flat.max_y.push_back(bounds.max_y);
+            flat.refs.push_back(ref);
+        };
+        
+        if (node->is_leaf) {
+            for (size_t idx : node->data_indices) {
+                addEntry(object_bounds_[idx], static_cast<uint32_t>(idx));
+            }
+            flat_node.entry_count = static_cast<uint16_t>(node->data_indices.size());
+        } else {
+            for (const auto& child : node->children) {
+                addEntry(child->bounds, static_cast<uint32_t>(order.size()));
+                order.push_back({child.get(), depth + 1});
             }
+            flat_node.entry_count = static_cast<uint16_t>(node->children.size());
+        }
+        
+        if (flat_node.entry_count > kMaxFlatFanout) {
+            return false;  // Overfull node from a split that never happened
         }
+        flat.nodes.push_back(flat_node);
     }
     
-    return results;
+    // Depth-first traversal holds at most (fanout - 1) pending siblings per level
+    if (static_cast<size_t>(flat.height) * kMaxFlatFanout > kMaxFlatStack) {
+        return false;
+    }
+    
+    if (object_count_ == 0) {
+        flat.root_bounds = BoundingBox::empty();
+    }
+    
+    flat_ = std::move(flat);
+    frozen_ = true;
+    root_.reset();
+    return true;
+}
+
+bool RTree::restoreFrozen(FlatRTree flat, std::vector<BoundingBox> object_bounds) {
+    clear();
+    
+    const size_t entry_count = flat.refs.size();
+    if (flat.nodes.empty() || flat.nodes.size() > std::numeric_limits<uint32_t>::max() ||
+        object_bounds.size() > std::numeric_limits<uint32_t>::max() ||
+        flat.min_x.size() != entry_count || flat.min_y.size() != entry_count ||
+        flat.max_x.size() != entry_count || flat.max_y.size() != entry_count) {
+        return false;
+    }
+    
+    // Every node but the root must be referenced exactly once, by an earlier
+    // node (BFS order), which also rules out cycles; depths give the height
+    std::vector<uint32_t> depth(flat.nodes.size(), 0);
+    depth[0] = 1;
+    uint32_t height = 1;
+    for (size_t n = 0; n < flat.nodes.size(); ++n) {
+        const FlatRTree::Node& node = flat.nodes[n];
+        if (depth[n] == 0 || node.entry_count > kMaxFlatFanout ||
+            static_cast<size_t>(node.first_entry) + node.entry_count > entry_count) {
+            return false;
+        }
+        
+        for (uint32_t e = node.first_entry; e < node.first_entry + node.entry_count; ++e) {
+            uint32_t ref = flat.refs[e];
+            if (node.is_leaf) {
+                if (ref >= object_bounds.size()) return false;
+            } else {
+                if (ref <= n || ref >= flat.nodes.size() || depth[ref] != 0) return false;
+                depth[ref] = depth[n] + 1;
+                height = std::max(height, depth[ref]);
+            }
+        }
+    }
+    if (static_cast<size_t>(height) * kMaxFlatFanout > kMaxFlatStack) {
+        return false;
+    }
+    
+    object_count_ = 0;
+    for (const BoundingBox& bounds : object_bounds) {
+        if (!bounds.isEmpty()) ++object_count_;
+    }
+    flat.height = height;
+    
+    object_bounds_ = std::move(object_bounds);
+    flat_ = std::move(flat);
+    frozen_ = true;
+    root_.reset();
+    return true;
+}
+
+void RTree::thaw() {
+    std::vector<BoundingBox> bounds = object_bounds_;
+    bulkLoad(bounds);
 }
 
 void RTree::splitNode(RTreeNode* node) {
@@ -274,17 +580,78 @@ void RTree::updateInternalNodeBounds(RTreeNode* node) {
     }
 }
 
+void FlatRTree::clear() {
+    nodes.clear();
+    min_x.clear();
+    min_y.clear();
+    max_x.clear();
+    max_y.clear();
+    refs.clear();
+    root_bounds = BoundingBox::empty();
+    height = 0;
+}
+
+size_t FlatRTree::memoryUsage() const {
+    return nodes.size() * sizeof(Node) + refs.size() * (4 * sizeof(double) + sizeof(uint32_t));
+}
+
 void RTree::clear() {
+    flat_.clear();
+    frozen_ = false;
     object_bounds_.clear();
+    object_count_ = 0;
+    build_time_ms_ = 0.0;
+    query_count_ = 0;
+    nodes_visited_ = 0;
     root_ = std::make_unique<RTreeNode>(true);
 }
 
 std::string RTree::getStats() const {
     std::ostringstream oss;
     oss << "R-Tree Statistics:\n";
-    oss << "  Indexed Objects: " << object_bounds_.size() << "\n";
+    oss << "  Indexed Objects: " << object_count_ << "\n";
     oss << "  Max Entries per Node: " << max_entries_ << "\n";
     oss << "  Min Entries per Node: " << min_entries_ << "\n";
+    
+    // Walk the tree for shape information
+    size_t node_count = 0;
+    size_t leaf_count = 0;
+    size_t height = 0;
+    std::vector<std::pair<const RTreeNode*, size_t>> stack;
+    if (frozen_) {
+        node_count = flat_.nodes.size();
+        height = flat_.height;
+        for (const auto& node : flat_.nodes) {
+            leaf_count += node.is_leaf;
+        }
+    } else {
+        stack.push_back({root_.get(), 1});
+    }
+    while (!stack.empty()) {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        ++node_count;
+        height = std::max(height, depth);
+        if (node->is_leaf) {
+            ++leaf_count;
+        } else {
+            for (const auto& child : node->children) {
+                stack.push_back({child.get(), depth + 1});
+            }
+        }
+    }
+    
+    uint64_t queries = query_count_.load(std::memory_order_relaxed);
+    uint64_t visited = nodes_visited_.load(std::memory_order_relaxed);
+    oss << "  Nodes: " << node_count << " (" << leaf_count << " leaves)\n";
+    oss << "  Height: " << height << "\n";
+    if (frozen_) {
+        oss << "  Layout: frozen (" << flat_.memoryUsage() << " bytes)\n";
+    }
+    oss << "  Build Time: " << build_time_ms_ << " ms\n";
+    oss << "  Queries: " << queries << "\n";
+    oss << "  Avg Nodes Visited per Query: "
+        << (queries > 0 ? static_cast<double>(visited) / queries : 0.0) << "\n";
     return oss.str();
 }
 
@@ -292,17 +659,51 @@ std::string RTree::getStats() const {
 SpatialIndex::SpatialIndex() : records_(nullptr) {}
 SpatialIndex::~SpatialIndex() = default;
 
-void SpatialIndex::buildIndex(std::vector<std::unique_ptr<ShapeRecord>>& records) {
+void SpatialIndex::buildIndex(std::vector<std::unique_ptr<ShapeRecord>>& records, DatasetArena* arena) {
     records_ = &records;
-    rtree_.clear();
     
+    // Static dataset: pack the tree in one pass instead of inserting one by one
+    std::vector<BoundingBox> bounds(records.size(), BoundingBox::empty());
     for (size_t i = 0; i < records.size(); ++i) {
         const auto& record = records[i];
         if (record && record->geometry) {
-            BoundingBox bounds = record->geometry->getBounds();
-            rtree_.insert(bounds, i);
+            bounds[i] = record->geometry->getBounds();
         }
     }
+    rtree_.bulkLoad(bounds);
+    rtree_.freeze();
+    
+    // Prepare polygons once so containment tests stay cheap per query
+    cell_grid_ = CellGrid();
+    prepared_.clear();
+    prepared_.resize(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        const auto& record = records[i];
+        if (record && record->geometry && record->geometry->getType() == ShapeType::Polygon) {
+            prepared_[i] = PreparedPolygon(static_cast<const PolygonGeometry&>(*record->geometry), arena);
+        }
+    }
+}
+
+bool SpatialIndex::restoreIndex(std::vector<std::unique_ptr<ShapeRecord>>& records, FlatRTree tree,
+                                std::vector<BoundingBox> object_bounds, std::vector<PreparedPolygon> prepared,
+                                CellGrid cell_grid) {
+    records_ = &records;
+    prepared_.clear();
+    cell_grid_ = CellGrid();
+    
+    if (object_bounds.size() != records.size() || prepared.size() != records.size() ||
+        !cell_grid.fits(prepared) || !rtree_.restoreFrozen(std::move(tree), std::move(object_bounds))) {
+        rtree_.clear();
+        return false;
+    }
+    prepared_ = std::move(prepared);
+    cell_grid_ = std::move(cell_grid);
+    return true;
+}
+
+void SpatialIndex::buildCellGrid(size_t resolution) {
+    cell_grid_ = CellGrid(prepared_, resolution);
 }
 
 std::vector<ShapeRecord*> SpatialIndex::queryIntersects(const BoundingBox& bounds) const {
@@ -342,7 +743,10 @@ std::vector<ShapeRecord*> SpatialIndex::queryNearest(const Point2D& point, size_
     
     if (!records_) return results;
     
-    std::vector<size_t> indices = rtree_.nearestNeighbors(point, count);
+    // Rank by true distance to the geometry; the bbox distance bounds it from below
+    std::vector<size_t> indices = rtree_.nearestNeighbors(point, count, [this, &point](size_t idx) {
+        return (*records_)[idx]->geometry->distanceTo(point);
+    });
     
     for (size_t idx : indices) {
         if (idx < records_->size() && (*records_)[idx]) {
@@ -354,35 +758,53 @@ std::vector<ShapeRecord*> SpatialIndex::queryNearest(const Point2D& point, size_
 }
 
 ShapeRecord* SpatialIndex::pointInPolygon(const Point2D& point) const {
-    if (!records_) return nullptr;
-    
-    // Create small bounding box around point for initial filtering
-    BoundingBox point_bounds(point.x - 0.0001, point.y - 0.0001,
-                            point.x + 0.0001, point.y + 0.0001);
-    
-    std::vector<size_t> candidates = rtree_.query(point_bounds);
-    
-    for (size_t idx : candidates) {
-        if (idx < records_->size() && (*records_)[idx] && (*records_)[idx]->geometry) {
-            //const auto& geometry = (*records_)[idx]->geometry;
-            //
-            //if (geometry->getType() == ShapeType::Polygon) {
-            //    auto* polygon = dynamic_cast<const PolygonGeometry*>(geometry.get());
-            //    if (polygon && polygon->contains(point)) {
-            //        return (*records_)[idx].get();
-            //    }
-            //}
-            return (*records_)[idx].get();
-        }
+    size_t idx = findContainingRecord(point);
+    return idx != SIZE_MAX ? (*records_)[idx].get() : nullptr;
+}
+
+size_t SpatialIndex::findContainingRecord(const Point2D& point) const {
+    if (!records_) return SIZE_MAX;
+    if (!cell_grid_.isEmpty()) {
+        return cell_grid_.findContaining(point, prepared_);
     }
     
-    return nullptr;
+    // Only polygons whose bbox holds the point can contain it
+    BoundingBox point_bounds(point.x, point.y, point.x, point.y);
+    
+    size_t best = SIZE_MAX;
+    rtree_.search(point_bounds, [&](size_t idx) {
+        if (idx < best && idx < records_->size() && idx < prepared_.size()) {
+            StageTimer refine(QueryStage::Refine);
+            if (prepared_[idx].contains(point)) {
+                best = idx;
+            }
+        }
+    });
+    
+    return best;
+}
+
+bool SpatialIndex::recordContains(size_t index, const Point2D& point) const {
+    StageTimer refine(QueryStage::Refine);
+    return index < prepared_.size() && prepared_[index].contains(point);
 }
 
 std::string SpatialIndex::getStats() const {
     std::ostringstream oss;
     oss << "Spatial Index Statistics:\n";
     oss << "  Indexed Records: " << (records_ ? records_->size() : 0) << "\n";
+    
+    size_t prepared_count = 0;
+    size_t prepared_bytes = 0;
+    for (const auto& prepared : prepared_) {
+        if (prepared.isEmpty()) continue;
+        ++prepared_count;
+        prepared_bytes += prepared.memoryUsage();
+    }
+    oss << "  Prepared Polygons: " << prepared_count << " (" << prepared_bytes << " bytes)\n";
+    if (!cell_grid_.isEmpty()) {
+        oss << "  Cell Grid: " << cell_grid_.getStats() << " (" << cell_grid_.memoryUsage() << " bytes)\n";
+    }
     oss << rtree_.getStats();
     return oss.str();
 }